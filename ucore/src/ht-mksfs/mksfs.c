@@ -124,6 +124,13 @@ void safe_fchdir(int fd)
 #define SFS_BLKN_ROOT                           1
 #define SFS_BLKN_FREEMAP                        2
 
+#define SFS_JOURNAL_MAGIC                       0x4a534653
+#define SFS_JOURNAL_NBLKS                       512
+
+#define SFS_INLINE_MAX                          108
+#define SFS_DIN_INLINE                          0x1
+#define SFS_INODES_PER_BLK                      (SFS_BLKSIZE / sizeof(struct inode))
+
 struct cache_block {
 	uint32_t ino;
 	struct cache_block *hash_next;
@@ -144,9 +151,15 @@ struct cache_inode {
 		uint16_t type;
 		uint16_t nlinks;
 		uint32_t blocks;
-		uint32_t direct[SFS_NDIRECT];
-		uint32_t indirect;
-		uint32_t db_indirect;
+		union {
+			struct {
+				uint32_t direct[SFS_NDIRECT];
+				uint32_t indirect;
+				uint32_t db_indirect;
+			};
+			uint8_t inline_data[SFS_INLINE_MAX];
+		};
+		uint32_t flags;
 	} inode;
 	ino_t real;
 	uint32_t ino;
@@ -161,6 +174,12 @@ struct sfs_fs {
 		uint32_t blocks;
 		uint32_t unused_blocks;
 		char info[SFS_MAX_INFO_LEN + 1];
+		uint32_t journal;
+		uint32_t journal_blocks;
+		uint32_t inodes;
+		uint32_t unused_inodes;
+		uint32_t inodemap;
+		uint32_t inode_table;
 	} super;
 	struct subpath {
 		struct subpath *next, *prev;
@@ -168,6 +187,7 @@ struct sfs_fs {
 	} __sp_nil, *sp_root, *sp_end;
 	int imgfd;
 	uint32_t ninos, next_ino;
+	uint32_t ninodes, next_inode;
 	struct cache_inode *root;
 	struct cache_inode *inodes[HASH_LIST_SIZE];
 	struct cache_block *blocks[HASH_LIST_SIZE];
@@ -187,6 +207,15 @@ static uint32_t sfs_alloc_ino(struct sfs_fs *sfs)
 	bug("out of disk space.\n");
 }
 
+static uint32_t sfs_alloc_inode(struct sfs_fs *sfs)
+{
+	if (sfs->next_inode < sfs->ninodes) {
+		sfs->super.unused_inodes--;
+		return sfs->next_inode++;
+	}
+	bug("out of inodes.\n");
+}
+
 static struct cache_block *alloc_cache_block(struct sfs_fs *sfs, uint32_t ino)
 {
 	struct cache_block *cb = safe_malloc(sizeof(struct cache_block));
@@ -210,7 +239,7 @@ static struct cache_inode *alloc_cache_inode(struct sfs_fs *sfs, ino_t real,
 					     uint32_t ino, uint16_t type)
 {
 	struct cache_inode *ci = safe_malloc(sizeof(struct cache_inode));
-	ci->ino = (ino != 0) ? ino : sfs_alloc_ino(sfs);
+	ci->ino = (ino != 0) ? ino : sfs_alloc_inode(sfs);
 	ci->real = real, ci->nblks = 0, ci->l1 = ci->l2 = NULL;
 	struct inode *inode = &(ci->inode);
 	memset(inode, 0, sizeof(struct inode));
@@ -256,12 +285,38 @@ struct sfs_fs *create_sfs(int imgfd)
 		bug("img file is too small (%llu bytes, %u blocks, bitmap use at least %u blocks).\n", (unsigned long long)stat->st_size, ninos, next_ino - 2);
 	}
 
+	/* the journal goes right after the freemap, at most 1/16 of the image */
+	uint32_t journal = next_ino, journal_blocks = SFS_JOURNAL_NBLKS;
+	if (journal_blocks > ninos / 16) {
+		journal_blocks = (ninos / 16 >= 16) ? ninos / 16 : 0;
+	}
+	next_ino += journal_blocks;
+
+	/* then the inode bitmap and the inode table, an inode for every 4 blocks */
+	uint32_t ninodes =
+	    (ninos / 4 + SFS_INODES_PER_BLK - 1) / SFS_INODES_PER_BLK *
+	    SFS_INODES_PER_BLK;
+	if (ninodes == 0) {
+		ninodes = SFS_INODES_PER_BLK;
+	}
+	uint32_t inodemap = next_ino, inode_table =
+	    inodemap + (ninodes + SFS_BLKBITS - 1) / SFS_BLKBITS;
+	if ((next_ino = inode_table + ninodes / SFS_INODES_PER_BLK) >= ninos) {
+		bug("img file is too small (%u blocks, inode table ends at %u).\n", ninos, next_ino);
+	}
+
 	struct sfs_fs *sfs = safe_malloc(sizeof(struct sfs_fs));
 	sfs->super.magic = SFS_MAGIC;
 	sfs->super.blocks = ninos, sfs->super.unused_blocks = ninos - next_ino;
 	snprintf(sfs->super.info, SFS_MAX_INFO_LEN, "simple file system");
+	sfs->super.journal = (journal_blocks != 0) ? journal : 0;
+	sfs->super.journal_blocks = journal_blocks;
+	sfs->super.inodes = ninodes, sfs->super.unused_inodes =
+	    ninodes - (SFS_BLKN_ROOT + 1);
+	sfs->super.inodemap = inodemap, sfs->super.inode_table = inode_table;
 
 	sfs->ninos = ninos, sfs->next_ino = next_ino, sfs->imgfd = imgfd;
+	sfs->ninodes = ninodes, sfs->next_inode = SFS_BLKN_ROOT + 1;
 	sfs->sp_root = sfs->sp_end = &(sfs->__sp_nil);
 	sfs->sp_end->prev = sfs->sp_end->next = NULL;
 
@@ -332,23 +387,33 @@ static void flush_cache_block(struct sfs_fs *sfs, struct cache_block *cb)
 
 static void flush_cache_inode(struct sfs_fs *sfs, struct cache_inode *ci)
 {
-	write_block(sfs, &(ci->inode), sizeof(ci->inode), ci->ino);
+	uint32_t ino = ci->ino;
+	off_t offset =
+	    (off_t) (sfs->super.inode_table +
+		     ino / SFS_INODES_PER_BLK) * SFS_BLKSIZE +
+	    (ino % SFS_INODES_PER_BLK) * sizeof(ci->inode);
+	if (pwrite(sfs->imgfd, &(ci->inode), sizeof(ci->inode), offset) !=
+	    sizeof(ci->inode)) {
+		bug("write %u inode failed.\n", ino);
+	}
 }
 
-void close_sfs(struct sfs_fs *sfs)
+/* write the bitmap of @total things at @blkno, the first @used in use */
+static void
+write_bitmap(struct sfs_fs *sfs, uint32_t blkno, uint32_t total,
+	     uint32_t used)
 {
 	static char buffer[SFS_BLKSIZE];
-	uint32_t i, j, ino = SFS_BLKN_FREEMAP;
-	uint32_t ninos = sfs->ninos, next_ino = sfs->next_ino;
-	for (i = 0; i < ninos; ino++, i += SFS_BLKBITS) {
+	uint32_t i, j;
+	for (i = 0; i < total; blkno++, i += SFS_BLKBITS) {
 		memset(buffer, 0, sizeof(buffer));
-		if (i + SFS_BLKBITS > next_ino) {
+		if (i + SFS_BLKBITS > used) {
 			uint32_t start = 0, end = SFS_BLKBITS;
-			if (i < next_ino) {
-				start = next_ino - i;
+			if (i < used) {
+				start = used - i;
 			}
-			if (i + SFS_BLKBITS > ninos) {
-				end = ninos - i;
+			if (i + SFS_BLKBITS > total) {
+				end = total - i;
 			}
 			uint32_t *data = (uint32_t *) buffer;
 			const uint32_t bits = sizeof(bits) * CHAR_BIT;
@@ -356,9 +421,28 @@ void close_sfs(struct sfs_fs *sfs)
 				data[j / bits] |= (1 << (j % bits));
 			}
 		}
-		write_block(sfs, buffer, sizeof(buffer), ino);
+		write_block(sfs, buffer, sizeof(buffer), blkno);
+	}
+}
+
+void close_sfs(struct sfs_fs *sfs)
+{
+	static char buffer[SFS_BLKSIZE];
+	uint32_t i;
+	write_bitmap(sfs, SFS_BLKN_FREEMAP, sfs->ninos, sfs->next_ino);
+	write_bitmap(sfs, sfs->super.inodemap, sfs->ninodes, sfs->next_inode);
+	memset(buffer, 0, sizeof(buffer));
+	for (i = 0; i < sfs->ninodes / SFS_INODES_PER_BLK; i++) {
+		write_block(sfs, buffer, sizeof(buffer),
+			    sfs->super.inode_table + i);
 	}
 	write_block(sfs, &(sfs->super), sizeof(sfs->super), SFS_BLKN_SUPER);
+	if (sfs->super.journal != 0) {
+		uint32_t *header = (uint32_t *) buffer;
+		memset(buffer, 0, sizeof(buffer));
+		header[0] = SFS_JOURNAL_MAGIC, header[1] = 1;
+		write_block(sfs, buffer, sizeof(buffer), sfs->super.journal);
+	}
 
 	for (i = 0; i < HASH_LIST_SIZE; i++) {
 		struct cache_block *cb = sfs->blocks[i];
@@ -581,6 +665,14 @@ open_file(struct sfs_fs *sfs, struct cache_inode *file, const char *filename,
 {
 	static char buffer[SFS_BLKSIZE];
 	ssize_t ret, last = SFS_BLKSIZE;
+	if (safe_fstat(fd)->st_size <= SFS_INLINE_MAX) {
+		struct inode *inode = &(file->inode);
+		if ((ret = read(fd, inode->inline_data, SFS_INLINE_MAX)) < 0) {
+			open_bug(sfs, filename, "read file failed.\n");
+		}
+		inode->fileinfo.size = ret, inode->flags |= SFS_DIN_INLINE;
+		return;
+	}
 	while ((ret = read(fd, buffer, sizeof(buffer))) != 0) {
 		assert(last == SFS_BLKSIZE);
 		uint32_t ino = sfs_alloc_ino(sfs);
@@ -125,6 +125,13 @@ void safe_fchdir(int fd)
 #define SFS_BLKN_ROOT                           1
 #define SFS_BLKN_FREEMAP                        2
 
+#define SFS_JOURNAL_MAGIC                       0x4a534653
+#define SFS_JOURNAL_NBLKS                       512
+
+#define SFS_INLINE_MAX                          108
+#define SFS_DIN_INLINE                          0x1
+#define SFS_INODES_PER_BLK                      (SFS_BLKSIZE / sizeof(struct inode))
+
 char endian_buffer[SFS_BLKSIZE];
 
 struct cache_block {
@@ -147,9 +154,15 @@ struct cache_inode {
 		uint16_t type;
 		uint16_t nlinks;
 		uint32_t blocks;
-		uint32_t direct[SFS_NDIRECT];
-		uint32_t indirect;
-		uint32_t db_indirect;
+		union {
+			struct {
+				uint32_t direct[SFS_NDIRECT];
+				uint32_t indirect;
+				uint32_t db_indirect;
+			};
+			uint8_t inline_data[SFS_INLINE_MAX];
+		};
+		uint32_t flags;
 	} inode;
 	ino_t real;
 	uint32_t ino;
@@ -163,6 +176,12 @@ struct super_block {
 	uint32_t blocks;
 	uint32_t unused_blocks;
 	char info[SFS_MAX_INFO_LEN + 1];
+	uint32_t journal;
+	uint32_t journal_blocks;
+	uint32_t inodes;
+	uint32_t unused_inodes;
+	uint32_t inodemap;
+	uint32_t inode_table;
 };
 
 struct sfs_fs {
@@ -173,6 +192,7 @@ struct sfs_fs {
 	} __sp_nil, *sp_root, *sp_end;
 	int imgfd;
 	uint32_t ninos, next_ino;
+	uint32_t ninodes, next_inode;
 	struct cache_inode *root;
 	struct cache_inode *inodes[HASH_LIST_SIZE];
 	struct cache_block *blocks[HASH_LIST_SIZE];
@@ -193,6 +213,7 @@ static void inode_big_endian(struct inode *inode)
 	struct inode *be_inode = (struct inode *)endian_buffer;
 	int i;
 
+	memset(be_inode, 0, sizeof(struct inode));
 	switch (inode->type) {
 	case SFS_TYPE_FILE:
 	case SFS_TYPE_LINK:
@@ -206,11 +227,17 @@ static void inode_big_endian(struct inode *inode)
 	htobe(be_inode, inode, type, 16);
 	htobe(be_inode, inode, nlinks, 16);
 	htobe(be_inode, inode, blocks, 32);
-	for (i = 0; i < SFS_NDIRECT; i++) {
-		htobe(be_inode, inode, direct[i], 32);
+	if (inode->flags & SFS_DIN_INLINE) {
+		memcpy(be_inode->inline_data, inode->inline_data,
+		       SFS_INLINE_MAX);
+	} else {
+		for (i = 0; i < SFS_NDIRECT; i++) {
+			htobe(be_inode, inode, direct[i], 32);
+		}
+		htobe(be_inode, inode, indirect, 32);
+		htobe(be_inode, inode, db_indirect, 32);
 	}
-	htobe(be_inode, inode, indirect, 32);
-	htobe(be_inode, inode, db_indirect, 32);
+	htobe(be_inode, inode, flags, 32);
 }
 
 static void super_big_endian(struct super_block *super)
@@ -221,6 +248,12 @@ static void super_big_endian(struct super_block *super)
 	htobe(be_super, super, blocks, 32);
 	htobe(be_super, super, unused_blocks, 32);
 	memcpy(be_super->info, super->info, SFS_MAX_INFO_LEN + 1);
+	htobe(be_super, super, journal, 32);
+	htobe(be_super, super, journal_blocks, 32);
+	htobe(be_super, super, inodes, 32);
+	htobe(be_super, super, unused_inodes, 32);
+	htobe(be_super, super, inodemap, 32);
+	htobe(be_super, super, inode_table, 32);
 }
 
 static void entry_big_endian(struct sfs_entry *entry)
@@ -253,6 +286,15 @@ static uint32_t sfs_alloc_ino(struct sfs_fs *sfs)
 	bug("out of disk space.\n");
 }
 
+static uint32_t sfs_alloc_inode(struct sfs_fs *sfs)
+{
+	if (sfs->next_inode < sfs->ninodes) {
+		sfs->super.unused_inodes--;
+		return sfs->next_inode++;
+	}
+	bug("out of inodes.\n");
+}
+
 static struct cache_block *alloc_cache_block(struct sfs_fs *sfs, uint32_t ino)
 {
 	struct cache_block *cb = safe_malloc(sizeof(struct cache_block));
@@ -276,7 +318,7 @@ static struct cache_inode *alloc_cache_inode(struct sfs_fs *sfs, ino_t real,
 					     uint32_t ino, uint16_t type)
 {
 	struct cache_inode *ci = safe_malloc(sizeof(struct cache_inode));
-	ci->ino = (ino != 0) ? ino : sfs_alloc_ino(sfs);
+	ci->ino = (ino != 0) ? ino : sfs_alloc_inode(sfs);
 	ci->real = real, ci->nblks = 0, ci->l1 = ci->l2 = NULL;
 	struct inode *inode = &(ci->inode);
 	memset(inode, 0, sizeof(struct inode));
@@ -322,12 +364,38 @@ struct sfs_fs *create_sfs(int imgfd)
 		bug("img file is too small (%llu bytes, %u blocks, bitmap use at least %u blocks).\n", (unsigned long long)stat->st_size, ninos, next_ino - 2);
 	}
 
+	/* the journal goes right after the freemap, at most 1/16 of the image */
+	uint32_t journal = next_ino, journal_blocks = SFS_JOURNAL_NBLKS;
+	if (journal_blocks > ninos / 16) {
+		journal_blocks = (ninos / 16 >= 16) ? ninos / 16 : 0;
+	}
+	next_ino += journal_blocks;
+
+	/* then the inode bitmap and the inode table, an inode for every 4 blocks */
+	uint32_t ninodes =
+	    (ninos / 4 + SFS_INODES_PER_BLK - 1) / SFS_INODES_PER_BLK *
+	    SFS_INODES_PER_BLK;
+	if (ninodes == 0) {
+		ninodes = SFS_INODES_PER_BLK;
+	}
+	uint32_t inodemap = next_ino, inode_table =
+	    inodemap + (ninodes + SFS_BLKBITS - 1) / SFS_BLKBITS;
+	if ((next_ino = inode_table + ninodes / SFS_INODES_PER_BLK) >= ninos) {
+		bug("img file is too small (%u blocks, inode table ends at %u).\n", ninos, next_ino);
+	}
+
 	struct sfs_fs *sfs = safe_malloc(sizeof(struct sfs_fs));
 	sfs->super.magic = SFS_MAGIC;
 	sfs->super.blocks = ninos, sfs->super.unused_blocks = ninos - next_ino;
 	snprintf(sfs->super.info, SFS_MAX_INFO_LEN, "simple file system");
+	sfs->super.journal = (journal_blocks != 0) ? journal : 0;
+	sfs->super.journal_blocks = journal_blocks;
+	sfs->super.inodes = ninodes, sfs->super.unused_inodes =
+	    ninodes - (SFS_BLKN_ROOT + 1);
+	sfs->super.inodemap = inodemap, sfs->super.inode_table = inode_table;
 
 	sfs->ninos = ninos, sfs->next_ino = next_ino, sfs->imgfd = imgfd;
+	sfs->ninodes = ninodes, sfs->next_inode = SFS_BLKN_ROOT + 1;
 	sfs->sp_root = sfs->sp_end = &(sfs->__sp_nil);
 	sfs->sp_end->prev = sfs->sp_end->next = NULL;
 
@@ -403,28 +471,34 @@ static void flush_cache_block(struct sfs_fs *sfs, struct cache_block *cb)
 
 static void flush_cache_inode(struct sfs_fs *sfs, struct cache_inode *ci)
 {
-	//write_block(sfs, &(ci->inode), sizeof(ci->inode), ci->ino);
-	{
-		inode_big_endian(&(ci->inode));
-		//printf ("cache_inode: ino = %d\n", ci->ino);
-		write_block(sfs, endian_buffer, sizeof(ci->inode), ci->ino);
+	uint32_t ino = ci->ino;
+	off_t offset =
+	    (off_t) (sfs->super.inode_table +
+		     ino / SFS_INODES_PER_BLK) * SFS_BLKSIZE +
+	    (ino % SFS_INODES_PER_BLK) * sizeof(ci->inode);
+	inode_big_endian(&(ci->inode));
+	if (pwrite(sfs->imgfd, endian_buffer, sizeof(ci->inode), offset) !=
+	    sizeof(ci->inode)) {
+		bug("write %u inode failed.\n", ino);
 	}
 }
 
-void close_sfs(struct sfs_fs *sfs)
+/* write the bitmap of @total things at @blkno, the first @used in use */
+static void
+write_bitmap(struct sfs_fs *sfs, uint32_t blkno, uint32_t total,
+	     uint32_t used)
 {
 	static char buffer[SFS_BLKSIZE];
-	uint32_t i, j, ino = SFS_BLKN_FREEMAP;
-	uint32_t ninos = sfs->ninos, next_ino = sfs->next_ino;
-	for (i = 0; i < ninos; ino++, i += SFS_BLKBITS) {
+	uint32_t i, j;
+	for (i = 0; i < total; blkno++, i += SFS_BLKBITS) {
 		memset(buffer, 0, sizeof(buffer));
-		if (i + SFS_BLKBITS > next_ino) {
+		if (i + SFS_BLKBITS > used) {
 			uint32_t start = 0, end = SFS_BLKBITS;
-			if (i < next_ino) {
-				start = next_ino - i;
+			if (i < used) {
+				start = used - i;
 			}
-			if (i + SFS_BLKBITS > ninos) {
-				end = ninos - i;
+			if (i + SFS_BLKBITS > total) {
+				end = total - i;
 			}
 			uint32_t *data = (uint32_t *) buffer;
 			const uint32_t bits = sizeof(bits) * CHAR_BIT;
@@ -432,16 +506,22 @@ void close_sfs(struct sfs_fs *sfs)
 				data[j / bits] |= (1 << (j % bits));
 			}
 		}
-		/* This block is the bitmap of the whole disk.
-		 * As it is accessed by word, we have to transform it to big-endian.
-		 */
-		//printf ("close_sfs 1: ino = %d\n", ino);
-		//write_block(sfs, buffer, sizeof(buffer), ino);
-		{
-			cache_block_big_endian(buffer);
-			write_block(sfs, endian_buffer, sizeof(endian_buffer),
-				    ino);
-		}
+		/* This block is accessed by word, we have to transform it to big-endian. */
+		cache_block_big_endian(buffer);
+		write_block(sfs, endian_buffer, sizeof(endian_buffer), blkno);
+	}
+}
+
+void close_sfs(struct sfs_fs *sfs)
+{
+	static char buffer[SFS_BLKSIZE];
+	uint32_t i;
+	write_bitmap(sfs, SFS_BLKN_FREEMAP, sfs->ninos, sfs->next_ino);
+	write_bitmap(sfs, sfs->super.inodemap, sfs->ninodes, sfs->next_inode);
+	memset(buffer, 0, sizeof(buffer));
+	for (i = 0; i < sfs->ninodes / SFS_INODES_PER_BLK; i++) {
+		write_block(sfs, buffer, sizeof(buffer),
+			    sfs->super.inode_table + i);
 	}
 	//write_block(sfs, &(sfs->super), sizeof(sfs->super), SFS_BLKN_SUPER);
 	{
@@ -450,6 +530,12 @@ void close_sfs(struct sfs_fs *sfs)
 		write_block(sfs, endian_buffer, sizeof(sfs->super),
 			    SFS_BLKN_SUPER);
 	}
+	if (sfs->super.journal != 0) {
+		uint32_t *header = (uint32_t *) buffer;
+		memset(buffer, 0, sizeof(buffer));
+		header[0] = htobe32(SFS_JOURNAL_MAGIC), header[1] = htobe32(1);
+		write_block(sfs, buffer, sizeof(buffer), sfs->super.journal);
+	}
 
 	for (i = 0; i < HASH_LIST_SIZE; i++) {
 		struct cache_block *cb = sfs->blocks[i];
@@ -677,6 +763,14 @@ open_file(struct sfs_fs *sfs, struct cache_inode *file, const char *filename,
 {
 	static char buffer[SFS_BLKSIZE];
 	ssize_t ret, last = SFS_BLKSIZE;
+	if (safe_fstat(fd)->st_size <= SFS_INLINE_MAX) {
+		struct inode *inode = &(file->inode);
+		if ((ret = read(fd, inode->inline_data, SFS_INLINE_MAX)) < 0) {
+			open_bug(sfs, filename, "read file failed.\n");
+		}
+		inode->fileinfo.size = ret, inode->flags |= SFS_DIN_INLINE;
+		return;
+	}
 	while ((ret = read(fd, buffer, sizeof(buffer))) != 0) {
 		assert(last == SFS_BLKSIZE);
 		uint32_t ino = sfs_alloc_ino(sfs);
@@ -16,6 +16,9 @@ void __panic(const char *file, int line, const char *fmt, ...)
 		goto panic_dead;
 	}
 	is_panic = 1;
+#ifdef UCONFIG_KMSG
+	kmsg_panic();
+#endif
 
 	// print the 'message'
 	va_list ap;
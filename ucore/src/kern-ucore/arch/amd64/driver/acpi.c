@@ -35,6 +35,7 @@ static int table_inited = 0;
 static ACPI_TABLE_DESC table_desc[MAX_TABLE_DESC];
 static ACPI_TABLE_MADT *hdr_madt;
 static ACPI_TABLE_SRAT *hdr_srat;
+static ACPI_TABLE_SLIT *hdr_slit;
 static ACPI_TABLE_DMAR *hdr_dmar;
 
 /* Early ACPI Table Access */
@@ -62,6 +63,13 @@ int acpitables_init(void)
 	if (r == AE_OK)
 		hdr_srat = (ACPI_TABLE_SRAT*)hdr;
 
+	// Get the SLIT (NUMA distances)
+	r = AcpiGetTable((char*)ACPI_SIG_SLIT, 0, &hdr);
+	if (ACPI_FAILURE(r) && r != AE_NOT_FOUND)
+		panic("acpi: AcpiGetTable failed: %s", AcpiFormatException(r));
+	if (r == AE_OK)
+		hdr_slit = (ACPI_TABLE_SLIT*)hdr;
+
 	// Get the DMAR (DMA remapping reporting table)
 	r = AcpiGetTable((char*)ACPI_SIG_DMAR, 0, &hdr);
 	if (ACPI_FAILURE(r) && r != AE_NOT_FOUND)
@@ -172,6 +180,45 @@ proximity_domain_to_node(uint32_t proximity_domain)
 	return NULL;
 }
 
+#define NUMA_LOCAL_DISTANCE	10
+#define NUMA_REMOTE_DISTANCE	20
+
+/* fill in the node distances from the SLIT, and the fallback order */
+static void numa_distance_init(void)
+{
+	int i, j, k;
+	for(i=0;i<sysconf.lnuma_count;i++){
+		struct numa_node *node = &numa_nodes[i];
+		for(j=0;j<sysconf.lnuma_count;j++){
+			uint32_t from = node->hwid, to = numa_nodes[j].hwid;
+			if(hdr_slit && from < hdr_slit->LocalityCount
+					&& to < hdr_slit->LocalityCount)
+				node->distance[j] = hdr_slit->Entry[from * hdr_slit->LocalityCount + to];
+			else
+				node->distance[j] = (i == j) ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+		}
+		/* insertion sort by distance, ties keep the id order */
+		node->fallback[0] = i;
+		int n = 1;
+		for(j=0;j<sysconf.lnuma_count;j++){
+			if(j == i)
+				continue;
+			for(k=n; k>1 && node->distance[node->fallback[k-1]] > node->distance[j]; k--)
+				node->fallback[k] = node->fallback[k-1];
+			node->fallback[k] = j;
+			n++;
+		}
+	}
+	if(!hdr_slit || sysconf.lnuma_count <= 1)
+		return;
+	for(i=0;i<sysconf.lnuma_count;i++){
+		kprintf("acpi: NUMA node %d distances:", numa_nodes[i].hwid);
+		for(j=0;j<sysconf.lnuma_count;j++)
+			kprintf(" %d", numa_nodes[i].distance[j]);
+		kprintf("\n");
+	}
+}
+
 int numa_init(void)
 {
 	int numa_node_nr = 0;
@@ -188,6 +235,7 @@ int numa_init(void)
 		for(i=0;i<sysconf.lcpu_count;i++)
 			numa_nodes[0].cpu_ids[i] = i;
 		sysconf.lnuma_count = 1;
+		numa_distance_init();
 		return;
 	}
 	ACPI_SUBTABLE_HEADER *sub;
@@ -264,7 +312,7 @@ int numa_init(void)
 			kprintf("  %p - %p\n", numa_nodes[i].mems[j].base, 
 					numa_nodes[i].mems[j].base+numa_nodes[i].mems[j].length-1);
 	}
-
+	numa_distance_init();
 }
 
 static int cpuacpi_init(void)
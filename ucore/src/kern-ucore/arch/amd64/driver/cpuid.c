@@ -96,6 +96,8 @@ int cpuid_check_feature(CPUID_INFO_TYPE type)
 			return features_.d & (1<<9);
 		case CPUID_FEATURE_PAGE1G:
 			return extended_features_.d & (1<<26);
+		case CPUID_FEATURE_RDTSCP:
+			return extended_features_.d & (1<<27);
 		default:
 			return 0;
 	}
@@ -23,6 +23,7 @@ typedef enum{
 	CPUID_FEATURE_X2APIC,
 	CPUID_FEATURE_APIC,
 	CPUID_FEATURE_PAGE1G,
+	CPUID_FEATURE_RDTSCP,
 }CPUID_INFO_TYPE;
 
 
@@ -19,6 +19,9 @@
 #define __ARCH_HZ_H
 
 #include <types.h>
+
+extern uint64_t cpuhz;
+
 void hz_init();
 void microdelay(uint64_t delay);
 
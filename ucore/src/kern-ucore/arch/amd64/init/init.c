@@ -21,10 +21,12 @@
 #include <sysconf.h>
 #include <lapic.h>
 #include <multiboot.h>
-#include <refcache.h>
 #include <dde_kit/dde_kit.h>
 #include <pci.h>
 #include <network.h>
+#ifdef UCONFIG_VDSO
+#include <vdso_data.h>
+#endif
 
 int kern_init(uint64_t, uint64_t) __attribute__ ((noreturn));
 
@@ -104,6 +106,9 @@ int kern_init(uint64_t mbmagic, uint64_t mbmem)
 	hz_init();
 	gdt_init(per_cpu_ptr(cpus, 0));
 	tls_init(per_cpu_ptr(cpus, 0));
+#ifdef UCONFIG_KMSG
+	kmsg_init();
+#endif
 	acpitables_init();
 	lapic_init();
 	numa_init();
@@ -129,12 +134,13 @@ int kern_init(uint64_t mbmagic, uint64_t mbmem)
 	ipi_init();
 #endif
 
-	refcache_init();
-
 	vmm_init();		// init virtual memory management
 	sched_init();		// init scheduler
 	proc_init();		// init process table
 	sync_init();		// init sync struct
+#ifdef UCONFIG_VDSO
+	vdso_init();
+#endif
 
 	/* ext int */
   ioapic_init();
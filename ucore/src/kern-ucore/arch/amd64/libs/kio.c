@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <mod.h>
 
+#ifndef UCONFIG_KMSG
 /* *
  * cputch - writes a single character @c to stdout, and it will
  * increace the value of counter pointed by @cnt.
@@ -19,6 +20,7 @@ static void cputch(int c, int *cnt, int fd)
 }
 
 static spinlock_s kprintf_lock = { 0 };
+#endif
 
 /* *
  * vcprintf - format a string and writes it to stdout
@@ -31,6 +33,9 @@ static spinlock_s kprintf_lock = { 0 };
  * */
 int vkprintf(const char *fmt, va_list ap)
 {
+#ifdef UCONFIG_KMSG
+	return kmsg_vprintf(fmt, ap);
+#else
 	int cnt = 0;
 	int flag;
 	local_intr_save_hw(flag);
@@ -39,6 +44,7 @@ int vkprintf(const char *fmt, va_list ap)
 	spinlock_release(&kprintf_lock);
 	local_intr_restore_hw(flag);
 	return cnt;
+#endif
 }
 
 /* *
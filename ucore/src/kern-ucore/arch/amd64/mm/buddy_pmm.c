@@ -6,6 +6,8 @@
 #include <sysconf.h>
 #include <mp.h>
 #include <spinlock.h>
+#include <percpu.h>
+#include <atomic.h>
 /* XXX struct page may contain race condition?? */
 
 struct numa_mem_zone;
@@ -28,6 +30,30 @@ static int buddy_numa_borrow = 1;
 #define free_list(n,x) (free_area[n][x].free_list)
 #define nr_free(n,x) (free_area[n][x].nr_free)
 
+/*
+ * Per-cpu lists of free order-0 pages, kept in front of the buddy free
+ * areas so that single page alloc/free does not touch fa_lock. Pages
+ * freed on this cpu are hot and go to the head, pages refilled from the
+ * buddy system are cold and go to the tail; allocation takes from the
+ * head and draining gives back from the tail. Only pages of the cpu's
+ * own node are cached. All accesses run with local interrupts disabled
+ * (see alloc_pages/free_pages in pmm.c).
+ */
+#define PCP_HIGH	96	/* drain PCP_BATCH pages once above this */
+#define PCP_LOW		16	/* an idle cpu keeps at most this many */
+#define PCP_BATCH	32	/* pages moved per refill/drain */
+
+struct pcp_pages {
+	list_entry_t list;
+	int count;
+	uint32_t numa_id;
+	int drain_gen;
+};
+
+static DEFINE_PERCPU_NOINIT(struct pcp_pages, pcp_pages);
+/* bumped under memory pressure, every cpu then drains its list */
+static atomic_t pcp_drain_gen = ATOMIC_INIT(0);
+
 #if 0
 #define MAX_ZONE_NUM 10
 struct Zone {
@@ -95,15 +121,12 @@ static inline size_t getorder(size_t n)
 	panic("getorder failed. %d\n", n);
 }
 
-//buddy_alloc_pages_sub - the actual allocation implimentation, return a page whose size >=n,
-//                      - the remaining free parts insert to other free list
-static inline struct Page *buddy_alloc_pages_sub(uint32_t numa_id, size_t order)
+//__buddy_alloc_pages_sub - the actual allocation implimentation, return a page whose size >=n,
+//                        - the remaining free parts insert to other free list. fa_lock must be held
+static struct Page *__buddy_alloc_pages_sub(uint32_t numa_id, size_t order)
 {
 	assert(order <= MAX_ORDER);
 	size_t cur_order;
-
-	int intr_flag;
-	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
 	for (cur_order = order; cur_order <= MAX_ORDER; cur_order++) {
 		if (!list_empty(&free_list(numa_id, cur_order))) {
 			list_entry_t *le = list_next(&free_list(numa_id, cur_order));
@@ -122,16 +145,33 @@ static inline struct Page *buddy_alloc_pages_sub(uint32_t numa_id, size_t order)
 					 &(buddy->page_link));
 			}
 			ClearPageProperty(page);
-			spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
 			return page;
 		}
 	}
-	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
 	return NULL;
 }
 
+static inline struct Page *buddy_alloc_pages_sub(uint32_t numa_id, size_t order)
+{
+	struct Page *page;
+	int intr_flag;
+	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	page = __buddy_alloc_pages_sub(numa_id, order);
+	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	return page;
+}
+
+static struct pcp_pages *pcp_get(void);
+static struct Page *pcp_alloc_page(struct pcp_pages *pcp);
+
 static struct Page *__buddy_alloc_pages_numa(uint32_t numa_id, size_t n)
 {
+	if (n == 1) {
+		struct pcp_pages *pcp = pcp_get();
+		if (pcp->numa_id == numa_id) {
+			return pcp_alloc_page(pcp);
+		}
+	}
 	size_t order = getorder(n), order_size = (1 << order);
 	struct Page *page = buddy_alloc_pages_sub(numa_id, order);
 	if (page != NULL && n != order_size) {
@@ -140,33 +180,43 @@ static struct Page *__buddy_alloc_pages_numa(uint32_t numa_id, size_t n)
 	return page;
 }
 
+//numa_account - count an allocation meant for node want in the per-node counters
+static void numa_account(uint32_t want, struct Page *page)
+{
+	uint32_t got = numa_mem_zones[page->zone_num].node->id;
+	uint32_t here = mycpu()->node ? mycpu()->node->id : 0;
+	struct numa_node_stat *stat = &numa_nodes[got].stat;
+	if (got == want) {
+		atomic_inc(&stat->numa_hit);
+	} else {
+		atomic_inc(&stat->numa_miss);
+		atomic_inc(&numa_nodes[want].stat.numa_foreign);
+	}
+	atomic_inc(got == here ? &stat->local_node : &stat->other_node);
+}
+
 static struct Page *buddy_alloc_pages_numa(struct numa_node *node, size_t n)
 {
 	assert(n > 0 && node!=NULL);
-	return __buddy_alloc_pages_numa(node->id, n);
+	struct Page *page = __buddy_alloc_pages_numa(node->id, n);
+	if (page)
+		numa_account(node->id, page);
+	return page;
 }
 
 
-//buddy_alloc_pages - call buddy_alloc_pages_sub to alloc 2^order>=n pages
+//buddy_alloc_pages - alloc from the current cpu's node, then from the
+//                  - other nodes by increasing SLIT distance
 static struct Page *buddy_alloc_pages(size_t n)
 {
 	int i;
 	assert(n > 0);
-	size_t order = getorder(n), order_size = (1 << order);
-	uint32_t numa_id = 0;
-	if(mycpu()->node)
-		numa_id = mycpu()->node->id;
-	struct Page *page = __buddy_alloc_pages_numa(numa_id, n);
-	if(page)
-		return page;
-	if(!buddy_numa_borrow)
-		return NULL;
-	for(i=0;i<sysconf.lnuma_count;i++){
-		if(i == numa_id)
-			continue;
-		page = __buddy_alloc_pages_numa(i, n);
+	struct numa_node *node = mycpu()->node ? mycpu()->node : &numa_nodes[0];
+	int nr_nodes = buddy_numa_borrow ? sysconf.lnuma_count : 1;
+	for(i=0;i<nr_nodes;i++){
+		struct Page *page = __buddy_alloc_pages_numa(node->fallback[i], n);
 		if(page){
-			kprintf("warning: cpu%d borrow page from node %d\n", myid(), i);
+			numa_account(node->id, page);
 			return page;
 		}
 	}
@@ -198,32 +248,20 @@ static inline struct Page *idx2page(int zone_num, ppn_t idx)
 	return numa_mem_zones[zone_num].page + idx;
 }
 
-//buddy_free_pages_sub - the actual free implimentation, should consider how to 
-//                     - merge the adjacent buddy block
-static void buddy_free_pages_sub(uint32_t numa_id, struct Page *base, size_t order)
+//__buddy_free_pages_sub - the actual free implimentation, should consider how to 
+//                       - merge the adjacent buddy block. fa_lock must be held
+static void __buddy_free_pages_sub(uint32_t numa_id, struct Page *base, size_t order)
 {
 	ppn_t buddy_idx, page_idx = page2idx(base);
-	assert((page_idx & ((1 << order) - 1)) == 0);
-	struct Page *p = base;
-	for (; p != base + (1 << order); p++) {
-		assert(!PageReserved(p) && !PageProperty(p));
-		p->flags = 0;
-		set_page_ref(p, 0);
-	}
 	int zone_num = base->zone_num;
-	int intr_flag;
 	while (order < MAX_ORDER) {
 		buddy_idx = page_idx ^ (1 << order);
 		struct Page *buddy = idx2page(zone_num, buddy_idx);
 		if (!page_is_buddy(buddy, order, zone_num)) {
 			break;
 		}
-		/* modify free_list, should lock first */
-		spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
 		nr_free(numa_id, order)--;
 		list_del(&(buddy->page_link));
-		spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
-
 		ClearPageProperty(buddy);
 		page_idx &= buddy_idx;
 		order++;
@@ -231,12 +269,137 @@ static void buddy_free_pages_sub(uint32_t numa_id, struct Page *base, size_t ord
 	struct Page *page = idx2page(zone_num, page_idx);
 	page->property = order;
 	SetPageProperty(page);
-	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
 	nr_free(numa_id, order)++;
 	list_add(&free_list(numa_id, order), &(page->page_link));
+}
+
+static inline void buddy_reset_pages(struct Page *base, size_t order)
+{
+	assert((page2idx(base) & ((1 << order) - 1)) == 0);
+	struct Page *p = base;
+	for (; p != base + (1 << order); p++) {
+		assert(!PageReserved(p) && !PageProperty(p));
+		p->flags = 0;
+		set_page_ref(p, 0);
+	}
+}
+
+//buddy_free_pages_sub - reset the pages, then give them back with fa_lock held once
+static void buddy_free_pages_sub(uint32_t numa_id, struct Page *base, size_t order)
+{
+	buddy_reset_pages(base, order);
+	int intr_flag;
+	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	__buddy_free_pages_sub(numa_id, base, order);
+	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+}
+
+static void pcp_drain(struct pcp_pages *pcp, int n);
+
+//pcp_get - this cpu's page list, set up on first use
+static struct pcp_pages *pcp_get(void)
+{
+	struct pcp_pages *pcp = get_cpu_ptr(pcp_pages);
+	uint32_t numa_id = mycpu()->node ? mycpu()->node->id : 0;
+	if (pcp->list.next == NULL) {
+		list_init(&(pcp->list));
+		pcp->count = 0;
+		pcp->numa_id = numa_id;
+		pcp->drain_gen = atomic_read(&pcp_drain_gen);
+	} else if (pcp->numa_id != numa_id) {
+		/* cpus are bound to their nodes after the pmm is up */
+		pcp_drain(pcp, pcp->count);
+		pcp->numa_id = numa_id;
+	}
+	return pcp;
+}
+
+//pcp_drain - give up to n of the coldest pages back to the buddy system
+static void pcp_drain(struct pcp_pages *pcp, int n)
+{
+	if (n <= 0 || pcp->count == 0) {
+		return;
+	}
+	uint32_t numa_id = pcp->numa_id;
+	int intr_flag;
+	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	while (n-- > 0 && pcp->count > 0) {
+		list_entry_t *le = list_prev(&(pcp->list));
+		list_del(le);
+		pcp->count--;
+		__buddy_free_pages_sub(numa_id, le2page(le, page_link), 0);
+	}
+	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+}
+
+//pcp_check_drain - drain everything if some cpu ran short of memory since our last look
+static inline void pcp_check_drain(struct pcp_pages *pcp)
+{
+	int gen = atomic_read(&pcp_drain_gen);
+	if (pcp->drain_gen != gen) {
+		pcp->drain_gen = gen;
+		pcp_drain(pcp, pcp->count);
+	}
+}
+
+//pcp_refill - move up to PCP_BATCH order-0 pages from the buddy system to the tail
+static void pcp_refill(struct pcp_pages *pcp)
+{
+	uint32_t numa_id = pcp->numa_id;
+	int i, intr_flag;
+	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	for (i = 0; i < PCP_BATCH; i++) {
+		struct Page *page = __buddy_alloc_pages_sub(numa_id, 0);
+		if (page == NULL) {
+			break;
+		}
+		list_add_before(&(pcp->list), &(page->page_link));
+		pcp->count++;
+	}
 	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
 }
 
+static struct Page *pcp_alloc_page(struct pcp_pages *pcp)
+{
+	pcp_check_drain(pcp);
+	if (pcp->count == 0) {
+		pcp_refill(pcp);
+		if (pcp->count == 0) {
+			return NULL;
+		}
+	}
+	list_entry_t *le = list_next(&(pcp->list));
+	list_del(le);
+	pcp->count--;
+	return le2page(le, page_link);
+}
+
+static void pcp_free_page(struct pcp_pages *pcp, struct Page *page)
+{
+	buddy_reset_pages(page, 0);
+	list_add(&(pcp->list), &(page->page_link));
+	pcp->count++;
+	pcp_check_drain(pcp);
+	if (pcp->count > PCP_HIGH) {
+		pcp_drain(pcp, PCP_BATCH);
+	}
+}
+
+//buddy_drain_local - trim this cpu's list to PCP_LOW pages, or empty it if all is set.
+//                  - Emptying it also asks every other cpu to empty its own.
+static void buddy_drain_local(bool all)
+{
+	struct pcp_pages *pcp = pcp_get();
+	if (all) {
+		atomic_inc(&pcp_drain_gen);
+		pcp->drain_gen = atomic_read(&pcp_drain_gen);
+		pcp_drain(pcp, pcp->count);
+	} else {
+		pcp_check_drain(pcp);
+		pcp_drain(pcp, pcp->count - PCP_LOW);
+	}
+}
+
 //buddy_free_pages - call buddy_free_pages_sub to free n continuing page block
 static void buddy_free_pages(struct Page *base, size_t n)
 {
@@ -244,7 +407,12 @@ static void buddy_free_pages(struct Page *base, size_t n)
 	uint32_t numa_id = numa_mem_zones[base->zone_num].node->id;
 	assert(numa_id < sysconf.lnuma_count);
 	if (n == 1) {
-		buddy_free_pages_sub(numa_id, base, 0);
+		struct pcp_pages *pcp = pcp_get();
+		if (pcp->numa_id == numa_id) {
+			pcp_free_page(pcp, base);
+		} else {
+			buddy_free_pages_sub(numa_id, base, 0);
+		}
 	} else {
 		size_t order = 0, order_size = 1;
 		while (n >= order_size) {
@@ -279,6 +447,17 @@ static size_t __buddy_nr_free_pages(uint32_t numa_id)
 		ret += nr_free(numa_id, order) * (1 << order);
 	}
 	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	/* pages cached per cpu are free too, the count is only a snapshot */
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (percpu_offsets[i] == NULL) {
+			continue;
+		}
+		struct pcp_pages *pcp = per_cpu_ptr(pcp_pages, i);
+		if (pcp->list.next != NULL && pcp->numa_id == numa_id) {
+			ret += pcp->count;
+		}
+	}
 	return ret;
 }
 
@@ -308,6 +487,8 @@ static void buddy_check(void)
 	uint32_t numa_id = 0;
 	int can_borrow = buddy_numa_borrow;
 	buddy_numa_borrow = 0;
+	/* the free lists are swapped out below, keep single pages off the cpu list */
+	buddy_drain_local(1);
 	int i;
 	int count = 0, total = 0;
 	for (i = 0; i <= MAX_ORDER; i++) {
@@ -390,6 +571,18 @@ static void buddy_check(void)
 	}
 	assert(count == 0);
 	assert(total == 0);
+
+	/* single pages go through this cpu's list and come back hot */
+	size_t nr_free_before = nr_free_pages();
+	struct pcp_pages *pcp = pcp_get();
+	assert(pcp->count == 0);
+	assert((p0 = alloc_page()) != NULL && pcp->count == PCP_BATCH - 1);
+	assert(nr_free_pages() == nr_free_before - 1);
+	free_page(p0);
+	assert(pcp->count == PCP_BATCH && alloc_page() == p0);
+	free_page(p0);
+	buddy_drain_local(1);
+	assert(pcp->count == 0 && nr_free_pages() == nr_free_before);
 	buddy_numa_borrow = can_borrow;
 #undef nr_free_pages
 }
@@ -404,6 +597,7 @@ const struct pmm_manager buddy_pmm_manager = {
 	.free_pages = buddy_free_pages,
 	.nr_free_pages = buddy_nr_free_pages,
 	.nr_free_pages_numa = buddy_nr_free_pages_numa,
+	.drain_local = buddy_drain_local,
 	.check = buddy_check,
 };
 
@@ -0,0 +1,401 @@
+#include <types.h>
+#include <error.h>
+#include <string.h>
+#include <assert.h>
+#include <sync.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <proc.h>
+#include <mempolicy.h>
+
+#if MAX_NUMA_NODES > MPOL_MAX_NODES
+#error mempolicy: a nodemask holds at most MPOL_MAX_NODES nodes
+#endif
+
+#define node_isset(nodes, id)	(((nodes) >> (id)) & 1)
+
+static inline uint64_t online_nodes(void)
+{
+	if (sysconf.lnuma_count >= MPOL_MAX_NODES) {
+		return ~0ull;
+	}
+	return (1ull << sysconf.lnuma_count) - 1;
+}
+
+static inline struct numa_node *local_node(void)
+{
+	return mycpu()->node ? mycpu()->node : &numa_nodes[0];
+}
+
+static inline struct numa_node *page2node(struct Page *page)
+{
+	return numa_mem_zones[page->zone_num].node;
+}
+
+//nth_node - id of the n-th node (from 0) in @nodes
+static int nth_node(uint64_t nodes, int n)
+{
+	int id;
+	for (id = 0; id < MPOL_MAX_NODES; id++) {
+		if (node_isset(nodes, id) && n-- == 0) {
+			return id;
+		}
+	}
+	panic("nth_node: %d out of range\n", n);
+}
+
+static int nr_nodes(uint64_t nodes)
+{
+	int n = 0;
+	for (; nodes != 0; nodes &= nodes - 1) {
+		n++;
+	}
+	return n;
+}
+
+//mpol_get - the policy in force for @vma: its own, else the process's
+static struct mempolicy *mpol_get(struct vma_struct *vma)
+{
+	if (vma != NULL && vma->vm_policy.mode != MPOL_DEFAULT) {
+		return &(vma->vm_policy);
+	}
+	return &(current->mempolicy);
+}
+
+//interleave_node - interleave by page index, so that a page keeps its node
+//                - whichever thread faults it in first
+static int interleave_node(struct mempolicy *pol, uintptr_t addr, size_t n)
+{
+	uintptr_t idx = (addr >> PGSHIFT) / n;
+	return nth_node(pol->nodes, idx % nr_nodes(pol->nodes));
+}
+
+//bind_node - the allowed node nearest to the faulting cpu
+static struct numa_node *bind_node(struct mempolicy *pol)
+{
+	struct numa_node *local = local_node();
+	int i;
+	for (i = 0; i < sysconf.lnuma_count; i++) {
+		if (node_isset(pol->nodes, local->fallback[i])) {
+			return &numa_nodes[local->fallback[i]];
+		}
+	}
+	panic("bind_node: no node allowed\n");
+}
+
+/**
+ * mpol_node - the node @n pages at @addr in @vma should come from, NULL
+ * for the local one. Used where only one node can be tried, like for
+ * huge pages, which fall back to small pages anyway.
+ */
+struct numa_node *mpol_node(struct vma_struct *vma, uintptr_t addr, size_t n)
+{
+	struct mempolicy *pol = mpol_get(vma);
+	switch (pol->mode) {
+	case MPOL_PREFERRED:
+		return &numa_nodes[nth_node(pol->nodes, 0)];
+	case MPOL_INTERLEAVE:
+		return &numa_nodes[interleave_node(pol, addr, n)];
+	case MPOL_BIND:
+		return bind_node(pol);
+	}
+	return NULL;
+}
+
+//alloc_pages_near - alloc on @node, then on the others by distance from it
+static struct Page *alloc_pages_near(struct numa_node *node, size_t n)
+{
+	int i;
+	for (i = 0; i < sysconf.lnuma_count; i++) {
+		struct Page *page =
+		    alloc_pages_numa(&numa_nodes[node->fallback[i]], n);
+		if (page != NULL) {
+			return page;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * alloc_pages_vma - allocate @n pages to be mapped at @addr in @vma,
+ * following the vma or process policy
+ */
+struct Page *alloc_pages_vma(struct vma_struct *vma, uintptr_t addr, size_t n)
+{
+	struct mempolicy *pol = mpol_get(vma);
+	struct numa_node *local = local_node(), *node;
+	struct Page *page;
+	int i;
+	switch (pol->mode) {
+	case MPOL_PREFERRED:
+		return alloc_pages_near(&numa_nodes[nth_node(pol->nodes, 0)], n);
+	case MPOL_INTERLEAVE:
+		node = &numa_nodes[interleave_node(pol, addr, n)];
+		page = alloc_pages_near(node, n);
+		if (page != NULL && page2node(page) == node) {
+			atomic_inc(&(node->stat.interleave_hit));
+		}
+		return page;
+	case MPOL_BIND:
+		for (i = 0; i < sysconf.lnuma_count; i++) {
+			if (!node_isset(pol->nodes, local->fallback[i])) {
+				continue;
+			}
+			node = &numa_nodes[local->fallback[i]];
+			if ((page = alloc_pages_numa(node, n)) != NULL) {
+				return page;
+			}
+		}
+		return NULL;
+	}
+	return alloc_pages(n);
+}
+
+//mpol_init - check and normalize a policy given by the user
+static int mpol_init(struct mempolicy *pol, int mode, uint64_t nodes)
+{
+	if (mode < 0 || mode >= MPOL_MAX || (nodes & ~online_nodes())) {
+		return -E_INVAL;
+	}
+	switch (mode) {
+	case MPOL_DEFAULT:
+	case MPOL_LOCAL:
+		if (nodes != 0) {
+			return -E_INVAL;
+		}
+		break;
+	case MPOL_PREFERRED:
+		/* like linux, an empty preferred set means local */
+		if (nodes == 0) {
+			mode = MPOL_LOCAL;
+		} else {
+			nodes &= -nodes;
+		}
+		break;
+	case MPOL_BIND:
+	case MPOL_INTERLEAVE:
+		if (nodes == 0) {
+			return -E_INVAL;
+		}
+		break;
+	}
+	pol->mode = mode;
+	pol->nodes = nodes;
+	return 0;
+}
+
+//get_nodemask - read a nodemask of @maxnode - 1 bits, as linux does.
+//             - Bits past MPOL_MAX_NODES are not looked at.
+static int
+get_nodemask(struct mm_struct *mm, uint64_t * nodes,
+	     const unsigned long *nmask, unsigned long maxnode)
+{
+	unsigned long mask;
+	*nodes = 0;
+	if (nmask == NULL || maxnode <= 1) {
+		return 0;
+	}
+	maxnode--;
+	lock_mm_read(mm);
+	bool ok = copy_from_user(mm, &mask, nmask, sizeof(mask), 0);
+	unlock_mm_read(mm);
+	if (!ok) {
+		return -E_INVAL;
+	}
+	if (maxnode < MPOL_MAX_NODES) {
+		mask &= (1ul << maxnode) - 1;
+	}
+	*nodes = mask;
+	return 0;
+}
+
+int do_set_mempolicy(int mode, const unsigned long *nmask,
+		     unsigned long maxnode)
+{
+	struct mm_struct *mm = current->mm;
+	struct mempolicy pol;
+	uint64_t nodes;
+	int ret;
+	if ((ret = get_nodemask(mm, &nodes, nmask, maxnode)) != 0) {
+		return ret;
+	}
+	if ((ret = mpol_init(&pol, mode, nodes)) != 0) {
+		return ret;
+	}
+	current->mempolicy = pol;
+	return 0;
+}
+
+/**
+ * do_mbind - set the policy of the mappings in [start, start + len). The
+ * vmas at both ends are split. Pages already present are not migrated,
+ * so MPOL_MF_STRICT and MPOL_MF_MOVE are accepted and have no effect.
+ */
+int do_mbind(uintptr_t start, size_t len, int mode,
+	     const unsigned long *nmask, unsigned long maxnode,
+	     unsigned int flags)
+{
+	struct mm_struct *mm = current->mm;
+	struct vma_struct *vma;
+	struct mempolicy pol;
+	uint64_t nodes;
+	int ret;
+	if (start % PGSIZE != 0 || (flags & ~(MPOL_MF_STRICT | MPOL_MF_MOVE))) {
+		return -E_INVAL;
+	}
+	uintptr_t end = ROUNDUP(start + len, PGSIZE), addr;
+	if (end < start || !USER_ACCESS(start, end)) {
+		return -E_INVAL;
+	}
+	if ((ret = get_nodemask(mm, &nodes, nmask, maxnode)) != 0) {
+		return ret;
+	}
+	if ((ret = mpol_init(&pol, mode, nodes)) != 0) {
+		return ret;
+	}
+
+	lock_mm(mm);
+	/* the whole range has to be mapped */
+	for (addr = start; addr < end; addr = vma->vm_end) {
+		vma = find_vma(mm, addr);
+		if (vma == NULL || vma->vm_start > addr) {
+			ret = -E_FAULT;
+			goto out;
+		}
+	}
+	for (addr = start; addr < end;) {
+		vma = find_vma(mm, addr);
+		if (vma->vm_start < addr) {
+			if ((ret = split_vma(mm, vma, addr)) != 0) {
+				goto out;
+			}
+		}
+		if (end < vma->vm_end) {
+			if ((ret = split_vma(mm, vma, end)) != 0) {
+				goto out;
+			}
+			vma = find_vma(mm, addr);
+		}
+		vma->vm_policy = pol;
+		addr = vma->vm_end;
+		vma_merge(mm, vma);
+	}
+out:
+	unlock_mm(mm);
+	return ret;
+}
+
+/**
+ * do_get_mempolicy - return the process policy, or with MPOL_F_ADDR the
+ * one of the vma at @addr. MPOL_F_NODE | MPOL_F_ADDR returns the node of
+ * the page at @addr instead, faulting it in if needed.
+ */
+int do_get_mempolicy(int *mode, unsigned long *nmask, unsigned long maxnode,
+		     uintptr_t addr, unsigned int flags)
+{
+	struct mm_struct *mm = current->mm;
+	struct mempolicy *pol = &(current->mempolicy);
+	int rmode, ret = 0;
+	uint64_t rnodes = 0;
+	if (flags & ~(MPOL_F_NODE | MPOL_F_ADDR | MPOL_F_MEMS_ALLOWED)) {
+		return -E_INVAL;
+	}
+	if (nmask != NULL && maxnode - 1 < sysconf.lnuma_count) {
+		return -E_INVAL;
+	}
+
+	lock_mm_read(mm);
+	if (flags & MPOL_F_MEMS_ALLOWED) {
+		if (flags != MPOL_F_MEMS_ALLOWED) {
+			ret = -E_INVAL;
+			goto out;
+		}
+		rmode = MPOL_DEFAULT;
+		rnodes = online_nodes();
+	} else if (flags & MPOL_F_ADDR) {
+		struct vma_struct *vma = find_vma(mm, addr);
+		if (vma == NULL || vma->vm_start > addr) {
+			ret = -E_FAULT;
+			goto out;
+		}
+		if (flags & MPOL_F_NODE) {
+			struct Page *page = get_page(mm->pgdir, addr, NULL);
+			if (page == NULL) {
+				/* we hold the lock, do_pgfault will not retake it */
+				if ((ret = do_pgfault(mm, 0, addr)) != 0) {
+					goto out;
+				}
+				page = get_page(mm->pgdir, addr, NULL);
+				assert(page != NULL);
+			}
+			rmode = page2node(page)->id;
+		} else {
+			rmode = vma->vm_policy.mode;
+			rnodes = vma->vm_policy.nodes;
+		}
+	} else if (flags & MPOL_F_NODE) {
+		ret = -E_INVAL;
+		goto out;
+	} else {
+		rmode = pol->mode;
+		rnodes = pol->nodes;
+	}
+
+	if (mode != NULL && !copy_to_user(mm, mode, &rmode, sizeof(int))) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	if (nmask != NULL) {
+		unsigned long mask = rnodes;
+		if (!copy_to_user(mm, nmask, &mask, sizeof(mask))) {
+			ret = -E_INVAL;
+		}
+	}
+out:
+	unlock_mm_read(mm);
+	return ret;
+}
+
+//do_numa_stat - copy the size, distances and allocation counters of a node
+int do_numa_stat(int id, struct numa_stat *stat)
+{
+	struct mm_struct *mm = current->mm;
+	struct numa_stat s;
+	int i;
+	if (id < 0 || id >= sysconf.lnuma_count) {
+		return -E_INVAL;
+	}
+	struct numa_node *node = &numa_nodes[id];
+	memset(&s, 0, sizeof(s));
+	s.nr_cpus = node->nr_cpus;
+	for (i = 0; i < MAX_NUMA_MEM_ZONES; i++) {
+		if (numa_mem_zones[i].node == node) {
+			s.total_pages += numa_mem_zones[i].n;
+		}
+	}
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		s.free_pages = pmm_manager->nr_free_pages_numa(node);
+	}
+	local_intr_restore(intr_flag);
+	for (i = 0; i < sysconf.lnuma_count; i++) {
+		s.distance[i] = node->distance[i];
+	}
+	s.numa_hit = (unsigned int)atomic_read(&(node->stat.numa_hit));
+	s.numa_miss = (unsigned int)atomic_read(&(node->stat.numa_miss));
+	s.numa_foreign = (unsigned int)atomic_read(&(node->stat.numa_foreign));
+	s.interleave_hit = (unsigned int)atomic_read(&(node->stat.interleave_hit));
+	s.local_node = (unsigned int)atomic_read(&(node->stat.local_node));
+	s.other_node = (unsigned int)atomic_read(&(node->stat.other_node));
+
+	int ret = 0;
+	lock_mm_read(mm);
+	if (!copy_to_user(mm, stat, &s, sizeof(s))) {
+		ret = -E_INVAL;
+	}
+	unlock_mm_read(mm);
+	return ret;
+}
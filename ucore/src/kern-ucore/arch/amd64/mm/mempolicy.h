@@ -0,0 +1,34 @@
+#ifndef __KERN_MM_MEMPOLICY_H__
+#define __KERN_MM_MEMPOLICY_H__
+
+#include <types.h>
+#include <mpolicy.h>
+
+struct Page;
+struct numa_node;
+struct vma_struct;
+
+/*
+ * Where the user pages of a process, or of one of its vmas, come from.
+ * A vma with MPOL_DEFAULT follows the process, a process with
+ * MPOL_DEFAULT allocates on the node of the faulting cpu. Kernel memory
+ * (page tables, kernel stacks, slab) always comes from the local node.
+ */
+struct mempolicy {
+	int mode;		// MPOL_*
+	uint64_t nodes;		// one bit per node id
+};
+
+struct numa_node *mpol_node(struct vma_struct *vma, uintptr_t addr, size_t n);
+struct Page *alloc_pages_vma(struct vma_struct *vma, uintptr_t addr, size_t n);
+
+int do_set_mempolicy(int mode, const unsigned long *nmask,
+		     unsigned long maxnode);
+int do_mbind(uintptr_t start, size_t len, int mode,
+	     const unsigned long *nmask, unsigned long maxnode,
+	     unsigned int flags);
+int do_get_mempolicy(int *mode, unsigned long *nmask, unsigned long maxnode,
+		     uintptr_t addr, unsigned int flags);
+int do_numa_stat(int node, struct numa_stat *stat);
+
+#endif /* !__KERN_MM_MEMPOLICY_H__ */
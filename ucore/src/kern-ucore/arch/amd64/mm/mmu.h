@@ -234,6 +234,8 @@ struct taskstate {
 #define PMD_ADDR(pmd)   PTE_ADDR(pmd)
 #define PUD_ADDR(pud)   PTE_ADDR(pud)
 #define PGD_ADDR(pgd)   PTE_ADDR(pgd)
+// frame of a huge (PTE_PS) pmd entry, without its PAT and high bits
+#define HPMD_ADDR(pmd)  ((uintptr_t)(pmd) & ~PTE_HIGH & ~(HPAGE_SIZE - 1))
 
 /* page directory and page table constants */
 #define NPGENTRY        512	// #entries per page directory
@@ -245,6 +247,9 @@ struct taskstate {
 #define PMSIZE         (1LLU * NPGENTRY * PTSIZE)	// bytes mapped by a pud entry
 #define PUSIZE         (1LLU * NPGENTRY * PMSIZE)	// bytes mapped by a pgd entry
 
+#define HPAGE_SIZE      PTSIZE	// bytes mapped by a huge (PTE_PS) pmd entry
+#define HPAGE_NR        NPGENTRY	// # of pages in a huge page
+
 #define PTXSHIFT        12	// offset of PTX in a linear address
 #define PMXSHIFT        21	// offset of PMX in a linear address
 #define PUXSHIFT        30	// offset of PUX in a linear address
@@ -264,6 +269,9 @@ struct taskstate {
 							// The PTE_AVAIL bits aren't used by the kernel or interpreted by the
 							// hardware, so user processes are allowed to set them arbitrarily.
 
+#define PTE_NX          0x8000000000000000LLU	// No Execute
+#define PTE_HIGH        0xFFF0000000000000LLU	// NX, protection key and software bits
+
 #define PTE_SWAP        (PTE_A | PTE_D)
 #define PTE_USER        (PTE_U | PTE_W | PTE_P)
 
@@ -425,6 +433,12 @@ static inline void ptep_unset_dirty(pte_t * ptep)
 	*ptep &= (~PTE_D);
 }
 
+/* a pmd entry mapping a HPAGE_SIZE page instead of a page table */
+static inline int ptep_huge(pte_t * ptep)
+{
+	return (*ptep & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
 #endif
 
 #endif /* !__KERN_MM_MMU_H__ */
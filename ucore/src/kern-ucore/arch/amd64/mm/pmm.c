@@ -14,6 +14,7 @@
 #include <mp.h>
 #include <sysconf.h>
 #include <ramdisk.h>
+#include <zeropool.h>
 
 /* *
  * Task State Segment:
@@ -364,6 +365,10 @@ try_again:
 	local_intr_save(intr_flag);
 	{
 		page = pmm_manager->alloc_pages(n);
+		if (page == NULL && pmm_manager->drain_local != NULL) {
+			pmm_manager->drain_local(1);
+			page = pmm_manager->alloc_pages(n);
+		}
 	}
 	local_intr_restore(intr_flag);
 #ifdef UCONFIG_SWAP
@@ -371,6 +376,11 @@ try_again:
 		goto try_again;
 	}
 #endif
+#ifdef UCONFIG_PREZERO_POOL
+	if (page == NULL && zero_pool_release() != 0) {
+		return alloc_pages(n);
+	}
+#endif
 
 	get_cpu_var(used_pages) += n;
 	return page;
@@ -388,8 +398,17 @@ struct Page *alloc_pages_cpu(struct cpu *cpu, size_t n)
 	local_intr_save(intr_flag);
 	{
 		page = pmm_manager->alloc_pages_numa(cpu->node, n);
+		if (page == NULL && pmm_manager->drain_local != NULL) {
+			pmm_manager->drain_local(1);
+			page = pmm_manager->alloc_pages_numa(cpu->node, n);
+		}
 	}
 	local_intr_restore(intr_flag);
+#ifdef UCONFIG_PREZERO_POOL
+	if (page == NULL && zero_pool_release() != 0) {
+		return alloc_pages_cpu(cpu, n);
+	}
+#endif
 	per_cpu(used_pages, cpu->id) += n;
 	return page;
 }
@@ -405,8 +424,20 @@ struct Page *alloc_pages_numa(struct numa_node* node, size_t n)
 	local_intr_save(intr_flag);
 	{
 		page = pmm_manager->alloc_pages_numa(node, n);
+		if (page == NULL && pmm_manager->drain_local != NULL) {
+			pmm_manager->drain_local(1);
+			page = pmm_manager->alloc_pages_numa(node, n);
+		}
 	}
 	local_intr_restore(intr_flag);
+#ifdef UCONFIG_PREZERO_POOL
+	if (page == NULL && zero_pool_release() != 0) {
+		return alloc_pages_numa(node, n);
+	}
+#endif
+	if (page != NULL) {
+		get_cpu_var(used_pages) += n;
+	}
 	return page;
 }
 
@@ -455,6 +486,25 @@ size_t nr_free_pages(void)
 	return ret;
 }
 
+/**
+ * drain_local_pages - give the free pages cached by this cpu back to the
+ * page allocator
+ * @param all empty the cache and ask the other cpus to do the same,
+ *            otherwise only trim it to its low watermark
+ */
+void drain_local_pages(bool all)
+{
+	bool intr_flag;
+	if (pmm_manager->drain_local == NULL) {
+		return;
+	}
+	local_intr_save(intr_flag);
+	{
+		pmm_manager->drain_local(all);
+	}
+	local_intr_restore(intr_flag);
+}
+
 	void
 boot_map_segment(pgd_t * pgdir, uintptr_t la, size_t size, uintptr_t pa,
 		uint32_t perm)
@@ -463,13 +513,119 @@ boot_map_segment(pgd_t * pgdir, uintptr_t la, size_t size, uintptr_t pa,
 	size_t n = ROUNDUP(size + PGOFF(la), PGSIZE) / PGSIZE;
 	la = ROUNDDOWN(la, PGSIZE);
 	pa = ROUNDDOWN(pa, PGSIZE);
-	for (; n > 0; n--, la += PGSIZE, pa += PGSIZE) {
+	while (n > 0) {
+#ifdef UCONFIG_HUGEPAGE
+		/* use a whole pmd entry when nothing is mapped in its range yet */
+		if (la % HPAGE_SIZE == 0 && pa % HPAGE_SIZE == 0
+		    && n >= HPAGE_NR) {
+			pmd_t *pmdp = get_pmd(pgdir, la, 1);
+			assert(pmdp != NULL);
+			if (ptep_invalid(pmdp)) {
+				*pmdp = pa | PTE_P | PTE_PS | perm;
+				n -= HPAGE_NR, la += HPAGE_SIZE, pa += HPAGE_SIZE;
+				continue;
+			}
+		}
+#endif
 		pte_t *ptep = get_pte(pgdir, la, 1);
 		assert(ptep != NULL);
 		*ptep = pa | PTE_P | perm;
+		n--, la += PGSIZE, pa += PGSIZE;
+	}
+}
+
+#ifdef UCONFIG_HUGEPAGE
+static inline struct Page *alloc_pages_on(struct numa_node *node, size_t n)
+{
+	return node != NULL ? alloc_pages_numa(node, n) : alloc_pages(n);
+}
+
+/**
+ * alloc_huge_page - allocate HPAGE_NR pages starting at a HPAGE_SIZE aligned
+ * physical address, on @node or on the local one if it is NULL. The buddy
+ * blocks are only aligned within their zone, so fall back to a block twice
+ * as large and give back what is around it.
+ */
+struct Page *alloc_huge_page(struct numa_node *node)
+{
+	struct Page *page = alloc_pages_on(node, HPAGE_NR);
+	if (page == NULL || page2pa(page) % HPAGE_SIZE == 0) {
+		return page;
+	}
+	free_pages(page, HPAGE_NR);
+	if ((page = alloc_pages_on(node, 2 * HPAGE_NR)) == NULL) {
+		return NULL;
+	}
+	size_t head =
+	    (ROUNDUP(page2pa(page), HPAGE_SIZE) - page2pa(page)) / PGSIZE;
+	if (head != 0) {
+		free_pages(page, head);
+	}
+	free_pages(page + head + HPAGE_NR, HPAGE_NR - head);
+	return page + head;
+}
+
+/**
+ * set_huge_pmd - map a huge page with one pmd entry. Every small page in it
+ * holds its own reference, so splitting the entry later is only a matter of
+ * building the page table.
+ */
+void set_huge_pmd(pmd_t * pmdp, struct Page *page, pte_perm_t perm)
+{
+	assert(ptep_invalid(pmdp) && page2pa(page) % HPAGE_SIZE == 0);
+	int i;
+	for (i = 0; i < HPAGE_NR; i++) {
+		set_page_ref(page + i, 1);
 	}
+	*pmdp = page2pa(page) | PTE_P | PTE_PS | perm;
 }
 
+/**
+ * split_huge_pmd - replace the huge mapping of @pmdp, which covers @la, by a
+ * page table mapping the same pages with the same permissions.
+ * @return 0 on success, -E_NO_MEM if no page table could be allocated
+ */
+int split_huge_pmd(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp)
+{
+	assert(ptep_huge(pmdp));
+	struct Page *page;
+	if ((page = alloc_page()) == NULL) {
+		return -E_NO_MEM;
+	}
+	set_page_ref(page, 1);
+	pte_t *pt = page2kva(page);
+	uintptr_t pa = HPMD_ADDR(*pmdp);
+	/* bit 7 is PS in a pmd but PAT in a pte, everything else carries over */
+	pte_perm_t perm = *pmdp & (0xFFF | PTE_HIGH) & ~PTE_PS;
+	int i;
+	for (i = 0; i < NPGENTRY; i++) {
+		pt[i] = (pa + i * PGSIZE) | perm;
+	}
+	*pmdp = page2pa(page) | PTE_P | PTE_W | PTE_U | PTE_A | PTE_D;
+	/* the translation is unchanged, a stale entry elsewhere does no harm */
+	tlb_invalidate(pgdir, ROUNDDOWN(la, HPAGE_SIZE));
+	return 0;
+}
+
+/**
+ * unmap_huge_pmd - remove a whole huge user mapping and drop the references
+ * of its pages.
+ */
+void unmap_huge_pmd(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp)
+{
+	assert(ptep_huge(pmdp));
+	struct Page *page = pa2page(HPMD_ADDR(*pmdp));
+	int i;
+	for (i = 0; i < HPAGE_NR; i++, page++) {
+		if (page_ref_dec(page) == 0) {
+			free_page(page);
+		}
+	}
+	*pmdp = 0;
+	mp_tlb_invalidate(pgdir, ROUNDDOWN(la, HPAGE_SIZE));
+}
+#endif /* UCONFIG_HUGEPAGE */
+
 //pmm_init - setup a pmm to manage physical memory, build PDT&PT to setup paging mechanism 
 //         - check the correctness of pmm & paging mechanism, print PDT&PT
 void pmm_init_numa(void)
@@ -522,6 +678,9 @@ void pmm_init_numa(void)
 
 	print_pgdir(kprintf);
 	slab_init();
+#ifdef UCONFIG_PREZERO_POOL
+	zero_pool_init();
+#endif
 }
 
 void pmm_init_ap(void)
@@ -603,8 +762,8 @@ get_pgtable_items(size_t left, size_t right, size_t start, uintptr_t * table,
 		if (left_store != NULL) {
 			*left_store = start;
 		}
-		int perm = (table[start++] & PTE_USER);
-		while (start < right && (table[start] & PTE_USER) == perm) {
+		int perm = (table[start++] & (PTE_USER | PTE_PS));
+		while (start < right && (table[start] & (PTE_USER | PTE_PS)) == perm) {
 			start++;
 		}
 		if (right_store != NULL) {
@@ -634,8 +793,12 @@ print_pgdir_sub(int deep, size_t left, size_t right,
 			}
 			printf(" %016llx-%016llx %016llx %s\n", lb, rb, rb - lb,
 			       perm2str(perm));
-			print_pgdir_sub(deep - 1, l * NPGENTRY, r * NPGENTRY,
-					s1 + 1, s2 + 1, s3 + 1, printf);
+			/* a huge entry maps memory, not a lower table */
+			if (!(perm & PTE_PS)) {
+				print_pgdir_sub(deep - 1, l * NPGENTRY,
+						r * NPGENTRY, s1 + 1, s2 + 1,
+						s3 + 1, printf);
+			}
 		}
 	}
 }
@@ -22,6 +22,7 @@ struct pmm_manager {
 	void (*free_pages) (struct Page * base, size_t n);
 	 size_t(*nr_free_pages) (void);
 	 size_t(*nr_free_pages_numa) (struct numa_node *node);
+	void (*drain_local) (bool all);
 	void (*check) (void);
 };
 struct proc_struct;
@@ -46,6 +47,7 @@ void *boot_alloc_page(void);
 void free_pages(struct Page *base, size_t n);
 size_t nr_used_pages(void);
 size_t nr_free_pages(void);
+void drain_local_pages(bool all);
 
 #define alloc_page() alloc_pages(1)
 #define free_page(page) free_pages(page, 1)
@@ -59,6 +61,13 @@ void page_remove(pgd_t * pgdir, uintptr_t la);
 int page_insert(pgd_t * pgdir, struct Page *page, uintptr_t la, pte_perm_t perm);
 int pmm_mmio_map_direct(pgd_t *pgdir, uintptr_t physics_address_start, uintptr_t logic_address_start, uint32_t size, pte_perm_t perm);
 
+#ifdef UCONFIG_HUGEPAGE
+struct Page *alloc_huge_page(struct numa_node *node);
+void set_huge_pmd(pmd_t * pmdp, struct Page *page, pte_perm_t perm);
+int split_huge_pmd(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp);
+void unmap_huge_pmd(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp);
+#endif
+
 void load_rsp0(uintptr_t rsp0);
 void set_pgdir(struct proc_struct *proc, pgd_t * pgdir);
 void load_pgdir(struct proc_struct *proc);
@@ -0,0 +1,123 @@
+#include <types.h>
+#include <list.h>
+#include <string.h>
+#include <spinlock.h>
+#include <sync.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <proc.h>
+#include <zeropool.h>
+
+/*
+ * Anonymous memory has to read as zero, and clearing the page is most of
+ * what the first write to fresh memory costs. Each node keeps a pool of
+ * pages its idle cpus have cleared beforehand. A fault takes a page from
+ * the pool of the node the page is meant for, and clears one itself only
+ * when that pool is empty. Pools grow only while their node has plenty
+ * of free memory, and are given back when an allocation fails.
+ */
+struct zero_pool {
+	spinlock_s lock;
+	list_entry_t list;
+	size_t nr;
+};
+
+static struct zero_pool zero_pools[MAX_NUMA_NODES];
+
+static inline struct numa_node *local_node(void)
+{
+	return mycpu()->node ? mycpu()->node : &numa_nodes[0];
+}
+
+static struct Page *zero_pool_pop(struct zero_pool *pool)
+{
+	struct Page *page = NULL;
+	bool intr_flag;
+	spin_lock_irqsave(&(pool->lock), intr_flag);
+	if (pool->nr != 0) {
+		list_entry_t *le = list_next(&(pool->list));
+		list_del(le);
+		pool->nr--;
+		page = le2page(le, page_link);
+	}
+	spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	return page;
+}
+
+void zero_pool_init(void)
+{
+	int i;
+	for (i = 0; i < MAX_NUMA_NODES; i++) {
+		spinlock_init(&(zero_pools[i].lock));
+		list_init(&(zero_pools[i].list));
+		zero_pools[i].nr = 0;
+	}
+}
+
+/**
+ * zero_pool_get - a cleared page for @addr in @vma from the pool of the
+ * node its policy picks, or NULL if that pool is empty
+ */
+struct Page *zero_pool_get(struct vma_struct *vma, uintptr_t addr)
+{
+	struct numa_node *node = NULL;
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	node = mpol_node(vma, addr, 1);
+#endif
+	if (node == NULL) {
+		node = local_node();
+	}
+	return zero_pool_pop(&zero_pools[node->id]);
+}
+
+/**
+ * zero_pool_refill - called by an idle cpu: clear pages for the pool of
+ * its node until the pool is full or the cpu has work to do
+ */
+void zero_pool_refill(void)
+{
+	struct numa_node *node = local_node();
+	struct zero_pool *pool = &zero_pools[node->id];
+	bool intr_flag;
+	while (pool->nr < ZERO_POOL_PAGES && !current->need_resched) {
+		size_t nr_free;
+		local_intr_save(intr_flag);
+		{
+			nr_free = pmm_manager->nr_free_pages_numa(node);
+		}
+		local_intr_restore(intr_flag);
+		if (nr_free < ZERO_POOL_RESERVE) {
+			break;
+		}
+		struct Page *page;
+		if ((page = alloc_pages_numa(node, 1)) == NULL) {
+			break;
+		}
+		memset(page2kva(page), 0, PGSIZE);
+		spin_lock_irqsave(&(pool->lock), intr_flag);
+		list_add(&(pool->list), &(page->page_link));
+		pool->nr++;
+		spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	}
+}
+
+/**
+ * zero_pool_release - give the pages of all pools back to the page
+ * allocator
+ * @return the number of pages given back
+ */
+size_t zero_pool_release(void)
+{
+	size_t nr = 0;
+	int i;
+	for (i = 0; i < sysconf.lnuma_count; i++) {
+		struct Page *page;
+		while ((page = zero_pool_pop(&zero_pools[i])) != NULL) {
+			free_page(page);
+			nr++;
+		}
+	}
+	return nr;
+}
@@ -0,0 +1,17 @@
+#ifndef __KERN_MM_ZEROPOOL_H__
+#define __KERN_MM_ZEROPOOL_H__
+
+#include <types.h>
+
+#define ZERO_POOL_PAGES     256	// cleared pages kept per node
+#define ZERO_POOL_RESERVE   4096	// free pages a node keeps before the pool grows
+
+struct Page;
+struct vma_struct;
+
+void zero_pool_init(void);
+struct Page *zero_pool_get(struct vma_struct *vma, uintptr_t addr);
+void zero_pool_refill(void);
+size_t zero_pool_release(void);
+
+#endif /* !__KERN_MM_ZEROPOOL_H__ */
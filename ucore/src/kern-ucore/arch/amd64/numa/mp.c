@@ -108,6 +108,7 @@ void ap_init(void)
 	/* load new pagetable(shared with bsp) */
 	pmm_init_ap();
 	idt_init();		// init interrupt descriptor table
+	syscall_init();		// the SYSCALL msrs are per cpu too
 #ifdef UCONFIG_ENABLE_IPI
 	ipi_init();
 #endif
@@ -6,6 +6,10 @@
 #include <stdlib.h>
 #include <elf.h>
 #include <mp.h>
+#include <zeropool.h>
+#ifdef UCONFIG_VDSO
+#include <vdso_data.h>
+#endif
 
 void forkret(void);
 void forkrets(struct trapframe *tf);
@@ -22,6 +26,8 @@ struct proc_struct *alloc_proc(void)
 		proc->need_resched = 0;
 		proc->parent = NULL;
 		proc->mm = NULL;
+		proc->mm_rlocked = NULL;
+		proc->journal_info = NULL;
 		memset(&(proc->context), 0, sizeof(struct context));
 		proc->tf = NULL;
 		proc->cr3 = PADDR(init_pgdir_get());
@@ -38,6 +44,10 @@ struct proc_struct *alloc_proc(void)
 		proc->fs_struct = NULL;
 		proc->cpu_affinity = myid();
 		spinlock_init(&proc->lock);
+#ifdef UCONFIG_NUMA_MEMPOLICY
+		proc->mempolicy.mode = MPOL_DEFAULT;
+		proc->mempolicy.nodes = 0;
+#endif
 	}
 	return proc;
 }
@@ -211,6 +221,11 @@ int init_new_context_dynamic(struct proc_struct *proc, struct elfhdr *elf, int a
   //looks up data on the stack.
 	tf->tf_regs.reg_rdi = (uint64_t)argc;
 	tf->tf_regs.reg_rsi = (uintptr_t)new_argv;
+#ifdef UCONFIG_VDSO
+	// and the vDSO image, see libs/vdso.h. Not in %rdx, which the ABI
+	// gives to an atexit handler.
+	tf->tf_regs.reg_rcx = VDSO_BASE + PGSIZE;
+#endif
 	return 0;
 }
 
@@ -219,6 +234,10 @@ void cpu_idle(void)
 {
 	while (1) {
 		assert((read_rflags() & FL_IF) != 0);
+		drain_local_pages(0);
+#ifdef UCONFIG_PREZERO_POOL
+		zero_pool_refill();
+#endif
 		asm volatile ("hlt");
 	}
 }
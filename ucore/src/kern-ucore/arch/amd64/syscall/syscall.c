@@ -4,12 +4,14 @@
 #include <stdio.h>
 #include <pmm.h>
 #include <vmm.h>
+#include <ksm.h>
 #include <clock.h>
 #include <error.h>
 #include <assert.h>
 #include <sem.h>
 #include <event.h>
 #include <mbox.h>
+#include <futex.h>
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
@@ -136,6 +138,28 @@ static uint64_t sys_shmem(uint64_t arg[])
 	return do_shmem(addr_store, len, mmap_flags);
 }
 
+static uint64_t sys_madvise(uint64_t arg[])
+{
+	void *addr = (void *)arg[0];
+	size_t len = (size_t) arg[1];
+	int advice = (int)arg[2];
+	return do_madvise(addr, len, advice);
+}
+
+static uint64_t sys_faultstat(uint64_t arg[])
+{
+	struct fault_stat *stat = (struct fault_stat *)arg[0];
+	return do_faultstat(stat);
+}
+
+#ifdef UCONFIG_KSM
+static uint64_t sys_ksmstat(uint64_t arg[])
+{
+	struct ksm_stat *stat = (struct ksm_stat *)arg[0];
+	return do_ksmstat(stat);
+}
+#endif
+
 static uint64_t sys_putc(uint64_t arg[])
 {
 	int c = (int)arg[0];
@@ -181,6 +205,15 @@ static uint64_t sys_sem_get_value(uint64_t arg[])
 	return ipc_sem_get_value(sem_id, value_store);
 }
 
+static uint64_t sys_futex(uint64_t arg[])
+{
+	uintptr_t uaddr = (uintptr_t) arg[0];
+	int op = (int)arg[1];
+	int val = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return do_futex(uaddr, op, val, timeout);
+}
+
 static uint64_t sys_event_send(uint64_t arg[])
 {
 	int pid = (int)arg[0];
@@ -232,6 +265,44 @@ static uint64_t sys_mbox_info(uint64_t arg[])
 	return ipc_mbox_info(id, info);
 }
 
+#ifdef UCONFIG_NUMA_MEMPOLICY
+static uint64_t sys_mbind(uint64_t arg[])
+{
+	uintptr_t start = (uintptr_t) arg[0];
+	size_t len = (size_t) arg[1];
+	int mode = (int)arg[2];
+	const unsigned long *nmask = (const unsigned long *)arg[3];
+	unsigned long maxnode = (unsigned long)arg[4];
+	unsigned int flags = (unsigned int)arg[5];
+	return do_mbind(start, len, mode, nmask, maxnode, flags);
+}
+
+static uint64_t sys_set_mempolicy(uint64_t arg[])
+{
+	int mode = (int)arg[0];
+	const unsigned long *nmask = (const unsigned long *)arg[1];
+	unsigned long maxnode = (unsigned long)arg[2];
+	return do_set_mempolicy(mode, nmask, maxnode);
+}
+
+static uint64_t sys_get_mempolicy(uint64_t arg[])
+{
+	int *mode = (int *)arg[0];
+	unsigned long *nmask = (unsigned long *)arg[1];
+	unsigned long maxnode = (unsigned long)arg[2];
+	uintptr_t addr = (uintptr_t) arg[3];
+	unsigned int flags = (unsigned int)arg[4];
+	return do_get_mempolicy(mode, nmask, maxnode, addr, flags);
+}
+
+static uint64_t sys_numa_stat(uint64_t arg[])
+{
+	int node = (int)arg[0];
+	struct numa_stat *stat = (struct numa_stat *)arg[1];
+	return do_numa_stat(node, stat);
+}
+#endif
+
 static uint64_t sys_seek(uint64_t arg[])
 {
 	int fd = (int)arg[0];
@@ -341,6 +412,11 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
 	    [SYS_mmap] sys_mmap,
 	    [SYS_munmap] sys_munmap,
 	    [SYS_shmem] sys_shmem,
+	    [SYS_madvise] sys_madvise,
+	    [SYS_faultstat] sys_faultstat,
+#ifdef UCONFIG_KSM
+	    [SYS_ksmstat] sys_ksmstat,
+#endif
 	    [SYS_putc] sys_putc,
 	    [SYS_pgdir] sys_pgdir,
 	    [SYS_sem_init] sys_sem_init,
@@ -348,6 +424,7 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
 	    [SYS_sem_wait] sys_sem_wait,
 	    [SYS_sem_free] sys_sem_free,
 	    [SYS_sem_get_value] sys_sem_get_value,
+	    [SYS_futex] sys_futex,
 	    [SYS_event_send] sys_event_send,
 	    [SYS_event_recv] sys_event_recv,
 	    [SYS_mbox_init] sys_mbox_init,
@@ -355,6 +432,12 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
 	    [SYS_mbox_recv] sys_mbox_recv,
 	    [SYS_mbox_free] sys_mbox_free,
 	    [SYS_mbox_info] sys_mbox_info,
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	    [SYS_mbind] sys_mbind,
+	    [SYS_set_mempolicy] sys_set_mempolicy,
+	    [SYS_get_mempolicy] sys_get_mempolicy,
+	    [SYS_numa_stat] sys_numa_stat,
+#endif
 	    [SYS_open] syscall_linux_open,
 	    [SYS_close] syscall_linux_close,
 	    [SYS_read] syscall_linux_read,
@@ -374,7 +457,15 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
       [SYS_mkfifo] sys_mkfifo,
       [SYS_halt] sys_halt,
       [SYS_mount] syscall_linux_mount,
-      [SYS_umount] syscall_linux_umount
+      [SYS_umount] syscall_linux_umount,
+      [SYS_socket] syscall_linux_socket,
+      [SYS_connect] syscall_linux_connect,
+      [SYS_bind] syscall_linux_bind,
+      [SYS_listen] syscall_linux_listen,
+      [SYS_accept] syscall_linux_accept,
+      [SYS_sendto] syscall_linux_sendto,
+      [SYS_recvfrom] syscall_linux_recvfrom,
+      [SYS_setsockopt] syscall_linux_setsockopt
     };
 
 #define NUM_SYSCALLS        ((sizeof(syscalls)) / (sizeof(syscalls[0])))
@@ -655,7 +746,7 @@ static uint64_t(*syscalls_linux[305]) (uint64_t arg[]) = {
 	[__NR_mremap] unknown,
 	[__NR_msync] unknown,
 	[__NR_mincore] unknown,
-	[__NR_madvise] unknown,
+	[__NR_madvise] syscall_linux_madvise,
 	[__NR_shmget] unknown,
 	[__NR_shmat] unknown,
 	[__NR_shmctl] unknown,
@@ -864,9 +955,15 @@ static uint64_t(*syscalls_linux[305]) (uint64_t arg[]) = {
 	[__NR_tgkill] unknown,
 	[__NR_utimes] unknown,
 	[__NR_vserver] unknown,
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	[__NR_mbind] sys_mbind,
+	[__NR_set_mempolicy] sys_set_mempolicy,
+	[__NR_get_mempolicy] sys_get_mempolicy,
+#else
 	[__NR_mbind] unknown,
 	[__NR_set_mempolicy] unknown,
 	[__NR_get_mempolicy] unknown,
+#endif
 	[__NR_mq_open] unknown,
 	[__NR_mq_unlink] unknown,
 	[__NR_mq_timedsend] unknown,
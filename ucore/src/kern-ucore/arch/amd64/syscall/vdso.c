@@ -0,0 +1,127 @@
+/*
+ * vDSO: clock and pid queries without a kernel crossing.
+ *
+ * The data page and a copy of vdso_text.S live in a shmem object that is
+ * never destroyed, and load_icode maps it at VDSO_BASE into every new
+ * image, so fork shares it like any other shared mapping. The bsp keeps
+ * the clock in the data page current on every tick, and proc_run records
+ * which process runs on each cpu for getpid.
+ */
+
+#include <types.h>
+#include <arch.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <shmem.h>
+#include <proc.h>
+#include <clock.h>
+#include <hz.h>
+#include <cpuid.h>
+#include <msrbits.h>
+#include <string.h>
+#include <assert.h>
+#include <kio.h>
+#include <time/time.h>
+#include <vdso.h>
+#include <vdso_data.h>
+
+#define VDSO_TICK_NS        10000000	// clock ticks are 100 Hz
+
+extern char __vdso_text_start[], __vdso_text_end[];
+
+static struct shmem_struct *vdso_shmem;
+static struct vdso_data *vdso_data;
+
+static struct Page *vdso_page(uintptr_t off)
+{
+	struct Page *page;
+	pte_t entry;
+	if ((page = alloc_page()) == NULL) {
+		panic("vdso: no memory.\n");
+	}
+	memset(page2kva(page), 0, PGSIZE);
+	ptep_map(&entry, page2pa(page));
+	if (shmem_insert_entry(vdso_shmem, off, entry) != 0) {
+		panic("vdso: no memory.\n");
+	}
+	return page;
+}
+
+void vdso_init(void)
+{
+	static_assert(sizeof(struct vdso_data) <= PGSIZE);
+	static_assert(offsetof(struct vdso_data, tsc_mult) == VD_TSC_MULT);
+	static_assert(offsetof(struct vdso_data, wall_sec) == VD_WALL_SEC);
+	static_assert(offsetof(struct vdso_data, cpu) == VD_CPU);
+	assert(__vdso_text_end - __vdso_text_start <= PGSIZE);
+
+	if ((vdso_shmem = shmem_create(VDSO_SIZE)) == NULL) {
+		panic("vdso: no memory.\n");
+	}
+	// pinned, mappings come and go but it stays
+	shmem_ref_inc(vdso_shmem);
+
+	struct vdso_data *data = page2kva(vdso_page(0));
+	memcpy(page2kva(vdso_page(PGSIZE)), __vdso_text_start,
+	       __vdso_text_end - __vdso_text_start);
+
+	data->wall_sec = time_get_current();
+	data->ticks = ticks;
+	data->mono_ns = (uint64_t)ticks * VDSO_TICK_NS;
+	if (cpuhz != 0) {
+		data->tsc_base = rdtsc();
+		data->tsc_mult = ((uint64_t)1000000000 << VD_TSC_SHIFT) / cpuhz;
+	}
+	if (cpuid_check_feature(CPUID_FEATURE_RDTSCP)) {
+		data->flags |= VDSO_CPU_PID;
+	}
+	vdso_data = data;
+	kprintf("vdso: %d bytes of text, %s clock, %s getpid.\n",
+		__vdso_text_end - __vdso_text_start,
+		data->tsc_mult ? "tsc" : "tick",
+		(data->flags & VDSO_CPU_PID) ? "rdtscp" : "syscall");
+}
+
+// vdso_init_cpu - let rdtscp tell the vDSO which cpu it runs on
+void vdso_init_cpu(void)
+{
+	if (cpuid_check_feature(CPUID_FEATURE_RDTSCP)) {
+		writemsr(MSR_TSC_AUX, myid());
+	}
+}
+
+int vdso_map(struct mm_struct *mm)
+{
+	assert(vdso_shmem != NULL);
+	return mm_map_shmem(mm, VDSO_BASE,
+			    VM_READ | VM_EXEC | VM_NOWRITE, vdso_shmem, NULL);
+}
+
+// vdso_tick - called on the bsp for every clock tick, the only writer of the clock
+void vdso_tick(void)
+{
+	struct vdso_data *data = vdso_data;
+	if (data == NULL) {
+		return;
+	}
+	data->seq++;
+	barrier();
+	data->ticks = ticks;
+	if (data->tsc_mult == 0) {
+		data->mono_ns = (uint64_t)ticks * VDSO_TICK_NS;
+	}
+	barrier();
+	data->seq++;
+}
+
+// vdso_switch - @next is about to run on this cpu, called with interrupts off
+void vdso_switch(struct proc_struct *next)
+{
+	struct vdso_data *data = vdso_data;
+	if (data != NULL) {
+		data->cpu[myid()].gen++;
+		data->cpu[myid()].pid = next->pid;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef __KERN_SYSCALL_VDSO_DATA_H__
+#define __KERN_SYSCALL_VDSO_DATA_H__
+
+/*
+ * The vDSO is two pages mapped at VDSO_BASE: the data page the kernel
+ * keeps up to date, read-only for the process, then the text copied
+ * from vdso_text.S. The text finds the data one page below itself.
+ */
+
+/* offsets in struct vdso_data, for vdso_text.S */
+#define VD_SEQ              0
+#define VD_FLAGS            4
+#define VD_TICKS            8
+#define VD_MONO_NS          16
+#define VD_TSC_BASE         24
+#define VD_TSC_MULT         32
+#define VD_WALL_SEC         40
+#define VD_CPU              64
+
+#define VD_TSC_SHIFT        32
+
+/* vdso_data flags */
+#define VDSO_CPU_PID        0x1	// cpu[] is kept and rdtscp gives the cpu
+
+#ifndef __ASSEMBLY__
+
+#include <types.h>
+#include <memlayout.h>
+#include <mplimits.h>
+
+#define VDSO_BASE           (USTACKTOP - USTACKSIZE - 3 * PGSIZE)
+#define VDSO_SIZE           (2 * PGSIZE)
+
+/*
+ * The clock is read like a seqlock: seq is odd while the kernel updates
+ * it. Nanoseconds since boot are mono_ns + (tsc - tsc_base) * tsc_mult
+ * >> VD_TSC_SHIFT; without a usable tsc, tsc_mult is 0 and mono_ns
+ * follows the ticks.
+ */
+struct vdso_data {
+	volatile uint32_t seq;
+	uint32_t flags;
+	uint64_t ticks;
+	uint64_t mono_ns;
+	uint64_t tsc_base;
+	uint64_t tsc_mult;
+	int64_t wall_sec;	// time of day at boot
+	uint64_t reserved[2];
+	/* the process running on each cpu, gen is bumped on every switch */
+	struct {
+		volatile uint32_t gen;
+		int32_t pid;
+	} cpu[NCPU];
+};
+
+struct mm_struct;
+struct proc_struct;
+
+void vdso_init(void);
+void vdso_init_cpu(void);
+int vdso_map(struct mm_struct *mm);
+void vdso_tick(void);
+void vdso_switch(struct proc_struct *next);
+
+#endif /* !__ASSEMBLY__ */
+
+#endif /* !__KERN_SYSCALL_VDSO_DATA_H__ */
@@ -22,6 +22,9 @@
 #include <sysconf.h>
 #include <refcache.h>
 #include <interrupt_manager.h>
+#ifdef UCONFIG_VDSO
+#include <vdso_data.h>
+#endif
 
 #define TICK_NUM 30
 
@@ -51,9 +54,13 @@ void syscall_init()
 	extern void syscall_entry();
 	//extern void fastcall_entry();
 	writemsr(MSR_EFER, readmsr(MSR_EFER) | (1 << 0));
-	writemsr(MSR_SFMASK, FL_IF); // set EFLAGS
+	// cleared on entry, the kernel must not run with the user's DF, TF or AC
+	writemsr(MSR_SFMASK, FL_IF | FL_DF | FL_TF | FL_AC | FL_NT);
 	writemsr(MSR_LSTAR, (uint64_t)syscall_entry); // set syscall entry
 	writemsr(MSR_STAR, ((uint64_t)(GD_UTEXT_32 | 3) << 48) | ((uint64_t)(GD_KTEXT) << 32 ));
+#ifdef UCONFIG_VDSO
+	vdso_init_cpu();
+#endif
 }
 
 static const char *trapname(int trapno)
@@ -254,9 +261,14 @@ uintptr_t addr;
 	case IRQ_OFFSET + IRQ_TIMER:
 		if(id==0){
 			ticks++;
+#ifdef UCONFIG_VDSO
+			vdso_tick();
+#endif
 			run_timer_list();
+		}else{
+			/* only the BSP runs the timer list */
+			refcache_tick();
 		}
-		refcache_tick();
 
 		assert(current != NULL);
 		break;
@@ -93,6 +93,7 @@ struct trapframe {
 } __attribute__ ((packed));
 
 void idt_init(void);
+void syscall_init(void);
 void print_trapframe(struct trapframe *tf);
 void print_regs(struct pushregs *regs);
 bool trap_in_kernel(struct trapframe *tf);
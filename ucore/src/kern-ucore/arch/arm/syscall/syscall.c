@@ -8,6 +8,7 @@
 #include <sem.h>
 #include <event.h>
 #include <mbox.h>
+#include <futex.h>
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
@@ -164,6 +165,15 @@ static uint32_t sys_sem_get_value(uint32_t arg[])
 	return ipc_sem_get_value(sem_id, value_store);
 }
 
+static uint32_t sys_futex(uint32_t arg[])
+{
+	uintptr_t uaddr = (uintptr_t) arg[0];
+	int op = (int)arg[1];
+	int val = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return do_futex(uaddr, op, val, timeout);
+}
+
 static uint32_t sys_event_send(uint32_t arg[])
 {
 	int pid = (int)arg[0];
@@ -454,6 +464,8 @@ static uint32_t __sys_linux_mmap2(uint32_t arg[])
 		uint32_t ucoreflags = 0;
 		if (prot & PROT_WRITE)
 			ucoreflags |= MMAP_WRITE;
+		if (flags & MAP_POPULATE)
+			ucoreflags |= MMAP_POPULATE;
 		int ret = __do_linux_mmap((uintptr_t) & addr, len, ucoreflags);
 		//kprintf("@@@ ret=%d %e %08x\n", ret,ret, addr);
 		if (ret)
@@ -653,7 +665,7 @@ static uint32_t __sys_linux_futex(uint32_t arg[])
 	uintptr_t uaddr = (uintptr_t) arg[0];
 	int op = arg[1] & 127;
 	int val = arg[2];
-	return do_futex(uaddr, op, val);
+	return do_futex(uaddr, op, val, 0);
 }
 
 static uint32_t __sys_linux_clock_gettime(uint32_t arg[])
@@ -829,6 +841,7 @@ static uint32_t(*syscalls[]) (uint32_t arg[]) = {
 	    [SYS_sem_wait] sys_sem_wait,
 	    [SYS_sem_free] sys_sem_free,
 	    [SYS_sem_get_value] sys_sem_get_value,
+	    [SYS_futex] sys_futex,
 	    [SYS_event_send] sys_event_send,
 	    [SYS_event_recv] sys_event_recv,
 	    [SYS_mbox_init] sys_mbox_init,
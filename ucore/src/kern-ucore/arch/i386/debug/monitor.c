@@ -6,6 +6,8 @@
 #include <monitor.h>
 #include <kdebug.h>
 #include <kio.h>
+#include <swap.h>
+#include <zswap.h>
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -42,6 +44,12 @@ static struct command commands[] = {
 	 "    @example: delbp 3", mon_delete_dr},
 	{"listdr", "List all breakpoints or watchpoints.", mon_list_dr},
 	{"halt", "shutdown qemu(modified)",mon_halt},
+#ifdef UCONFIG_SWAP
+	{"swap", "Display page reclaim statistics.", mon_swap},
+#endif
+#ifdef UCONFIG_ZSWAP
+	{"zswap", "Display compressed swap cache statistics.", mon_zswap},
+#endif
 };
 
 /* return if kernel is panic, in kern/debug/panic.c */
@@ -341,3 +349,19 @@ int mon_halt(int argc, char **argv, struct trapframe *tf)
 
 	return 0;
 }
+
+#ifdef UCONFIG_SWAP
+int mon_swap(int argc, char **argv, struct trapframe *tf)
+{
+	swap_print_stat();
+	return 0;
+}
+#endif
+
+#ifdef UCONFIG_ZSWAP
+int mon_zswap(int argc, char **argv, struct trapframe *tf)
+{
+	zswap_print_stat();
+	return 0;
+}
+#endif
@@ -15,5 +15,11 @@ int mon_watchpoint(int argc, char **argv, struct trapframe *tf);
 int mon_delete_dr(int argc, char **argv, struct trapframe *tf);
 int mon_list_dr(int argc, char **argv, struct trapframe *tf);
 int mon_halt(int argc, char **argv, struct trapframe *tf);
+#ifdef UCONFIG_SWAP
+int mon_swap(int argc, char **argv, struct trapframe *tf);
+#endif
+#ifdef UCONFIG_ZSWAP
+int mon_zswap(int argc, char **argv, struct trapframe *tf);
+#endif
 
 #endif /* !__KERN_DEBUG_MONITOR_H__ */
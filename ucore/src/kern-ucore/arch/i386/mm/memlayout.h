@@ -142,6 +142,7 @@ struct Page {
 #define PG_swap                     4	// the page is in the active or inactive page list (and swap hash table)
 #define PG_active                   5	// the page is in the active page list
 #define PG_IO                       6	//dma page, never free in unmap_page
+#define PG_workingset               7	// the swap cache page refaulted within the working set (hot)
 
 #define SetPageReserved(page)       set_bit(PG_reserved, &((page)->flags))
 #define ClearPageReserved(page)     clear_bit(PG_reserved, &((page)->flags))
@@ -164,6 +165,9 @@ struct Page {
 #define SetPageIO(page)         set_bit(PG_IO, &((page)->flags))
 #define ClearPageIO(page)       clear_bit(PG_IO, &((page)->flags))
 #define PageIO(page)            test_bit(PG_IO, &((page)->flags))
+#define SetPageWorkingset(page)     set_bit(PG_workingset, &((page)->flags))
+#define ClearPageWorkingset(page)   clear_bit(PG_workingset, &((page)->flags))
+#define PageWorkingset(page)        test_bit(PG_workingset, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
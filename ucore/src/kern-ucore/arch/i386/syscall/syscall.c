@@ -8,6 +8,7 @@
 #include <sem.h>
 #include <event.h>
 #include <mbox.h>
+#include <futex.h>
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
@@ -162,6 +163,15 @@ static uint32_t sys_sem_get_value(uint32_t arg[])
 	return ipc_sem_get_value(sem_id, value_store);
 }
 
+static uint32_t sys_futex(uint32_t arg[])
+{
+	uintptr_t uaddr = (uintptr_t) arg[0];
+	int op = (int)arg[1];
+	int val = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return do_futex(uaddr, op, val, timeout);
+}
+
 static uint32_t sys_event_send(uint32_t arg[])
 {
 	int pid = (int)arg[0];
@@ -347,6 +357,7 @@ static uint32_t(*syscalls[]) (uint32_t arg[]) = {
 	    [SYS_sem_wait] sys_sem_wait,
 	    [SYS_sem_free] sys_sem_free,
 	    [SYS_sem_get_value] sys_sem_get_value,
+	    [SYS_futex] sys_futex,
 	    [SYS_event_send] sys_event_send,
 	    [SYS_event_recv] sys_event_recv,
 	    [SYS_mbox_init] sys_mbox_init,
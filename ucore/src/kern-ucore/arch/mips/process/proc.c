@@ -91,6 +91,8 @@ struct proc_struct *alloc_proc(void)
 		proc->need_resched = 0;
 		proc->parent = NULL;
 		proc->mm = NULL;
+		proc->mm_rlocked = NULL;
+		proc->journal_info = NULL;
 		proc->tf = NULL;
 		proc->flags = 0;
 		proc->need_resched = 0;
@@ -10,6 +10,7 @@
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
+#include <futex.h>
 #include <error.h>
 
 //#define current (pls_read(current))
@@ -167,6 +168,21 @@ static int sys_dup(uint32_t arg[])
 	return sysfile_dup(fd1, fd2);
 }
 
+static uint32_t sys_mmap(uint32_t arg[])
+{
+	uintptr_t *addr_store = (uintptr_t *) arg[0];
+	size_t len = (size_t) arg[1];
+	uint32_t mmap_flags = (uint32_t) arg[2];
+	return do_mmap(addr_store, len, mmap_flags);
+}
+
+static uint32_t sys_munmap(uint32_t arg[])
+{
+	uintptr_t addr = (uintptr_t) arg[0];
+	size_t len = (size_t) arg[1];
+	return do_munmap(addr, len);
+}
+
 static uint32_t sys_shmem(uint32_t arg[])
 {
 	uintptr_t *addr_store = (uintptr_t *) arg[0];
@@ -175,6 +191,15 @@ static uint32_t sys_shmem(uint32_t arg[])
 	return do_shmem(addr_store, len, mmap_flags);
 }
 
+static uint32_t sys_futex(uint32_t arg[])
+{
+	uintptr_t uaddr = (uintptr_t) arg[0];
+	int op = (int)arg[1];
+	int val = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return do_futex(uaddr, op, val, timeout);
+}
+
 static uint32_t sys_mkdir(uint32_t arg[])
 {
 	const char *path = (const char *)arg[0];
@@ -334,7 +359,10 @@ static int (*syscalls[]) (uint32_t arg[]) = {
 	    [SYS_getcwd] sys_getcwd,
 	    [SYS_getdirentry] sys_getdirentry,
 	    [SYS_dup] sys_dup,
+      [SYS_mmap] sys_mmap,
+      [SYS_munmap] sys_munmap,
       [SYS_shmem] sys_shmem,
+      [SYS_futex] sys_futex,
       [SYS_mount] syscall_linux_mount,
       [SYS_umount] syscall_linux_umount,
       [SYS_mkdir] sys_mkdir,
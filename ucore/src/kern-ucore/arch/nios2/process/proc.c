@@ -29,6 +29,8 @@ struct proc_struct *alloc_proc(void)
 		proc->need_resched = 0;
 		proc->parent = NULL;
 		proc->mm = NULL;
+		proc->mm_rlocked = NULL;
+		proc->journal_info = NULL;
 		memset(&(proc->context), 0, sizeof(struct context));
 		proc->tf = NULL;
 		proc->cr3 = boot_cr3;
@@ -9,6 +9,7 @@
 #include <sem.h>
 #include <event.h>
 #include <mbox.h>
+#include <futex.h>
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
@@ -162,6 +163,15 @@ static uint64_t sys_sem_get_value(uint64_t arg[])
 	return ipc_sem_get_value(sem_id, value_store);
 }
 
+static uint64_t sys_futex(uint64_t arg[])
+{
+	uintptr_t uaddr = (uintptr_t) arg[0];
+	int op = (int)arg[1];
+	int val = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return do_futex(uaddr, op, val, timeout);
+}
+
 static uint64_t sys_event_send(uint64_t arg[])
 {
 	int pid = (int)arg[0];
@@ -386,6 +396,7 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
 	    [SYS_sem_wait] sys_sem_wait,
 	    [SYS_sem_free] sys_sem_free,
 	    [SYS_sem_get_value] sys_sem_get_value,
+	    [SYS_futex] sys_futex,
 	    [SYS_event_send] sys_event_send,
 	    [SYS_event_recv] sys_event_recv,
 	    [SYS_mbox_init] sys_mbox_init,
@@ -9,6 +9,10 @@ int host_mmap(struct proc_struct *proc,
 	      void *addr, size_t length, int prot, int flags,
 	      int fd, uint32_t offset);
 int host_munmap(struct proc_struct *proc, void *addr, size_t length);
+int host_mmap_queue(struct proc_struct *proc, uintptr_t addr, size_t length,
+		    int prot, int fd, uint32_t offset);
+int host_munmap_queue(struct proc_struct *proc, uintptr_t addr, size_t length);
+int host_flush_batch(struct proc_struct *proc);
 int host_assign(struct proc_struct *proc, uintptr_t addr, uint32_t data);
 int host_getvalue(struct proc_struct *proc, uintptr_t addr, uint32_t * data);
 int host_map_user(struct proc_struct *proc,
@@ -24,6 +24,7 @@
 #define __NR_sigprocmask 126
 #define __NR_nanosleep   162
 #define __NR_sigaltstack 186
+#define __NR_mmap2       192
 
 #ifndef __ASSEMBLER__
 
@@ -26,10 +26,12 @@
  *	  |                              |
  *	  :                              :
  *	  |                              |
+ *	  +------------------------------+
+ *	  |          Stub Batch          |
  *	  +------------------------------+ <---------- STUB_END
  *
  * Address is used by the stub interpreting code (see stub_exec_syscall.S) which determines what to do
- *     by eax of the current frame and executes the syscall/read/write.
+ *     by eax of the current frame and executes the syscall/read/write/batch.
  * Serial No. is used by the kernel to keep track of how many frames there are in the stack.
  * Note that the page STUB_DATA is writable by the user (to fill eax with the return value)
  *     and may be visited illegally.
@@ -53,6 +55,39 @@ struct stub_frame {
 	uint32_t data[10];
 };
 
+/* Values of eax in a stub frame which are not syscall numbers. */
+#define STUB_OP_READ		0
+#define STUB_OP_WRITE		(-1)
+#define STUB_OP_BATCH		(-2)
+
+/*
+ * Page table changes are not sent to the container one by one. They are queued in the batch
+ *     at the end of the stub page, adjacent pages being merged into one range, and the whole
+ *     queue is run by a single STUB_OP_BATCH stub call before the container runs user code
+ *     or another stub call again. The stub stops at the first call which fails.
+ */
+#define STUB_BATCH_MAX		32
+
+struct stub_call {
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+	uint32_t esi;
+	uint32_t edi;
+	uint32_t ebp;
+};
+
+struct stub_batch {
+	uint32_t nr;
+	struct stub_call calls[STUB_BATCH_MAX];
+};
+
+#define STUB_BATCH_OFFSET	(PGSIZE - sizeof(struct stub_batch))
+
+#define stub_batch(stack)							\
+	((struct stub_batch *)((uintptr_t)(stack) + STUB_BATCH_OFFSET))
+
 struct stub_stack {
 	uintptr_t current_addr;
 	uint32_t current_no;
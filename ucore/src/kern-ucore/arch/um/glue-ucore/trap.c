@@ -8,6 +8,7 @@
 #include <pmm.h>
 #include <vmm.h>
 #include <kio.h>
+#include <host_syscall.h>
 
 #define current pls_read(current)
 
@@ -54,6 +55,9 @@ int wait_stub_done(int pid)
 
 			if (user_segv(pid, &regs) < 0)
 				goto bad_wait;
+			/* the faulting access is retried as soon as the stub goes on */
+			if (host_flush_batch(current) < 0)
+				goto bad_wait;
 
 			stub_pop_frame(current->arch.host->stub_stack);
 			if ((err =
@@ -8,13 +8,14 @@
 #include <vmm.h>
 #include <arch.h>
 #include <kio.h>
+#include <stddef.h>
 
 /**
- * Carry out the syscall specified in the stub stack.
+ * Run the stub call in the current frame of the stub stack.
  * @param proc the PCB of the process to execute the stub call
  * @return the return value of the call
  */
-static int host_syscall_in_child(struct proc_struct *proc)
+static int run_stub_in_child(struct proc_struct *proc)
 {
 	struct user_regs_struct regs;
 	int err, pid = proc->arch.host->host_pid;
@@ -50,6 +51,129 @@ static int host_syscall_in_child(struct proc_struct *proc)
 	return err;
 }
 
+/**
+ * Run all page table changes queued for the container in one stub call.
+ *     The call gets a frame of its own, so it may be made while another stub call is being set up.
+ * @param proc the PCB whose container process has changes queued
+ * @return 0 on success, or the (negative) result of the first call that failed
+ */
+int host_flush_batch(struct proc_struct *proc)
+{
+	struct stub_stack *stub_stack = proc->arch.host->stub_stack;
+	struct stub_batch *batch = stub_batch(stub_stack);
+	if (batch->nr == 0)
+		return 0;
+
+	stub_push_frame(stub_stack);
+	struct stub_frame *frame = current_stub_frame(stub_stack);
+	frame->eax = STUB_OP_BATCH;
+	frame->ebx =
+	    STUB_DATA + STUB_BATCH_OFFSET + offsetof(struct stub_batch, calls);
+	frame->ecx = batch->nr;
+	int ret = run_stub_in_child(proc);
+	stub_pop_frame(stub_stack);
+
+	batch->nr = 0;
+	return ret < 0 ? ret : 0;
+}
+
+/**
+ * Reserve the next call in the batch, flushing it first if it is full.
+ */
+static struct stub_call *host_batch_next(struct proc_struct *proc)
+{
+	struct stub_batch *batch = stub_batch(proc->arch.host->stub_stack);
+	if (batch->nr == STUB_BATCH_MAX && host_flush_batch(proc) < 0)
+		return NULL;
+	return &(batch->calls[batch->nr++]);
+}
+
+/**
+ * Get the last call queued if it is a @nr call, so that it can be extended.
+ */
+static struct stub_call *host_batch_last(struct proc_struct *proc, int nr)
+{
+	struct stub_batch *batch = stub_batch(proc->arch.host->stub_stack);
+	if (batch->nr == 0 || batch->calls[batch->nr - 1].eax != nr)
+		return NULL;
+	return &(batch->calls[batch->nr - 1]);
+}
+
+/**
+ * Queue a shared fixed mapping of @fd for the container process.
+ *     A mapping that continues the last one queued, both in memory and in the file, with the same
+ *     protection, extends it instead of taking a new call.
+ * @param proc the PCB whose container process is going to be mapped
+ * @param addr the address where to map the content (page aligned)
+ * @param length the size of the content (a multiple of PGSIZE)
+ * @param prot map access properties. see 'man mmap' for details
+ * @param fd the file descriptor of the file to be mapped
+ * @param offset the offset of the content in the file (page aligned)
+ * @return 0 on success, or a negative if flushing a full batch failed
+ */
+int
+host_mmap_queue(struct proc_struct *proc, uintptr_t addr, size_t length,
+		int prot, int fd, uint32_t offset)
+{
+	struct stub_call *call = host_batch_last(proc, __NR_mmap2);
+	if (call != NULL && call->ebx + call->ecx == addr
+	    && call->edx == prot && call->edi == fd
+	    && call->ebp * PGSIZE + call->ecx == offset) {
+		call->ecx += length;
+		return 0;
+	}
+	if ((call = host_batch_next(proc)) == NULL)
+		return -1;
+	call->eax = __NR_mmap2;
+	call->ebx = addr;
+	call->ecx = length;
+	call->edx = prot;
+	call->esi = MAP_SHARED | MAP_FIXED;
+	call->edi = fd;
+	call->ebp = offset / PGSIZE;
+	return 0;
+}
+
+/**
+ * Queue the unmapping of a range of the container process, merged with the last call queued
+ *     if that unmaps the range right before it.
+ * @param proc the PCB whose container process is going to be operated on
+ * @param addr the beginning address of the area to be unmapped (page aligned)
+ * @param length the size of the area to be unmapped (a multiple of PGSIZE)
+ * @return 0 on success, or a negative if flushing a full batch failed
+ */
+int host_munmap_queue(struct proc_struct *proc, uintptr_t addr, size_t length)
+{
+	struct stub_call *call = host_batch_last(proc, __NR_munmap);
+	if (call != NULL && call->ebx + call->ecx == addr) {
+		call->ecx += length;
+		return 0;
+	}
+	if ((call = host_batch_next(proc)) == NULL)
+		return -1;
+	call->eax = __NR_munmap;
+	call->ebx = addr;
+	call->ecx = length;
+	return 0;
+}
+
+/**
+ * Carry out the syscall specified in the stub stack.
+ *     Page table changes still queued are carried out first, as the call may depend on them.
+ * @param proc the PCB of the process to execute the stub call
+ * @return the return value of the call
+ */
+static int host_syscall_in_child(struct proc_struct *proc)
+{
+	int err = host_flush_batch(proc);
+	if (err < 0) {
+		kprintf("host_syscall_in_child: flush failed with err = %d\n",
+			err);
+		return -1;
+	}
+	return run_stub_in_child(proc);
+}
+
 /**
  * Map a part of file to the container process when we are in the main one.
  * @param proc the PCB whose container process is going to be mapped
@@ -119,7 +243,7 @@ int host_assign(struct proc_struct *proc, uintptr_t addr, uint32_t data)
 	/* Use stub call so that the page table will be modified properly */
 	struct stub_stack *stub_stack = proc->arch.host->stub_stack;
 	struct stub_frame *frame = current_stub_frame(stub_stack);
-	frame->eax = -1;
+	frame->eax = STUB_OP_WRITE;
 	frame->ebx = addr;
 	frame->ecx = data;
 
@@ -143,7 +267,7 @@ int host_getvalue(struct proc_struct *proc, uintptr_t addr, uint32_t * data)
 
 	struct stub_stack *stub_stack = proc->arch.host->stub_stack;
 	struct stub_frame *frame = current_stub_frame(stub_stack);
-	frame->eax = 0;
+	frame->eax = STUB_OP_READ;
 	frame->ebx = addr;
 	int ret = host_syscall_in_child(proc);
 	if (data != NULL)
@@ -75,6 +75,7 @@ static struct proc_struct *find_proc_by_pgdir(pde_t * pgdir)
 
 /**
  * Remap the specified address to a new page with new permission.
+ *     Changes to a container process are only queued, see host_flush_batch.
  * @param pgdir   page directory
  * @param la      linear address
  */
@@ -95,32 +96,27 @@ void tlb_update(pde_t * pgdir, uintptr_t la)
 	else if (Get_PTE_W(pte) == 0 || Get_PTE_D(pte) == 0)
 		w = 0;
 
-	/* Make sure that the page is invalid before mapping
-	 *     It is better to use 'mprotect' here actually.
-	 */
-	tlb_invalidate(pgdir, la);
+	int prot =
+	    (r ? PROT_READ : 0) | (w ? PROT_WRITE : 0) | (x ? PROT_EXEC : 0);
 
 	struct proc_struct *proc = find_proc_by_pgdir(pgdir);
 	if (current != NULL && proc != NULL) {
-		/* Map the page to the container process found using the stub code */
-		if (host_mmap(proc,
-			      (void *)la, PGSIZE,
-			      (r ? PROT_READ : 0) | (w ? PROT_WRITE : 0) | (x ?
-									    PROT_EXEC
-									    :
-									    0),
-			      MAP_SHARED | MAP_FIXED, ginfo->mem_fd,
-			      pa) == MAP_FAILED)
+		/* Queue the mapping for the container process found.
+		 *     MAP_FIXED replaces whatever was mapped there, so no unmapping is needed first.
+		 */
+		if (host_mmap_queue(proc, la, PGSIZE, prot, ginfo->mem_fd, pa) < 0)
 			panic("map in child failed.\n");
 	} else {
+		/* Make sure that the page is invalid before mapping
+		 *     It is better to use 'mprotect' here actually.
+		 */
+		tlb_invalidate(pgdir, la);
+
 		/* Map the page to the host process */
 		struct mmap_arg_struct args = {
 			.addr = la,
 			.len = PGSIZE,
-			.prot =
-			    (r ? PROT_READ : 0) | (w ? PROT_WRITE : 0) | (x ?
-									  PROT_EXEC
-									  : 0),
+			.prot = prot,
 			.flags = MAP_SHARED | MAP_FIXED,
 			.fd = ginfo->mem_fd,
 			.offset = pa,
@@ -131,6 +127,7 @@ void tlb_update(pde_t * pgdir, uintptr_t la)
 
 /**
  * unmap the page specified by @la in the container process corresponding to @pgdir
+ *     (queued like in tlb_update)
  * @param pgdir page directory
  * @param la the logical address of the page to be flushed
  */
@@ -138,7 +135,7 @@ void tlb_invalidate(pde_t * pgdir, uintptr_t la)
 {
 	struct proc_struct *proc = find_proc_by_pgdir(pgdir);
 	if (current != NULL && proc != NULL) {
-		if (host_munmap(proc, (void *)la, PGSIZE) < 0)
+		if (host_munmap_queue(proc, la, PGSIZE) < 0)
 			panic("unmap in child failed\n");
 	} else {
 		syscall2(__NR_munmap, la, PGSIZE);
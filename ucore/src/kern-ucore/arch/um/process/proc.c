@@ -50,6 +50,8 @@ struct proc_struct *alloc_proc(void)
 		proc->need_resched = 0;
 		proc->parent = NULL;
 		proc->mm = NULL;
+		proc->mm_rlocked = NULL;
+		proc->journal_info = NULL;
 		memset(proc->name, 0, PROC_NAME_LEN);
 		proc->wait_state = 0;
 		proc->cptr = proc->optr = proc->yptr = NULL;
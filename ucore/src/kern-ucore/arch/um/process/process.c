@@ -136,7 +136,7 @@ static int userspace_tramp(void *stub_stack)
 	struct sigaltstack ss = {
 		.ss_flags = 0,
 		.ss_sp = (void *)(STUB_DATA),
-		.ss_size = PGSIZE - sizeof(void *)
+		.ss_size = STUB_BATCH_OFFSET - sizeof(void *)
 	};
 	if (syscall2(__NR_sigaltstack, (long)&ss, 0) != 0)
 		syscall1(__NR_exit, 1);
@@ -197,6 +197,7 @@ int start_userspace(void *stub_stack)
 	stack->current_no = 0;
 	stack->current_addr =
 	    (uintptr_t) & (stack->frames) - (uintptr_t) stack + STUB_DATA;
+	stub_batch(stack)->nr = 0;
 
 	return pid;
 
@@ -243,6 +244,9 @@ int user_segv(int pid, struct um_pt_regs *regs)
 	return 0;
 }
 
+/* Cleared when the host refuses PTRACE_SYSEMU; PTRACE_SYSCALL and nullify_syscall are used then. */
+static int use_sysemu = 1;
+
 /**
  * The main loop for monitor threads.
  * @param regs register and status storage to be used (may be dummy)
@@ -257,6 +261,14 @@ void userspace(struct um_pt_regs *regs)
 		/* As a host process may be the container of multiple threads, we need to reread 'regs' */
 		regs = &(pls_read(current)->arch.regs);
 
+		/* Page table changes made since the container stopped must be there before it goes on */
+		err = host_flush_batch(pls_read(current));
+		if (err != 0) {
+			kprintf("userspace: cannot flush page table changes: %d\n",
+				err);
+			goto exit;
+		}
+
 		err =
 		    syscall4(__NR_ptrace, PTRACE_SETREGS, pid, 0,
 			     (long)&(regs->regs));
@@ -266,8 +278,16 @@ void userspace(struct um_pt_regs *regs)
 		}
 		//kprintf ("start at eip = 0x%x\n", regs->regs.eip);
 
-		/* it seems that my fedora doesn't support PTRACE_SYSEMU (sigh...) */
-		if (syscall4(__NR_ptrace, PTRACE_SYSCALL, pid, 0, 0) != 0) {
+		/* PTRACE_SYSEMU stops once at syscall entry and never lets the host run the syscall,
+		 *     while PTRACE_SYSCALL needs nullify_syscall to run a harmless one in its place.
+		 */
+		if (use_sysemu
+		    && syscall4(__NR_ptrace, PTRACE_SYSEMU, pid, 0, 0) != 0) {
+			kprintf("userspace: no PTRACE_SYSEMU, using PTRACE_SYSCALL\n");
+			use_sysemu = 0;
+		}
+		if (!use_sysemu
+		    && syscall4(__NR_ptrace, PTRACE_SYSCALL, pid, 0, 0) != 0) {
 			kprintf("userspace: ptrace continue failed\n");
 			goto exit;
 		}
@@ -297,7 +317,7 @@ void userspace(struct um_pt_regs *regs)
 					goto exit;
 				break;
 			case SIGTRAP + 0x80:	/* system call */
-				if (nullify_syscall(pid, regs) < 0)
+				if (!use_sysemu && nullify_syscall(pid, regs) < 0)
 					goto exit;
 				regs->syscall = regs->regs.orig_eax;
 				regs->regs.eax = syscall(regs);
@@ -0,0 +1,221 @@
+/*
+ * Kernel log ring.
+ *
+ * kprintf formats into a small buffer on the caller's stack and commits the
+ * text as fixed-size records to a ring shared by all cpus. A writer claims
+ * its slot with a single atomic increment of kmsg_head and publishes the
+ * record by storing seq + 1 into the slot state, so producers never wait for
+ * each other or for the console. The slow console devices are fed from the
+ * ring by kmsgd a tick later; records can also be read back, ring-sized
+ * history included, through /dev/kmsg.
+ *
+ * Until kmsgd runs, and from the moment the kernel panics, the console is
+ * drained synchronously by the printing cpu instead.
+ */
+
+#include <types.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <error.h>
+#include <trap.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <proc.h>
+#include <kio.h>
+#include <kmsg.h>
+#include <mp.h>
+
+#define KMSG_NR_RECORDS         1024	// power of 2
+#define KMSG_DEFAULT_LEVEL      KMSG_WARNING
+#define KMSG_CONSOLE_LEVEL      KMSG_DEBUG	// levels below this reach the console
+#define KMSG_FLUSH_TICKS        1
+/* a panicking cpu gives up on the console lock or a half written record after this */
+#define KMSG_PANIC_SPINS        1000000
+
+struct kmsg_slot {
+	volatile uint32_t state;	// seq + 1 when complete, 0 while being written
+	struct kmsg_record rec;
+};
+
+static struct kmsg_slot kmsg_ring[KMSG_NR_RECORDS];
+static volatile uint32_t kmsg_head;
+
+/* only ever touched by their own cpu, with interrupts off */
+static struct {
+	uint32_t seq;
+	bool midline;
+} kmsg_cpu[NCPU];
+
+/* %gs is not set up before tls_init, see kmsg_init */
+static bool kmsg_percpu_ready;
+
+static spinlock_s kmsg_console_lock;
+static uint32_t kmsg_console_seq;
+static volatile bool kmsg_deferred;
+static volatile bool kmsg_panicked;
+
+struct kmsg_buf {
+	int level;
+	int len;
+	int cnt;
+	char text[KMSG_TEXT_MAX];
+};
+
+void kmsg_init(void)
+{
+	kmsg_percpu_ready = 1;
+}
+
+static void kmsg_commit(struct kmsg_buf *buf)
+{
+	bool intr_flag;
+	local_intr_save_hw(intr_flag);
+	int cpu = kmsg_percpu_ready ? myid() : 0;
+	uint32_t seq = __sync_fetch_and_add(&kmsg_head, 1);
+	struct kmsg_slot *slot = &kmsg_ring[seq & (KMSG_NR_RECORDS - 1)];
+	struct kmsg_record *rec = &(slot->rec);
+
+	slot->state = 0;
+	__sync_synchronize();
+	rec->seq = seq;
+	rec->cpu_seq = kmsg_cpu[cpu].seq++;
+	rec->ticks = ticks;
+	rec->cpu = cpu;
+	rec->level = buf->level;
+	rec->flags = kmsg_cpu[cpu].midline ? KMSG_CONT : 0;
+	rec->len = buf->len;
+	memcpy(rec->text, buf->text, buf->len);
+	kmsg_cpu[cpu].midline = (buf->text[buf->len - 1] != '\n');
+	__sync_synchronize();
+	slot->state = seq + 1;
+
+	local_intr_restore_hw(intr_flag);
+	buf->len = 0;
+}
+
+// kmsg_putch - vprintfmt callback, a record ends at a newline or when full
+static void kmsg_putch(int c, struct kmsg_buf *buf, int fd)
+{
+	buf->text[buf->len++] = c;
+	buf->cnt++;
+	if (c == '\n' || buf->len == KMSG_TEXT_MAX) {
+		kmsg_commit(buf);
+	}
+}
+
+int kmsg_vprintf(const char *fmt, va_list ap)
+{
+	struct kmsg_buf buf;
+	buf.level = KMSG_DEFAULT_LEVEL;
+	buf.len = buf.cnt = 0;
+	if (fmt[0] == '<' && fmt[1] >= '0' && fmt[1] <= '7' && fmt[2] == '>') {
+		buf.level = fmt[1] - '0';
+		fmt += 3;
+	}
+	vprintfmt((void *)kmsg_putch, NO_FD, &buf, fmt, ap);
+	if (buf.len != 0) {
+		kmsg_commit(&buf);
+	}
+	if (!kmsg_deferred) {
+		kmsg_console_flush(kmsg_panicked);
+	}
+	return buf.cnt;
+}
+
+/*
+ * kmsg_read - copy record @seq into @rec. Returns -E_AGAIN if it has not
+ * been (completely) written yet, and -E_NOENT if it has been overwritten
+ * already.
+ */
+int kmsg_read(uint32_t seq, struct kmsg_record *rec)
+{
+	struct kmsg_slot *slot = &kmsg_ring[seq & (KMSG_NR_RECORDS - 1)];
+	uint32_t state = slot->state;
+	if ((int32_t)(kmsg_head - seq) > KMSG_NR_RECORDS) {
+		return -E_NOENT;
+	}
+	if (state != seq + 1) {
+		return ((int32_t)(state - (seq + 1)) > 0) ? -E_NOENT : -E_AGAIN;
+	}
+	__sync_synchronize();
+	*rec = slot->rec;
+	__sync_synchronize();
+	if (slot->state != seq + 1) {
+		return -E_NOENT;
+	}
+	return 0;
+}
+
+// kmsg_first - the oldest record that may still be in the ring
+uint32_t kmsg_first(void)
+{
+	uint32_t head = kmsg_head;
+	return (head > KMSG_NR_RECORDS) ? head - KMSG_NR_RECORDS : 0;
+}
+
+/*
+ * kmsg_console_flush - print the records the console has not seen yet. With
+ * @force, as when panicking, records still being written by another cpu are
+ * skipped and the console lock is only waited for a bounded time.
+ */
+void kmsg_console_flush(bool force)
+{
+	struct kmsg_record rec;
+	bool intr_flag, locked;
+	int i, ret, spins = 0;
+
+	local_intr_save_hw(intr_flag);
+	if (!force) {
+		spinlock_acquire(&kmsg_console_lock);
+		locked = 1;
+	} else {
+		for (spins = 0; !(locked = spinlock_acquire_try(&kmsg_console_lock))
+		     && ++spins < KMSG_PANIC_SPINS;) ;
+	}
+	for (spins = 0; (int32_t)(kmsg_head - kmsg_console_seq) > 0;) {
+		if ((ret = kmsg_read(kmsg_console_seq, &rec)) == -E_NOENT) {
+			kmsg_console_seq = kmsg_first();
+			continue;
+		}
+		if (ret == -E_AGAIN) {
+			if (!force) {
+				break;
+			}
+			if (++spins < KMSG_PANIC_SPINS) {
+				continue;
+			}
+			// the cpu writing it is not coming back
+			kmsg_console_seq++, spins = 0;
+			continue;
+		}
+		kmsg_console_seq++, spins = 0;
+		if (rec.level < KMSG_CONSOLE_LEVEL) {
+			for (i = 0; i < rec.len; i++) {
+				cons_putc(rec.text[i]);
+			}
+		}
+	}
+	if (locked) {
+		spinlock_release(&kmsg_console_lock);
+	}
+	local_intr_restore_hw(intr_flag);
+}
+
+// kmsg_panic - from now on print synchronously, and print what is pending
+void kmsg_panic(void)
+{
+	kmsg_panicked = 1;
+	kmsg_deferred = 0;
+	kmsg_console_flush(1);
+}
+
+int kmsgd_main(void *arg)
+{
+	kmsg_deferred = 1;
+	while (1) {
+		kmsg_console_flush(0);
+		do_sleep(KMSG_FLUSH_TICKS);
+	}
+}
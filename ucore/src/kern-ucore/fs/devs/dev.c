@@ -188,6 +188,9 @@ void dev_init(void)
 #ifdef UCONFIG_HAVE_FUSE
   init_device(fuse);
 #endif
+#ifdef UCONFIG_KMSG
+	init_device(kmsg);
+#endif
 
 #ifdef UCONFIG_MIPS_ENABLE_THINPAD_FLASH_DRIVER
   init_device(thinpad_flashrom);
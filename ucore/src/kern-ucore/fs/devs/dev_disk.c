@@ -12,12 +12,12 @@
 #include <assert.h>
 
 #define DISK_BLKSIZE                   PGSIZE
-#define DISK_BUFSIZE                   (4 * DISK_BLKSIZE)
 #define DISK_BLK_NSECT                 (DISK_BLKSIZE / SECTSIZE)
+/* blocks per ide command, 128 sectors is the most the drivers take */
+#define DISK_IO_NBLKS                  (128 / DISK_BLK_NSECT)
 
 struct disk_private_data {
   int device_index;
-  char* buffer;
   semaphore_t mutex;
 };
 
@@ -58,7 +58,6 @@ static int disk_io(struct device *dev, struct iobuf *iob, bool write)
   struct disk_private_data *private_data = dev_get_private_data(dev);
 
   uint32_t device_index = private_data->device_index;
-  char *buffer = private_data->buffer;
   semaphore_t *device_mutex = &private_data->mutex;
 	off_t offset = iob->io_offset;
 	size_t resid = iob->io_resid;
@@ -80,25 +79,24 @@ static int disk_io(struct device *dev, struct iobuf *iob, bool write)
 		return 0;
 	}
 
+	/*
+	 * iob always refers to kernel memory, so transfer to and from it
+	 * directly, as many blocks per command as the driver takes
+	 */
 	down(device_mutex);
 	while (resid != 0) {
-		size_t copied, alen = DISK_BUFSIZE;
+		if ((nblks = resid / DISK_BLKSIZE) > DISK_IO_NBLKS) {
+			nblks = DISK_IO_NBLKS;
+		}
 		if (write) {
-			iobuf_move(iob, buffer, alen, 0, &copied);
-			assert(copied != 0 && copied <= resid
-			       && copied % DISK_BLKSIZE == 0);
-			nblks = copied / DISK_BLKSIZE;
-			disk_write_blks_nolock(device_index, blkno, nblks, buffer);
+			disk_write_blks_nolock(device_index, blkno, nblks,
+					       iob->io_base);
 		} else {
-			if (alen > resid) {
-				alen = resid;
-			}
-			nblks = alen / DISK_BLKSIZE;
-			disk_read_blks_nolock(device_index, blkno, nblks, buffer);
-			iobuf_move(iob, buffer, alen, 1, &copied);
-			assert(copied == alen && copied % DISK_BLKSIZE == 0);
+			disk_read_blks_nolock(device_index, blkno, nblks,
+					      iob->io_base);
 		}
-		resid -= copied, blkno += nblks;
+		iobuf_skip(iob, nblks * DISK_BLKSIZE);
+		resid -= nblks * DISK_BLKSIZE, blkno += nblks;
 	}
 	up(device_mutex);
 	return 0;
@@ -124,14 +122,10 @@ static void disk_device_init(struct device *dev, int device_index)
 	dev->d_ioctl = disk_ioctl;
   struct disk_private_data *private_data = kmalloc(sizeof(struct disk_private_data));
   private_data->device_index = device_index;
-  private_data->buffer = kmalloc(DISK_BUFSIZE);
-  if(private_data->buffer == NULL) {
-    panic("disk%d alloc buffer failed.\n", device_index);
-  }
   sem_init(&(private_data->mutex), 1);
   dev_set_private_data(dev, private_data);
 
-	static_assert(DISK_BUFSIZE % DISK_BLKSIZE == 0);
+	static_assert(DISK_IO_NBLKS != 0);
 }
 
 void dev_init_disk(void)
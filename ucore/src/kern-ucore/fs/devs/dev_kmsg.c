@@ -0,0 +1,100 @@
+/*
+ * Implementation of the kernel log device, "kmsg:". The device is an array
+ * of struct kmsg_record indexed by sequence number, see libs/kmsg.h: seek
+ * to seq * sizeof(struct kmsg_record) and read whole records from there.
+ * Reading at a record that has been overwritten returns a single
+ * KMSG_LOST record whose seq is the oldest one still kept.
+ */
+#include <types.h>
+#include <string.h>
+#include <dev.h>
+#include <poll.h>
+#include <vfs.h>
+#include <iobuf.h>
+#include <inode.h>
+#include <unistd.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+#include <kmsg.h>
+
+static int kmsg_open(struct device *dev, uint32_t open_flags)
+{
+	if ((open_flags & O_ACCMODE) != O_RDONLY) {
+		return -E_INVAL;
+	}
+	return 0;
+}
+
+static int kmsg_close(struct device *dev)
+{
+	return 0;
+}
+
+static int kmsg_io(struct device *dev, struct iobuf *iob, bool write, int io_flags)
+{
+	struct kmsg_record rec;
+	if (write) {
+		return -E_INVAL;
+	}
+	if (iob->io_offset % sizeof(rec) != 0 || iob->io_resid < sizeof(rec)) {
+		return -E_INVAL;
+	}
+	uint32_t seq = iob->io_offset / sizeof(rec);
+	for (; iob->io_resid >= sizeof(rec); seq++) {
+		int ret = kmsg_read(seq, &rec);
+		if (ret == -E_AGAIN) {
+			break;
+		}
+		if (ret == -E_NOENT) {
+			// hand out what was read first, the next read reports the loss
+			if (iobuf_used(iob) != 0) {
+				break;
+			}
+			memset(&rec, 0, sizeof(rec));
+			rec.seq = kmsg_first();
+			rec.flags = KMSG_LOST;
+			iobuf_move(iob, &rec, sizeof(rec), 1, NULL);
+			break;
+		}
+		iobuf_move(iob, &rec, sizeof(rec), 1, NULL);
+	}
+	return 0;
+}
+
+static int kmsg_poll(struct device *dev, wait_t *wait, int io_requests)
+{
+	return io_requests & POLL_READ_AVAILABLE;
+}
+
+static int kmsg_ioctl(struct device *dev, int op, void *data)
+{
+	return -E_INVAL;
+}
+
+static void kmsg_device_init(struct device *dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	// only there so that seeking to any record is allowed
+	dev->d_blocks = ((size_t)-1 >> 1) / sizeof(struct kmsg_record);
+	dev->d_blocksize = sizeof(struct kmsg_record);
+	dev->d_open = kmsg_open;
+	dev->d_close = kmsg_close;
+	dev->d_io = kmsg_io;
+	dev->d_ioctl = kmsg_ioctl;
+	dev->d_poll = kmsg_poll;
+}
+
+void dev_init_kmsg(void)
+{
+	struct inode *node;
+	if ((node = dev_create_inode()) == NULL) {
+		panic("kmsg: dev_create_node.\n");
+	}
+	kmsg_device_init(vop_info(node, device));
+
+	int ret;
+	if ((ret = vfs_add_dev("kmsg", node, 0)) != 0) {
+		panic("kmsg: vfs_add_dev: %e.\n", ret);
+	}
+}
@@ -16,8 +16,6 @@
 #include "file_desc_table.h"
 #include "kernel_file_pool.h"
 
-#define testfd(fd)                          ((fd) >= 0 && (fd) < FS_STRUCT_NENTRY)
-
 void filemap_acquire(struct file *file)
 {
 	fopen_count_inc(file);
@@ -65,7 +63,7 @@ inline int fd2file(int fd, struct file **file_store)
 struct file* fd2file_onfs(int fd, struct fs_struct *fs_struct)
 {
   struct file_desc_table *desc_table = fs_get_desc_table(fs_struct);
-	if(testfd(fd)) {
+	if(fd >= 0 && fd < desc_table->limit) {
 		assert(fs_struct != NULL && fs_count(fs_struct) > 0);
 		struct file *file = file_desc_table_get_file(desc_table, fd);
     return file;
@@ -114,20 +112,14 @@ int file_open(char *path, uint32_t open_flags)
 
   //Try to allocate a new kernel struct file object.
 	struct file *file = kernel_file_pool_allocate();
-  file_init(file);
   if(file == NULL) {
     return -E_NO_MEM;
   }
+  file_init(file);
   file->readable = readable;
   file->writable = writable;
 
-  //Allocate a new file descriptor
   struct file_desc_table *desc_table = fs_get_desc_table(current->fs_struct);
-  int fd = file_desc_table_get_unused(desc_table);
-  if(fd < 0) {
-    return -E_MFILE;
-  }
-
   int ret;
   //Allocate a new inode for the kernel file
 	struct inode *node;
@@ -149,11 +141,15 @@ int file_open(char *path, uint32_t open_flags)
 		file->pos = stat->st_size;
 	}
 
-  //Associate the file descriptor with kernel file object
-  file_desc_table_associate(desc_table, fd, file);
-
 	file->node = node;
   file->io_flags = 0;
+
+  //Allocate a file descriptor for the kernel file object, once it is ready
+  int fd = file_desc_table_install(desc_table, file);
+  if(fd < 0) {
+    vfs_close(node);
+    kernel_file_pool_free(file);
+  }
 	return fd;
 }
 
@@ -367,17 +363,18 @@ int file_dup(int fd1, int fd2)
   //If fd2 is an opened file, close it first. This is what dup2 on linux does.
   struct file *file2 = file_desc_table_get_file(desc_table, fd2);
   if(file2 != NULL) {
-		kprintf("file_desc_table_get_unused called by dup2!\n");
     file_desc_table_dissociate(desc_table, fd2);
   }
 
   //If fd2 is NO_FD, a new fd will be assigned.
   if (fd2 == NO_FD) {
-    fd2 = file_desc_table_get_unused(desc_table);
+    return file_desc_table_install(desc_table, file);
   }
 
   //Now let fd2 become a duplication for fd1.
-  file_desc_table_associate(desc_table, fd2, file);
+  if ((ret = file_desc_table_associate(desc_table, fd2, file)) != 0) {
+    return ret;
+  }
 
   //fd2 is returned.
 	return fd2;
@@ -408,19 +405,19 @@ int file_pipe(int fd[])
   file[1]->readable = 0;
   file[1]->writable = 1;
 
-  fd[0] = file_desc_table_get_unused(desc_table);
-  if(fd[0] == -1) {
-    ret = -E_MFILE;
+  if((fd[0] = file_desc_table_install(desc_table, file[0])) < 0) {
+    vfs_close(file[0]->node);
+    vfs_close(file[1]->node);
+    ret = fd[0];
     goto failed_cleanup;
   }
-  file_desc_table_associate(desc_table, fd[0], file[0]);
-  fd[1] = file_desc_table_get_unused(desc_table);
-  if(fd[1] == -1) {
+  if((fd[1] = file_desc_table_install(desc_table, file[1])) < 0) {
+    //file[0] goes away with its fd
     file_desc_table_dissociate(desc_table, fd[0]);
-    ret = -E_MFILE;
-    goto failed_cleanup;
+    vfs_close(file[1]->node);
+    kernel_file_pool_free(file[1]);
+    return fd[1];
   }
-  file_desc_table_associate(desc_table, fd[1], file[1]);
 	return 0;
 
 failed_cleanup:
@@ -621,9 +618,8 @@ void *linux_regfile_mmap2(void *addr, size_t len, int prot, int flags, int fd,
 		goto out_unlock;
 	}
 	uintptr_t end = start + len;
-	struct vma_struct *vma = find_vma(mm, start);
-	if (vma == NULL || vma->vm_start >= end) {
-		vma = NULL;
+	struct vma_struct *vma = find_vma_intersection(mm, start, end);
+	if (vma == NULL) {
 	} else if (!(flags & MAP_FIXED)) {
 		start = get_unmapped_area(mm, len);
 		vma = NULL;
@@ -653,6 +649,10 @@ void *linux_regfile_mmap2(void *addr, size_t len, int prot, int flags, int fd,
     vma_mapfile(vma, file, off, current->fs_struct);
 #endif
 	}
+	vma_merge(mm, vma);
+	if (flags & MAP_POPULATE) {
+		mm_populate(mm, start, len, 1);
+	}
 	subret = 0;
 out_unlock:
 	unlock_mm(mm);
@@ -1,103 +1,279 @@
 #include <error.h>
 #include <assert.h>
 #include <slab.h>
+#include <string.h>
 #include "file.h"
 #include "file_desc_table.h"
 
 const int FILE_DESC_TABLE_INIT_CAPACITY = 32;
 
+#define FDS_PER_WORD      32
+#define FDS_WORDS(n)      (((n) + FDS_PER_WORD - 1) / FDS_PER_WORD)
+
+static struct file_desc_array* file_desc_array_create(int capacity)
+{
+  int words = FDS_WORDS(capacity), full_words = FDS_WORDS(words);
+  size_t size = sizeof(struct file_desc_array) + sizeof(struct file_desc_entry) * capacity
+    + sizeof(uint32_t) * (words + full_words);
+  struct file_desc_array *fdt = kmalloc(size);
+  if(fdt == NULL) {
+    return NULL;
+  }
+  memset(fdt, 0, size);
+  fdt->capacity = capacity;
+  fdt->entries = (struct file_desc_entry *)(fdt + 1);
+  fdt->open_fds = (uint32_t *)(fdt->entries + capacity);
+  fdt->full_fds = fdt->open_fds + words;
+  fdt->old_fdt = NULL;
+  return fdt;
+}
+
+static void file_desc_array_set_open(struct file_desc_array *fdt, int file_desc)
+{
+  int word = file_desc / FDS_PER_WORD;
+  fdt->open_fds[word] |= 1u << (file_desc % FDS_PER_WORD);
+  if(fdt->open_fds[word] == ~0u) {
+    fdt->full_fds[word / FDS_PER_WORD] |= 1u << (word % FDS_PER_WORD);
+  }
+}
+
+static void file_desc_array_clear_open(struct file_desc_array *fdt, int file_desc)
+{
+  int word = file_desc / FDS_PER_WORD;
+  fdt->open_fds[word] &= ~(1u << (file_desc % FDS_PER_WORD));
+  fdt->full_fds[word / FDS_PER_WORD] &= ~(1u << (word % FDS_PER_WORD));
+}
+
+// file_desc_array_find_unused - lowest fd >= start that is not open, or -1
+static int file_desc_array_find_unused(struct file_desc_array *fdt, int start)
+{
+  int words = FDS_WORDS(fdt->capacity), word = start / FDS_PER_WORD;
+  if(start >= fdt->capacity) {
+    return -1;
+  }
+  uint32_t bits = fdt->open_fds[word] | ((1u << (start % FDS_PER_WORD)) - 1);
+  if(bits != ~0u) {
+    int file_desc = word * FDS_PER_WORD + __builtin_ctz(~bits);
+    return file_desc < fdt->capacity ? file_desc : -1;
+  }
+  //Skip over fully used words with the summary bitmap.
+  for(word++; word < words; word = (word / FDS_PER_WORD + 1) * FDS_PER_WORD) {
+    bits = fdt->full_fds[word / FDS_PER_WORD] | ((1u << (word % FDS_PER_WORD)) - 1);
+    if(bits != ~0u) {
+      word = word / FDS_PER_WORD * FDS_PER_WORD + __builtin_ctz(~bits);
+      if(word >= words) {
+        return -1;
+      }
+      int file_desc = word * FDS_PER_WORD + __builtin_ctz(~fdt->open_fds[word]);
+      return file_desc < fdt->capacity ? file_desc : -1;
+    }
+  }
+  return -1;
+}
+
+// file_desc_array_last_open - one past the highest open fd below @end
+static int file_desc_array_last_open(struct file_desc_array *fdt, int end)
+{
+  int word = FDS_WORDS(end);
+  while(word > 0) {
+    uint32_t bits = fdt->open_fds[--word];
+    if(word == end / FDS_PER_WORD) {
+      bits &= (1u << (end % FDS_PER_WORD)) - 1;
+    }
+    if(bits != 0) {
+      return word * FDS_PER_WORD + (FDS_PER_WORD - __builtin_clz(bits));
+    }
+  }
+  return 0;
+}
+
+/*
+ * file_desc_table_expand - grow the table so that @file_desc fits. The new
+ * array is completely filled in before it is published, and the old one is
+ * kept on the old_fdt chain for lookups that may still be reading it.
+ * Called with table->sem held.
+ */
+static int file_desc_table_expand(struct file_desc_table *table, int file_desc)
+{
+  struct file_desc_array *old_fdt = table->fdt, *new_fdt;
+  int new_capacity = old_fdt->capacity;
+  if(file_desc >= table->limit) {
+    return -E_MFILE;
+  }
+  while(new_capacity <= file_desc) {
+    new_capacity *= 2;
+  }
+  if(new_capacity > table->limit) {
+    new_capacity = table->limit;
+  }
+  if((new_fdt = file_desc_array_create(new_capacity)) == NULL) {
+    return -E_NOMEM;
+  }
+  int words = FDS_WORDS(old_fdt->capacity);
+  memcpy(new_fdt->entries, old_fdt->entries, sizeof(struct file_desc_entry) * old_fdt->capacity);
+  memcpy(new_fdt->open_fds, old_fdt->open_fds, sizeof(uint32_t) * words);
+  memcpy(new_fdt->full_fds, old_fdt->full_fds, sizeof(uint32_t) * FDS_WORDS(words));
+  new_fdt->old_fdt = old_fdt;
+  __sync_synchronize();
+  table->fdt = new_fdt;
+  return 0;
+}
+
 int file_desc_table_init(struct file_desc_table *table, int limit)
 {
   assert(limit > 0);
   assert(table != NULL);
-  struct file_desc_entry *entries = kmalloc(sizeof(struct file_desc_entry) * limit);
-  if(entries == NULL) {
-    if(entries != NULL) kfree(entries);
+  int capacity = limit < FILE_DESC_TABLE_INIT_CAPACITY ? limit : FILE_DESC_TABLE_INIT_CAPACITY;
+  if((table->fdt = file_desc_array_create(capacity)) == NULL) {
     return -E_NOMEM;
   }
-  for(int i = 0; i < limit; i++) {
-    entries[i].opened_file = NULL;
-  }
-  table->entries = entries;
-  //TODO: Initialize with a smaller size and implement auto expand.
-  table->capacity = limit;
   table->limit = limit;
-  table->last_free_desc = 0;
+  table->next_fd = 0;
+  table->max_fd = 0;
+  sem_init(&(table->sem), 1);
   return 0;
 }
 
 int file_desc_table_uninit(struct file_desc_table *table)
 {
-  for(int i = 0; i < table->capacity; i++) {
-    if(table->entries[i].opened_file != NULL) {
-      file_desc_table_dissociate(table, i);
+  struct file_desc_array *fdt = table->fdt, *old_fdt;
+  for(int word = 0; word < FDS_WORDS(table->max_fd); word++) {
+    uint32_t bits = fdt->open_fds[word];
+    while(bits != 0) {
+      int file_desc = word * FDS_PER_WORD + __builtin_ctz(bits);
+      bits &= bits - 1;
+      fopen_count_dec(fdt->entries[file_desc].opened_file);
     }
   }
-  kfree(table->entries);
+  while(fdt != NULL) {
+    old_fdt = fdt->old_fdt;
+    kfree(fdt);
+    fdt = old_fdt;
+  }
+  table->fdt = NULL;
   return 0;
 }
 
+/*
+ * file_desc_table_copy - duplicate the open fds of @from into the empty
+ * table @to. Only the words of the bitmap below @from's highest open fd are
+ * visited, so a fork costs in proportion to the fds in use, not the limit.
+ */
 int file_desc_table_copy(struct file_desc_table *to, struct file_desc_table *from)
 {
-  int capacity = to->capacity > from->capacity ? from->capacity : to->capacity;
-  for(int i = 0; i < capacity; i++) {
-    struct file *file = file_desc_table_get_file(from, i);
-    if(file != NULL) {
-      file_desc_table_associate(to, i, file);
+  int ret = 0;
+  assert(to->max_fd == 0);
+  down(&(from->sem));
+  int max_fd = from->max_fd < to->limit ? from->max_fd : to->limit;
+  if(max_fd > to->fdt->capacity && (ret = file_desc_table_expand(to, max_fd - 1)) != 0) {
+    goto out;
+  }
+  struct file_desc_array *from_fdt = from->fdt, *to_fdt = to->fdt;
+  for(int word = 0; word < FDS_WORDS(max_fd); word++) {
+    uint32_t bits = from_fdt->open_fds[word];
+    while(bits != 0) {
+      int file_desc = word * FDS_PER_WORD + __builtin_ctz(bits);
+      bits &= bits - 1;
+      if(file_desc >= max_fd) {
+        break;
+      }
+      struct file *file = from_fdt->entries[file_desc].opened_file;
+      fopen_count_inc(file);
+      to_fdt->entries[file_desc].opened_file = file;
+      file_desc_array_set_open(to_fdt, file_desc);
     }
   }
-  return 0;
+  to->next_fd = from->next_fd < max_fd ? from->next_fd : max_fd;
+  to->max_fd = max_fd;
+out:
+  up(&(from->sem));
+  return ret;
 }
 
-static struct file* file_desc_table_expand(struct file_desc_table *table)
+struct file* file_desc_table_get_file(struct file_desc_table *table, int file_desc)
 {
-  int old_capacity = table->capacity;
-  int new_capacity = old_capacity * 2;
-  if(new_capacity > table->limit) {
-    new_capacity = table->limit;
-  }
-  //TODO: reallocate and copy old fds.
+  //No lock here, see the comment on struct file_desc_array.
+  struct file_desc_array *fdt = *(struct file_desc_array * volatile *)&(table->fdt);
+  if(file_desc < 0 || file_desc >= fdt->capacity) return NULL;
+  return fdt->entries[file_desc].opened_file;
 }
 
-struct file* file_desc_table_get_file(struct file_desc_table *table, int file_desc)
+// file_desc_table_set - put @file at the free @file_desc, called with table->sem held
+static void file_desc_table_set(struct file_desc_table *table, int file_desc, struct file* file)
 {
-  if(file_desc < 0 || file_desc >= table->capacity) return NULL;
-  return table->entries[file_desc].opened_file;
+  struct file_desc_array *fdt = table->fdt;
+  fopen_count_inc(file);
+  fdt->entries[file_desc].opened_file = file;
+  file_desc_array_set_open(fdt, file_desc);
+  if(file_desc == table->next_fd) {
+    table->next_fd = file_desc + 1;
+  }
+  if(file_desc >= table->max_fd) {
+    table->max_fd = file_desc + 1;
+  }
 }
 
-int file_desc_table_get_unused(struct file_desc_table *table)
+/*
+ * file_desc_table_install - give @file the lowest free fd. Finding the fd
+ * and taking it is one step under table->sem, so threads sharing the
+ * table never get the same one.
+ * @return the fd, or -E_MFILE / -E_NOMEM
+ */
+int file_desc_table_install(struct file_desc_table *table, struct file* file)
 {
-  if(table->entries[table->last_free_desc].opened_file == NULL)
-    return table->last_free_desc;
-  int search_begin = table->last_free_desc + 1;
-  int search_end = table->last_free_desc;
-  if(search_begin >= table->capacity) search_begin = 0;
-  for(int i = search_begin; i != search_end;) {
-    if(table->entries[i].opened_file == NULL) {
-      table->last_free_desc = i;
-      return i;
+  int ret;
+  down(&(table->sem));
+  int file_desc = file_desc_array_find_unused(table->fdt, table->next_fd);
+  if(file_desc < 0) {
+    file_desc = table->fdt->capacity;
+    if((ret = file_desc_table_expand(table, file_desc)) != 0) {
+      file_desc = ret;
+      goto out;
     }
-    i++;
-    if(i == table->capacity) i = 0;
   }
-  return -1;
+  file_desc_table_set(table, file_desc, file);
+out:
+  up(&(table->sem));
+  return file_desc;
 }
 
 int file_desc_table_associate(struct file_desc_table *table, int file_desc, struct file* file)
 {
-  assert(file_desc >= 0 && file_desc < table->capacity);
-  assert(table->entries[file_desc].opened_file == NULL);
-  fopen_count_inc(file);
-  table->entries[file_desc].opened_file = file;
-  return 0;
+  int ret = 0;
+  if(file_desc < 0 || file_desc >= table->limit) {
+    return -E_BADF;
+  }
+  down(&(table->sem));
+  if(file_desc >= table->fdt->capacity && (ret = file_desc_table_expand(table, file_desc)) != 0) {
+    goto out;
+  }
+  //Another thread may have taken it since the caller freed it.
+  if(table->fdt->entries[file_desc].opened_file != NULL) {
+    ret = -E_BUSY;
+    goto out;
+  }
+  file_desc_table_set(table, file_desc, file);
+out:
+  up(&(table->sem));
+  return ret;
 }
 
 int file_desc_table_dissociate(struct file_desc_table *table, int file_desc)
 {
-  assert(file_desc >= 0 && file_desc < table->capacity);
-  struct file *file = table->entries[file_desc].opened_file;
+  down(&(table->sem));
+  struct file_desc_array *fdt = table->fdt;
+  assert(file_desc >= 0 && file_desc < fdt->capacity);
+  struct file *file = fdt->entries[file_desc].opened_file;
   assert(file != NULL);
   fopen_count_dec(file);
-  table->entries[file_desc].opened_file = NULL;
+  fdt->entries[file_desc].opened_file = NULL;
+  file_desc_array_clear_open(fdt, file_desc);
+  if(file_desc < table->next_fd) {
+    table->next_fd = file_desc;
+  }
+  if(file_desc == table->max_fd - 1) {
+    table->max_fd = file_desc_array_last_open(fdt, file_desc);
+  }
+  up(&(table->sem));
   return 0;
 }
@@ -12,6 +12,7 @@
 #define __KERN_FS_FILE_DESC_TABLE_H__
 
 #include <types.h>
+#include <sem.h>
 
 struct file;
 
@@ -19,18 +20,41 @@ struct file_desc_entry {
   struct file *opened_file;
 };
 
-struct file_desc_table {
-  struct file_desc_entry *entries;
+/*
+ * The table starts at FILE_DESC_TABLE_INIT_CAPACITY entries and doubles up to
+ * its limit when an fd beyond the current capacity is needed. Each array has
+ * a bitmap of open fds next to it, plus a summary bitmap with one bit per
+ * fully used word of open_fds, so the lowest free fd is found in a couple of
+ * word scans instead of an entry-by-entry walk.
+ *
+ * Lookups (file_desc_table_get_file) take no lock: they read the current
+ * array through table->fdt, which is only replaced after the new array is
+ * filled in. Replaced arrays stay on the old_fdt chain until the table is
+ * torn down, so a lookup racing with an expansion never touches freed
+ * memory. Growth is geometric, so the leftovers never outweigh the live
+ * array. Everything that changes the table is serialized by table->sem.
+ */
+struct file_desc_array {
   int capacity;
+  struct file_desc_entry *entries;
+  uint32_t *open_fds;
+  uint32_t *full_fds;
+  struct file_desc_array *old_fdt;
+};
+
+struct file_desc_table {
+  struct file_desc_array *fdt;
   int limit;
-  int last_free_desc;
+  int next_fd;  // no fd below this one is free
+  int max_fd;   // no fd at or above this one is open
+  semaphore_t sem;
 };
 
 int file_desc_table_init(struct file_desc_table *table, int limit);
 int file_desc_table_uninit(struct file_desc_table *table);
 int file_desc_table_copy(struct file_desc_table *to, struct file_desc_table *from);
 struct file* file_desc_table_get_file(struct file_desc_table *table, int file_desc);
-int file_desc_table_get_unused(struct file_desc_table *table);
+int file_desc_table_install(struct file_desc_table *table, struct file* file);
 int file_desc_table_associate(struct file_desc_table *table, int file_desc, struct file* file);
 int file_desc_table_dissociate(struct file_desc_table *table, int file_desc);
 
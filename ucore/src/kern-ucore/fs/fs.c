@@ -59,11 +59,16 @@ void unlock_fs(struct fs_struct *fs_struct)
 
 struct fs_struct *fs_create(void)
 {
-	static_assert((int)FS_STRUCT_NENTRY > 128);
 	struct fs_struct *fs_struct = kmalloc(sizeof(struct fs_struct));
   //TODO: This function needs to be rewritten.
+	if (fs_struct == NULL) {
+		return NULL;
+	}
 	fs_struct->pwd = NULL;
-  file_desc_table_init(&fs_struct->desc_table, 1024);
+  if (file_desc_table_init(&fs_struct->desc_table, 1024) != 0) {
+		kfree(fs_struct);
+		return NULL;
+	}
 	atomic_set(&(fs_struct->fs_count), 0);
 	sem_init(&(fs_struct->fs_sem), 1);
 	return fs_struct;
@@ -103,7 +108,10 @@ int dup_fs(struct fs_struct *to, struct fs_struct *from)
 	if ((to->pwd = from->pwd) != NULL) {
 		vop_ref_inc(to->pwd);
 	}
-  file_desc_table_copy(&to->desc_table, &from->desc_table);
+  int ret;
+  if ((ret = file_desc_table_copy(&to->desc_table, &from->desc_table)) != 0) {
+		return ret;
+	}
 	/*int i;
 	struct file *to_file = to->filemap, *from_file = from->filemap;
 	for (i = 0; i < FS_STRUCT_NENTRY; i++, to_file++, from_file++) {
@@ -29,9 +29,6 @@ struct fs_struct {
 	semaphore_t fs_sem;
 };
 
-#define FS_STRUCT_BUFSIZE                       (2 * PGSIZE - sizeof(struct fs_struct))
-#define FS_STRUCT_NENTRY                        (FS_STRUCT_BUFSIZE / sizeof(struct file))
-
 void lock_fs(struct fs_struct *fs_struct);
 void unlock_fs(struct fs_struct *fs_struct);
 
@@ -68,6 +68,36 @@ int bitmap_alloc(struct bitmap *bitmap, uint32_t * index_store)
 	return -E_NO_MEM;
 }
 
+// bitmap_alloc_from - like bitmap_alloc, but search from bit @start on and wrap around
+int bitmap_alloc_from(struct bitmap *bitmap, uint32_t start,
+		      uint32_t * index_store)
+{
+	WORD_TYPE *map = bitmap->map, word;
+	uint32_t i, ix, offset, nwords = bitmap->nwords;
+	if (start >= bitmap->nbits) {
+		start = 0;
+	}
+	/* the first word is looked at twice, its low bits only at the end */
+	for (i = 0; i <= nwords; i++) {
+		ix = (start / WORD_BITS + i) % nwords;
+		if ((word = map[ix]) != 0 && i == 0) {
+			word &= ~((1 << (start % WORD_BITS)) - 1);
+		}
+		if (word != 0) {
+			for (offset = 0; offset < WORD_BITS; offset++) {
+				WORD_TYPE mask = (1 << offset);
+				if (word & mask) {
+					map[ix] ^= mask;
+					*index_store = ix * WORD_BITS + offset;
+					return 0;
+				}
+			}
+			assert(0);
+		}
+	}
+	return -E_NO_MEM;
+}
+
 static void
 bitmap_translate(struct bitmap *bitmap, uint32_t index, WORD_TYPE ** word,
 		 WORD_TYPE * mask)
@@ -7,6 +7,8 @@ struct bitmap;
 
 struct bitmap *bitmap_create(uint32_t nbits);
 int bitmap_alloc(struct bitmap *bitmap, uint32_t * index_store);
+int bitmap_alloc_from(struct bitmap *bitmap, uint32_t start,
+		      uint32_t * index_store);
 bool bitmap_test(struct bitmap *bitmap, uint32_t index);
 void bitmap_free(struct bitmap *bitmap, uint32_t index);
 void bitmap_destroy(struct bitmap *bitmap);
@@ -6,6 +6,7 @@
 
 void sfs_init(void)
 {
+	sfs_flush_init();
 	int ret = register_filesystem(&sfs_fs_type);
 	if (ret != 0) {
 		panic("failed: sfs: register_filesystem: %e.\n", ret);
@@ -5,6 +5,7 @@
 #include <mmu.h>
 #include <list.h>
 #include <sem.h>
+#include <rwsem.h>
 #include <atomic.h>
 #include <unistd.h>
 
@@ -41,9 +42,55 @@ struct sfs_super {
 	uint32_t blocks;	/* # of blocks in fs */
 	uint32_t unused_blocks;	/* # of unused blocks in fs */
 	char info[SFS_MAX_INFO_LEN + 1];	/* infomation for sfs  */
+	uint32_t journal;	/* 1st block of the journal, 0 if there is none */
+	uint32_t journal_blocks;	/* # of blocks in the journal */
+	uint32_t inodes;	/* # of inodes in the inode table, 0 if each inode has a block of its own */
+	uint32_t unused_inodes;	/* # of unused inodes in the inode table */
+	uint32_t inodemap;	/* 1st block of the inode bitmap */
+	uint32_t inode_table;	/* 1st block of the inode table */
 };
 
-/* inode (on disk) */
+/*
+ * Metadata journal (on disk). The first block of the journal is its header,
+ * the log follows. A transaction is logged as descriptor blocks, each
+ * followed by the blocks whose home it lists, and ends with a commit block.
+ * Transactions are numbered; replay starts at the header's seq and stops at
+ * the first one that was not committed completely.
+ */
+#define SFS_JOURNAL_MAGIC                           0x4a534653	/* journal header */
+#define SFS_JDESC_MAGIC                             0x4a534644	/* descriptor block */
+#define SFS_JCOMMIT_MAGIC                           0x4a534643	/* commit block */
+
+struct sfs_journal_header {
+	uint32_t magic;		/* SFS_JOURNAL_MAGIC */
+	uint32_t seq;		/* # of the transaction logged first */
+};
+
+/* # of blocks a descriptor block lists */
+#define SFS_JDESC_NENTRY                            ((SFS_BLKSIZE / sizeof(uint32_t)) - 3)
+
+struct sfs_journal_desc {
+	uint32_t magic;		/* SFS_JDESC_MAGIC */
+	uint32_t seq;		/* # of the transaction */
+	uint32_t nblks;		/* # of blocks following */
+	uint32_t home[SFS_JDESC_NENTRY];	/* where they belong */
+};
+
+struct sfs_journal_commit {
+	uint32_t magic;		/* SFS_JCOMMIT_MAGIC */
+	uint32_t seq;		/* # of the transaction */
+	uint32_t nblks;		/* # of blocks logged, descriptors not counted */
+	uint32_t checksum;	/* over the blocks logged */
+};
+
+/*
+ * inode (on disk). On a packed sfs inodes are numbered from 1 and kept
+ * SFS_INODES_PER_BLK to a block in the inode table, and a regular file of
+ * up to SFS_INLINE_MAX bytes keeps its data in place of its block map.
+ */
+#define SFS_INLINE_MAX                              108	/* max size of inline data */
+#define SFS_DIN_INLINE                              0x1	/* data is in inline_data */
+
 struct sfs_disk_inode {
 	union {
 		struct {
@@ -57,11 +104,19 @@ struct sfs_disk_inode {
 	uint16_t type;		/* one of SYS_TYPE_* above */
 	uint16_t nlinks;	/* # of hard links to this file */
 	uint32_t blocks;	/* # of blocks */
-	uint32_t direct[SFS_NDIRECT];	/* direct blocks */
-	uint32_t indirect;	/* indirect blocks */
-	uint32_t db_indirect;	/* double indirect blocks */
+	union {
+		struct {
+			uint32_t direct[SFS_NDIRECT];	/* direct blocks */
+			uint32_t indirect;	/* indirect blocks */
+			uint32_t db_indirect;	/* double indirect blocks */
+		};
+		uint8_t inline_data[SFS_INLINE_MAX];	/* contents of a small file */
+	};
+	uint32_t flags;		/* SFS_DIN_* */
 };
 
+#define SFS_INODES_PER_BLK                          (SFS_BLKSIZE / sizeof(struct sfs_disk_inode))
+
 /* file entry (on disk) */
 struct sfs_disk_entry {
 	uint32_t ino;		/* inode number */
@@ -78,6 +133,8 @@ struct sfs_inode {
 	uintptr_t flags;		/* inode flags */
 	int dirty;		/* true if inode modified */
 	int reclaim_count;	/* kill inode if it hits zero */
+	uint32_t nr_delayed;	/* # of blocks past din->blocks not allocated yet */
+	list_entry_t delay_list;	/* those blocks, in file order */
 	semaphore_t sem;	/* semaphore for din */
 	list_entry_t inode_link;	/* entry for linked-list in sfs_fs */
 	list_entry_t hash_link;	/* entry for hash linked-list in sfs_fs */
@@ -92,33 +149,110 @@ struct sfs_inode {
 #define le2sin(le, member)                          \
     to_struct((le), struct sfs_inode, member)
 
+/*
+ * Cached block. Dirty blocks are written back by the flusher or fsync. A
+ * delayed block holds file data that has no disk block yet: it hangs off
+ * the inode's delay_list with blkno set to its index in the file, and is
+ * moved into the cache once the disk block is allocated.
+ */
+struct sfs_buf {
+	uint32_t blkno;		/* block number, file block index while delayed */
+	uint32_t owner;		/* inode the block belongs to, 0 if shared */
+	bool dirty;		/* true if the block is newer than the disk */
+	bool pinned;		/* metadata of the running transaction, stays in memory until it commits */
+	size_t dirtied;		/* ticks when it became dirty */
+	void *data;		/* block contents */
+	list_entry_t hash_link;	/* entry in the block hash, or delay_list */
+	list_entry_t lru_link;	/* entry in lru_list */
+	list_entry_t dirty_link;	/* entry in dirty_list */
+};
+
+#define le2buf(le, member)                          \
+    to_struct((le), struct sfs_buf, member)
+
 /* filesystem for sfs */
 struct sfs_fs {
 	struct sfs_super super;	/* on-disk superblock */
 	struct device *dev;	/* device mounted on */
 	struct bitmap *freemap;	/* blocks in use are mared 0 */
 	bool super_dirty;	/* true if super/freemap modified */
+	bool *freemap_dirty;	/* true for each freemap block modified */
+	struct bitmap *inodemap;	/* inodes in use are marked 0, NULL unless packed */
+	bool *inodemap_dirty;	/* true for each inode bitmap block modified */
+	uint32_t alloc_hint;	/* where the next block allocation starts */
+	uint32_t reserved_blocks;	/* free blocks promised to delayed blocks */
 	void *sfs_buffer;	/* buffer for non-block aligned io */
+	void *io_buffer;	/* SFS_IO_NBLKS blocks written back in one go */
+	list_entry_t *buf_hash;	/* block cache hash linked-list */
+	list_entry_t lru_list;	/* cached blocks, least recently used first */
+	list_entry_t dirty_list;	/* dirty cached blocks */
+	size_t nr_bufs;		/* # of cached blocks */
+	size_t nr_dirty;	/* # of dirty cached blocks */
+	size_t nr_delayed;	/* # of delayed blocks */
 	semaphore_t fs_sem;	/* semaphore for fs */
 	semaphore_t io_sem;	/* semaphore for io */
 	semaphore_t mutex_sem;	/* semaphore for link/unlink and rename */
 	list_entry_t inode_list;	/* inode linked-list */
 	list_entry_t *hash_list;	/* inode hash linked-list */
+	list_entry_t sfs_link;	/* entry in the list of mounted sfs */
+	rw_semaphore_t journal_sem;	/* shared by metadata updates, held alone to commit */
+	uint32_t jhead;		/* where the next transaction is logged */
+	uint32_t jseq;		/* # of the running transaction */
+	bool jreset;		/* true if a block was freed, the log must restart */
+	size_t nr_pinned;	/* # of metadata blocks in the running transaction */
+	size_t jcommitted;	/* ticks at the last commit */
 };
 
+#define sfs_journaled(sfs)                          ((sfs)->super.journal != 0)
+#define sfs_packed(sfs)                             ((sfs)->super.inodes != 0)
+
+/* # of dirty and delayed blocks the flusher is free to write back */
+#define sfs_nr_writeback(sfs)                       \
+    ((sfs)->nr_dirty - (sfs)->nr_pinned + (sfs)->nr_delayed)
+
+#define le2sfs(le, member)                          \
+    to_struct((le), struct sfs_fs, member)
+
 /* hash for sfs */
 #define SFS_HLIST_SHIFT                             10
 #define SFS_HLIST_SIZE                              (1 << SFS_HLIST_SHIFT)
 #define sin_hashfn(x)                               (hash32(x, SFS_HLIST_SHIFT))
 
+/* hash for the block cache */
+#define SFS_BHASH_SHIFT                             10
+#define SFS_BHASH_SIZE                              (1 << SFS_BHASH_SHIFT)
+#define sbuf_hashfn(x)                              (hash32(x, SFS_BHASH_SHIFT))
+
+/* write-back, ticks are counted at 100 a second */
+#define SFS_BCACHE_NBUF                             512	/* # of blocks the cache keeps */
+#define SFS_DIRTY_BACKGROUND                        128	/* flusher writes all back above this */
+#define SFS_DIRTY_LIMIT                             256	/* writers write back themselves above this */
+#define SFS_DIRTY_EXPIRE                            500	/* ticks before dirty data is written back */
+#define SFS_FLUSH_INTERVAL                          100	/* ticks between two flusher passes */
+#define SFS_IO_NBLKS                                16	/* max # of blocks written back at once */
+#define SFS_JOURNAL_INTERVAL                        500	/* ticks between two journal commits */
+
+/* a transaction this big is committed early */
+#define sfs_journal_txn_max(sfs)                    (((sfs)->super.journal_blocks - 1) / 4)
+
 /* size of freemap (in bits) */
 #define sfs_freemap_bits(super)                     ROUNDUP((super)->blocks, SFS_BLKBITS)
 
 /* size of freemap (in blocks) */
 #define sfs_freemap_blocks(super)                   ROUNDUP_DIV((super)->blocks, SFS_BLKBITS)
 
+/* size of inode bitmap (in bits) */
+#define sfs_inodemap_bits(super)                    ROUNDUP((super)->inodes, SFS_BLKBITS)
+
+/* size of inode bitmap (in blocks) */
+#define sfs_inodemap_blocks(super)                  ROUNDUP_DIV((super)->inodes, SFS_BLKBITS)
+
+/* size of inode table (in blocks) */
+#define sfs_inode_table_blocks(super)               ROUNDUP_DIV((super)->inodes, SFS_INODES_PER_BLK)
+
 struct fs;
 struct inode;
+struct device;
 
 void lock_sfs_fs(struct sfs_fs *sfs);
 void lock_sfs_io(struct sfs_fs *sfs);
@@ -127,16 +261,49 @@ void unlock_sfs_fs(struct sfs_fs *sfs);
 void unlock_sfs_io(struct sfs_fs *sfs);
 void unlock_sfs_mutex(struct sfs_fs *sfs);
 
+int sfs_rwblock_nolock(struct sfs_fs *sfs, void *buf, uint32_t blkno,
+		       uint32_t nblks, bool write, bool check);
+int sfs_bcache_init(struct sfs_fs *sfs);
+void sfs_bcache_shrink(struct sfs_fs *sfs);
+void sfs_bcache_destroy(struct sfs_fs *sfs);
 int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
-int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
+int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks,
+	       uint32_t owner);
 int sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
 	     off_t offset);
 int sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
-	     off_t offset);
+	     off_t offset, uint32_t owner, bool meta);
 int sfs_sync_super(struct sfs_fs *sfs);
 int sfs_sync_freemap(struct sfs_fs *sfs);
-int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks);
+int sfs_sync_alloc(struct sfs_fs *sfs);
+int sfs_cache_alloc(struct sfs_fs *sfs);
+int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks,
+		    uint32_t owner, bool meta);
+struct sfs_buf *sfs_buf_alloc(struct sfs_fs *sfs);
+void sfs_buf_free(struct sfs_fs *sfs, struct sfs_buf *buf);
+void sfs_buf_install(struct sfs_fs *sfs, struct sfs_buf *buf, uint32_t blkno,
+		     uint32_t owner);
+void sfs_buf_forget(struct sfs_fs *sfs, uint32_t blkno);
+int sfs_buf_flush(struct sfs_fs *sfs, uint32_t owner, size_t age);
+int sfs_buf_sync(struct sfs_fs *sfs, uint32_t blkno);
 
 int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino);
+int sfs_writeback_inodes(struct sfs_fs *sfs, size_t age);
+int sfs_sync_inodes(struct sfs_fs *sfs);
+
+int sfs_journal_replay(struct device *dev, struct sfs_super *super,
+		       uint32_t * seq_store);
+void sfs_journal_init(struct sfs_fs *sfs, uint32_t seq);
+void *sfs_journal_start(struct sfs_fs *sfs);
+int sfs_journal_trystart(struct sfs_fs *sfs, void **handle_store);
+void sfs_journal_stop(struct sfs_fs *sfs, void *handle);
+int sfs_journal_commit(struct sfs_fs *sfs);
+
+void sfs_flush_init(void);
+void sfs_flush_add(struct sfs_fs *sfs);
+void sfs_flush_del(struct sfs_fs *sfs);
+void sfs_wakeup_flushd(void);
+int sfs_flushd_main(void *arg);
+void sfs_drop_caches(void);
 
 #endif /* !__KERN_FS_SFS_SFS_H__ */
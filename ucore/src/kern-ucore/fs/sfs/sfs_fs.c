@@ -14,6 +14,9 @@
 #include <assert.h>
 #include <stat.h>
 #include <kio.h>
+#include <proc.h>
+#include <sched.h>
+#include <clock.h>
 
 static int sfs_mount(struct file_system_type* file_system_type, int flags,
   const char *devname, void* data, struct fs** fs_store);
@@ -31,7 +34,6 @@ struct file_system_type sfs_fs_type = {
 static int sfs_sync(struct fs *fs)
 {
 	struct sfs_fs *sfs = fsop_info(fs, sfs);
-	lock_sfs_fs(sfs);
 /*
  * Get the sfs_fs from the generic abstract fs.
  *
@@ -61,30 +63,24 @@ static int sfs_sync(struct fs *fs)
  * similar things all over the place in ucore, so taking the
  * time to straighten it out in your mind is worthwhile.
  */
-	{
-		list_entry_t *list = &(sfs->inode_list), *le = list;
-		while ((le = list_next(le)) != list) {
-			struct sfs_inode *sin = le2sin(le, inode_link);
-			vop_fsync(info2node(sin, sfs_inode));
-		}
-	}
-	unlock_sfs_fs(sfs);
-
 	int ret;
-	if (sfs->super_dirty) {
-		sfs->super_dirty = 0;
-		/* If the superblock needs to be written, write it. */
-		if ((ret = sfs_sync_super(sfs)) != 0) {
-			sfs->super_dirty = 1;
-			return ret;
-		}
-		/* If the free block map needs to be written, write it. */
-		if ((ret = sfs_sync_freemap(sfs)) != 0) {
-			sfs->super_dirty = 1;
+	/* Move every dirty inode and delayed block into the block cache. */
+	if ((ret = sfs_writeback_inodes(sfs, 0)) != 0) {
+		return ret;
+	}
+	/* Commit the metadata, and then write it home with the rest. */
+	if (sfs_journaled(sfs)) {
+		if ((ret = sfs_journal_commit(sfs)) != 0) {
 			return ret;
 		}
+		return sfs_buf_flush(sfs, 0, 0);
 	}
-	return 0;
+	/* Write back the whole cache. */
+	if ((ret = sfs_buf_flush(sfs, 0, 0)) != 0) {
+		return ret;
+	}
+	/* If the superblock or free block map needs to be written, write it. */
+	return sfs_sync_alloc(sfs);
 }
 
 /*
@@ -116,7 +112,14 @@ static int sfs_cleanup(struct fs *fs)
 		return -E_BUSY;
 	}
 	assert(!sfs->super_dirty);
+	sfs_flush_del(sfs);
+	sfs_bcache_destroy(sfs);
 	bitmap_destroy(sfs->freemap);
+	kfree(sfs->freemap_dirty);
+	if (sfs->inodemap != NULL) {
+		bitmap_destroy(sfs->inodemap);
+		kfree(sfs->inodemap_dirty);
+	}
 	kfree(sfs->sfs_buffer);
 	kfree(sfs->hash_list);
 	kfree(sfs);
@@ -201,6 +204,7 @@ static int sfs_mount(struct file_system_type* file_system_type, int flags,
  */
 	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_super));
 	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_disk_inode));
+	static_assert(sizeof(struct sfs_disk_inode) == 128);
 	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_disk_entry));
 
 /*
@@ -254,6 +258,46 @@ static int sfs_mount(struct file_system_type* file_system_type, int flags,
 		goto failed_cleanup_sfs_buffer;
 	}
 	super->info[SFS_MAX_INFO_LEN] = '\0';
+	if (super->inodes != 0
+	    && (super->inodemap <= SFS_BLKN_FREEMAP
+		|| super->inode_table <= super->inodemap
+		|| super->inode_table + sfs_inode_table_blocks(super) >
+		super->blocks || super->unused_inodes >= super->inodes)) {
+		kprintf("sfs: bad inode table at %u, %u inodes.\n",
+			super->inode_table, super->inodes);
+		goto failed_cleanup_sfs_buffer;
+	}
+
+	/* bring the blocks up to date with the journal before reading them */
+	uint32_t jseq = 0;
+	if (super->journal != 0) {
+		if (super->journal <= SFS_BLKN_FREEMAP
+		    || super->journal_blocks < 2
+		    || super->journal + super->journal_blocks > super->blocks) {
+			kprintf("sfs: bad journal at %u, %u blocks.\n",
+				super->journal, super->journal_blocks);
+			goto failed_cleanup_sfs_buffer;
+		}
+		struct sfs_super jsuper = *super;
+		if ((ret = sfs_journal_replay(dev, &jsuper, &jseq)) != 0) {
+			goto failed_cleanup_sfs_buffer;
+		}
+		if ((ret =
+		     sfs_init_read(dev, SFS_BLKN_SUPER, sfs_buffer)) != 0) {
+			goto failed_cleanup_sfs_buffer;
+		}
+		ret = -E_INVAL;
+		if (super->magic != SFS_MAGIC || super->blocks != jsuper.blocks
+		    || super->journal != jsuper.journal
+		    || super->journal_blocks != jsuper.journal_blocks
+		    || super->inodes != jsuper.inodes
+		    || super->inodemap != jsuper.inodemap
+		    || super->inode_table != jsuper.inode_table) {
+			kprintf("sfs: superblock changed by journal replay.\n");
+			goto failed_cleanup_sfs_buffer;
+		}
+		super->info[SFS_MAX_INFO_LEN] = '\0';
+	}
 	sfs->super = *super;
 
 	ret = -E_NO_MEM;
@@ -292,14 +336,69 @@ static int sfs_mount(struct file_system_type* file_system_type, int flags,
 	}
 	assert(unused_blocks == sfs->super.unused_blocks);
 
+	ret = -E_NO_MEM;
+
+	/* freemap blocks to write back, and the block cache */
+	bool *freemap_dirty;
+	if ((sfs->freemap_dirty = freemap_dirty =
+	     kmalloc(sizeof(bool) * freemap_size_nblks)) == NULL) {
+		goto failed_cleanup_freemap;
+	}
+	memset(freemap_dirty, 0, sizeof(bool) * freemap_size_nblks);
+
+	/* and the inode bitmap of a packed sfs */
+	struct bitmap *inodemap = NULL;
+	bool *inodemap_dirty = NULL;
+	if (super->inodes != 0) {
+		uint32_t inodemap_size_nblks = sfs_inodemap_blocks(super);
+		if ((inodemap = bitmap_create(sfs_inodemap_bits(super))) == NULL) {
+			goto failed_cleanup_freemap_dirty;
+		}
+		if ((ret =
+		     sfs_init_freemap(dev, inodemap, super->inodemap,
+				      inodemap_size_nblks, sfs_buffer)) != 0) {
+			goto failed_cleanup_inodemap;
+		}
+		uint32_t unused_inodes = 0;
+		for (i = 0; i < super->inodes; i++) {
+			if (bitmap_test(inodemap, i)) {
+				unused_inodes++;
+			}
+		}
+		assert(unused_inodes == super->unused_inodes);
+		ret = -E_NO_MEM;
+		if ((inodemap_dirty =
+		     kmalloc(sizeof(bool) * inodemap_size_nblks)) == NULL) {
+			goto failed_cleanup_inodemap;
+		}
+		memset(inodemap_dirty, 0, sizeof(bool) * inodemap_size_nblks);
+	}
+	sfs->inodemap = inodemap, sfs->inodemap_dirty = inodemap_dirty;
+
+	if ((ret = sfs_bcache_init(sfs)) != 0) {
+		goto failed_cleanup_inodemap_dirty;
+	}
+
 	/* and other fields */
 	sfs->super_dirty = 0;
+	sfs->alloc_hint = 0, sfs->reserved_blocks = 0;
 	sem_init(&(sfs->fs_sem), 1);
 	sem_init(&(sfs->io_sem), 1);
 	sem_init(&(sfs->mutex_sem), 1);
 	list_init(&(sfs->inode_list));
+	sfs_journal_init(sfs, jseq);
 	kprintf("sfs: mount: '%s' (%d/%d/%d)\n", sfs->super.info,
 		blocks - unused_blocks, unused_blocks, blocks);
+	if (sfs_journaled(sfs)) {
+		kprintf("sfs: journal: %d blocks at %d, transaction %d.\n",
+			sfs->super.journal_blocks, sfs->super.journal, jseq);
+	}
+	if (sfs_packed(sfs)) {
+		kprintf("sfs: inodes: %d/%d in %d blocks at %d.\n",
+			sfs->super.inodes - sfs->super.unused_inodes,
+			sfs->super.inodes, sfs_inode_table_blocks(super),
+			sfs->super.inode_table);
+	}
 
 	/* Set up abstract fs calls */
 	fs->fs_sync = sfs_sync;
@@ -307,9 +406,20 @@ static int sfs_mount(struct file_system_type* file_system_type, int flags,
 	fs->fs_unmount = sfs_unmount;
 	fs->fs_cleanup = sfs_cleanup;
 
+	sfs_flush_add(sfs);
 	*fs_store = fs;
 	return 0;
 
+failed_cleanup_inodemap_dirty:
+	if (inodemap_dirty != NULL) {
+		kfree(inodemap_dirty);
+	}
+failed_cleanup_inodemap:
+	if (inodemap != NULL) {
+		bitmap_destroy(inodemap);
+	}
+failed_cleanup_freemap_dirty:
+	kfree(freemap_dirty);
 failed_cleanup_freemap:
 	bitmap_destroy(freemap);
 failed_cleanup_hash_list:
@@ -320,3 +430,104 @@ failed_cleanup_fs:
 	kfree(fs);
 	return ret;
 }
+
+/*
+ * Flusher. ksfsflushd wakes up every SFS_FLUSH_INTERVAL ticks and writes
+ * back what has been dirty for SFS_DIRTY_EXPIRE ticks, or everything once
+ * an sfs has more than SFS_DIRTY_BACKGROUND dirty and delayed blocks. It
+ * also commits the journal every SFS_JOURNAL_INTERVAL ticks, or sooner
+ * when the running transaction gets big.
+ */
+
+static list_entry_t sfs_mount_list;
+static semaphore_t sfs_mount_sem;
+static struct proc_struct *sfs_flushd;
+
+void sfs_flush_init(void)
+{
+	list_init(&sfs_mount_list);
+	sem_init(&sfs_mount_sem, 1);
+}
+
+void sfs_flush_add(struct sfs_fs *sfs)
+{
+	down(&sfs_mount_sem);
+	list_add(&sfs_mount_list, &(sfs->sfs_link));
+	up(&sfs_mount_sem);
+}
+
+void sfs_flush_del(struct sfs_fs *sfs)
+{
+	down(&sfs_mount_sem);
+	list_del(&(sfs->sfs_link));
+	up(&sfs_mount_sem);
+}
+
+// sfs_wakeup_flushd - start a flusher pass early, writers have dirtied a lot
+void sfs_wakeup_flushd(void)
+{
+	struct proc_struct *proc = sfs_flushd;
+	if (proc != NULL && proc->wait_state == WT_TIMER) {
+		wakeup_proc(proc);
+	}
+}
+
+static void sfs_writeback(struct sfs_fs *sfs)
+{
+	size_t age = SFS_DIRTY_EXPIRE;
+	if (sfs_nr_writeback(sfs) > SFS_DIRTY_BACKGROUND) {
+		age = 0;
+	}
+	int ret;
+	if ((ret = sfs_writeback_inodes(sfs, age)) == 0
+	    && (ret = sfs_buf_flush(sfs, 0, age)) == 0) {
+		if (sfs_journaled(sfs)) {
+			if (sfs->nr_pinned >= sfs_journal_txn_max(sfs)
+			    || ((sfs->nr_pinned != 0 || sfs->super_dirty)
+				&& ticks - sfs->jcommitted >=
+				SFS_JOURNAL_INTERVAL)) {
+				ret = sfs_journal_commit(sfs);
+			}
+		} else if (sfs->nr_dirty == 0) {
+			ret = sfs_sync_alloc(sfs);
+		}
+	}
+	if (ret != 0) {
+		warn("sfs: writeback error: '%s': %e.\n", sfs->super.info, ret);
+	}
+}
+
+int sfs_flushd_main(void *arg)
+{
+	sfs_flushd = current;
+	while (1) {
+		down(&sfs_mount_sem);
+		{
+			list_entry_t *list = &sfs_mount_list, *le = list;
+			while ((le = list_next(le)) != list) {
+				sfs_writeback(le2sfs(le, sfs_link));
+			}
+		}
+		up(&sfs_mount_sem);
+		do_sleep(SFS_FLUSH_INTERVAL);
+	}
+}
+
+// sfs_drop_caches - write back every mounted sfs and drop its clean blocks, before memory is checked
+void sfs_drop_caches(void)
+{
+	down(&sfs_mount_sem);
+	{
+		list_entry_t *list = &sfs_mount_list, *le = list;
+		while ((le = list_next(le)) != list) {
+			struct sfs_fs *sfs = le2sfs(le, sfs_link);
+			int ret;
+			if ((ret = sfs_sync(info2fs(sfs, sfs))) != 0) {
+				warn("sfs: sync error: '%s': %e.\n",
+				     sfs->super.info, ret);
+			}
+			sfs_bcache_shrink(sfs);
+		}
+	}
+	up(&sfs_mount_sem);
+}
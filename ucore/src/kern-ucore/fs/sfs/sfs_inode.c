@@ -10,6 +10,7 @@
 #include <inode.h>
 #include <iobuf.h>
 #include <bitmap.h>
+#include <clock.h>
 #include <error.h>
 #include <assert.h>
 
@@ -73,23 +74,105 @@ static bool sfs_block_inuse(struct sfs_fs *sfs, uint32_t ino)
 	      sfs->super.blocks, ino);
 }
 
-static int sfs_block_alloc(struct sfs_fs *sfs, uint32_t * ino_store)
+static void sfs_freemap_dirty(struct sfs_fs *sfs, uint32_t ino)
+{
+	sfs->freemap_dirty[ino / SFS_BLKBITS] = 1, sfs->super_dirty = 1;
+}
+
+static bool sfs_inode_inuse(struct sfs_fs *sfs, uint32_t ino)
+{
+	if (!sfs_packed(sfs)) {
+		return sfs_block_inuse(sfs, ino);
+	}
+	if (ino != 0 && ino < sfs->super.inodes) {
+		return !bitmap_test(sfs->inodemap, ino);
+	}
+	panic("sfs_inode_inuse: called out of range (0, %u) %u.\n",
+	      sfs->super.inodes, ino);
+}
+
+static void sfs_inodemap_dirty(struct sfs_fs *sfs, uint32_t ino)
+{
+	sfs->inodemap_dirty[ino / SFS_BLKBITS] = 1, sfs->super_dirty = 1;
+}
+
+/*
+ * sfs_inode_locate - where inode @ino is on disk: a block of its own, or a
+ * slot in the inode table of a packed sfs
+ */
+static void
+sfs_inode_locate(struct sfs_fs *sfs, uint32_t ino, uint32_t * blkno_store,
+		 off_t * offset_store)
+{
+	if (!sfs_packed(sfs)) {
+		*blkno_store = ino, *offset_store = 0;
+		return;
+	}
+	*blkno_store = sfs->super.inode_table + ino / SFS_INODES_PER_BLK;
+	*offset_store =
+	    (ino % SFS_INODES_PER_BLK) * sizeof(struct sfs_disk_inode);
+}
+
+/*
+ * Blocks are handed out next-fit, so the blocks allocated one after another
+ * when delayed blocks are written back end up next to each other on disk.
+ */
+static int
+sfs_block_alloc(struct sfs_fs *sfs, uint32_t owner, bool meta,
+		uint32_t * ino_store)
 {
 	int ret;
-	if ((ret = bitmap_alloc(sfs->freemap, ino_store)) != 0) {
+	if (sfs->super.unused_blocks <= sfs->reserved_blocks) {
+		return -E_NO_MEM;
+	}
+	if ((ret =
+	     bitmap_alloc_from(sfs->freemap, sfs->alloc_hint,
+			       ino_store)) != 0) {
 		return ret;
 	}
 	assert(sfs->super.unused_blocks > 0);
-	sfs->super.unused_blocks--, sfs->super_dirty = 1;
+	sfs->super.unused_blocks--, sfs_freemap_dirty(sfs, *ino_store);
+	sfs->alloc_hint = *ino_store + 1;
 	assert(sfs_block_inuse(sfs, *ino_store));
-	return sfs_clear_block(sfs, *ino_store, 1);
+	return sfs_clear_block(sfs, *ino_store, 1, owner, meta);
 }
 
 static void sfs_block_free(struct sfs_fs *sfs, uint32_t ino)
 {
 	assert(sfs_block_inuse(sfs, ino));
 	bitmap_free(sfs->freemap, ino);
-	sfs->super.unused_blocks++, sfs->super_dirty = 1;
+	sfs->super.unused_blocks++, sfs_freemap_dirty(sfs, ino);
+	sfs_buf_forget(sfs, ino);
+	/* an older transaction in the log may still hold the block */
+	sfs->jreset = 1;
+}
+
+static int sfs_inode_alloc(struct sfs_fs *sfs, uint32_t * ino_store)
+{
+	int ret;
+	if (!sfs_packed(sfs)) {
+		return sfs_block_alloc(sfs, 0, 1, ino_store);
+	}
+	if (sfs->super.unused_inodes == 0) {
+		return -E_NO_MEM;
+	}
+	if ((ret = bitmap_alloc(sfs->inodemap, ino_store)) != 0) {
+		return ret;
+	}
+	sfs->super.unused_inodes--, sfs_inodemap_dirty(sfs, *ino_store);
+	assert(sfs_inode_inuse(sfs, *ino_store));
+	return 0;
+}
+
+static void sfs_inode_free(struct sfs_fs *sfs, uint32_t ino)
+{
+	if (!sfs_packed(sfs)) {
+		sfs_block_free(sfs, ino);
+		return;
+	}
+	assert(sfs_inode_inuse(sfs, ino));
+	bitmap_free(sfs->inodemap, ino);
+	sfs->super.unused_inodes++, sfs_inodemap_dirty(sfs, ino);
 }
 
 static int
@@ -102,6 +185,8 @@ sfs_create_inode(struct sfs_fs *sfs, struct sfs_disk_inode *din, uint32_t ino,
 		struct sfs_inode *sin = vop_info(node, sfs_inode);
 		sin->din = din, sin->ino = ino, sin->dirty = 0, sin->flags =
 		    0, sin->reclaim_count = 1;
+		sin->nr_delayed = 0;
+		list_init(&(sin->delay_list));
 		sem_init(&(sin->sem), 1);
 		*node_store = node;
 		return 0;
@@ -140,9 +225,13 @@ int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino)
 		goto failed_unlock;
 	}
 
-	assert(sfs_block_inuse(sfs, ino));
+	uint32_t blkno;
+	off_t offset;
+	assert(sfs_inode_inuse(sfs, ino));
+	sfs_inode_locate(sfs, ino, &blkno, &offset);
 	if ((ret =
-	     sfs_rbuf(sfs, din, sizeof(struct sfs_disk_inode), ino, 0)) != 0) {
+	     sfs_rbuf(sfs, din, sizeof(struct sfs_disk_inode), blkno,
+		      offset)) != 0) {
 		goto failed_cleanup_din;
 	}
 
@@ -165,8 +254,9 @@ failed_unlock:
 }
 
 static int
-sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t * entp, uint32_t index,
-			bool create, uint32_t * ino_store)
+sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t owner, uint32_t * entp,
+			uint32_t index, bool create, bool meta,
+			uint32_t * ino_store)
 {
 	assert(index < SFS_BLK_NENTRY);
 	int ret;
@@ -184,15 +274,17 @@ sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t * entp, uint32_t index,
 		if (!create) {
 			goto out;
 		}
-		if ((ret = sfs_block_alloc(sfs, &ent)) != 0) {
+		if ((ret = sfs_block_alloc(sfs, owner, 1, &ent)) != 0) {
 			return ret;
 		}
 	}
 
-	if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {
+	if ((ret = sfs_block_alloc(sfs, owner, meta, &ino)) != 0) {
 		goto failed_cleanup;
 	}
-	if ((ret = sfs_wbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
+	if ((ret =
+	     sfs_wbuf(sfs, &ino, sizeof(uint32_t), ent, offset, owner,
+		      1)) != 0) {
 		sfs_block_free(sfs, ino);
 		goto failed_cleanup;
 	}
@@ -216,11 +308,14 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 		    bool create, uint32_t * ino_store)
 {
 	struct sfs_disk_inode *din = sin->din;
+	/* the blocks of a directory hold its entries */
+	bool meta = (din->type == SFS_TYPE_DIR);
 	int ret;
 	uint32_t ent, ino;
 	if (index < SFS_NDIRECT) {
 		if ((ino = din->direct[index]) == 0 && create) {
-			if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {
+			if ((ret =
+			     sfs_block_alloc(sfs, sin->ino, meta, &ino)) != 0) {
 				return ret;
 			}
 			din->direct[index] = ino;
@@ -233,8 +328,8 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	if (index < SFS_BLK_NENTRY) {
 		ent = din->indirect;
 		if ((ret =
-		     sfs_bmap_get_sub_nolock(sfs, &ent, index, create,
-					     &ino)) != 0) {
+		     sfs_bmap_get_sub_nolock(sfs, sin->ino, &ent, index,
+					     create, meta, &ino)) != 0) {
 			return ret;
 		}
 		if (ent != din->indirect) {
@@ -248,7 +343,8 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	index -= SFS_BLK_NENTRY;
 	ent = din->db_indirect;
 	if ((ret =
-	     sfs_bmap_get_sub_nolock(sfs, &ent, index / SFS_BLK_NENTRY, create,
+	     sfs_bmap_get_sub_nolock(sfs, sin->ino, &ent,
+				     index / SFS_BLK_NENTRY, create, 1,
 				     &ino)) != 0) {
 		return ret;
 	}
@@ -259,8 +355,9 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	}
 	if ((ent = ino) != 0) {
 		if ((ret =
-		     sfs_bmap_get_sub_nolock(sfs, &ent, index % SFS_BLK_NENTRY,
-					     create, &ino)) != 0) {
+		     sfs_bmap_get_sub_nolock(sfs, sin->ino, &ent,
+					     index % SFS_BLK_NENTRY, create,
+					     meta, &ino)) != 0) {
 			return ret;
 		}
 	}
@@ -273,7 +370,8 @@ out:
 }
 
 static int
-sfs_bmap_free_sub_nolock(struct sfs_fs *sfs, uint32_t ent, uint32_t index)
+sfs_bmap_free_sub_nolock(struct sfs_fs *sfs, uint32_t owner, uint32_t ent,
+			 uint32_t index)
 {
 	assert(sfs_block_inuse(sfs, ent) && index < SFS_BLK_NENTRY);
 	int ret;
@@ -284,8 +382,8 @@ sfs_bmap_free_sub_nolock(struct sfs_fs *sfs, uint32_t ent, uint32_t index)
 	}
 	if (ino != 0) {
 		if ((ret =
-		     sfs_wbuf(sfs, &zero, sizeof(uint32_t), ent,
-			      offset)) != 0) {
+		     sfs_wbuf(sfs, &zero, sizeof(uint32_t), ent, offset,
+			      owner, 1)) != 0) {
 			return ret;
 		}
 		sfs_block_free(sfs, ino);
@@ -312,7 +410,8 @@ sfs_bmap_free_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index)
 	if (index < SFS_BLK_NENTRY) {
 		if ((ent = din->indirect) != 0) {
 			if ((ret =
-			     sfs_bmap_free_sub_nolock(sfs, ent, index)) != 0) {
+			     sfs_bmap_free_sub_nolock(sfs, sin->ino, ent,
+						      index)) != 0) {
 				return ret;
 			}
 		}
@@ -322,13 +421,14 @@ sfs_bmap_free_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index)
 	index -= SFS_BLK_NENTRY;
 	if ((ent = din->db_indirect) != 0) {
 		if ((ret =
-		     sfs_bmap_get_sub_nolock(sfs, &ent, index / SFS_BLK_NENTRY,
-					     0, &ino)) != 0) {
+		     sfs_bmap_get_sub_nolock(sfs, sin->ino, &ent,
+					     index / SFS_BLK_NENTRY, 0, 1,
+					     &ino)) != 0) {
 			return ret;
 		}
 		if ((ent = ino) != 0) {
 			if ((ret =
-			     sfs_bmap_free_sub_nolock(sfs, ent,
+			     sfs_bmap_free_sub_nolock(sfs, sin->ino, ent,
 						      index %
 						      SFS_BLK_NENTRY)) != 0) {
 				return ret;
@@ -360,6 +460,36 @@ sfs_bmap_load_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	return 0;
 }
 
+/*
+ * sfs_bmap_run_nolock - map block @index of a file and count how many of the
+ * (at most @nblks) blocks from there on lie one after another on disk
+ */
+static int
+sfs_bmap_run_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
+		    uint32_t nblks, uint32_t * ino_store, uint32_t * run_store)
+{
+	struct sfs_disk_inode *din = sin->din;
+	assert(index < din->blocks && nblks != 0);
+	int ret;
+	uint32_t ino, next, run = 1;
+	if ((ret = sfs_bmap_get_nolock(sfs, sin, index, 0, &ino)) != 0) {
+		return ret;
+	}
+	while (run < nblks && index + run < din->blocks) {
+		if ((ret =
+		     sfs_bmap_get_nolock(sfs, sin, index + run, 0,
+					 &next)) != 0) {
+			return ret;
+		}
+		if (next != ino + run) {
+			break;
+		}
+		run++;
+	}
+	*ino_store = ino, *run_store = run;
+	return 0;
+}
+
 static int sfs_bmap_truncate_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
 {
 	struct sfs_disk_inode *din = sin->din;
@@ -415,7 +545,9 @@ sfs_dirent_write_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
 		goto out;
 	}
 	assert(sfs_block_inuse(sfs, ino));
-	ret = sfs_wbuf(sfs, entry, sizeof(struct sfs_disk_entry), ino, 0);
+	ret =
+	    sfs_wbuf(sfs, entry, sizeof(struct sfs_disk_entry), ino, 0,
+		     sin->ino, 1);
 out:
 	kfree(entry);
 	return ret;
@@ -531,10 +663,13 @@ sfs_dirent_create_inode(struct sfs_fs *sfs, uint16_t type,
 	}
 	memset(din, 0, sizeof(struct sfs_disk_inode));
 	din->type = type;
+	if (sfs_packed(sfs) && type == SFS_TYPE_FILE) {
+		din->flags |= SFS_DIN_INLINE;
+	}
 
 	int ret;
 	uint32_t ino;
-	if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {
+	if ((ret = sfs_inode_alloc(sfs, &ino)) != 0) {
 		goto failed_cleanup_din;
 	}
 	struct inode *node;
@@ -550,7 +685,7 @@ sfs_dirent_create_inode(struct sfs_fs *sfs, uint16_t type,
 	return 0;
 
 failed_cleanup_ino:
-	sfs_block_free(sfs, ino);
+	sfs_inode_free(sfs, ino);
 failed_cleanup_din:
 	kfree(din);
 	return ret;
@@ -601,9 +736,271 @@ static int sfs_openfile(struct inode *node, uint32_t open_flags)
 	return 0;
 }
 
+/*
+ * Delayed allocation. A write past the blocks a file has does not allocate
+ * a disk block; it fills a delayed block that gets one when it is written
+ * back, and all delayed blocks of a file get theirs in one go. The free
+ * blocks the delayed blocks will need, map blocks included, are reserved up
+ * front so write back cannot run out of space.
+ */
+
+/* # of map blocks allocated along with file block @index */
+static uint32_t sfs_bmap_overhead(uint32_t index)
+{
+	if (index < SFS_NDIRECT) {
+		return 0;
+	}
+	index -= SFS_NDIRECT;
+	if (index < SFS_BLK_NENTRY) {
+		return (index == 0);
+	}
+	index -= SFS_BLK_NENTRY;
+	return (index == 0) + (index % SFS_BLK_NENTRY == 0);
+}
+
+static struct sfs_buf *sfs_delay_lookup(struct sfs_inode *sin, uint32_t index)
+{
+	list_entry_t *list = &(sin->delay_list), *le = list;
+	while ((le = list_prev(le)) != list) {
+		struct sfs_buf *buf = le2buf(le, hash_link);
+		if (buf->blkno == index) {
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+static int
+sfs_delay_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf,
+		    size_t len, uint32_t index, off_t offset, bool write)
+{
+	struct sfs_buf *dbuf;
+	if ((dbuf = sfs_delay_lookup(sin, index)) == NULL) {
+		assert(write && index == sin->din->blocks + sin->nr_delayed);
+		uint32_t need = 1 + sfs_bmap_overhead(index);
+		if (sfs->super.unused_blocks < sfs->reserved_blocks + need) {
+			return -E_NO_MEM;
+		}
+		if ((dbuf = sfs_buf_alloc(sfs)) == NULL) {
+			return -E_NO_MEM;
+		}
+		sfs->reserved_blocks += need;
+		dbuf->blkno = index, dbuf->owner = sin->ino;
+		list_add_before(&(sin->delay_list), &(dbuf->hash_link));
+		sin->nr_delayed++;
+	}
+	if (write) {
+		memcpy(dbuf->data + offset, buf, len);
+	} else {
+		memcpy(buf, dbuf->data + offset, len);
+	}
+	return 0;
+}
+
+// sfs_delay_commit_nolock - allocate disk blocks for all delayed blocks of @sin
+static int sfs_delay_commit_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	struct sfs_disk_inode *din = sin->din;
+	int ret;
+	while (sin->nr_delayed != 0) {
+		struct sfs_buf *dbuf =
+		    le2buf(list_next(&(sin->delay_list)), hash_link);
+		uint32_t ino, index = din->blocks;
+		uint32_t need = 1 + sfs_bmap_overhead(index);
+		assert(dbuf->blkno == index);
+		sfs->reserved_blocks -= need;
+		if ((ret = sfs_bmap_load_nolock(sfs, sin, index, &ino)) != 0) {
+			sfs->reserved_blocks += need;
+			return ret;
+		}
+		list_del(&(dbuf->hash_link));
+		sin->nr_delayed--, sin->dirty = 1;
+		sfs_buf_install(sfs, dbuf, ino, sin->ino);
+	}
+	return 0;
+}
+
+// sfs_delay_drop_nolock - throw the delayed blocks of @sin away
+static void sfs_delay_drop_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	while (sin->nr_delayed != 0) {
+		struct sfs_buf *dbuf =
+		    le2buf(list_prev(&(sin->delay_list)), hash_link);
+		list_del(&(dbuf->hash_link));
+		sin->nr_delayed--;
+		sfs->reserved_blocks -= 1 + sfs_bmap_overhead(dbuf->blkno);
+		sfs_buf_free(sfs, dbuf);
+	}
+}
+
+/*
+ * sfs_inode_writeback_nolock - allocate the delayed blocks of @sin and copy
+ * its inode to the block cache, where the flusher will find both
+ */
+static int
+sfs_inode_writeback_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	int ret;
+	if ((ret = sfs_delay_commit_nolock(sfs, sin)) != 0) {
+		return ret;
+	}
+	if (sin->dirty) {
+		uint32_t blkno;
+		off_t offset;
+		sfs_inode_locate(sfs, sin->ino, &blkno, &offset);
+		sin->dirty = 0;
+		if ((ret =
+		     sfs_wbuf(sfs, sin->din, sizeof(struct sfs_disk_inode),
+			      blkno, offset, sin->ino, 1)) != 0) {
+			sin->dirty = 1;
+		}
+	}
+	return ret;
+}
+
+/*
+ * The size in an inode on disk must not cover delayed blocks, so an inode
+ * with delayed blocks waits until they are old enough to be allocated.
+ */
+static bool sfs_inode_needs_writeback(struct sfs_inode *sin, size_t age)
+{
+	/* sfs_reclaim left it to the flusher */
+	if (sin->reclaim_count == 0) {
+		return 1;
+	}
+	if (SFSInodeRemoved(sin) || sin->din->nlinks == 0) {
+		return 0;
+	}
+	if (sin->nr_delayed != 0) {
+		struct sfs_buf *dbuf =
+		    le2buf(list_next(&(sin->delay_list)), hash_link);
+		return ticks - dbuf->dirtied >= age;
+	}
+	return sin->dirty;
+}
+
+/*
+ * sfs_writeback_inodes - write back the inodes of @sfs and the delayed
+ * blocks that have been dirty for at least @age ticks, to the block cache.
+ * The inodes are collected under fs_sem but locked without it, writers take
+ * the inode lock first.
+ */
+int sfs_writeback_inodes(struct sfs_fs *sfs, size_t age)
+{
+	struct inode **nodes;
+	int i, n = 0, ret = 0;
+	lock_sfs_fs(sfs);
+	list_entry_t *list = &(sfs->inode_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		if (sfs_inode_needs_writeback(le2sin(le, inode_link), age)) {
+			n++;
+		}
+	}
+	if (n == 0 || (nodes = kmalloc(sizeof(struct inode *) * n)) == NULL) {
+		unlock_sfs_fs(sfs);
+		return (n == 0) ? 0 : -E_NO_MEM;
+	}
+	for (i = 0; (le = list_next(le)) != list && i < n;) {
+		struct sfs_inode *sin = le2sin(le, inode_link);
+		if (sfs_inode_needs_writeback(sin, age)) {
+			struct inode *node = info2node(sin, sfs_inode);
+			if (vop_ref_inc(node) == 1) {
+				sin->reclaim_count++;
+			}
+			nodes[i++] = node;
+		}
+	}
+	unlock_sfs_fs(sfs);
+
+	for (n = i, i = 0; i < n; i++) {
+		struct sfs_inode *sin = vop_info(nodes[i], sfs_inode);
+		void *handle = sfs_journal_start(sfs);
+		if (trylock_sin(sin) == 0) {
+			int err = 0;
+			if (!SFSInodeRemoved(sin) && sin->din->nlinks != 0) {
+				err = sfs_inode_writeback_nolock(sfs, sin);
+			}
+			unlock_sin(sin);
+			if (ret == 0) {
+				ret = err;
+			}
+		}
+		sfs_journal_stop(sfs, handle);
+		vop_ref_dec(nodes[i]);
+	}
+	kfree(nodes);
+	return ret;
+}
+
+/*
+ * sfs_sync_inodes - copy every dirty inode of @sfs to the block cache for the
+ * commit, which holds off all updates. Delayed blocks stay where they are,
+ * and the inode on disk does not count them.
+ */
+int sfs_sync_inodes(struct sfs_fs *sfs)
+{
+	int ret = 0;
+	lock_sfs_fs(sfs);
+	list_entry_t *list = &(sfs->inode_list), *le = list;
+	while (ret == 0 && (le = list_next(le)) != list) {
+		struct sfs_inode *sin = le2sin(le, inode_link);
+		struct sfs_disk_inode din = *(sin->din);
+		if (!sin->dirty || SFSInodeRemoved(sin) || din.nlinks == 0) {
+			continue;
+		}
+		if (sin->nr_delayed != 0) {
+			if (din.type != SFS_TYPE_DIR
+			    && din.fileinfo.size > din.blocks * SFS_BLKSIZE) {
+				din.fileinfo.size = din.blocks * SFS_BLKSIZE;
+			}
+		} else {
+			sin->dirty = 0;
+		}
+		uint32_t blkno;
+		off_t offset;
+		sfs_inode_locate(sfs, sin->ino, &blkno, &offset);
+		if ((ret =
+		     sfs_wbuf(sfs, &din, sizeof(struct sfs_disk_inode), blkno,
+			      offset, sin->ino, 1)) != 0) {
+			sin->dirty = 1;
+		}
+	}
+	unlock_sfs_fs(sfs);
+	return ret;
+}
+
+/* dirty data is left to the flusher, fsync makes it durable */
 static int sfs_close(struct inode *node)
 {
-	return vop_fsync(node);
+	return 0;
+}
+
+/*
+ * sfs_inline_expand_nolock - move the inline data of @sin to a delayed block,
+ * the file has outgrown its inode
+ */
+static int sfs_inline_expand_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	struct sfs_disk_inode *din = sin->din;
+	uint8_t data[SFS_INLINE_MAX];
+	uint32_t size = din->fileinfo.size;
+	assert((din->flags & SFS_DIN_INLINE) && din->blocks == 0
+	       && sin->nr_delayed == 0);
+	memcpy(data, din->inline_data, SFS_INLINE_MAX);
+	memset(din->inline_data, 0, SFS_INLINE_MAX);
+	din->flags &= ~SFS_DIN_INLINE;
+	if (size != 0) {
+		int ret;
+		if ((ret =
+		     sfs_delay_io_nolock(sfs, sin, data, size, 0, 0,
+					 1)) != 0) {
+			memcpy(din->inline_data, data, SFS_INLINE_MAX);
+			din->flags |= SFS_DIN_INLINE;
+			return ret;
+		}
+	}
+	sin->dirty = 1;
+	return 0;
 }
 
 static int
@@ -632,57 +1029,66 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf,
 		}
 	}
 
-	int (*sfs_buf_op) (struct sfs_fs * sfs, void *buf, size_t len,
-			   uint32_t blkno, off_t offset);
-	int (*sfs_block_op) (struct sfs_fs * sfs, void *buf, uint32_t blkno,
-			     uint32_t nblks);
-	if (write) {
-		sfs_buf_op = sfs_wbuf, sfs_block_op = sfs_wblock;
-	} else {
-		sfs_buf_op = sfs_rbuf, sfs_block_op = sfs_rblock;
-	}
-
 	int ret = 0;
 	size_t size, alen = 0;
-	uint32_t ino;
+	uint32_t ino, run;
 	uint32_t blkno = offset / SFS_BLKSIZE;
-	uint32_t nblks = endpos / SFS_BLKSIZE - blkno;
 
-	if ((blkoff = offset % SFS_BLKSIZE) != 0) {
-		size =
-		    (nblks != 0) ? (SFS_BLKSIZE - blkoff) : (endpos - offset);
-		if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
-			goto out;
-		}
-		if ((ret = sfs_buf_op(sfs, buf, size, ino, blkoff)) != 0) {
-			goto out;
-		}
-		alen += size;
-		if (nblks == 0) {
+	if (din->flags & SFS_DIN_INLINE) {
+		if (write && endpos > SFS_INLINE_MAX) {
+			if ((ret = sfs_inline_expand_nolock(sfs, sin)) != 0) {
+				return ret;
+			}
+		} else {
+			alen = endpos - offset;
+			if (write) {
+				memcpy(din->inline_data + offset, buf, alen);
+				sin->dirty = 1;
+			} else {
+				memcpy(buf, din->inline_data + offset, alen);
+			}
 			goto out;
 		}
-		buf += size, blkno++, nblks--;
 	}
 
-	size = SFS_BLKSIZE;
-	while (nblks != 0) {
-		if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
-			goto out;
+	blkoff = offset % SFS_BLKSIZE;
+	while (offset + alen < endpos) {
+		/* whole blocks next to each other on disk are read in one go */
+		if (!write && blkoff == 0 && blkno < din->blocks
+		    && (run = (endpos - offset - alen) / SFS_BLKSIZE) > 1) {
+			if ((ret =
+			     sfs_bmap_run_nolock(sfs, sin, blkno, run, &ino,
+						 &run)) != 0
+			    || (ret = sfs_rblock(sfs, buf, ino, run)) != 0) {
+				break;
+			}
+			size = run * SFS_BLKSIZE;
+			alen += size, buf += size, blkno += run;
+			continue;
 		}
-		if ((ret = sfs_block_op(sfs, buf, ino, 1)) != 0) {
-			goto out;
+		size = SFS_BLKSIZE - blkoff;
+		if (size > endpos - offset - alen) {
+			size = endpos - offset - alen;
 		}
-		alen += size, buf += size, blkno++, nblks--;
-	}
-
-	if ((size = endpos % SFS_BLKSIZE) != 0) {
-		if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
-			goto out;
+		if (blkno >= din->blocks) {
+			ret =
+			    sfs_delay_io_nolock(sfs, sin, buf, size, blkno,
+						blkoff, write);
+		} else
+		    if ((ret =
+			 sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) == 0) {
+			if (write) {
+				ret =
+				    sfs_wbuf(sfs, buf, size, ino, blkoff,
+					     sin->ino, 0);
+			} else {
+				ret = sfs_rbuf(sfs, buf, size, ino, blkoff);
+			}
 		}
-		if ((ret = sfs_buf_op(sfs, buf, size, ino, 0)) != 0) {
-			goto out;
+		if (ret != 0) {
+			break;
 		}
-		alen += size;
+		alen += size, buf += size, blkno++, blkoff = 0;
 	}
 
 out:
@@ -694,13 +1100,34 @@ out:
 	return ret;
 }
 
+// sfs_balance_dirty_nolock - keep writers from running too far ahead of the flusher
+static int sfs_balance_dirty_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	size_t nr_dirty = sfs_nr_writeback(sfs);
+	if (nr_dirty > SFS_DIRTY_BACKGROUND) {
+		sfs_wakeup_flushd();
+	}
+	if (nr_dirty <= SFS_DIRTY_LIMIT) {
+		return 0;
+	}
+	int ret;
+	if ((ret = sfs_inode_writeback_nolock(sfs, sin)) != 0) {
+		return ret;
+	}
+	return sfs_buf_flush(sfs, 0, 0);
+}
+
 static inline int sfs_io(struct inode *node, struct iobuf *iob, bool write)
 {
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	void *handle = NULL;
 	int ret;
+	if (write) {
+		handle = sfs_journal_start(sfs);
+	}
 	if ((ret = trylock_sin(sin)) != 0) {
-		return ret;
+		goto out;
 	}
 	size_t alen = iob->io_resid;
 	ret =
@@ -708,7 +1135,14 @@ static inline int sfs_io(struct inode *node, struct iobuf *iob, bool write)
 	if (alen != 0) {
 		iobuf_skip(iob, alen);
 	}
+	if (write && ret == 0) {
+		ret = sfs_balance_dirty_nolock(sfs, sin);
+	}
 	unlock_sin(sin);
+out:
+	if (write) {
+		sfs_journal_stop(sfs, handle);
+	}
 	return ret;
 }
 
@@ -732,7 +1166,7 @@ static int sfs_fstat(struct inode *node, struct stat *stat)
 	struct sfs_disk_inode *din = vop_info(node, sfs_inode)->din;
   stat->st_ino = vop_info(node, sfs_inode)->ino;
 	stat->st_nlinks = din->nlinks;
-	stat->st_blocks = din->blocks;
+	stat->st_blocks = din->blocks + vop_info(node, sfs_inode)->nr_delayed;
 	if (din->type != SFS_TYPE_DIR) {
 		stat->st_size = din->fileinfo.size;
 	} else {
@@ -759,26 +1193,39 @@ sfs_dirinfo_set_parent(struct sfs_inode *sin, struct sfs_inode *parent)
 	sin->din->dirinfo.parent = parent->ino;
 }
 
+/*
+ * Only the blocks of this file go to disk, along with the freemap blocks
+ * and superblock if allocation changed them. With a journal the running
+ * transaction commits instead, taking the fsyncs around it along.
+ */
 static int sfs_fsync(struct inode *node)
 {
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
-	if (sin->din->nlinks == 0 || !sin->dirty) {
+	if (sin->din->nlinks == 0) {
 		return 0;
 	}
+	void *handle = sfs_journal_start(sfs);
 	int ret;
-	if ((ret = trylock_sin(sin)) != 0) {
+	if ((ret = trylock_sin(sin)) == 0) {
+		ret = sfs_inode_writeback_nolock(sfs, sin);
+		unlock_sin(sin);
+	}
+	sfs_journal_stop(sfs, handle);
+	if (ret != 0) {
 		return ret;
 	}
-	if (sin->dirty) {
-		sin->dirty = 0;
-		if ((ret =
-		     sfs_wbuf(sfs, sin->din, sizeof(struct sfs_disk_inode),
-			      sin->ino, 0)) != 0) {
-			sin->dirty = 1;
-		}
+	if (sfs_journaled(sfs)) {
+		return sfs_journal_commit(sfs);
+	}
+	/* the inode table block is shared, and may belong to another inode */
+	uint32_t blkno;
+	off_t offset;
+	sfs_inode_locate(sfs, sin->ino, &blkno, &offset);
+	if ((ret = sfs_buf_flush(sfs, sin->ino, 0)) == 0
+	    && (ret = sfs_buf_sync(sfs, blkno)) == 0) {
+		ret = sfs_sync_alloc(sfs);
 	}
-	unlock_sin(sin);
 	return ret;
 }
 
@@ -827,11 +1274,13 @@ static int sfs_mkdir(struct inode *node, const char *name)
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	void *handle = sfs_journal_start(sfs);
 	int ret;
 	if ((ret = trylock_sin(sin)) == 0) {
 		ret = sfs_mkdir_nolock(sfs, sin, name);
 		unlock_sin(sin);
 	}
+	sfs_journal_stop(sfs, handle);
 	return ret;
 }
 
@@ -863,11 +1312,13 @@ sfs_link(struct inode *node, const char *name, struct inode *link_node)
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	void *handle = sfs_journal_start(sfs);
 	int ret;
 	if ((ret = trylock_sin(sin)) == 0) {
 		ret = sfs_link_nolock(sfs, sin, lnksin, name);
 		unlock_sin(sin);
 	}
+	sfs_journal_stop(sfs, handle);
 	return ret;
 }
 
@@ -970,6 +1421,7 @@ sfs_rename(struct inode *node, const char *name, struct inode *new_node,
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode), *newsin =
 	    vop_info(new_node, sfs_inode);
+	void *handle = sfs_journal_start(sfs);
 	int ret;
 	lock_sfs_mutex(sfs);
 	{
@@ -988,6 +1440,7 @@ sfs_rename(struct inode *node, const char *name, struct inode *new_node,
 		}
 	}
 	unlock_sfs_mutex(sfs);
+	sfs_journal_stop(sfs, handle);
 	return ret;
 }
 
@@ -1118,6 +1571,21 @@ static int sfs_reclaim(struct inode *node)
 {
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	void *handle;
+
+	/*
+	 * The last reference may go away under the lock of another inode,
+	 * where waiting for a commit could deadlock. The flusher reclaims
+	 * the inode later then.
+	 */
+	if (sfs_journal_trystart(sfs, &handle) != 0) {
+		lock_sfs_fs(sfs);
+		assert(sin->reclaim_count > 0);
+		sin->reclaim_count--;
+		unlock_sfs_fs(sfs);
+		sfs_wakeup_flushd();
+		return -E_BUSY;
+	}
 
 	lock_sfs_fs(sfs);
 
@@ -1130,11 +1598,12 @@ static int sfs_reclaim(struct inode *node)
 
 	if (sin->din->nlinks == 0) {
 		uint32_t nblks;
+		sfs_delay_drop_nolock(sfs, sin);
 		for (nblks = sin->din->blocks; nblks != 0; nblks--) {
 			sfs_bmap_truncate_nolock(sfs, sin);
 		}
-	} else if (sin->dirty) {
-		if ((ret = vop_fsync(node)) != 0) {
+	} else if (sin->dirty || sin->nr_delayed != 0) {
+		if ((ret = sfs_inode_writeback_nolock(sfs, sin)) != 0) {
 			goto failed_unlock;
 		}
 	}
@@ -1143,7 +1612,9 @@ static int sfs_reclaim(struct inode *node)
 	unlock_sfs_fs(sfs);
 
 	if (sin->din->nlinks == 0) {
-		sfs_block_free(sfs, sin->ino);
+		sfs_inode_free(sfs, sin->ino);
+	}
+	if (sin->din->nlinks == 0 && !(sin->din->flags & SFS_DIN_INLINE)) {
 		uint32_t ent;
 		if ((ent = sin->din->indirect) != 0) {
 			sfs_block_free(sfs, ent);
@@ -1151,17 +1622,19 @@ static int sfs_reclaim(struct inode *node)
 		if ((ent = sin->din->db_indirect) != 0) {
 			int i;
 			for (i = 0; i < SFS_BLK_NENTRY; i++) {
-				sfs_bmap_free_sub_nolock(sfs, ent, i);
+				sfs_bmap_free_sub_nolock(sfs, sin->ino, ent, i);
 			}
 			sfs_block_free(sfs, ent);
 		}
 	}
+	sfs_journal_stop(sfs, handle);
 	kfree(sin->din);
 	vop_kill(node);
 	return 0;
 
 failed_unlock:
 	unlock_sfs_fs(sfs);
+	sfs_journal_stop(sfs, handle);
 	return ret;
 }
 
@@ -1207,12 +1680,29 @@ static int sfs_truncfile(struct inode *node, off_t len)
 	int ret = 0;
 	uint32_t nblks, tblks = ROUNDUP_DIV(len, SFS_BLKSIZE);
 	if (din->fileinfo.size == len) {
-		assert(tblks == din->blocks);
+		assert((din->flags & SFS_DIN_INLINE)
+		       || tblks == din->blocks + sin->nr_delayed);
 		return 0;
 	}
 
+	void *handle = sfs_journal_start(sfs);
 	if ((ret = trylock_sin(sin)) != 0) {
-		return ret;
+		goto out;
+	}
+	if (din->flags & SFS_DIN_INLINE) {
+		if (len <= SFS_INLINE_MAX) {
+			if (len < din->fileinfo.size) {
+				memset(din->inline_data + len, 0,
+				       din->fileinfo.size - len);
+			}
+			goto out_size;
+		}
+		if ((ret = sfs_inline_expand_nolock(sfs, sin)) != 0) {
+			goto out_unlock;
+		}
+	}
+	if ((ret = sfs_delay_commit_nolock(sfs, sin)) != 0) {
+		goto out_unlock;
 	}
 	nblks = din->blocks;
 	if (nblks < tblks) {
@@ -1233,11 +1723,14 @@ static int sfs_truncfile(struct inode *node, off_t len)
 		}
 	}
 	assert(din->blocks == tblks);
+out_size:
 	din->fileinfo.size = len;
 	sin->dirty = 1;
 
 out_unlock:
 	unlock_sin(sin);
+out:
+	sfs_journal_stop(sfs, handle);
 	return ret;
 }
 
@@ -1297,11 +1790,13 @@ sfs_create(struct inode *node, const char *name, bool excl,
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	void *handle = sfs_journal_start(sfs);
 	int ret;
 	if ((ret = trylock_sin(sin)) == 0) {
 		ret = sfs_create_nolock(sfs, sin, name, excl, node_store);
 		unlock_sin(sin);
 	}
+	sfs_journal_stop(sfs, handle);
 	return ret;
 }
 
@@ -1356,6 +1851,7 @@ static int sfs_unlink(struct inode *node, const char *name)
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	void *handle = sfs_journal_start(sfs);
 	int ret;
 	lock_sfs_mutex(sfs);
 	{
@@ -1365,6 +1861,7 @@ static int sfs_unlink(struct inode *node, const char *name)
 		}
 	}
 	unlock_sfs_mutex(sfs);
+	sfs_journal_stop(sfs, handle);
 	return ret;
 }
 
@@ -1,93 +1,393 @@
 #include <types.h>
 #include <string.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <list.h>
+#include <clock.h>
 #include <dev.h>
 #include <sfs.h>
 #include <iobuf.h>
 #include <bitmap.h>
+#include <error.h>
 #include <assert.h>
 
-static int
-sfs_rwblock_nolock(struct sfs_fs *sfs, void *buf, uint32_t blkno, bool write,
-		   bool check)
+/* one dop_io for @nblks blocks that follow each other on disk */
+int
+sfs_rwblock_nolock(struct sfs_fs *sfs, void *buf, uint32_t blkno,
+		   uint32_t nblks, bool write, bool check)
 {
-	assert((blkno != 0 || !check) && blkno < sfs->super.blocks);
+	assert((blkno != 0 || !check) && nblks != 0
+	       && blkno + nblks <= sfs->super.blocks);
 	struct iobuf __iob, *iob =
-	    iobuf_init(&__iob, buf, SFS_BLKSIZE, blkno * SFS_BLKSIZE);
+	    iobuf_init(&__iob, buf, nblks * SFS_BLKSIZE, blkno * SFS_BLKSIZE);
 	return dop_io(sfs->dev, iob, write);
 }
 
+/*
+ * Block cache. Every block sfs reads or writes goes through it and is
+ * protected by io_sem. Writes only mark the cached block dirty; the
+ * flusher, fsync and sync write it back later. Clean blocks are recycled
+ * least recently used first once SFS_BCACHE_NBUF blocks are cached.
+ */
+
+static list_entry_t *sfs_buf_hash(struct sfs_fs *sfs, uint32_t blkno)
+{
+	return sfs->buf_hash + sbuf_hashfn(blkno);
+}
+
+static struct sfs_buf *sfs_buf_create(void)
+{
+	struct sfs_buf *buf;
+	if ((buf = kmalloc(sizeof(struct sfs_buf))) != NULL) {
+		if ((buf->data = kmalloc(SFS_BLKSIZE)) != NULL) {
+			buf->owner = 0, buf->dirty = buf->pinned = 0;
+			return buf;
+		}
+		kfree(buf);
+	}
+	return NULL;
+}
+
+static void sfs_buf_destroy(struct sfs_buf *buf)
+{
+	kfree(buf->data);
+	kfree(buf);
+}
+
+static struct sfs_buf *sfs_buf_lookup_nolock(struct sfs_fs *sfs,
+					     uint32_t blkno)
+{
+	list_entry_t *list = sfs_buf_hash(sfs, blkno), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct sfs_buf *buf = le2buf(le, hash_link);
+		if (buf->blkno == blkno) {
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+static void sfs_buf_hash_nolock(struct sfs_fs *sfs, struct sfs_buf *buf)
+{
+	list_add(sfs_buf_hash(sfs, buf->blkno), &(buf->hash_link));
+	list_add_before(&(sfs->lru_list), &(buf->lru_link));
+	sfs->nr_bufs++;
+}
+
+static void sfs_buf_unhash_nolock(struct sfs_fs *sfs, struct sfs_buf *buf)
+{
+	if (buf->dirty) {
+		list_del(&(buf->dirty_link));
+		sfs->nr_dirty--;
+	}
+	if (buf->pinned) {
+		buf->pinned = 0;
+		sfs->nr_pinned--;
+	}
+	list_del(&(buf->hash_link));
+	list_del(&(buf->lru_link));
+	sfs->nr_bufs--;
+}
+
+static void
+sfs_buf_dirty_nolock(struct sfs_fs *sfs, struct sfs_buf *buf, uint32_t owner)
+{
+	if (!buf->dirty) {
+		buf->dirty = 1, buf->dirtied = ticks;
+		list_add_before(&(sfs->dirty_list), &(buf->dirty_link));
+		sfs->nr_dirty++;
+	}
+	if (owner != 0) {
+		buf->owner = owner;
+	}
+}
+
+static int sfs_buf_write_nolock(struct sfs_fs *sfs, struct sfs_buf *buf)
+{
+	assert(buf->dirty && !buf->pinned);
+	int ret;
+	if ((ret =
+	     sfs_rwblock_nolock(sfs, buf->data, buf->blkno, 1, 1, 1)) == 0) {
+		buf->dirty = 0;
+		list_del(&(buf->dirty_link));
+		sfs->nr_dirty--;
+	}
+	return ret;
+}
+
+static bool
+sfs_buf_flushable(struct sfs_buf *buf, uint32_t owner)
+{
+	return buf != NULL && buf->dirty && !buf->pinned
+	    && (owner == 0 || buf->owner == owner);
+}
+
+/*
+ * write back @buf together with the dirty blocks of @owner next to it on
+ * disk, up to SFS_IO_NBLKS of them, gathered into io_buffer for one dop_io
+ */
 static int
-sfs_rwblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks,
-	    bool write)
+sfs_buf_write_run_nolock(struct sfs_fs *sfs, struct sfs_buf *buf,
+			 uint32_t owner)
 {
-	int ret = 0;
-	lock_sfs_io(sfs);
-	{
-		while (nblks != 0) {
-			if ((ret =
-			     sfs_rwblock_nolock(sfs, buf, blkno, write,
-						1)) != 0) {
-				break;
-			}
-			blkno++, nblks--;
-			buf += SFS_BLKSIZE;
+	struct sfs_buf *run[SFS_IO_NBLKS], *next;
+	uint32_t i, n = 1, blkno = buf->blkno;
+	while (n < SFS_IO_NBLKS && blkno > 1
+	       && sfs_buf_flushable(next =
+				    sfs_buf_lookup_nolock(sfs, blkno - 1),
+				    owner)) {
+		buf = next, blkno--, n++;
+	}
+	for (run[0] = buf, n = 1; n < SFS_IO_NBLKS; n++) {
+		if (!sfs_buf_flushable(next =
+				       sfs_buf_lookup_nolock(sfs, blkno + n),
+				       owner)) {
+			break;
+		}
+		run[n] = next;
+	}
+	if (n == 1) {
+		return sfs_buf_write_nolock(sfs, buf);
+	}
+	for (i = 0; i < n; i++) {
+		memcpy(sfs->io_buffer + i * SFS_BLKSIZE, run[i]->data,
+		       SFS_BLKSIZE);
+	}
+	int ret;
+	if ((ret =
+	     sfs_rwblock_nolock(sfs, sfs->io_buffer, blkno, n, 1, 1)) == 0) {
+		for (i = 0; i < n; i++) {
+			run[i]->dirty = 0;
+			list_del(&(run[i]->dirty_link));
+			sfs->nr_dirty--;
 		}
 	}
-	unlock_sfs_io(sfs);
 	return ret;
 }
 
-int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks)
+/*
+ * take the least recently used block out of a full cache, clean ones first,
+ * then the one dirty longest. Pinned blocks stay.
+ */
+static struct sfs_buf *sfs_buf_evict_nolock(struct sfs_fs *sfs)
+{
+	struct sfs_buf *buf;
+	list_entry_t *list = &(sfs->lru_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		if (!(buf = le2buf(le, lru_link))->dirty) {
+			goto out;
+		}
+	}
+	list = &(sfs->dirty_list), le = list;
+	while ((le = list_next(le)) != list) {
+		if (!(buf = le2buf(le, dirty_link))->pinned) {
+			if (sfs_buf_write_nolock(sfs, buf) != 0) {
+				return NULL;
+			}
+			goto out;
+		}
+	}
+	return NULL;
+out:
+	sfs_buf_unhash_nolock(sfs, buf);
+	buf->owner = 0;
+	return buf;
+}
+
+/*
+ * get the cached copy of @blkno, reading it in if @fill is set. When @fill
+ * is clear the caller is going to overwrite the whole block.
+ */
+static int
+sfs_buf_get_nolock(struct sfs_fs *sfs, uint32_t blkno, bool fill,
+		   struct sfs_buf **buf_store)
 {
-	return sfs_rwblock(sfs, buf, blkno, nblks, 0);
+	struct sfs_buf *buf;
+	if ((buf = sfs_buf_lookup_nolock(sfs, blkno)) != NULL) {
+		list_del(&(buf->lru_link));
+		list_add_before(&(sfs->lru_list), &(buf->lru_link));
+		goto out;
+	}
+	if (sfs->nr_bufs < SFS_BCACHE_NBUF
+	    || (buf = sfs_buf_evict_nolock(sfs)) == NULL) {
+		if ((buf = sfs_buf_create()) == NULL) {
+			return -E_NO_MEM;
+		}
+	}
+	if (fill) {
+		int ret;
+		if ((ret =
+		     sfs_rwblock_nolock(sfs, buf->data, blkno, 1, 0,
+					1)) != 0) {
+			sfs_buf_destroy(buf);
+			return ret;
+		}
+	}
+	buf->blkno = blkno;
+	sfs_buf_hash_nolock(sfs, buf);
+out:
+	*buf_store = buf;
+	return 0;
 }
 
-int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks)
+int sfs_bcache_init(struct sfs_fs *sfs)
 {
-	return sfs_rwblock(sfs, buf, blkno, nblks, 1);
+	int i;
+	if ((sfs->buf_hash =
+	     kmalloc(sizeof(list_entry_t) * SFS_BHASH_SIZE)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((sfs->io_buffer = kmalloc(SFS_IO_NBLKS * SFS_BLKSIZE)) == NULL) {
+		kfree(sfs->buf_hash);
+		return -E_NO_MEM;
+	}
+	for (i = 0; i < SFS_BHASH_SIZE; i++) {
+		list_init(sfs->buf_hash + i);
+	}
+	list_init(&(sfs->lru_list));
+	list_init(&(sfs->dirty_list));
+	sfs->nr_bufs = sfs->nr_dirty = sfs->nr_delayed = sfs->nr_pinned = 0;
+	return 0;
 }
 
-int
-sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
-	 off_t offset)
+// sfs_bcache_shrink - drop all clean blocks from the cache
+void sfs_bcache_shrink(struct sfs_fs *sfs)
+{
+	lock_sfs_io(sfs);
+	{
+		list_entry_t *list = &(sfs->lru_list), *le = list_next(list);
+		while (le != list) {
+			struct sfs_buf *buf = le2buf(le, lru_link);
+			le = list_next(le);
+			if (!buf->dirty) {
+				sfs_buf_unhash_nolock(sfs, buf);
+				sfs_buf_destroy(buf);
+			}
+		}
+	}
+	unlock_sfs_io(sfs);
+}
+
+void sfs_bcache_destroy(struct sfs_fs *sfs)
+{
+	assert(sfs->nr_dirty == 0 && sfs->nr_delayed == 0);
+	sfs_bcache_shrink(sfs);
+	assert(sfs->nr_bufs == 0);
+	kfree(sfs->io_buffer);
+	kfree(sfs->buf_hash);
+}
+
+int sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+	     off_t offset)
 {
 	assert(offset >= 0 && offset < SFS_BLKSIZE
 	       && offset + len <= SFS_BLKSIZE);
 	int ret;
+	struct sfs_buf *bp;
 	lock_sfs_io(sfs);
 	{
-		if ((ret =
-		     sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0,
-					1)) == 0) {
-			memcpy(buf, sfs->sfs_buffer + offset, len);
+		if ((ret = sfs_buf_get_nolock(sfs, blkno, 1, &bp)) == 0) {
+			memcpy(buf, bp->data + offset, len);
 		}
 	}
 	unlock_sfs_io(sfs);
 	return ret;
 }
 
+/*
+ * Metadata written on a journaled sfs is pinned to the running transaction.
+ * A block already committed is written home before it changes again, so
+ * everything in the log is home once the dirty blocks that are not pinned
+ * have been written back, and the log can start over.
+ */
+static int
+sfs_buf_pin_nolock(struct sfs_fs *sfs, struct sfs_buf *buf, bool meta)
+{
+	if (!meta || !sfs_journaled(sfs) || buf->pinned) {
+		return 0;
+	}
+	if (buf->dirty) {
+		int ret;
+		if ((ret = sfs_buf_write_nolock(sfs, buf)) != 0) {
+			return ret;
+		}
+	}
+	buf->pinned = 1;
+	sfs->nr_pinned++;
+	return 0;
+}
+
 int
 sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
-	 off_t offset)
+	 off_t offset, uint32_t owner, bool meta)
 {
 	assert(offset >= 0 && offset < SFS_BLKSIZE
 	       && offset + len <= SFS_BLKSIZE);
 	int ret;
+	struct sfs_buf *bp;
 	lock_sfs_io(sfs);
 	{
 		if ((ret =
-		     sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0,
-					1)) == 0) {
-			memcpy(sfs->sfs_buffer + offset, buf, len);
-			ret =
-			    sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1,
-					       1);
+		     sfs_buf_get_nolock(sfs, blkno, len != SFS_BLKSIZE,
+					&bp)) == 0
+		    && (ret = sfs_buf_pin_nolock(sfs, bp, meta)) == 0) {
+			memcpy(bp->data + offset, buf, len);
+			sfs_buf_dirty_nolock(sfs, bp, owner);
 		}
 	}
 	unlock_sfs_io(sfs);
 	return ret;
 }
 
+/*
+ * sfs_rblock - read @nblks blocks that follow each other on disk. Cached
+ * blocks are copied, each run of the others is read with one dop_io
+ * straight into @buf, without going through the cache.
+ */
+int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks)
+{
+	int ret = 0;
+	struct sfs_buf *bp;
+	lock_sfs_io(sfs);
+	while (nblks != 0) {
+		uint32_t n = 1;
+		if ((bp = sfs_buf_lookup_nolock(sfs, blkno)) != NULL) {
+			memcpy(buf, bp->data, SFS_BLKSIZE);
+		} else {
+			while (n < nblks
+			       && sfs_buf_lookup_nolock(sfs, blkno + n) == NULL) {
+				n++;
+			}
+			if ((ret =
+			     sfs_rwblock_nolock(sfs, buf, blkno, n, 0,
+						1)) != 0) {
+				break;
+			}
+		}
+		blkno += n, nblks -= n;
+		buf += n * SFS_BLKSIZE;
+	}
+	unlock_sfs_io(sfs);
+	return ret;
+}
+
+int
+sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks,
+	   uint32_t owner)
+{
+	int ret = 0;
+	while (nblks != 0) {
+		if ((ret =
+		     sfs_wbuf(sfs, buf, SFS_BLKSIZE, blkno, 0, owner,
+			      0)) != 0) {
+			break;
+		}
+		blkno++, nblks--;
+		buf += SFS_BLKSIZE;
+	}
+	return ret;
+}
+
 int sfs_sync_super(struct sfs_fs *sfs)
 {
 	int ret;
@@ -97,34 +397,258 @@ int sfs_sync_super(struct sfs_fs *sfs)
 		memcpy(sfs->sfs_buffer, &(sfs->super), sizeof(sfs->super));
 		ret =
 		    sfs_rwblock_nolock(sfs, sfs->sfs_buffer, SFS_BLKN_SUPER, 1,
-				       0);
+				       1, 0);
 	}
 	unlock_sfs_io(sfs);
 	return ret;
 }
 
+// write the @nblks blocks of @bitmap at @blkno marked in @dirty, a run at a time
+static int
+sfs_sync_bitmap_nolock(struct sfs_fs *sfs, struct bitmap *bitmap, bool *dirty,
+		       uint32_t blkno, uint32_t nblks)
+{
+	void *data = bitmap_getdata(bitmap, NULL);
+	uint32_t i, n;
+	int ret = 0;
+	for (i = 0; i < nblks; i += n) {
+		for (n = 0; i + n < nblks && dirty[i + n]; n++) {
+			dirty[i + n] = 0;
+		}
+		if (n == 0) {
+			n = 1;
+			continue;
+		}
+		if ((ret =
+		     sfs_rwblock_nolock(sfs, data + i * SFS_BLKSIZE, blkno + i,
+					n, 1, 1)) != 0) {
+			while (n != 0) {
+				dirty[i + (--n)] = 1;
+			}
+			break;
+		}
+	}
+	return ret;
+}
+
+// sfs_sync_freemap - write the freemap and inode bitmap blocks allocation has changed
 int sfs_sync_freemap(struct sfs_fs *sfs)
 {
-	uint32_t nblks = sfs_freemap_blocks(&(sfs->super));
-	return sfs_wblock(sfs, bitmap_getdata(sfs->freemap, NULL),
-			  SFS_BLKN_FREEMAP, nblks);
+	struct sfs_super *super = &(sfs->super);
+	int ret;
+	lock_sfs_io(sfs);
+	{
+		if ((ret =
+		     sfs_sync_bitmap_nolock(sfs, sfs->freemap,
+					    sfs->freemap_dirty,
+					    SFS_BLKN_FREEMAP,
+					    sfs_freemap_blocks(super))) == 0
+		    && sfs_packed(sfs)) {
+			ret =
+			    sfs_sync_bitmap_nolock(sfs, sfs->inodemap,
+						   sfs->inodemap_dirty,
+						   super->inodemap,
+						   sfs_inodemap_blocks(super));
+		}
+	}
+	unlock_sfs_io(sfs);
+	return ret;
+}
+
+// sfs_sync_alloc - write the superblock and freemap if block allocation changed them
+int sfs_sync_alloc(struct sfs_fs *sfs)
+{
+	int ret = 0;
+	if (sfs->super_dirty) {
+		sfs->super_dirty = 0;
+		if ((ret = sfs_sync_super(sfs)) != 0
+		    || (ret = sfs_sync_freemap(sfs)) != 0) {
+			sfs->super_dirty = 1;
+		}
+	}
+	return ret;
 }
 
-int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks)
+// copy the @nblks blocks of @bitmap at @blkno marked in @dirty to the block cache
+static int
+sfs_cache_bitmap(struct sfs_fs *sfs, struct bitmap *bitmap, bool *dirty,
+		 uint32_t blkno, uint32_t nblks)
 {
+	void *data = bitmap_getdata(bitmap, NULL);
+	uint32_t i;
 	int ret;
+	for (i = 0; i < nblks; i++, data += SFS_BLKSIZE) {
+		if (dirty[i]) {
+			if ((ret =
+			     sfs_wbuf(sfs, data, SFS_BLKSIZE, blkno + i, 0, 0,
+				      1)) != 0) {
+				return ret;
+			}
+			dirty[i] = 0;
+		}
+	}
+	return 0;
+}
+
+/*
+ * sfs_cache_alloc - copy the superblock, freemap and inode bitmap blocks
+ * allocation has changed to the block cache, as metadata of the running
+ * transaction
+ */
+int sfs_cache_alloc(struct sfs_fs *sfs)
+{
+	int ret;
+	if (!sfs->super_dirty) {
+		return 0;
+	}
+	if ((ret =
+	     sfs_cache_bitmap(sfs, sfs->freemap, sfs->freemap_dirty,
+			      SFS_BLKN_FREEMAP,
+			      sfs_freemap_blocks(&(sfs->super)))) != 0) {
+		return ret;
+	}
+	if (sfs_packed(sfs)
+	    && (ret =
+		sfs_cache_bitmap(sfs, sfs->inodemap, sfs->inodemap_dirty,
+				 sfs->super.inodemap,
+				 sfs_inodemap_blocks(&(sfs->super)))) != 0) {
+		return ret;
+	}
+	if ((ret =
+	     sfs_wbuf(sfs, &(sfs->super), sizeof(sfs->super), SFS_BLKN_SUPER,
+		      0, 0, 1)) == 0) {
+		sfs->super_dirty = 0;
+	}
+	return ret;
+}
+
+int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks,
+		    uint32_t owner, bool meta)
+{
+	int ret = 0;
+	struct sfs_buf *bp;
 	lock_sfs_io(sfs);
 	{
-		memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
 		while (nblks != 0) {
-			if ((ret =
-			     sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1,
-						1)) != 0) {
+			if ((ret = sfs_buf_get_nolock(sfs, blkno, 0, &bp)) != 0
+			    || (ret = sfs_buf_pin_nolock(sfs, bp, meta)) != 0) {
 				break;
 			}
+			memset(bp->data, 0, SFS_BLKSIZE);
+			sfs_buf_dirty_nolock(sfs, bp, owner);
 			blkno++, nblks--;
 		}
 	}
 	unlock_sfs_io(sfs);
 	return ret;
 }
+
+// sfs_buf_alloc - a zeroed delayed block, not in the cache until it gets a disk block
+struct sfs_buf *sfs_buf_alloc(struct sfs_fs *sfs)
+{
+	struct sfs_buf *buf;
+	if ((buf = sfs_buf_create()) != NULL) {
+		memset(buf->data, 0, SFS_BLKSIZE);
+		buf->dirty = 1, buf->dirtied = ticks;
+		lock_sfs_io(sfs);
+		sfs->nr_delayed++;
+		unlock_sfs_io(sfs);
+	}
+	return buf;
+}
+
+// sfs_buf_free - throw a delayed block away
+void sfs_buf_free(struct sfs_fs *sfs, struct sfs_buf *buf)
+{
+	lock_sfs_io(sfs);
+	assert(sfs->nr_delayed > 0);
+	sfs->nr_delayed--;
+	unlock_sfs_io(sfs);
+	sfs_buf_destroy(buf);
+}
+
+/*
+ * sfs_buf_install - cache a delayed block as dirty block @blkno, replacing
+ * what was cached for @blkno so far. It keeps its age.
+ */
+void
+sfs_buf_install(struct sfs_fs *sfs, struct sfs_buf *buf, uint32_t blkno,
+		uint32_t owner)
+{
+	struct sfs_buf *old;
+	size_t dirtied = buf->dirtied;
+	lock_sfs_io(sfs);
+	{
+		if ((old = sfs_buf_lookup_nolock(sfs, blkno)) != NULL) {
+			sfs_buf_unhash_nolock(sfs, old);
+			sfs_buf_destroy(old);
+		}
+		assert(sfs->nr_delayed > 0);
+		sfs->nr_delayed--;
+		buf->blkno = blkno, buf->dirty = 0;
+		sfs_buf_hash_nolock(sfs, buf);
+		sfs_buf_dirty_nolock(sfs, buf, owner);
+		buf->dirtied = dirtied;
+	}
+	unlock_sfs_io(sfs);
+}
+
+// sfs_buf_forget - drop the cached copy of a freed block, it need not be written
+void sfs_buf_forget(struct sfs_fs *sfs, uint32_t blkno)
+{
+	struct sfs_buf *buf;
+	lock_sfs_io(sfs);
+	{
+		if ((buf = sfs_buf_lookup_nolock(sfs, blkno)) != NULL) {
+			sfs_buf_unhash_nolock(sfs, buf);
+			sfs_buf_destroy(buf);
+		}
+	}
+	unlock_sfs_io(sfs);
+}
+
+// sfs_buf_sync - write back block @blkno if it is dirty, whoever it belongs to
+int sfs_buf_sync(struct sfs_fs *sfs, uint32_t blkno)
+{
+	struct sfs_buf *buf;
+	int ret = 0;
+	lock_sfs_io(sfs);
+	{
+		if (sfs_buf_flushable
+		    ((buf = sfs_buf_lookup_nolock(sfs, blkno)), 0)) {
+			ret = sfs_buf_write_nolock(sfs, buf);
+		}
+	}
+	unlock_sfs_io(sfs);
+	return ret;
+}
+
+/*
+ * sfs_buf_flush - write back the dirty blocks of inode @owner, or all of
+ * them if @owner is 0, that have been dirty for at least @age ticks. The
+ * dirty blocks next to them on disk go along, however young. Pinned blocks
+ * wait for their transaction to commit.
+ */
+int sfs_buf_flush(struct sfs_fs *sfs, uint32_t owner, size_t age)
+{
+	int ret = 0;
+	lock_sfs_io(sfs);
+	{
+		list_entry_t *list = &(sfs->dirty_list), *le = list_next(list);
+		while (le != list) {
+			struct sfs_buf *buf = le2buf(le, dirty_link);
+			if ((owner != 0 && buf->owner != owner) || buf->pinned
+			    || ticks - buf->dirtied < age) {
+				le = list_next(le);
+				continue;
+			}
+			/* a run takes more than @buf off the list, start over */
+			if ((ret = sfs_buf_write_run_nolock(sfs, buf, owner)) != 0) {
+				break;
+			}
+			le = list_next(list);
+		}
+	}
+	unlock_sfs_io(sfs);
+	return ret;
+}
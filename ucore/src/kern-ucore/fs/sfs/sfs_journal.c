@@ -0,0 +1,381 @@
+#include <types.h>
+#include <string.h>
+#include <slab.h>
+#include <list.h>
+#include <clock.h>
+#include <proc.h>
+#include <dev.h>
+#include <sfs.h>
+#include <iobuf.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+
+/*
+ * Metadata journal. Every operation that changes metadata runs between
+ * sfs_journal_start and sfs_journal_stop, and the metadata blocks it writes
+ * are pinned to the running transaction. A commit waits for the operations
+ * in flight, copies the dirty inodes, superblock and freemap to the cache,
+ * writes every other dirty block back, and logs the pinned blocks with one
+ * sequential write. Many operations share a commit. The logged blocks go
+ * home later, like any other dirty block, and mount replays what may not
+ * have got there.
+ */
+
+static uint32_t sfs_journal_checksum(uint32_t sum, const void *data)
+{
+	const uint32_t *p = data;
+	int i;
+	for (i = 0; i < SFS_BLKSIZE / sizeof(uint32_t); i++) {
+		sum = ((sum << 1) | (sum >> 31)) + p[i];
+	}
+	return sum;
+}
+
+static int
+sfs_journal_rw(struct device *dev, void *buf, uint32_t blkno, bool write)
+{
+	struct iobuf __iob, *iob =
+	    iobuf_init(&__iob, buf, SFS_BLKSIZE, blkno * SFS_BLKSIZE);
+	return dop_io(dev, iob, write);
+}
+
+static bool sfs_journal_home_valid(struct sfs_super *super, uint32_t home)
+{
+	return home < super->blocks && (home < super->journal
+					|| home >=
+					super->journal + super->journal_blocks);
+}
+
+/*
+ * find transaction @seq at @pos in the log, check that it was committed
+ * completely and store where the log goes on after it in @next_store
+ */
+static int
+sfs_journal_scan(struct device *dev, struct sfs_super *super, uint32_t pos,
+		 uint32_t seq, void *blk, void *data, uint32_t * next_store)
+{
+	struct sfs_journal_desc *desc = blk;
+	struct sfs_journal_commit *commit = blk;
+	uint32_t i, nblks = 0, sum = 0, end =
+	    super->journal + super->journal_blocks;
+	int ret;
+	while (pos < end) {
+		if ((ret = sfs_journal_rw(dev, desc, pos, 0)) != 0) {
+			return ret;
+		}
+		if (desc->seq != seq) {
+			break;
+		}
+		if (desc->magic == SFS_JCOMMIT_MAGIC) {
+			if (nblks == 0 || commit->nblks != nblks
+			    || commit->checksum != sum) {
+				break;
+			}
+			*next_store = pos + 1;
+			return 0;
+		}
+		if (desc->magic != SFS_JDESC_MAGIC
+		    || desc->nblks > SFS_JDESC_NENTRY
+		    || pos + 1 + desc->nblks >= end) {
+			break;
+		}
+		for (i = 0, pos++; i < desc->nblks; i++, pos++) {
+			if (!sfs_journal_home_valid(super, desc->home[i])) {
+				return -E_NOENT;
+			}
+			if ((ret = sfs_journal_rw(dev, data, pos, 0)) != 0) {
+				return ret;
+			}
+			sum = sfs_journal_checksum(sum, data);
+		}
+		nblks += desc->nblks;
+	}
+	return -E_NOENT;
+}
+
+// sfs_journal_apply - copy the blocks of the transaction logged in [pos, next) home
+static int
+sfs_journal_apply(struct device *dev, uint32_t pos, uint32_t next, void *blk,
+		  void *data)
+{
+	struct sfs_journal_desc *desc = blk;
+	uint32_t i;
+	int ret;
+	while (pos + 1 < next) {
+		if ((ret = sfs_journal_rw(dev, desc, pos, 0)) != 0) {
+			return ret;
+		}
+		assert(desc->magic == SFS_JDESC_MAGIC);
+		for (i = 0, pos++; i < desc->nblks; i++, pos++) {
+			if ((ret = sfs_journal_rw(dev, data, pos, 0)) != 0
+			    || (ret =
+				sfs_journal_rw(dev, data, desc->home[i],
+					       1)) != 0) {
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * sfs_journal_replay - bring the blocks on @dev up to date with every
+ * transaction committed to the journal of @super, before the fs is read.
+ * The # the next transaction gets is stored in @seq_store.
+ */
+int
+sfs_journal_replay(struct device *dev, struct sfs_super *super,
+		   uint32_t * seq_store)
+{
+	void *blk, *data;
+	int ret = -E_NO_MEM;
+	if ((blk = kmalloc(SFS_BLKSIZE)) == NULL) {
+		return ret;
+	}
+	if ((data = kmalloc(SFS_BLKSIZE)) == NULL) {
+		goto out_blk;
+	}
+	struct sfs_journal_header *header = blk;
+	if ((ret = sfs_journal_rw(dev, header, super->journal, 0)) != 0) {
+		goto out;
+	}
+	if (header->magic != SFS_JOURNAL_MAGIC) {
+		kprintf("sfs: wrong magic in journal. (%08x should be %08x).\n",
+			header->magic, SFS_JOURNAL_MAGIC);
+		ret = -E_INVAL;
+		goto out;
+	}
+
+	uint32_t seq = header->seq, first = seq, pos = super->journal + 1, next;
+	while ((ret =
+		sfs_journal_scan(dev, super, pos, seq, blk, data,
+				 &next)) == 0) {
+		if ((ret = sfs_journal_apply(dev, pos, next, blk, data)) != 0) {
+			goto out;
+		}
+		pos = next, seq++;
+	}
+	if (ret != -E_NOENT) {
+		goto out;
+	}
+	ret = 0;
+	if (seq != first) {
+		/* everything is home, start the log over */
+		memset(header, 0, SFS_BLKSIZE);
+		header->magic = SFS_JOURNAL_MAGIC, header->seq = seq;
+		if ((ret = sfs_journal_rw(dev, header, super->journal, 1)) != 0) {
+			goto out;
+		}
+		kprintf("sfs: journal: replayed %d transactions.\n",
+			seq - first);
+	}
+	*seq_store = seq;
+out:
+	kfree(data);
+out_blk:
+	kfree(blk);
+	return ret;
+}
+
+void sfs_journal_init(struct sfs_fs *sfs, uint32_t seq)
+{
+	rwsem_init(&(sfs->journal_sem));
+	sfs->jhead = sfs->super.journal + 1, sfs->jseq = seq;
+	sfs->jreset = 0, sfs->jcommitted = ticks;
+}
+
+/*
+ * sfs_journal_start - enter an operation that changes metadata, before any
+ * inode lock is taken. Operations nest, the handle returned is what
+ * sfs_journal_stop needs to leave.
+ */
+void *sfs_journal_start(struct sfs_fs *sfs)
+{
+	void *handle = current->journal_info;
+	if (sfs_journaled(sfs) && handle != sfs) {
+		down_read(&(sfs->journal_sem));
+		current->journal_info = sfs;
+	}
+	return handle;
+}
+
+/*
+ * sfs_journal_trystart - sfs_journal_start for callers that may hold the
+ * lock of an inode, and so must not wait for a commit. -E_BUSY if it would.
+ */
+int sfs_journal_trystart(struct sfs_fs *sfs, void **handle_store)
+{
+	void *handle = current->journal_info;
+	if (sfs_journaled(sfs) && handle != sfs) {
+		if (!try_down_read(&(sfs->journal_sem))) {
+			return -E_BUSY;
+		}
+		current->journal_info = sfs;
+	}
+	*handle_store = handle;
+	return 0;
+}
+
+void sfs_journal_stop(struct sfs_fs *sfs, void *handle)
+{
+	if (sfs_journaled(sfs) && handle != sfs) {
+		current->journal_info = handle;
+		up_read(&(sfs->journal_sem));
+		if (sfs->nr_pinned >= sfs_journal_txn_max(sfs)) {
+			sfs_wakeup_flushd();
+		}
+	}
+}
+
+static void sfs_journal_unpin_nolock(struct sfs_fs *sfs)
+{
+	list_entry_t *list = &(sfs->dirty_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		le2buf(le, dirty_link)->pinned = 0;
+	}
+	sfs->nr_pinned = 0;
+}
+
+static int
+sfs_journal_header_nolock(struct sfs_fs *sfs)
+{
+	struct sfs_journal_header *header = sfs->sfs_buffer;
+	memset(header, 0, SFS_BLKSIZE);
+	header->magic = SFS_JOURNAL_MAGIC, header->seq = sfs->jseq;
+	sfs->jhead = sfs->super.journal + 1, sfs->jreset = 0;
+	return sfs_rwblock_nolock(sfs, header, sfs->super.journal, 1, 1, 1);
+}
+
+/* the log is written SFS_IO_NBLKS blocks at a time through io_buffer */
+struct sfs_jlog {
+	uint32_t pos;		/* where io_buffer goes */
+	uint32_t n;		/* # of blocks in io_buffer */
+};
+
+static int sfs_jlog_flush_nolock(struct sfs_fs *sfs, struct sfs_jlog *log)
+{
+	int ret = 0;
+	if (log->n != 0) {
+		ret =
+		    sfs_rwblock_nolock(sfs, sfs->io_buffer, log->pos, log->n, 1,
+				       1);
+		log->pos += log->n, log->n = 0;
+	}
+	return ret;
+}
+
+static int
+sfs_jlog_append_nolock(struct sfs_fs *sfs, struct sfs_jlog *log,
+		       const void *data)
+{
+	memcpy(sfs->io_buffer + log->n * SFS_BLKSIZE, data, SFS_BLKSIZE);
+	if (++log->n == SFS_IO_NBLKS) {
+		return sfs_jlog_flush_nolock(sfs, log);
+	}
+	return 0;
+}
+
+/*
+ * log the pinned blocks as transaction jseq. Everything logged before is
+ * home by now, so the log starts over when it is full or a block was freed;
+ * a freed block may be in an older transaction, and replaying that would
+ * write over what the block holds now.
+ */
+static int sfs_journal_log_nolock(struct sfs_fs *sfs)
+{
+	size_t left = sfs->nr_pinned;
+	if (left == 0) {
+		return 0;
+	}
+	int ret;
+	uint32_t need = left + ROUNDUP_DIV(left, SFS_JDESC_NENTRY) + 1;
+	if (need > sfs->super.journal_blocks - 1) {
+		/* it does not fit at all, and will go home unprotected */
+		sfs->jseq++;
+		if ((ret = sfs_journal_header_nolock(sfs)) == 0) {
+			sfs_journal_unpin_nolock(sfs);
+			ret = -E_TOO_BIG;
+		}
+		return ret;
+	}
+	if (sfs->jreset
+	    || sfs->jhead + need > sfs->super.journal + sfs->super.journal_blocks) {
+		if ((ret = sfs_journal_header_nolock(sfs)) != 0) {
+			return ret;
+		}
+	}
+
+	struct sfs_jlog __log = { sfs->jhead, 0 }, *log = &__log;
+	struct sfs_journal_desc *desc = sfs->sfs_buffer;
+	list_entry_t *list = &(sfs->dirty_list), *le = list, *start;
+	uint32_t i, sum = 0;
+	while (left != 0) {
+		memset(desc, 0, SFS_BLKSIZE);
+		desc->magic = SFS_JDESC_MAGIC, desc->seq = sfs->jseq;
+		for (start = le; desc->nblks < SFS_JDESC_NENTRY
+		     && (le = list_next(le)) != list;) {
+			struct sfs_buf *buf = le2buf(le, dirty_link);
+			if (buf->pinned) {
+				desc->home[desc->nblks++] = buf->blkno;
+			}
+		}
+		assert(desc->nblks != 0 && desc->nblks <= left);
+		if ((ret = sfs_jlog_append_nolock(sfs, log, desc)) != 0) {
+			return ret;
+		}
+		for (le = start, i = 0; i < desc->nblks;) {
+			struct sfs_buf *buf =
+			    le2buf((le = list_next(le)), dirty_link);
+			if (buf->pinned) {
+				sum = sfs_journal_checksum(sum, buf->data);
+				if ((ret =
+				     sfs_jlog_append_nolock(sfs, log,
+							    buf->data)) != 0) {
+					return ret;
+				}
+				i++;
+			}
+		}
+		left -= desc->nblks;
+	}
+
+	struct sfs_journal_commit *commit = sfs->sfs_buffer;
+	memset(commit, 0, SFS_BLKSIZE);
+	commit->magic = SFS_JCOMMIT_MAGIC, commit->seq = sfs->jseq;
+	commit->nblks = sfs->nr_pinned, commit->checksum = sum;
+	if ((ret = sfs_jlog_append_nolock(sfs, log, commit)) != 0
+	    || (ret = sfs_jlog_flush_nolock(sfs, log)) != 0) {
+		return ret;
+	}
+	assert(log->pos == sfs->jhead + need);
+	sfs->jhead = log->pos, sfs->jseq++;
+	sfs_journal_unpin_nolock(sfs);
+	return 0;
+}
+
+/*
+ * sfs_journal_commit - commit the running transaction. The data blocks are
+ * written back before the metadata pointing to them is logged.
+ */
+int sfs_journal_commit(struct sfs_fs *sfs)
+{
+	assert(sfs_journaled(sfs) && current->journal_info != sfs);
+	int ret;
+	down_write(&(sfs->journal_sem));
+	if ((ret = sfs_sync_inodes(sfs)) == 0
+	    && (ret = sfs_cache_alloc(sfs)) == 0
+	    && (ret = sfs_buf_flush(sfs, 0, 0)) == 0) {
+		lock_sfs_io(sfs);
+		ret = sfs_journal_log_nolock(sfs);
+		unlock_sfs_io(sfs);
+		if (ret == -E_TOO_BIG) {
+			warn("sfs: journal: '%s': transaction too big, written in place.\n",
+			     sfs->super.info);
+			ret = sfs_buf_flush(sfs, 0, 0);
+		}
+	}
+	sfs->jcommitted = ticks;
+	up_write(&(sfs->journal_sem));
+	return ret;
+}
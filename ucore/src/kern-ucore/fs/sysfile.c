@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <error.h>
 #include <assert.h>
+#include <kio.h>
 #include <inode.h>
 #include <fd_set.h>
 #include <poll.h>
@@ -21,7 +22,8 @@
 
 #include "sysfile.h"
 
-#define IOBUF_SIZE                          4096
+/* large enough for sfs to see whole runs of blocks in one request */
+#define IOBUF_SIZE                          (64 * 1024)
 
 static void ucore_stat_to_linux_stat(const struct stat *ucore_stat, struct linux_stat *linux_stat)
 {
@@ -58,12 +60,12 @@ static int copy_path(char **to, const char *from)
 	if ((buffer = kmalloc(FS_MAX_FPATH_LEN + 1)) == NULL) {
 		return -E_NO_MEM;
 	}
-	lock_mm(mm);
+	lock_mm_read(mm);
 	if (!copy_string(mm, buffer, from, FS_MAX_FPATH_LEN + 1)) {
-		unlock_mm(mm);
+		unlock_mm_read(mm);
 		goto failed_cleanup;
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	*to = buffer;
 	return 0;
 
@@ -117,7 +119,7 @@ int sysfile_read(int fd, void *base, size_t len)
 		return alen;
 	}
 	void *buffer;
-	if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
+	if ((buffer = kmalloc((len < IOBUF_SIZE) ? len : IOBUF_SIZE)) == NULL) {
 		return -E_NO_MEM;
 	}
 
@@ -128,7 +130,7 @@ int sysfile_read(int fd, void *base, size_t len)
 		}
 		ret = file_read(fd, buffer, alen, &alen);
 		if (alen != 0) {
-			lock_mm(mm);
+			lock_mm_read(mm);
 			{
 				if (copy_to_user(mm, base, buffer, alen)) {
 					assert(len >= alen);
@@ -138,7 +140,7 @@ int sysfile_read(int fd, void *base, size_t len)
 					ret = -E_INVAL;
 				}
 			}
-			unlock_mm(mm);
+			unlock_mm_read(mm);
 		}
 		if (ret != 0 || alen == 0) {
 			goto out;
@@ -174,7 +176,7 @@ int sysfile_write(int fd, void *base, size_t len)
 		return alen;
 	}
 	void *buffer;
-	if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
+	if ((buffer = kmalloc((len < IOBUF_SIZE) ? len : IOBUF_SIZE)) == NULL) {
 		return -E_NO_MEM;
 	}
 
@@ -183,13 +185,13 @@ int sysfile_write(int fd, void *base, size_t len)
 		if ((alen = IOBUF_SIZE) > len) {
 			alen = len;
 		}
-		lock_mm(mm);
+		lock_mm_read(mm);
 		{
 			if (!copy_from_user(mm, buffer, base, alen, 0)) {
 				ret = -E_INVAL;
 			}
 		}
-		unlock_mm(mm);
+		unlock_mm_read(mm);
 		if (ret == 0) {
 			ret = file_write(fd, buffer, alen, &alen);
 			if (alen != 0) {
@@ -248,13 +250,13 @@ int sysfile_fstat(int fd, struct stat *__stat)
 		return ret;
 	}
 
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_to_user(mm, __stat, stat, sizeof(struct stat))) {
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	return ret;
 }
 
@@ -280,13 +282,13 @@ int sysfile_linux_fstat(int fd, struct linux_stat __user * buf)
 	kls->st_size = kstat->st_size;
 
 	ret = 0;
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_to_user(mm, buf, kls, sizeof(struct linux_stat))) {
 			ret = -1;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	kfree(kls);
 	return ret;
 }
@@ -302,9 +304,9 @@ int sysfile_linux_stat(const char __user *path, struct linux_stat *__user linux_
 	if ((ret = file_stat(path, &ucore_stat)) != 0) {
 		return ret;
 	}
-  lock_mm(current->mm);
+  lock_mm_read(current->mm);
 	ucore_stat_to_linux_stat(&ucore_stat, linux_stat_store);
-  unlock_mm(current->mm);
+  unlock_mm_read(current->mm);
 	return 0;
 }
 
@@ -319,9 +321,9 @@ int sysfile_linux_lstat(const char __user *path, struct linux_stat *__user linux
 	if ((ret = file_lstat(path, &ucore_stat)) != 0) {
 		return ret;
 	}
-  lock_mm(current->mm);
+  lock_mm_read(current->mm);
 	ucore_stat_to_linux_stat(&ucore_stat, linux_stat_store);
-  unlock_mm(current->mm);
+  unlock_mm_read(current->mm);
 	return 0;
 }
 
@@ -337,9 +339,9 @@ int sysfile_linux_fstat64(int fd, struct linux_stat64 __user * linux_stat_store)
 	if ((ret = file_fstat(fd, &ucore_stat)) != 0) {
 		return ret;
 	}
-  lock_mm(current->mm);
+  lock_mm_read(current->mm);
 	ucore_stat_to_linux_stat64(&ucore_stat, linux_stat_store);
-  unlock_mm(current->mm);
+  unlock_mm_read(current->mm);
 	return 0;
 }
 
@@ -354,9 +356,9 @@ int sysfile_linux_stat64(const char __user *path, struct linux_stat64 *__user li
 	if ((ret = file_stat(path, &ucore_stat)) != 0) {
 		return ret;
 	}
-  lock_mm(current->mm);
+  lock_mm_read(current->mm);
 	ucore_stat_to_linux_stat64(&ucore_stat, linux_stat_store);
-  unlock_mm(current->mm);
+  unlock_mm_read(current->mm);
 	return 0;
 }
 
@@ -371,9 +373,9 @@ int sysfile_linux_lstat64(const char __user *path, struct linux_stat64 *__user l
 	if ((ret = file_lstat(path, &ucore_stat)) != 0) {
 		return ret;
 	}
-  lock_mm(current->mm);
+  lock_mm_read(current->mm);
 	ucore_stat_to_linux_stat64(&ucore_stat, linux_stat_store);
-  unlock_mm(current->mm);
+  unlock_mm_read(current->mm);
 	return 0;
 }
 #endif /* __UCORE_64__ */
@@ -396,9 +398,9 @@ size_t sysfile_readlink(const char __user *pathname, char __user *base, size_t l
 	}
 	char *buffer = kmalloc(4096);
 	int length = 0;
-	lock_mm(current->mm);
+	lock_mm_read(current->mm);
 	ret = vop_readlink(node, buffer);
-	unlock_mm(current->mm);
+	unlock_mm_read(current->mm);
 	vop_ref_dec(node);
 	if(ret != 0) {
 		kfree(buffer);
@@ -534,7 +536,7 @@ int sysfile_getcwd(char *buf, size_t len)
 		return -E_INVAL;
 	}
 
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (user_mem_check(mm, (uintptr_t) buf, len, 1)) {
 			struct iobuf __iob, *iob =
@@ -542,7 +544,7 @@ int sysfile_getcwd(char *buf, size_t len)
 			vfs_getcwd(iob);
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	kprintf("SScwd %s %d\n", buf, len);
 	return 0;
 }
@@ -565,7 +567,7 @@ int sysfile_getdirentry(int fd, struct dirent *__direntp, uint32_t * len_store)
 	direntp->d_ino = 1;
 
 	int ret = 0;
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_from_user
 		    (mm, &(direntp->d_off), &(__direntp->d_off),
@@ -573,20 +575,20 @@ int sysfile_getdirentry(int fd, struct dirent *__direntp, uint32_t * len_store)
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 
 	if (ret != 0 || (ret = file_getdirentry(fd, direntp)) != 0) {
 		goto out;
 	}
 
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_to_user
 		    (mm, __direntp, direntp, sizeof(struct dirent))) {
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	if (len_store) {
 		*len_store = (direntp->d_name[0]) ? direntp->d_reclen : 0;
 	}
@@ -608,7 +610,7 @@ int sysfile_getdirentry64(int fd, struct dirent64 *__direntp, uint32_t * len_sto
 	direntp->d_ino = 1;
 
 	int ret = 0;
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_from_user
 		    (mm, &(direntp->d_off), &(__direntp->d_off),
@@ -616,20 +618,20 @@ int sysfile_getdirentry64(int fd, struct dirent64 *__direntp, uint32_t * len_sto
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 
 	if (ret != 0 || (ret = file_getdirentry64(fd, direntp)) != 0) {
 		goto out;
 	}
 
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_to_user
 		    (mm, __direntp, direntp, sizeof(struct dirent64))) {
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	if (len_store) {
 		*len_store = (direntp->d_name[0]) ? direntp->d_reclen : 0;
 	}
@@ -652,7 +654,7 @@ int sysfile_linux_getdents(int fd, struct linux_dirent *__dir, uint32_t count)
 	}
 	memset(dir, 0, sizeof(struct linux_dirent));
 
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_from_user
 		    (mm, &(dir->d_off), &(__dir->d_off), sizeof(dir->d_off),
@@ -660,7 +662,7 @@ int sysfile_linux_getdents(int fd, struct linux_dirent *__dir, uint32_t count)
 			ret = -1;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	direntp->offset = dir->d_off;
 
 	if (ret != 0 || (ret = file_getdirentry(fd, direntp)) != 0) {
@@ -672,13 +674,13 @@ int sysfile_linux_getdents(int fd, struct linux_dirent *__dir, uint32_t count)
 	dir->d_ino = 1;
 	strcpy(dir->d_name, direntp->name);
 
-	lock_mm(mm);
+	lock_mm_read(mm);
 	{
 		if (!copy_to_user(mm, __dir, dir, sizeof(struct linux_dirent))) {
 			ret = -1;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	ret = dir->d_reclen;
 	/* done */
 	if (!dir->d_name[0])
@@ -709,13 +711,13 @@ int sysfile_pipe(int *fd_store)
 		return -E_INVAL;
 	}
 	if ((ret = file_pipe(fd)) == 0) {
-		lock_mm(mm);
+		lock_mm_read(mm);
 		{
 			if (!copy_to_user(mm, fd_store, fd, sizeof(fd))) {
 				ret = -E_INVAL;
 			}
 		}
-		unlock_mm(mm);
+		unlock_mm_read(mm);
 		if (ret != 0) {
 			file_close(fd[0]), file_close(fd[1]);
 		}
@@ -767,7 +769,7 @@ void *sysfile_linux_mmap2(void *addr, size_t len, int prot, int flags,
 int sysfile_linux_select(int nfds, linux_fd_set_t *readfds, linux_fd_set_t *writefds,
   linux_fd_set_t *exceptfds, struct linux_timeval *timeout)
 {
-  kprintf("Entering sysfile_linux_select\n");
+  kprintf(KERN_DEBUG "Entering sysfile_linux_select\n");
   int ret;
   linux_fd_set_t *lwip_wrapper_readfds = kmalloc(sizeof(linux_fd_set_t));
   linux_fd_set_t *lwip_wrapper_writefds = kmalloc(sizeof(linux_fd_set_t));
@@ -829,7 +831,7 @@ int sysfile_linux_select(int nfds, linux_fd_set_t *readfds, linux_fd_set_t *writ
         goto out;
       }
       if(S_ISSOCK(fd_type)) {
-                kprintf("Adding excfd %d\n", i);
+                kprintf(KERN_DEBUG "Adding excfd %d\n", i);
         linux_fd_set_set(lwip_wrapper_exceptfds, i);
         socket_fds++;
       }
@@ -845,7 +847,7 @@ int sysfile_linux_select(int nfds, linux_fd_set_t *readfds, linux_fd_set_t *writ
     goto out;
   }
   else if(socket_fds != 0 && other_fds == 0) {
-      kprintf("XXXX = %x\n", *(uint32_t*)lwip_wrapper_exceptfds);
+      kprintf(KERN_DEBUG "XXXX = %x\n", *(uint32_t*)lwip_wrapper_exceptfds);
     ret = socket_lwip_select_wrapper(
       nfds, lwip_wrapper_readfds, lwip_wrapper_writefds, lwip_wrapper_exceptfds,
       ktimeout
@@ -949,10 +951,10 @@ out:
   kfree(ucore_exceptfds);
   if(ktimeout != NULL) kfree(ktimeout);
   if(writefds != NULL) {
-    kprintf("Leaving sysfile_linux_select %x %x\n", *(int*)readfds, *(int*)writefds);
+    kprintf(KERN_DEBUG "Leaving sysfile_linux_select %x %x\n", *(int*)readfds, *(int*)writefds);
   }
   else
-    kprintf("Leaving sysfile_linux_select %x\n", *(int*)readfds);
+    kprintf(KERN_DEBUG "Leaving sysfile_linux_select %x\n", *(int*)readfds);
 
   return ret;
 }
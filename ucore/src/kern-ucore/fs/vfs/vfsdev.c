@@ -15,6 +15,7 @@
 #include <error.h>
 #include <assert.h>
 #include <kio.h>
+#include <refcache.h>
 #include <devfs/devfs.h>
 
 /*
@@ -332,6 +333,8 @@ out:
 int vfs_unmount(const char *devname)
 {
 	int ret;
+	/* files mapped by a process that just exited go with its mm, a few ticks later */
+	refcache_drain();
 	lock_vdev_list();
 	vfs_dev_t *vdev;
 	if ((ret = find_mount(devname, &vdev)) != 0) {
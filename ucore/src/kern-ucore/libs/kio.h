@@ -10,6 +10,31 @@ int cons_getc(void);
 int kprintf(const char *fmt, ...);
 int vkprintf(const char *fmt, va_list ap);
 
+#ifdef UCONFIG_KMSG
+/* log level prefixes for kprintf, see libs/kmsg.h */
+#define KERN_EMERG      "<0>"
+#define KERN_ERR        "<3>"
+#define KERN_WARNING    "<4>"
+#define KERN_INFO       "<6>"
+#define KERN_DEBUG      "<7>"
+
+/* debug/kmsg.c */
+struct kmsg_record;
+void kmsg_init(void);
+int kmsg_vprintf(const char *fmt, va_list ap);
+int kmsg_read(uint32_t seq, struct kmsg_record *rec);
+uint32_t kmsg_first(void);
+void kmsg_console_flush(bool force);
+void kmsg_panic(void);
+int kmsgd_main(void *arg) __attribute__ ((noreturn));
+#else
+#define KERN_EMERG      ""
+#define KERN_ERR        ""
+#define KERN_WARNING    ""
+#define KERN_INFO       ""
+#define KERN_DEBUG      ""
+#endif
+
 /* libs/readline.c */
 char *readline(const char *prompt);
 
@@ -0,0 +1,38 @@
+#ifndef __LIBS_MPOLICY_H__
+#define __LIBS_MPOLICY_H__
+
+#include <types.h>
+
+/* SYS_set_mempolicy / SYS_mbind modes, numbered as in linux */
+#define MPOL_DEFAULT        0	// the process policy, or the local node
+#define MPOL_PREFERRED      1	// the given node first, then the nearest ones
+#define MPOL_BIND           2	// only the given nodes, nearest first
+#define MPOL_INTERLEAVE     3	// page by page over the given nodes
+#define MPOL_LOCAL          4	// the node of the faulting cpu
+#define MPOL_MAX            5
+
+/* SYS_get_mempolicy flags */
+#define MPOL_F_NODE         0x1	// return the node of the page at addr
+#define MPOL_F_ADDR         0x2	// look up the policy of the vma at addr
+#define MPOL_F_MEMS_ALLOWED 0x4	// return the online nodes
+
+/* SYS_mbind flags */
+#define MPOL_MF_STRICT      0x1
+#define MPOL_MF_MOVE        0x2
+
+#define MPOL_MAX_NODES      64	// nodemasks are one unsigned long
+
+struct numa_stat {
+	int nr_cpus;
+	size_t total_pages;
+	size_t free_pages;
+	uint8_t distance[MPOL_MAX_NODES];	// SLIT row, 10 is local
+	size_t numa_hit;	// allocated here as intended
+	size_t numa_miss;	// allocated here, intended for another node
+	size_t numa_foreign;	// intended here, allocated on another node
+	size_t interleave_hit;	// interleave policy got its node
+	size_t local_node;	// allocated here by a cpu of this node
+	size_t other_node;	// allocated here by a cpu of another node
+};
+
+#endif /* !__LIBS_MPOLICY_H__ */
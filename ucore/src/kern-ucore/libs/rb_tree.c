@@ -38,6 +38,7 @@ rb_tree *rb_tree_create(int (*compare) (rb_node * node1, rb_node * node2))
 	}
 
 	tree->compare = compare;
+	tree->augment = NULL;
 
 	if ((nil = rb_node_create()) == NULL) {
 		goto bad_node_cleanup_tree;
@@ -64,6 +65,39 @@ bad_tree:
 	return NULL;
 }
 
+/* *
+ * rb_tree_create_augmented - creates a red-black tree whose nodes carry a
+ * value computed from their subtree, like the largest key below them.
+ * @augment is called on a node whenever one of its children changes, and
+ * must look at nothing but the node and its two children.
+ * */
+rb_tree *rb_tree_create_augmented(int (*compare) (rb_node * node1,
+						   rb_node * node2),
+				  void (*augment) (rb_tree * tree,
+						   rb_node * node))
+{
+	rb_tree *tree = rb_tree_create(compare);
+	if (tree != NULL) {
+		tree->augment = augment;
+	}
+	return tree;
+}
+
+/* *
+ * rb_augment_propagate - recomputes the augmented value of @node and of
+ * all its ancestors, after what @augment reads of @node has changed.
+ * */
+void rb_augment_propagate(rb_tree * tree, rb_node * node)
+{
+	if (tree->augment == NULL) {
+		return;
+	}
+	while (node != tree->nil && node != tree->root) {
+		tree->augment(tree, node);
+		node = node->parent;
+	}
+}
+
 /* *
  * FUNC_ROTATE - rotates as described in "Introduction to Algorithm".
  *
@@ -94,6 +128,10 @@ func_name(rb_tree *tree, rb_node *x) {                          \
     }                                                           \
     y->_left = x;                                               \
     x->parent = y;                                              \
+    if (tree->augment != NULL) {                                \
+        tree->augment(tree, x);                                 \
+        tree->augment(tree, y);                                 \
+    }                                                           \
     assert(!(nil->red));                                        \
 }
 
@@ -132,6 +170,7 @@ static inline void rb_insert_binary(rb_tree * tree, rb_node * node)
 void rb_insert(rb_tree * tree, rb_node * node)
 {
 	rb_insert_binary(tree, node);
+	rb_augment_propagate(tree, node);
 	node->red = 1;
 
 	rb_node *x = node, *y;
@@ -317,6 +356,8 @@ void rb_delete(rb_tree * tree, rb_node * node)
 		z->left->parent = z->right->parent = y;
 		*y = *z;
 	}
+	/* x->parent is the lowest node whose subtree lost a node */
+	rb_augment_propagate(tree, x->parent);
 	if (need_fixup) {
 		rb_delete_fixup(tree, x);
 	}
@@ -3,6 +3,10 @@
 
 #define T_SYSCALL           0x80
 
+/* amd64: native calls made with the syscall instruction carry this bit in
+ * their number, the others are taken for linux ones */
+#define SYSCALL_NATIVE_BIT  30
+
 #define __SYS_linux         0
 
 /* syscall number */
@@ -21,6 +25,10 @@
 #define SYS_mmap            20
 #define SYS_munmap          21
 #define SYS_shmem           22
+#define SYS_madvise         23
+#define SYS_faultstat       24
+#define SYS_ksmstat         25
+#define SYS_futex           26
 #define SYS_putc            30
 #define SYS_pgdir           31
 #define SYS_sem_init        40
@@ -35,6 +43,10 @@
 #define SYS_mbox_recv       52
 #define SYS_mbox_free       53
 #define SYS_mbox_info       54
+#define SYS_mbind           60
+#define SYS_set_mempolicy   61
+#define SYS_get_mempolicy   62
+#define SYS_numa_stat       63
 #define SYS_open            100
 #define SYS_close           101
 #define SYS_read            102
@@ -75,6 +87,16 @@
 /* zhangyk May 30 2016 */
 #define SYS_debug           155
 
+/* BSD sockets, served by the linux socket syscalls */
+#define SYS_socket          160
+#define SYS_connect         161
+#define SYS_bind            162
+#define SYS_listen          163
+#define SYS_accept          164
+#define SYS_sendto          165
+#define SYS_recvfrom        166
+#define SYS_setsockopt      167
+
 /* liucong 20121109 */
 #define SYS_rf212           199
 
@@ -108,6 +130,11 @@
 /* SYS_mmap flags */
 #define MMAP_WRITE          0x00000100
 #define MMAP_STACK          0x00000200
+#define MMAP_POPULATE       0x00000400
+
+/* SYS_futex operations */
+#define FUTEX_WAIT          0
+#define FUTEX_WAKE          1
 
 #if 0
 /* VFS flags */
@@ -0,0 +1,328 @@
+#include <pmm.h>
+#include <vmm.h>
+#include <ksm.h>
+#include <proc.h>
+#include <slab.h>
+#include <sem.h>
+#include <list.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <error.h>
+#include <kio.h>
+#include <mp.h>
+
+#ifdef UCONFIG_KSM
+
+/* *
+ * ksmd - same-page merging for private anonymous memory
+ *
+ * Like kswapd, ksmd walks proc_mm_list, but it only looks at vmas marked
+ * VM_MERGEABLE by madvise(MADV_MERGEABLE), KSM_PAGES_TO_SCAN pages at a
+ * time. Each page is checksummed and then:
+ *   1 if a stable page has the same checksum and contents, the pte is
+ *     pointed at the stable page, read-only, and the page is released;
+ *   2 a zero-filled page is replaced by the shared zero page;
+ *   3 if another page with the same checksum was seen in this pass (the
+ *     unstable table), the page itself becomes a stable page, read-only.
+ *     The pages that matched it are merged with it on the next pass.
+ * Every pte is write-protected before the contents are compared, so they
+ * cannot change under ksmd. A write to a merged page then takes the usual
+ * copy-on-write path of do_pgfault: ksmd holds a reference of its own to
+ * each stable page, so the writer always gets a copy.
+ *
+ * At the end of a pass the unstable table is forgotten, and stable pages
+ * that nobody maps any more are freed.
+ * */
+
+#define KSM_HASH_SHIFT                  8
+#define KSM_HASH_SIZE                   (1 << KSM_HASH_SHIFT)
+#define KSM_UNSTABLE_SIZE               4096
+#define KSM_UNSTABLE_PROBES             8
+
+struct ksm_stable {
+	struct Page *page;
+	uint32_t checksum;
+	list_entry_t hash_link;
+};
+
+#define le2stable(le, member)               \
+    to_struct((le), struct ksm_stable, member)
+
+static list_entry_t stable_hash[KSM_HASH_SIZE];
+// checksums seen in this pass, 0 is a free slot
+static uint32_t unstable[KSM_UNSTABLE_SIZE];
+
+static struct ksm_stat ksm_stat;
+static size_t nr_wrapped;	// mms scanned to their end in this pass
+
+// held by ksmd while it scans, and by whoever reads or flushes the tables
+static semaphore_t ksm_sem;
+
+static uint32_t ksm_checksum(const void *kva)
+{
+	const uint32_t *p = kva;
+	uint32_t sum = 0x811C9DC5;
+	size_t i;
+	for (i = 0; i < PGSIZE / sizeof(uint32_t); i++) {
+		sum = (sum ^ p[i]) * 0x01000193;
+	}
+	return (sum != 0) ? sum : 1;
+}
+
+static bool ksm_page_zero(const void *kva)
+{
+	const unsigned long *p = kva;
+	size_t i;
+	for (i = 0; i < PGSIZE / sizeof(unsigned long); i++) {
+		if (p[i] != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// unstable_test_and_set - whether @sum was seen in this pass, remembering it if not
+static bool unstable_test_and_set(uint32_t sum)
+{
+	size_t i, slot = hash32(sum, 12) % KSM_UNSTABLE_SIZE;
+	for (i = 0; i < KSM_UNSTABLE_PROBES; i++) {
+		if (unstable[slot] == sum) {
+			return 1;
+		}
+		if (unstable[slot] == 0) {
+			unstable[slot] = sum;
+			return 0;
+		}
+		slot = (slot + 1) % KSM_UNSTABLE_SIZE;
+	}
+	return 0;
+}
+
+// ksm_prune - free the stable pages that only ksmd holds
+static void ksm_prune(void)
+{
+	int i;
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		list_entry_t *list = stable_hash + i, *le = list_next(list);
+		while (le != list) {
+			struct ksm_stable *stable = le2stable(le, hash_link);
+			le = list_next(le);
+			if (page_ref(stable->page) > 1) {
+				continue;
+			}
+			list_del(&(stable->hash_link));
+			if (page_ref_dec(stable->page) == 0) {
+				free_page(stable->page);
+			}
+			kfree(stable);
+			ksm_stat.pages_shared--;
+		}
+	}
+}
+
+// ksm_perm - the read-only user permission of a merged page in @vma
+static pte_perm_t ksm_perm(struct vma_struct *vma)
+{
+	pte_perm_t perm;
+	ptep_unmap(&perm);
+	ptep_set_u_read(&perm);
+#if (defined ARCH_RISCV) || (defined ARCH_RISCV64)
+	if (vma->vm_flags & VM_EXEC) {
+		ptep_set_exe(&perm);
+	}
+#endif
+	return perm;
+}
+
+// ksm_wrprotect - make the pte at @addr read-only, so the page stays as it is compared
+static void ksm_wrprotect(struct mm_struct *mm, pte_t * ptep, uintptr_t addr)
+{
+	if (ptep_s_write(ptep)) {
+		ptep_unset_s_write(ptep);
+		mp_tlb_invalidate(mm->pgdir, addr);
+	}
+}
+
+// ksm_scan_page - try to merge the page mapped at @addr, under the pt lock
+static void
+ksm_scan_page(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr)
+{
+	pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+	if (ptep == NULL || !ptep_present(ptep)) {
+		return;
+	}
+	struct Page *page = pte2page(*ptep);
+	if (page == zero_page || PageReserved(page) || PageIO(page)) {
+		return;
+	}
+	void *kva = page2kva(page);
+	uint32_t sum = ksm_checksum(kva);
+
+	list_entry_t *list = stable_hash + hash32(sum, KSM_HASH_SHIFT), *le =
+	    list;
+	while ((le = list_next(le)) != list) {
+		struct ksm_stable *stable = le2stable(le, hash_link);
+		if (stable->checksum != sum) {
+			continue;
+		}
+		if (stable->page == page) {
+			return;
+		}
+		ksm_wrprotect(mm, ptep, addr);
+		if (memcmp(kva, page2kva(stable->page), PGSIZE) == 0) {
+			page_insert(mm->pgdir, stable->page, addr, ksm_perm(vma));
+			ksm_stat.pages_merged++;
+			return;
+		}
+	}
+
+	if (zero_page != NULL && ksm_page_zero(kva)) {
+		ksm_wrprotect(mm, ptep, addr);
+		if (ksm_page_zero(kva)) {
+			page_insert(mm->pgdir, zero_page, addr, ksm_perm(vma));
+			ksm_stat.pages_zero++;
+			return;
+		}
+	}
+
+	if (unstable_test_and_set(sum)) {
+		struct ksm_stable *stable;
+		if ((stable = kmalloc(sizeof(struct ksm_stable))) == NULL) {
+			return;
+		}
+		ksm_wrprotect(mm, ptep, addr);
+		page_ref_inc(page);
+		stable->page = page;
+		stable->checksum = ksm_checksum(kva);
+		list_add(stable_hash + hash32(stable->checksum, KSM_HASH_SHIFT),
+			 &(stable->hash_link));
+		ksm_stat.pages_shared++;
+	}
+}
+
+// ksm_scan_mm - scan up to @budget pages of @mm from where the last scan stopped
+static size_t ksm_scan_mm(struct mm_struct *mm, size_t budget)
+{
+	size_t scanned = 0;
+	uintptr_t addr = mm->ksm_address;
+	struct vma_struct *vma;
+
+	lock_mm_read(mm);
+	while (scanned < budget
+	       && (vma = find_vma_intersection(mm, addr, USERTOP)) != NULL) {
+		if (addr < vma->vm_start) {
+			addr = vma->vm_start;
+		}
+		if (!(vma->vm_flags & VM_MERGEABLE)) {
+			addr = vma->vm_end;
+			continue;
+		}
+		lock_pt(mm);
+		for (; addr < vma->vm_end && scanned < budget;
+		     addr += PGSIZE, scanned++) {
+#ifdef UCONFIG_HUGEPAGE
+			pmd_t *pmdp = get_pmd(mm->pgdir, addr, 0);
+			if (pmdp != NULL && ptep_huge(pmdp)) {
+				addr = ROUNDDOWN(addr, HPAGE_SIZE) + HPAGE_SIZE - PGSIZE;
+				continue;
+			}
+#endif
+			ksm_scan_page(mm, vma, addr);
+		}
+		unlock_pt(mm);
+	}
+	if (scanned < budget) {
+		mm->ksm_address = 0;
+		nr_wrapped++;
+	} else {
+		mm->ksm_address = addr;
+	}
+	unlock_mm_read(mm);
+	return scanned;
+}
+
+// ksm_scan - scan up to @budget pages, going round proc_mm_list like kswapd
+static void ksm_scan(size_t budget)
+{
+	/* the count is only known after the first mm was taken */
+	int nr_mm = 1, i;
+	for (i = 0; i < nr_mm && budget > 0; i++) {
+		struct mm_struct *mm = proc_mm_next(&nr_mm);
+		if (mm == NULL) {
+			break;
+		}
+		size_t scanned = ksm_scan_mm(mm, budget);
+		budget -= scanned;
+		put_mm(mm);
+	}
+
+	if (nr_wrapped >= nr_mm) {
+		memset(unstable, 0, sizeof(unstable));
+		ksm_prune();
+		nr_wrapped = 0;
+		ksm_stat.full_scans++;
+	}
+}
+
+void ksm_init(void)
+{
+	int i;
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		list_init(stable_hash + i);
+	}
+	sem_init(&ksm_sem, 1);
+}
+
+int ksmd_main(void *arg)
+{
+	while (1) {
+		down(&ksm_sem);
+		ksm_scan(KSM_PAGES_TO_SCAN);
+		up(&ksm_sem);
+		do_sleep(KSM_SLEEP_TICKS);
+	}
+}
+
+// ksm_flush - free the stable pages nobody maps any more, before memory is checked
+void ksm_flush(void)
+{
+	down(&ksm_sem);
+	ksm_prune();
+	up(&ksm_sem);
+}
+
+// do_ksmstat - copy the ksmd counters to @stat
+int do_ksmstat(struct ksm_stat *stat)
+{
+	struct mm_struct *mm = current->mm;
+	struct ksm_stat s;
+	int i, ret = 0;
+	if (mm == NULL) {
+		return -E_INVAL;
+	}
+
+	down(&ksm_sem);
+	s = ksm_stat;
+	s.pages_sharing = 0;
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		list_entry_t *list = stable_hash + i, *le = list;
+		while ((le = list_next(le)) != list) {
+			struct ksm_stable *stable = le2stable(le, hash_link);
+			/* one reference is ksmd's, one the page would need anyway */
+			if (page_ref(stable->page) > 2) {
+				s.pages_sharing += page_ref(stable->page) - 2;
+			}
+		}
+	}
+	up(&ksm_sem);
+
+	lock_mm_read(mm);
+	if (!copy_to_user(mm, stat, &s, sizeof(s))) {
+		ret = -E_INVAL;
+	}
+	unlock_mm_read(mm);
+	return ret;
+}
+
+#endif /* UCONFIG_KSM */
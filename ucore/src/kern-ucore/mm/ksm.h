@@ -0,0 +1,20 @@
+#ifndef __KERN_MM_KSM_H__
+#define __KERN_MM_KSM_H__
+
+#include <types.h>
+#include <madvise.h>
+
+#ifdef UCONFIG_KSM
+
+/* pages ksmd looks at before it sleeps for KSM_SLEEP_TICKS */
+#define KSM_PAGES_TO_SCAN               256
+#define KSM_SLEEP_TICKS                 20
+
+void ksm_init(void);
+int ksmd_main(void *arg) __attribute__ ((noreturn));
+void ksm_flush(void);
+int do_ksmstat(struct ksm_stat *stat);
+
+#endif /* UCONFIG_KSM */
+
+#endif /* !__KERN_MM_KSM_H__ */
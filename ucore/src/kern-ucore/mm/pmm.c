@@ -101,6 +101,17 @@ pte_t *get_pte(pgd_t * pgdir, uintptr_t la, bool create)
 #endif
 #endif
 	}
+#ifdef UCONFIG_HUGEPAGE
+	/*
+	 * A huge mapping has no ptes. Only a caller that is going to set one
+	 * (@create) gets it split, lookups see nothing, see get_page.
+	 */
+	else if (ptep_huge(pmdp)) {
+		if (!create || split_huge_pmd(pgdir, la, pmdp) != 0) {
+			return NULL;
+		}
+	}
+#endif
 	return &((pte_t *) KADDR(PMD_ADDR(*pmdp)))[PTX(la)];
 #endif /* PTXSHIFT == PMXSHIFT */
 }
@@ -114,6 +125,16 @@ pte_t *get_pte(pgd_t * pgdir, uintptr_t la, bool create)
  */
 struct Page *get_page(pgd_t * pgdir, uintptr_t la, pte_t ** ptep_store)
 {
+#ifdef UCONFIG_HUGEPAGE
+	/* a page inside a huge mapping has no pte to store */
+	pmd_t *pmdp = get_pmd(pgdir, la, 0);
+	if (pmdp != NULL && ptep_huge(pmdp)) {
+		if (ptep_store != NULL) {
+			*ptep_store = NULL;
+		}
+		return pa2page(HPMD_ADDR(*pmdp)) + (la % HPAGE_SIZE) / PGSIZE;
+	}
+#endif
 	pte_t *ptep = get_pte(pgdir, la, 0);
 	if (ptep_store != NULL) {
 		*ptep_store = ptep;
@@ -231,8 +252,25 @@ void page_insert_pte(pgd_t * pgdir, struct Page *page, pte_t * ptep, uintptr_t l
  * @param pgdir page directory
  * @param la logical address of the page to be removed
  */
+#ifdef UCONFIG_HUGEPAGE
+// unhuge_pmd - split the huge mapping covering @la, if any, before its ptes change
+static int unhuge_pmd(pgd_t * pgdir, uintptr_t la)
+{
+	pmd_t *pmdp = get_pmd(pgdir, la, 0);
+	if (pmdp != NULL && ptep_huge(pmdp)) {
+		return split_huge_pmd(pgdir, la, pmdp);
+	}
+	return 0;
+}
+#endif
+
 void page_remove(pgd_t * pgdir, uintptr_t la)
 {
+#ifdef UCONFIG_HUGEPAGE
+	if (unhuge_pmd(pgdir, la) != 0) {
+		panic("page_remove: cannot split huge page.\n");
+	}
+#endif
 	pte_t *ptep = get_pte(pgdir, la, 0);
 	if (ptep != NULL) {
 		page_remove_pte(pgdir, la, ptep);
@@ -297,6 +335,15 @@ unmap_range_pmd(pgd_t * pgdir, pmd_t * pmd, uintptr_t base, uintptr_t start,
 			size = end - start;
 		}
 		pmd_t *pmdp = &pmd[PMX(la)];
+#ifdef UCONFIG_HUGEPAGE
+		if (ptep_huge(pmdp)) {
+			if (size == PTSIZE) {
+				unmap_huge_pmd(pgdir, base + la, pmdp);
+			} else if (split_huge_pmd(pgdir, base + la, pmdp) != 0) {
+				panic("unmap_range: cannot split huge page.\n");
+			}
+		}
+#endif
 		if (ptep_present(pmdp)) {
 			unmap_range_pte(pgdir, KADDR(PMD_ADDR(*pmdp)),
 					base + la, off, off + size);
@@ -365,6 +412,10 @@ static void exit_range_pmd(pmd_t * pmd)
 	do {
 		pmd_t *pmdp = &pmd[PMX(la)];
 		if (ptep_present(pmdp)) {
+#ifdef UCONFIG_HUGEPAGE
+			/* unmap_range has removed every huge mapping */
+			assert(!ptep_huge(pmdp));
+#endif
 			free_page(pmd2page(*pmdp)), *pmdp = 0;
 		}
 		la += PTSIZE;
@@ -418,8 +469,19 @@ copy_range(pgd_t * to, pgd_t * from, uintptr_t start, uintptr_t end, bool share)
 {
 	assert(start % PGSIZE == 0 && end % PGSIZE == 0);
 	assert(USER_ACCESS(start, end));
+#ifdef UCONFIG_HUGEPAGE
+	uintptr_t start0 = start;
+#endif
 
 	do {
+#ifdef UCONFIG_HUGEPAGE
+		/* copy-on-write works on small pages */
+		if (start % HPAGE_SIZE == 0 || start == start0) {
+			if (unhuge_pmd(from, start) != 0) {
+				return -E_NO_MEM;
+			}
+		}
+#endif
 		pte_t *ptep = get_pte(from, start, 0), *nptep;
 		if (ptep == NULL) {
 			if (get_pud(from, start, 0) == NULL) {
@@ -16,55 +16,62 @@
  * =====================================================================================
  */
 /* Reference: RadixVM: Scalable address spaces for multithreaded applications */
-#ifndef ARCH_RISCV64
 
 #include "refcache.h"
 #include <sysconf.h>
 #include <kio.h>
 #include <wait.h>
-#include <mp.h>
 #include <sync.h>
 #include <proc.h>
 #include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#ifdef ARCH_RISCV64
+#include <smp.h>
+#else
+#include <mp.h>
+#endif
 
-//#define __REFCACHE_TEST
 #if 0
 #define REFCACHE_DEBUG(...) kprintf(__VA_ARGS__)
 #else
 #define REFCACHE_DEBUG(...) 
 #endif
 
-DEFINE_PERCPU_NOINIT(struct refcache, refcaches);
+/* riscv64 has no percpu section, its struct cpu lives in a plain array */
+#ifdef ARCH_RISCV64
+static struct refcache refcaches[NCPU];
+#define refcache_of(id)		(&refcaches[id])
+#define my_refcache()		(&refcaches[myid()])
+#define refcache_ncpu()		NCPU
+#else
+static DEFINE_PERCPU_NOINIT(struct refcache, refcaches);
+#define refcache_of(id)		per_cpu_ptr(refcaches, id)
+#define my_refcache()		get_cpu_ptr(refcaches)
+#define refcache_ncpu()		(sysconf.lcpu_count)
+#endif
 
 static atomic_t global_epoch;
 static atomic_t global_epoch_left;
-
-#ifdef __REFCACHE_TEST
-static int __evict_counter = 0;
-static struct refobj __test_obj;
-static void test_on_zero(struct refobj* obj){
-	kprintf("CPU%d: free %p, evict %d\n", myid(), obj, __evict_counter);
-}
-#endif
+/* objects on a review list, or in the hands of krefcache_cleaner */
+static atomic_t nr_reviewing;
 
 void refcache_init(void)
 {
 	kprintf("refcache_init()\n");
 	int i, j;
-	for(i=0;i<sysconf.lcpu_count;i++){
-		struct refcache *r = per_cpu_ptr(refcaches, i);
+	for(i=0;i<refcache_ncpu();i++){
+		struct refcache *r = refcache_of(i);
 		assert(r!=NULL);
+		r->local_epoch = 0;
 		list_init(&r->review_head);
+		spinlock_init(&r->review_lock);
 		for(j=0;j<REF_CACHE_SLOT;j++)
-			memset(&r->way[i], 0, sizeof(struct refway));
+			memset(&r->way[j], 0, sizeof(struct refway));
 	}
+	atomic_set(&nr_reviewing, 0);
 	atomic_set(&global_epoch, 1);
-	atomic_set(&global_epoch_left, sysconf.lcpu_count);
-#ifdef __REFCACHE_TEST
-	refcache_refobj_init(&__test_obj);
-	set_refobj_callback(&__test_obj, test_on_zero);
-	refcache_refobj_inc(&__test_obj);
-#endif
+	atomic_set(&global_epoch_left, refcache_ncpu());
 }
 
 static inline unsigned int __hash_refobj(struct refobj *obj)
@@ -80,18 +87,15 @@ void refcache_refobj_init(struct refobj *obj)
 	spinlock_init(&obj->lock);
 }
 
-/* intr should be disabled */
-static void __evict(struct refway *way)
+/* intr should be disabled, lock order is review_lock, then obj->lock */
+static void __evict(struct refcache *cache, struct refway *way)
 {
 	struct refobj *obj = way->obj;
-	struct refcache * cache = get_cpu_ptr(refcaches);
 	assert(obj != NULL);
 	assert(way->delta != 0);
+	spinlock_acquire(&cache->review_lock);
 	spinlock_acquire(&obj->lock);
 	obj->refcount += way->delta;
-#ifdef __REFCACHE_TEST
-	__evict_counter++;
-#endif
 	if(obj->refcount == 0){
 		if(obj->review_epoch == 0){
 			obj->flag &= ~REFOBJ_FLAG_DIRTY;
@@ -99,11 +103,13 @@ static void __evict(struct refway *way)
 			obj->review_epoch = cache->local_epoch + 3;
 			list_add_before(&(cache->review_head), 
 					&(obj->review_link));
+			atomic_inc(&nr_reviewing);
 		}else{
 			obj->flag |= REFOBJ_FLAG_DIRTY;
 		}
 	}
 	spinlock_release(&obj->lock);
+	spinlock_release(&cache->review_lock);
 	way->obj = NULL;
 }
 
@@ -111,10 +117,13 @@ static void __evict(struct refway *way)
 
 static inline struct refway * __get_my_way(struct refobj* obj)
 {
-	struct refcache *r = get_cpu_ptr(refcaches);
+	struct refcache *r = my_refcache();
 	struct refway* way = &r->way[__hash_refobj(obj)];
 	if(way->obj!= NULL && way->obj != obj){
-		__evict(way);
+		/* a way that cancelled out may point to a released object */
+		if(way->delta != 0)
+			__evict(r, way);
+		way->obj = NULL;
 	}
 	if(way->obj == NULL){
 		way->obj = obj;
@@ -147,7 +156,7 @@ static void flush(void)
 	bool intr_flag;
 	int i;
 	local_intr_save(intr_flag);
-	struct refcache *r = get_cpu_ptr(refcaches);
+	struct refcache *r = my_refcache();
 	int ge = atomic_read(&global_epoch);
 	int nflush = 0;
 	if(ge == r->local_epoch)
@@ -160,13 +169,13 @@ static void flush(void)
 		if(way->delta != 0){
 			REFCACHE_DEBUG("RC %d %d\n", myid(), way->delta);
 			nflush ++;
-			__evict(way);
+			__evict(r, way);
 		}
 		way->obj = NULL;
 	}
 
 	if(atomic_dec_test_zero(&global_epoch_left)){
-		atomic_add(&global_epoch_left, sysconf.lcpu_count);
+		atomic_add(&global_epoch_left, refcache_ncpu());
 		atomic_inc(&global_epoch);
 	}
 done:
@@ -174,80 +183,95 @@ done:
 	REFCACHE_DEBUG("cpu%d flushed %d\n", myid(), nflush);
 }
 
-static void review(void)
+/* *
+ * review - release the objects of @r that stayed at zero for two epochs
+ * The objects are taken off the list first, onzero may sleep. They keep
+ * a review_epoch meanwhile, so that __evict does not queue them again.
+ * */
+static void review(struct refcache *r)
 {
 	bool intr_flag;
-	local_intr_save(intr_flag);
-	struct refcache *r = get_cpu_ptr(refcaches);
-	list_entry_t *list = &r->review_head, *le = list;
+	list_entry_t zero, *le;
 	int epoch = atomic_read(&global_epoch);
 	int nfree = 0, ntotal = 0;
-	while((le = list_next(le)) != list){
+	list_init(&zero);
+
+	spin_lock_irqsave(&r->review_lock, intr_flag);
+	le = list_next(&r->review_head);
+	while(le != &r->review_head){
 		struct refobj *obj = le2refobj(le, review_link);
+		le = list_next(le);
 		if(obj->review_epoch > epoch)
 			continue;
 		spinlock_acquire(&obj->lock);
 		list_del(&obj->review_link);
-		obj->review_epoch = 0;
 		ntotal ++;
 		if(obj->refcount != 0){
-			/* nothing */
+			obj->review_epoch = 0;
+			atomic_dec(&nr_reviewing);
 		}else if(obj->flag & REFOBJ_FLAG_DIRTY){
 			obj->flag &= ~REFOBJ_FLAG_DIRTY;
 			obj->review_epoch = epoch + 2;
 			list_add_before(&r->review_head, &obj->review_link);
 		}else{
-			if(obj->onzero)
-				obj->onzero(obj);
-			nfree++;
+			list_add_before(&zero, &obj->review_link);
 		}
 		spinlock_release(&obj->lock);
 	}
+	spin_unlock_irqrestore(&r->review_lock, intr_flag);
 
-	local_intr_restore(intr_flag);
+	while((le = list_next(&zero)) != &zero){
+		struct refobj *obj = le2refobj(le, review_link);
+		list_del(le);
+		if(obj->onzero == NULL || obj->onzero(obj)){
+			atomic_dec(&nr_reviewing);
+			nfree++;
+			continue;
+		}
+		spin_lock_irqsave(&r->review_lock, intr_flag);
+		spinlock_acquire(&obj->lock);
+		obj->review_epoch = atomic_read(&global_epoch) + 2;
+		list_add_before(&r->review_head, &obj->review_link);
+		spinlock_release(&obj->lock);
+		spin_unlock_irqrestore(&r->review_lock, intr_flag);
+	}
 	REFCACHE_DEBUG("%d: e %d, ntotal %d, nfree %d\n", myid(), epoch, ntotal, nfree);
-
-
 }
 
+/* called on every cpu at each clock tick, with intr disabled */
 void refcache_tick(void)
 {
 	flush();
-	review();
 }
 
-
-int krefcache_cleaner(void *arg)
+/* *
+ * refcache_drain - wait until the counts dropped so far are all released
+ * Cached deltas reach the objects within an epoch, so nothing is pending
+ * once no object was under review for two epochs.
+ * */
+void refcache_drain(void)
 {
-	int id = myid();
-	kprintf("start refcache test %d %d\n", id, current->cpu_affinity);
-	assert(current->cpu_affinity == id);
-	int i = 0;
+	int epoch = atomic_read(&global_epoch), busy = 0;
 	while(1){
-#ifdef __REFCACHE_TEST
-#define TEST_ROUND 19
-		/* basic test */
-		if(i < TEST_ROUND){
-			refcache_refobj_inc(&__test_obj);
-		}
-		if(i >= 10 && i<10+TEST_ROUND){
-			refcache_refobj_dec(&__test_obj);
-		}
-		if(i ==10+TEST_ROUND*2 && id==1){
-			/* should die soon */
-			refcache_refobj_dec(&__test_obj);
-		}else if(i>10+TEST_ROUND*2){
-			do_sleep(1);
+		int ge = atomic_read(&global_epoch);
+		if(atomic_read(&nr_reviewing) != 0){
+			busy = 1;
+		}else if(busy){
+			busy = 0;
+			epoch = ge;
+		}else if(ge >= epoch + 2){
+			break;
 		}
-		i++;
-		if(i%10==0)
-			kprintf("XX cpu%d g %d\n", id, __test_obj.refcount);
-		if(id % 4==0)
-			do_sleep(id*2);
-#else
 		do_sleep(1);
-#endif
 	}
 }
 
-#endif
+int krefcache_cleaner(void *arg)
+{
+	while(1){
+		int i;
+		for(i=0;i<refcache_ncpu();i++)
+			review(refcache_of(i));
+		do_sleep(1);
+	}
+}
@@ -18,13 +18,10 @@
 #ifndef __MM_REFCACHE_H
 #define __MM_REFCACHE_H
 
-#include <arch.h>
-#include <mp.h>
+#include <types.h>
 #include <list.h>
-#include <memlayout.h>
 #include <atomic.h>
 #include <spinlock.h>
-#include <percpu.h>
 
 #define REF_CACHE_SLOT_SHIFT 6
 #define REF_CACHE_SLOT (1<<6)
@@ -32,15 +29,22 @@
 
 /* this struct should be embedded into 
  * a reference-counted object
+ *
+ * inc/dec only touch a per core cache, the true count is only known
+ * two epochs after it was last seen reaching zero. onzero is then called
+ * by krefcache_cleaner, in process context, so it may sleep. It returns
+ * 1 once the object is released, or 0 to have the object reviewed again
+ * two epochs later, e.g. after it was taken off a list that lets others
+ * find it without holding a reference.
  */
 struct refobj{
 	/* global */
-	unsigned int refcount;
+	int refcount;
 	int review_epoch;
 	unsigned int flag;
 	list_entry_t review_link;
 	spinlock_s lock;
-	void (*onzero)(struct refobj*);
+	int (*onzero)(struct refobj*);
 };
 
 #define set_refobj_callback(obj, func) \
@@ -57,15 +61,15 @@ struct refcache
 	struct refway way[REF_CACHE_SLOT];
 	int local_epoch;
 	list_entry_t review_head;
+	spinlock_s review_lock;
 };
 
-DECLARE_PERCPU(struct refcache, refcaches);
-
 void refcache_init(void);
 void refcache_refobj_init(struct refobj *obj);
 void refcache_refobj_inc(struct refobj *obj);
 void refcache_refobj_dec(struct refobj *obj);
 void refcache_tick(void);
+void refcache_drain(void);
 
 int krefcache_cleaner(void *arg) __attribute__ ((noreturn));
 #endif
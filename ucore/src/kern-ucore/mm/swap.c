@@ -2,6 +2,7 @@
 #include <vmm.h>
 #include <swap.h>
 #include <swapfs.h>
+#include <zswap.h>
 #include <slab.h>
 #include <assert.h>
 #include <stdio.h>
@@ -76,6 +77,22 @@ swap implementation is in kswapd_main(swap.c::proj11::lab3), and the steps are s
     2.1 call swap_out_mm to try to evict N page frames in inactive page list from each process's mm struct.
     2.2 call page_launder & refill_inactive_scan to try to change some active page frames to inactive page frames and
     swap out some inactive swap page frame to swap space(disk).
+
+Working set detection (UCONFIG_WORKINGSET):
+----------------------------
+  The accessed bit alone cannot tell a page of the working set from a page used once: both are unmapped after
+one idle pass of swap_out_mm, and with a working set a little larger than memory every page is evicted just
+before it is used again. So, as in linux's workingset.c (a cheap form of CLOCK-Pro's non-resident test period):
+  1 workingset_age counts the pages evicted by page_launder (and the pages made hot). When page_launder frees
+    a page whose swap entry is still used, it stores the age in shadow_map[offset] of that entry.
+  2 When swap_in_page has to read the entry back (a refault), age - shadow is the number of pages evicted in
+    between: had memory been that much larger, the page would not have been evicted. If the distance is
+    within workingset_target(), the page is marked hot (PG_workingset).
+  3 swap_out_vma turns an idle hot page cold instead of unmapping it, so it gets one more pass before it can
+    be evicted. The pages made hot are limited to workingset_target() as well, so that in a thrashing load a
+    stable part of the working set stays in memory while the rest keeps cycling through swap.
+  There is no reverse map, so pages are still unmapped by walking the address spaces; the hot state lives in
+the swap cache page and is dropped when the page leaves the swap cache.
 */
 
 // the max offset of swap entry
@@ -125,6 +142,14 @@ static semaphore_t swap_in_sem;
 static volatile int pressure = 0;
 static wait_queue_t kswapd_done;
 
+#ifdef UCONFIG_WORKINGSET
+// the eviction age of each swap entry whose page was reclaimed, 0 for none.
+// only the low 16 bits are kept, refault distances are taken modulo 1 << 16
+static uint16_t *shadow_map;
+static unsigned int workingset_age;
+static struct workingset_stat workingset_stat;
+#endif
+
 // swap_list_init - initialize the swap list
 static void swap_list_init(swap_list_t * list)
 {
@@ -182,6 +207,12 @@ void swap_init(void)
 		mem_map[offset] = SWAP_UNUSED;
 	}
 
+#ifdef UCONFIG_WORKINGSET
+	shadow_map = kmalloc(sizeof(uint16_t) * max_swap_offset);
+	assert(shadow_map != NULL);
+	memset(shadow_map, 0, sizeof(uint16_t) * max_swap_offset);
+#endif
+
 	int i;
 	for (i = 0; i < HASH_LIST_SIZE; i++) {
 		list_init(hash_list + i);
@@ -192,6 +223,9 @@ void swap_init(void)
 	check_swap();
 	check_mm_swap();
 	check_mm_shm_swap();
+#ifdef UCONFIG_ZSWAP
+	zswap_init();
+#endif
 
 	wait_queue_init(&kswapd_done);
 	swap_init_ok = 1;
@@ -251,6 +285,81 @@ static void kswapd_wakeup_all(void)
 
 static swap_entry_t try_alloc_swap_entry(void);
 
+// swap_entry_release - mark the swap entry at @offset unused, dropping any copy kept in memory
+static void swap_entry_release(size_t offset)
+{
+	mem_map[offset] = SWAP_UNUSED;
+#ifdef UCONFIG_ZSWAP
+	zswap_invalidate(offset << 8);
+#endif
+#ifdef UCONFIG_WORKINGSET
+	shadow_map[offset] = 0;
+#endif
+}
+
+#ifdef UCONFIG_WORKINGSET
+// workingset_target - the most pages kept hot, and the longest refault distance
+//                   - that still counts as the working set
+static size_t workingset_target(void)
+{
+	return nr_used_pages() / 2;
+}
+
+// workingset_eviction - record when the page of @entry was reclaimed
+static void workingset_eviction(swap_entry_t entry)
+{
+	uint16_t age = (uint16_t)(++workingset_age);
+	shadow_map[swap_offset(entry)] = (age != 0) ? age : 1;
+	workingset_stat.nr_evicted++;
+}
+
+// workingset_refault - @page was read back for @entry, make it hot if it was
+//                    - evicted no more than workingset_target() pages ago
+static void workingset_refault(swap_entry_t entry, struct Page *page)
+{
+	size_t offset = swap_offset(entry);
+	uint16_t shadow = shadow_map[offset], distance;
+	if (shadow == 0) {
+		return;
+	}
+	shadow_map[offset] = 0;
+	workingset_stat.nr_refaults++;
+
+	distance = (uint16_t)workingset_age - shadow;
+	size_t target = workingset_target();
+	if (distance <= target && workingset_stat.nr_hot < target) {
+		SetPageWorkingset(page);
+		workingset_stat.nr_hot++;
+		workingset_age++;
+		workingset_stat.nr_activated++;
+	}
+}
+#endif /* UCONFIG_WORKINGSET */
+
+// swap_read_page - read the content of @entry, from the compressed cache when it is there
+static int swap_read_page(swap_entry_t entry, struct Page *page)
+{
+#ifdef UCONFIG_ZSWAP
+	int ret = zswap_load(entry, page);
+	if (ret != -E_NOENT) {
+		return ret;
+	}
+#endif
+	return swapfs_read(entry, page);
+}
+
+// swap_write_page - write the content of @page as @entry, to swap space only if
+//                 - the compressed cache cannot take it
+static int swap_write_page(swap_entry_t entry, struct Page *page)
+{
+#ifdef UCONFIG_ZSWAP
+	if (zswap_store(entry, page) == 0) {
+		return 0;
+	}
+#endif
+	return swapfs_write(entry, page);
+}
+
 // swap_page_add - set PG_swap flag in page, set page->index = entry, and add page to hash_list.
 //               - if entry==0, It means ???
 static bool swap_page_add(struct Page *page, swap_entry_t entry)
@@ -275,6 +384,12 @@ static void swap_page_del(struct Page *page)
 {
 	assert(PageSwap(page));
 	ClearPageSwap(page);
+#ifdef UCONFIG_WORKINGSET
+	if (PageWorkingset(page)) {
+		ClearPageWorkingset(page);
+		workingset_stat.nr_hot--;
+	}
+#endif
 	list_del(&(page->page_link));
 }
 
@@ -333,7 +448,7 @@ static swap_entry_t try_alloc_swap_entry(void)
 		} else {
 			swap_page_del(page);
 		}
-		mem_map[zero] = SWAP_UNUSED;
+		swap_entry_release(zero);
 	}
 
 	static unsigned int failed_counter = 0;
@@ -358,7 +473,7 @@ void swap_remove_entry(swap_entry_t entry)
 			swap_list_del(page);
 			swap_free_page(page);
 		}
-		mem_map[offset] = SWAP_UNUSED;
+		swap_entry_release(offset);
 	}
 }
 
@@ -411,13 +526,16 @@ int swap_in_page(swap_entry_t entry, struct Page **pagep)
 		goto failed_unlock;
 	}
 	page = newpage;
-	if (swapfs_read(entry, page) != 0) {
+	if (swap_read_page(entry, page) != 0) {
 		free_page(page);
 		ret = -E_SWAP_FAULT;
 		goto failed_unlock;
 	}
 	swap_page_add(page, entry);
 	swap_active_list_add(page);
+#ifdef UCONFIG_WORKINGSET
+	workingset_refault(entry, page);
+#endif
 
 found_unlock:
 	up(&swap_in_sem);
@@ -430,6 +548,13 @@ failed_unlock:
 	return ret;
 }
 
+// swap_lookup_page - the page of @entry if it is still in memory, without
+//                  - reading it back from swap space
+struct Page *swap_lookup_page(swap_entry_t entry)
+{
+	return swap_hash_find(entry);
+}
+
 // swap_copy_entry - copy a content of swap out page frame to a new page
 //                 - set this new page PG_swap flag and add to swap active list
 int swap_copy_entry(swap_entry_t entry, swap_entry_t * store)
@@ -470,7 +595,7 @@ static bool try_free_swap_entry(swap_entry_t entry)
 {
 	size_t offset = swap_offset(entry);
 	if (mem_map[offset] == 0) {
-		mem_map[offset] = SWAP_UNUSED;
+		swap_entry_release(offset);
 		return 1;
 	}
 	return 0;
@@ -498,7 +623,7 @@ int page_launder(void)
 			if (PageDirty(page)) {
 				ClearPageDirty(page);
 				swap_duplicate(entry);
-				if (swapfs_write(entry, page) != 0) {
+				if (swap_write_page(entry, page) != 0) {
 					SetPageDirty(page);
 				}
 				mem_map[swap_offset(entry)]--;
@@ -513,6 +638,11 @@ int page_launder(void)
 				try_free_swap_entry(entry);
 			}
 		}
+#ifdef UCONFIG_WORKINGSET
+		if (mem_map[swap_offset(entry)] != SWAP_UNUSED) {
+			workingset_eviction(entry);
+		}
+#endif
 		free_count++;
 		swap_free_page(page);
 	}
@@ -549,6 +679,21 @@ swap_out_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr,
 	size_t free_count = 0;
 	addr = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(vma->vm_end, PGSIZE);
 	while (addr < end && require != 0) {
+#ifdef UCONFIG_HUGEPAGE
+		/* a huge page is aged as a whole and only split once it is idle */
+		pmd_t *pmdp = get_pmd(mm->pgdir, addr, 0);
+		if (pmdp != NULL && ptep_huge(pmdp)) {
+			if (ptep_accessed(pmdp)) {
+				ptep_unset_accessed(pmdp);
+				mp_tlb_invalidate(mm->pgdir, ROUNDDOWN(addr, HPAGE_SIZE));
+				addr = ROUNDDOWN(addr + HPAGE_SIZE, HPAGE_SIZE);
+				continue;
+			}
+			if (split_huge_pmd(mm->pgdir, addr, pmdp) != 0) {
+				break;
+			}
+		}
+#endif
 		pte_t *ptep = get_pte(mm->pgdir, addr, 0);
 		if (ptep == NULL) {
 			if (get_pud(mm->pgdir, addr, 0) == NULL) {
@@ -563,11 +708,23 @@ swap_out_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr,
 		if (ptep_present(ptep)) {
 			struct Page *page = pte2page(*ptep);
 			assert(!PageReserved(page));
+			if (page == zero_page) {
+				goto try_next_entry;
+			}
+			/* without the flush a cached translation keeps the
+			 * bit from being set again and the page looks idle */
 			if (ptep_accessed(ptep)) {
 				ptep_unset_accessed(ptep);
 				mp_tlb_invalidate(mm->pgdir, addr);
 				goto try_next_entry;
 			}
+#ifdef UCONFIG_WORKINGSET
+			if (PageSwap(page) && PageWorkingset(page)) {
+				ClearPageWorkingset(page);
+				workingset_stat.nr_hot--;
+				goto try_next_entry;
+			}
+#endif
 			if (!PageSwap(page)) {
 				if (!swap_page_add(page, 0)) {
 					goto try_next_entry;
@@ -642,21 +799,32 @@ int swap_out_mm(struct mm_struct *mm, size_t require)
 	return free_count;
 }
 
+// swap_print_stat - print the swap lists and the working set counters
+void swap_print_stat(void)
+{
+	kprintf("swap: %d active, %d inactive pages in the swap cache\n",
+		nr_active_pages, nr_inactive_pages);
+#ifdef UCONFIG_WORKINGSET
+	kprintf("workingset: %d evicted, %d refaults, %d activated, %d hot\n",
+		workingset_stat.nr_evicted, workingset_stat.nr_refaults,
+		workingset_stat.nr_activated, workingset_stat.nr_hot);
+#endif
+}
+
 int kswapd_main(void *arg)
 {
 	int guard = 0;
 	while (1) {
 		if (pressure > 0) {
 			int needs = (pressure << 5), rounds = 16;
-			list_entry_t *list = &proc_mm_list;
-			assert(!list_empty(list));
 			while (needs > 0 && rounds-- > 0) {
-				list_entry_t *le = list_next(list);
-				list_del(le);
-				list_add_before(list, le);
-				struct mm_struct *mm = le2mm(le, proc_mm_link);
+				struct mm_struct *mm = proc_mm_next(NULL);
+				if (mm == NULL) {
+					break;
+				}
 				needs -=
 				    swap_out_mm(mm, (needs < 32) ? needs : 32);
+				put_mm(mm);
 			}
 		}
 		pressure -= page_launder();
@@ -820,6 +988,9 @@ static void check_swap(void)
 	assert(nr_inactive_pages == 0
 	       && list_empty(&(inactive_list.swap_list)));
 	assert(mem_map[1] == 1);
+#ifdef UCONFIG_WORKINGSET
+	assert(shadow_map[1] != 0);
+#endif
 
 	rp1 = alloc_page();
 	assert(rp1 != NULL);
@@ -837,11 +1008,19 @@ static void check_swap(void)
 	rp0 = pte2page(*ptep0);
 	assert(page_ref(rp0) == 1);
 	assert(PageSwap(rp0) && PageActive(rp0));
+#ifdef UCONFIG_WORKINGSET
+	// a refault right after the eviction, rp0 is hot
+	assert(shadow_map[1] == 0 && PageWorkingset(rp0));
+	assert(workingset_stat.nr_hot == 1);
+#endif
 
 	entry = try_alloc_swap_entry();
 	assert(swap_offset(entry) == 1 && mem_map[1] == SWAP_UNUSED);
 	assert(!PageSwap(rp0) && nr_active_pages == 0
 	       && nr_inactive_pages == 0);
+#ifdef UCONFIG_WORKINGSET
+	assert(!PageWorkingset(rp0) && workingset_stat.nr_hot == 0);
+#endif
 
 	// clear accessed flag
 
@@ -981,6 +1160,12 @@ static void check_swap(void)
 	for (offset = 0; offset < max_swap_offset; offset++) {
 		mem_map[offset] = SWAP_UNUSED;
 	}
+#ifdef UCONFIG_WORKINGSET
+	assert(workingset_stat.nr_hot == 0);
+	memset(shadow_map, 0, sizeof(uint16_t) * max_swap_offset);
+	memset(&workingset_stat, 0, sizeof(workingset_stat));
+	workingset_age = 0;
+#endif
 
 	assert(nr_used_pages_store == nr_used_pages());
 	assert(slab_allocated_store == slab_allocated());
@@ -29,13 +29,24 @@ extern size_t max_swap_offset;
             __offset;                                               \
         })
 
+#ifdef UCONFIG_WORKINGSET
+struct workingset_stat {
+	size_t nr_evicted;	// pages reclaimed while their swap entry was in use
+	size_t nr_refaults;	// ... and read back in afterwards
+	size_t nr_activated;	// ... soon enough to be in the working set
+	size_t nr_hot;		// working set pages in the swap cache now
+};
+#endif
+
 void swap_init(void);
 bool try_free_pages(size_t n);
+void swap_print_stat(void);
 
 void swap_remove_entry(swap_entry_t entry);
 int swap_page_count(struct Page *page);
 void swap_duplicate(swap_entry_t entry);
 int swap_in_page(swap_entry_t entry, struct Page **pagep);
+struct Page *swap_lookup_page(swap_entry_t entry);
 int swap_copy_entry(swap_entry_t entry, swap_entry_t * store);
 
 int kswapd_main(void *arg) __attribute__ ((noreturn));
@@ -19,6 +19,38 @@
 
 #define false	(0)
 
+#ifndef UCONFIG_NUMA_MEMPOLICY
+#define alloc_pages_vma(vma, addr, n) alloc_pages(n)
+#endif
+
+#ifdef UCONFIG_PREZERO_POOL
+#include <zeropool.h>
+#endif
+
+/*
+ * Reads from anonymous memory that was never written map zero_page read
+ * only, and the first write replaces it through copy-on-write. It holds a
+ * reference of its own, so it always looks shared and is never freed.
+ * ARM9 caches are virtually indexed and its faults clear the user alias of
+ * every new page, so it keeps allocating a page per read fault.
+ */
+struct Page *zero_page;
+
+// alloc_zeroed_page - a cleared page to map at @addr in @vma
+static struct Page *alloc_zeroed_page(struct vma_struct *vma, uintptr_t addr)
+{
+	struct Page *page;
+#ifdef UCONFIG_PREZERO_POOL
+	if ((page = zero_pool_get(vma, addr)) != NULL) {
+		return page;
+	}
+#endif
+	if ((page = alloc_pages_vma(vma, addr, 1)) != NULL) {
+		memset(page2kva(page), 0, PGSIZE);
+	}
+	return page;
+}
+
 /*
    vmm design include two parts: mm_struct (mm) & vma_struct (vma)
    mm is the memory manager for the set of continuous virtual memory
@@ -61,10 +93,21 @@ static void check_vmm(void);
 static void check_vma_struct(void);
 static void check_pgfault(void);
 
+/*
+ * mm->mm_sem is a reader/writer lock. lock_mm takes it exclusive, for
+ * anything that adds, removes or changes vmas. lock_mm_read takes it
+ * shared, for page faults and copies from or to user memory, so that the
+ * threads of a process fault in parallel. Page table entries changed
+ * under the shared lock are protected by mm->pt_sem.
+ *
+ * A fault taken while copying to or from user memory finds the lock
+ * already held by the same thread: mm->locked_by tells a writer,
+ * current->mm_rlocked a reader.
+ */
 void lock_mm(struct mm_struct *mm)
 {
 	if (mm != NULL) {
-		down(&(mm->mm_sem));
+		down_write(&(mm->mm_sem));
 		if (current != NULL) {
 			mm->locked_by = current->pid;
 		}
@@ -74,15 +117,15 @@ void lock_mm(struct mm_struct *mm)
 void unlock_mm(struct mm_struct *mm)
 {
 	if (mm != NULL) {
-		up(&(mm->mm_sem));
 		mm->locked_by = 0;
+		up_write(&(mm->mm_sem));
 	}
 }
 
 bool try_lock_mm(struct mm_struct *mm)
 {
 	if (mm != NULL) {
-		if (!try_down(&(mm->mm_sem))) {
+		if (!try_down_write(&(mm->mm_sem))) {
 			return 0;
 		}
 		if (current != NULL) {
@@ -92,22 +135,62 @@ bool try_lock_mm(struct mm_struct *mm)
 	return 1;
 }
 
+void lock_mm_read(struct mm_struct *mm)
+{
+	if (mm != NULL) {
+		down_read(&(mm->mm_sem));
+		if (current != NULL) {
+			current->mm_rlocked = mm;
+		}
+	}
+}
+
+void unlock_mm_read(struct mm_struct *mm)
+{
+	if (mm != NULL) {
+		if (current != NULL) {
+			current->mm_rlocked = NULL;
+		}
+		up_read(&(mm->mm_sem));
+	}
+}
+
+//mm_locked_by_current - whether the current thread holds @mm->mm_sem
+static inline bool mm_locked_by_current(struct mm_struct *mm)
+{
+	return current != NULL && (mm->locked_by == current->pid
+				   || current->mm_rlocked == mm);
+}
+
+static int vma_compare(rb_node * node1, rb_node * node2);
+static void vma_augment(rb_tree * tree, rb_node * node);
+
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *mm_create(void)
 {
 	struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
 	if (mm != NULL) {
 		list_init(&(mm->mmap_list));
-		mm->mmap_tree = NULL;
+		mm->mmap_tree = rb_tree_create_augmented(vma_compare, vma_augment);
+		if (mm->mmap_tree == NULL) {
+			kfree(mm);
+			return NULL;
+		}
 		mm->mmap_cache = NULL;
 		mm->pgdir = NULL;
 		mm->map_count = 0;
 		mm->swap_address = 0;
-		set_mm_count(mm, 0);
+		mm->ksm_address = 0;
+		refcache_refobj_init(&(mm->mm_ref));
 		mm->locked_by = 0;
 		mm->brk_start = mm->brk = 0;
 		list_init(&(mm->proc_mm_link));
-		sem_init(&(mm->mm_sem), 1);
+		rwsem_init(&(mm->mm_sem));
+		sem_init(&(mm->pt_sem), 1);
+		atomic_set(&(mm->nr_faults), 0);
+		atomic_set(&(mm->nr_major_faults), 0);
+		atomic_set(&(mm->nr_around), 0);
+		atomic_set(&(mm->nr_populated), 0);
 	}
 	return mm;
 }
@@ -121,9 +204,14 @@ struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end,
 		vma->vm_start = vm_start;
 		vma->vm_end = vm_end;
 		vma->vm_flags = vm_flags;
+		vma->vm_gap = vma->vm_gap_max = 0;
 		vma->shmem = NULL;
 		vma->shmem_off = 0;
 		vma->mfile.file = NULL;
+#ifdef UCONFIG_NUMA_MEMPOLICY
+		vma->vm_policy.mode = MPOL_DEFAULT;
+		vma->vm_policy.nodes = 0;
+#endif
 	}
 	return vma;
 }
@@ -139,63 +227,39 @@ static void vma_destroy(struct vma_struct *vma)
 	kfree(vma);
 }
 
-// find_vma_rb - find a vma  (vma->vm_start <= addr < vma_vm_end) in rb tree
-static inline struct vma_struct *find_vma_rb(rb_tree * tree, uintptr_t addr)
+// find_vma_above - find the lowest vma with vma->vm_end > addr
+static struct vma_struct *find_vma_above(struct mm_struct *mm, uintptr_t addr)
 {
+	rb_tree *tree = mm->mmap_tree;
 	rb_node *node = rb_node_root(tree);
 	struct vma_struct *vma = NULL, *tmp;
-    //kprintf("  find_vma_rb begin:: addr is %d\n",addr);
 	while (node != NULL) {
 		tmp = rbn2vma(node, rb_link);
-        //kprintf("find_vma_rb while:: vma tmp start %d, end %d, addr %d\n",tmp->vm_start, tmp->vm_end, addr);
 		if (tmp->vm_end > addr) {
 			vma = tmp;
 			if (tmp->vm_start <= addr) {
 				break;
 			}
-			vma = NULL;
 			node = rb_node_left(tree, node);
 		} else {
-			vma = NULL;
 			node = rb_node_right(tree, node);
 		}
 	}
-#if 0
-    if (vma!=NULL)
-      kprintf("  find_vma_rb end:: addr %d, vma %x, start %d, end %d\n",addr, vma, vma->vm_start, vma->vm_end);
-    else
-      kprintf("  find_vma_rb end:: vma is NULL\n");
-#endif
 	return vma;
 }
 
 // find_vma - find a vma  (vma->vm_start <= addr < vma_vm_end)
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr)
 {
-    //kprintf("find_vma begin:: addr %d\n",addr);
 	struct vma_struct *vma = NULL;
 	if (mm != NULL) {
 		vma = mm->mmap_cache;
 		if (!
 		    (vma != NULL && vma->vm_start <= addr
 		     && vma->vm_end > addr)) {
-			if (mm->mmap_tree != NULL) {
-				vma = find_vma_rb(mm->mmap_tree, addr);
-			} else {
-				bool found = 0;
-				list_entry_t *list = &(mm->mmap_list), *le =
-				    list;
-				while ((le = list_next(le)) != list) {
-					vma = le2vma(le, list_link);
-					if (vma->vm_start<=addr && addr < vma->vm_end) {
-						found = 1;
-						break;
-					}
-				}
-				if (!found) {
-					vma = NULL;
-				}
-                //kprintf("  find_vma linear:: vma %d\n",vma);
+			vma = find_vma_above(mm, addr);
+			if (vma != NULL && vma->vm_start > addr) {
+				vma = NULL;
 			}
 		}
 		if (vma != NULL) {
@@ -205,10 +269,11 @@ struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr)
 	return vma;
 }
 
+// find_vma_intersection - find the lowest vma overlapping [start, end)
 struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start,
 					 uintptr_t end)
 {
-	struct vma_struct *vma = find_vma(mm, start);
+	struct vma_struct *vma = find_vma_above(mm, start);
 	if (vma != NULL && end <= vma->vm_start) {
 		vma = NULL;
 	}
@@ -216,7 +281,7 @@ struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start,
 }
 
 // vma_compare - compare vma1->vm_start < vma2->vm_start ?
-static inline int vma_compare(rb_node * node1, rb_node * node2)
+static int vma_compare(rb_node * node1, rb_node * node2)
 {
 	struct vma_struct *vma1 = rbn2vma(node1, rb_link);
 	struct vma_struct *vma2 = rbn2vma(node2, rb_link);
@@ -224,6 +289,45 @@ static inline int vma_compare(rb_node * node1, rb_node * node2)
 	return (start1 < start2) ? -1 : (start1 > start2) ? 1 : 0;
 }
 
+/*
+ * Every vma remembers the free space in front of it (vm_gap), and every rb
+ * node the largest such gap in its subtree (vm_gap_max), so that
+ * get_unmapped_area finds a hole of a given size in O(log n).
+ */
+static void vma_augment(rb_tree * tree, rb_node * node)
+{
+	struct vma_struct *vma = rbn2vma(node, rb_link), *child;
+	rb_node *left = rb_node_left(tree, node), *right = rb_node_right(tree, node);
+	uintptr_t max = vma->vm_gap;
+	if (left != NULL && (child = rbn2vma(left, rb_link))->vm_gap_max > max) {
+		max = child->vm_gap_max;
+	}
+	if (right != NULL
+	    && (child = rbn2vma(right, rb_link))->vm_gap_max > max) {
+		max = child->vm_gap_max;
+	}
+	vma->vm_gap_max = max;
+}
+
+// vma_gap_update - recompute the gap in front of @vma, after the vma
+//                - before it or @vma->vm_start changed
+static void vma_gap_update(struct mm_struct *mm, struct vma_struct *vma)
+{
+	list_entry_t *le = list_prev(&(vma->list_link));
+	uintptr_t prev_end = (le == &(mm->mmap_list)) ? USERBASE :
+	    le2vma(le, list_link)->vm_end;
+	vma->vm_gap = (vma->vm_start > prev_end) ? vma->vm_start - prev_end : 0;
+	rb_augment_propagate(mm->mmap_tree, &(vma->rb_link));
+}
+
+// vma_next_gap_update - the same for the vma after @le, if there is one
+static void vma_next_gap_update(struct mm_struct *mm, list_entry_t * le)
+{
+	if ((le = list_next(le)) != &(mm->mmap_list)) {
+		vma_gap_update(mm, le2vma(le, list_link));
+	}
+}
+
 void vma_mapfile(struct vma_struct *vma, struct file *file, off_t off, struct fs_struct *fs_struct)
 {
 
@@ -274,40 +378,18 @@ check_vma_overlap(struct vma_struct *prev, struct vma_struct *next)
 	assert(next->vm_start < next->vm_end);
 }
 
-// insert_vma_rb - insert vma in rb tree according vma->start_addr
-static inline void
-insert_vma_rb(rb_tree * tree, struct vma_struct *vma,
-	      struct vma_struct **vma_prevp)
-{
-	rb_node *node = &(vma->rb_link), *prev;
-	rb_insert(tree, node);
-	if (vma_prevp != NULL) {
-		prev = rb_node_prev(tree, node);
-		*vma_prevp = (prev != NULL) ? rbn2vma(prev, rb_link) : NULL;
-	}
-}
-
 // insert_vma_struct -insert vma in mm's rb tree link & list link
 void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 {
 	assert(vma->vm_start < vma->vm_end);
 	list_entry_t *list = &(mm->mmap_list);
 	list_entry_t *le_prev = list, *le_next;
-	if (mm->mmap_tree != NULL) {
-		struct vma_struct *mmap_prev;
-		insert_vma_rb(mm->mmap_tree, vma, &mmap_prev);
-		if (mmap_prev != NULL) {
-			le_prev = &(mmap_prev->list_link);
-		}
-	} else {
-		list_entry_t *le = list;
-		while ((le = list_next(le)) != list) {
-			struct vma_struct *mmap_prev = le2vma(le, list_link);
-			if (mmap_prev->vm_start > vma->vm_start) {
-				break;
-			}
-			le_prev = le;
-		}
+	rb_node *node = &(vma->rb_link), *prev;
+
+	vma->vm_gap = vma->vm_gap_max = 0;
+	rb_insert(mm->mmap_tree, node);
+	if ((prev = rb_node_prev(mm->mmap_tree, node)) != NULL) {
+		le_prev = &(rbn2vma(prev, rb_link)->list_link);
 	}
 
 	le_next = list_next(le_prev);
@@ -322,31 +404,20 @@ void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 
 	vma->vm_mm = mm;
 	list_add_after(le_prev, &(vma->list_link));
+	vma_gap_update(mm, vma);
+	vma_next_gap_update(mm, &(vma->list_link));
 
 	mm->map_count++;
-	if (mm->mmap_tree == NULL && mm->map_count >= RB_MIN_MAP_COUNT) {
-
-		/* try to build red-black tree now, but may fail. */
-		mm->mmap_tree = rb_tree_create(vma_compare);
-
-		if (mm->mmap_tree != NULL) {
-			list_entry_t *list = &(mm->mmap_list), *le = list;
-			while ((le = list_next(le)) != list) {
-				insert_vma_rb(mm->mmap_tree,
-					      le2vma(le, list_link), NULL);
-			}
-		}
-	}
 }
 
 // remove_vma_struct - remove vma from mm's rb tree link & list link
 static int remove_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 {
 	assert(mm == vma->vm_mm);
-	if (mm->mmap_tree != NULL) {
-		rb_delete(mm->mmap_tree, &(vma->rb_link));
-	}
+	list_entry_t *le_prev = list_prev(&(vma->list_link));
+	rb_delete(mm->mmap_tree, &(vma->rb_link));
 	list_del(&(vma->list_link));
+	vma_next_gap_update(mm, le_prev);
 	if (vma == mm->mmap_cache) {
 		mm->mmap_cache = NULL;
 	}
@@ -357,10 +428,7 @@ static int remove_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 // mm_destroy - free mm and mm internal fields
 void mm_destroy(struct mm_struct *mm)
 {
-	assert(mm_count(mm) == 0);
-	if (mm->mmap_tree != NULL) {
-		rb_tree_destroy(mm->mmap_tree);
-	}
+	rb_tree_destroy(mm->mmap_tree);
 	list_entry_t *list = &(mm->mmap_list), *le;
 	while ((le = list_next(list)) != list) {
 		list_del(le);
@@ -373,6 +441,13 @@ void mm_destroy(struct mm_struct *mm)
 //          - now just call check_vmm to check correctness of vmm
 void vmm_init(void)
 {
+#ifndef ARCH_ARM
+	if ((zero_page = alloc_page()) == NULL) {
+		panic("vmm_init: no memory for the zero page.\n");
+	}
+	memset(page2kva(zero_page), 0, PGSIZE);
+	page_ref_inc(zero_page);
+#endif
 	check_vmm();
 }
 
@@ -391,7 +466,7 @@ mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
 	int ret = -E_INVAL;
 
 	struct vma_struct *vma;
-	if ((vma = find_vma(mm, start)) != NULL && end > vma->vm_start) {
+	if (find_vma_intersection(mm, start, end) != NULL) {
 		goto out;
 	}
 	ret = -E_NO_MEM;
@@ -446,6 +521,30 @@ static void vma_resize(struct vma_struct *vma, uintptr_t start, uintptr_t end)
 	vma->vm_start = start, vma->vm_end = end;
 }
 
+// split_vma - split @vma at @addr: a new vma takes [vm_start, addr) and
+//           - @vma keeps [addr, vm_end)
+int split_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr)
+{
+	assert(addr % PGSIZE == 0);
+	assert(vma->vm_start < addr && addr < vma->vm_end);
+	struct vma_struct *nvma;
+	if ((nvma = vma_create(vma->vm_start, addr, vma->vm_flags)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if (vma->vm_flags & VM_SHARE) {
+		nvma->shmem = vma->shmem;
+		nvma->shmem_off = vma->shmem_off;
+		shmem_ref_inc(vma->shmem);
+	}
+	vma_copymapfile(nvma, vma);
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	nvma->vm_policy = vma->vm_policy;
+#endif
+	vma_resize(vma, addr, vma->vm_end);
+	insert_vma_struct(mm, nvma);
+	return 0;
+}
+
 int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len)
 {
 	uintptr_t start = ROUNDDOWN(addr, PGSIZE), end =
@@ -457,7 +556,7 @@ int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len)
 	assert(mm != NULL);
 
 	struct vma_struct *vma;
-	if ((vma = find_vma(mm, start)) == NULL || end <= vma->vm_start) {
+	if ((vma = find_vma_intersection(mm, start, end)) == NULL) {
 		return 0;
 	}
 
@@ -468,6 +567,9 @@ int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len)
 			return -E_NO_MEM;
 		}
 		vma_copymapfile(nvma, vma);
+#ifdef UCONFIG_NUMA_MEMPOLICY
+		nvma->vm_policy = vma->vm_policy;
+#endif
 		vma_resize(vma, end, vma->vm_end);
 		insert_vma_struct(mm, nvma);
 		unmap_range(mm->pgdir, start, end);
@@ -522,7 +624,7 @@ int mm_unmap_keep_pages(struct mm_struct *mm, uintptr_t addr, size_t len)
 	assert(mm != NULL);
 
 	struct vma_struct *vma;
-	if ((vma = find_vma(mm, start)) == NULL || end <= vma->vm_start) {
+	if ((vma = find_vma_intersection(mm, start, end)) == NULL) {
 		return 0;
 	}
 
@@ -534,6 +636,9 @@ int mm_unmap_keep_pages(struct mm_struct *mm, uintptr_t addr, size_t len)
 		}
 
 		vma_copymapfile(nvma, vma);
+#ifdef UCONFIG_NUMA_MEMPOLICY
+		nvma->vm_policy = vma->vm_policy;
+#endif
 		vma_resize(vma, end, vma->vm_end);
 		insert_vma_struct(mm, nvma);
 
@@ -594,6 +699,9 @@ int dup_mmap(struct mm_struct *to, struct mm_struct *from)
 				shmem_ref_inc(vma->shmem);
 			}
 			nvma->mfile = vma->mfile;
+#ifdef UCONFIG_NUMA_MEMPOLICY
+			nvma->vm_policy = vma->vm_policy;
+#endif
 		}
 		insert_vma_struct(to, nvma);
 		bool share = (vma->vm_flags & VM_SHARE);
@@ -608,7 +716,7 @@ int dup_mmap(struct mm_struct *to, struct mm_struct *from)
 
 void exit_mmap(struct mm_struct *mm)
 {
-	assert(mm != NULL && mm_count(mm) == 0);
+	assert(mm != NULL);
 	pgd_t *pgdir = mm->pgdir;
 	list_entry_t *list = &(mm->mmap_list), *le = list;
 	while ((le = list_next(le)) != list) {
@@ -641,26 +749,100 @@ int remapfile(struct mm_struct *mm, struct proc_struct *proc)
 	return 0;
 }
 
+/**
+ * get_unmapped_area - the highest hole of @len bytes below USERTOP. The
+ * space above the last vma is looked at first, then the rb tree is walked
+ * down towards the rightmost vma with a large enough gap in front of it.
+ */
 uintptr_t get_unmapped_area(struct mm_struct * mm, size_t len)
 {
-	if (len == 0 || len > USERTOP) {
+	if (len == 0 || len > USERTOP - USERBASE) {
 		return 0;
 	}
-	uintptr_t start = USERTOP - len;
-	list_entry_t *list = &(mm->mmap_list), *le = list;
-	while ((le = list_prev(le)) != list) {
-		struct vma_struct *vma = le2vma(le, list_link);
-		if (start >= vma->vm_end) {
-			return start;
-		}
-		if (start + len > vma->vm_start) {
-			if (len >= vma->vm_start) {
-				return 0;
-			}
-			start = vma->vm_start - len;
+	list_entry_t *le = list_prev(&(mm->mmap_list));
+	uintptr_t top = (le == &(mm->mmap_list)) ? USERBASE :
+	    le2vma(le, list_link)->vm_end;
+	if (top <= USERTOP - len) {
+		return USERTOP - len;
+	}
+
+	rb_tree *tree = mm->mmap_tree;
+	rb_node *node = rb_node_root(tree), *child;
+	if (node == NULL || rbn2vma(node, rb_link)->vm_gap_max < len) {
+		return 0;
+	}
+	while (1) {
+		struct vma_struct *vma = rbn2vma(node, rb_link);
+		if ((child = rb_node_right(tree, node)) != NULL
+		    && rbn2vma(child, rb_link)->vm_gap_max >= len) {
+			node = child;
+		} else if (vma->vm_gap >= len) {
+			return vma->vm_start - len;
+		} else {
+			node = rb_node_left(tree, node);
+			assert(node != NULL);
 		}
 	}
-	return (start >= USERBASE) ? start : 0;
+}
+
+/*
+ * vma_mergeable - whether @next can be folded into @prev, which ends where
+ * it starts: same flags and policy, and either no file or the same file at
+ * the following offset. Shared memory vmas are left alone.
+ */
+static bool vma_mergeable(struct vma_struct *prev, struct vma_struct *next)
+{
+	if (prev->vm_end != next->vm_start || prev->vm_flags != next->vm_flags
+	    || (prev->vm_flags & VM_SHARE)) {
+		return 0;
+	}
+	if (prev->mfile.file != next->mfile.file
+	    || (prev->mfile.file != NULL
+		&& prev->mfile.offset + (prev->vm_end - prev->vm_start)
+		!= next->mfile.offset)) {
+		return 0;
+	}
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	if (prev->vm_policy.mode != next->vm_policy.mode
+	    || prev->vm_policy.nodes != next->vm_policy.nodes) {
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+// __vma_merge - fold @next into @prev and free it
+static void
+__vma_merge(struct mm_struct *mm, struct vma_struct *prev,
+	    struct vma_struct *next)
+{
+	uintptr_t end = next->vm_end;
+	remove_vma_struct(mm, next);
+	vma_unmapfile(next);
+	vma_destroy(next);
+	prev->vm_end = end;
+	vma_next_gap_update(mm, &(prev->list_link));
+}
+
+/**
+ * vma_merge - merge @vma with the vmas right before and after it where
+ * they are alike, once the caller is done setting it up.
+ * @return the vma now covering @vma's range
+ */
+struct vma_struct *vma_merge(struct mm_struct *mm, struct vma_struct *vma)
+{
+	list_entry_t *le;
+	if ((le = list_next(&(vma->list_link))) != &(mm->mmap_list)
+	    && vma_mergeable(vma, le2vma(le, list_link))) {
+		__vma_merge(mm, vma, le2vma(le, list_link));
+	}
+	if ((le = list_prev(&(vma->list_link))) != &(mm->mmap_list)
+	    && vma_mergeable(le2vma(le, list_link), vma)) {
+		struct vma_struct *prev = le2vma(le, list_link);
+		__vma_merge(mm, prev, vma);
+		vma = prev;
+	}
+	return vma;
 }
 
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len)
@@ -675,16 +857,12 @@ int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len)
 	if ((ret = mm_unmap(mm, start, end - start)) != 0) {
 		return ret;
 	}
-	uint32_t vm_flags = VM_READ | VM_WRITE;
-	struct vma_struct *vma = find_vma(mm, start - 1);
-	if (vma != NULL && vma->vm_end == start && vma->vm_flags == vm_flags) {
-		vma->vm_end = end;
-		return 0;
-	}
-	if ((vma = vma_create(start, end, vm_flags)) == NULL) {
+	struct vma_struct *vma;
+	if ((vma = vma_create(start, end, VM_READ | VM_WRITE)) == NULL) {
 		return -E_NO_MEM;
 	}
 	insert_vma_struct(mm, vma);
+	vma_merge(mm, vma);
 	return 0;
 }
 
@@ -741,8 +919,7 @@ static void check_vma_struct(void)
 	struct mm_struct *mm = mm_create();
 	assert(mm != NULL);
 
-	int step1 = RB_MIN_MAP_COUNT * 2, step2 = step1 * 10;
-//	int step1 = 2, step2 = step1 * 10;
+	int step1 = 64, step2 = step1 * 10;
 
 	int i;
 	for (i = step1; i >= 1; i--) {
@@ -766,6 +943,10 @@ static void check_vma_struct(void)
 		le = list_next(le);
 	}
 
+	/* every vma but the first has 3 bytes free in front of it */
+	rb_node *root = rb_node_root(mm->mmap_tree);
+	assert(root != NULL && rbn2vma(root, rb_link)->vm_gap_max == 3);
+
 	for (i = 5; i <= 5 * step2; i+=5) {
 		struct vma_struct *vma1 = find_vma(mm, i);
 		assert(vma1 != NULL);
@@ -809,8 +990,9 @@ static void check_pgfault(void)
 	pgd_t *pgdir = mm->pgdir = init_pgdir_get();
 	assert(pgdir[PGX(TEST_PAGE)] == 0);
 
+	/* one page short of a huge page, so that the fault maps a single page */
 	struct vma_struct *vma =
-	    vma_create(TEST_PAGE, TEST_PAGE + PTSIZE, VM_WRITE);
+	    vma_create(TEST_PAGE, TEST_PAGE + PTSIZE - PGSIZE, VM_WRITE);
 	assert(vma != NULL);
 
 	insert_vma_struct(mm, vma);
@@ -862,12 +1044,183 @@ static inline struct mapped_addr *find_maddr(struct file *file, off_t offset,
 	return NULL;
 }
 
-int do_madvise(void *addr, size_t len, int advice)
+
+#ifdef UCONFIG_HUGEPAGE
+/*
+ * Back the HPAGE_SIZE block around @addr with one huge page, if the block
+ * lies in a private writable vma without file backing and nothing in it is
+ * mapped yet. The page is zeroed, like any fresh anonymous memory.
+ */
+static bool
+do_huge_pgfault(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr,
+		pte_perm_t perm)
 {
-	return 0;
+	uintptr_t haddr = ROUNDDOWN(addr, HPAGE_SIZE);
+	if (!(vma->vm_flags & VM_WRITE)
+	    || (vma->vm_flags & (VM_SHARE | VM_STACK | VM_IO))
+	    || vma->mfile.file != NULL) {
+		return 0;
+	}
+	if (haddr < vma->vm_start || haddr + HPAGE_SIZE > vma->vm_end) {
+		return 0;
+	}
+	pmd_t *pmdp = get_pmd(mm->pgdir, haddr, 0);
+	if (pmdp != NULL && !ptep_invalid(pmdp)) {
+		return 0;
+	}
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	struct Page *page = alloc_huge_page(mpol_node(vma, haddr, HPAGE_NR));
+#else
+	struct Page *page = alloc_huge_page(NULL);
+#endif
+	if (page == NULL) {
+		return 0;
+	}
+	/* clearing 2MB takes a while, do it before taking the pt lock */
+	memset(page2kva(page), 0, HPAGE_SIZE);
+	lock_pt(mm);
+	if ((pmdp = get_pmd(mm->pgdir, haddr, 1)) == NULL
+	    || !ptep_invalid(pmdp)) {
+		unlock_pt(mm);
+		free_pages(page, HPAGE_NR);
+		/* raced with another thread, let the small page path sort it out */
+		return 0;
+	}
+	set_huge_pmd(pmdp, page, perm);
+	unlock_pt(mm);
+	return 1;
+}
+#endif /* UCONFIG_HUGEPAGE */
+
+/*
+ * Fault-around: a fault also maps the pages next to it that come cheap,
+ * so that streaming through a mapping takes a fault per window rather
+ * than per page. Those are pages of the file read in the same pass,
+ * swapped out pages still in memory and, for MADV_SEQUENTIAL anonymous
+ * memory, fresh zeroed pages. The window is FAULT_AROUND_PAGES aligned
+ * pages around the fault, or twice as many ahead of it for MADV_SEQUENTIAL,
+ * and never leaves the vma or the page table of the fault.
+ */
+#define FAULT_AROUND_PAGES      16
+
+#ifndef SHARE_MAPPED_FILE
+// vma_read_page - read the file contents behind @addr into @page, zero
+//               - filling past the end of file. Returns the bytes read.
+static size_t
+vma_read_page(struct vma_struct *vma, uintptr_t addr, struct Page *page)
+{
+	struct file *file = vma->mfile.file;
+	off_t old_pos = file->pos;
+	size_t copied = 0;
+	if (filestruct_setpos(file,
+			      vma->mfile.offset + addr - vma->vm_start) == 0) {
+		copied = filestruct_read(file, page2kva(page), PGSIZE);
+	}
+	filestruct_setpos(file, old_pos);
+	if (copied < PGSIZE) {
+		memset(page2kva(page) + copied, 0, PGSIZE - copied);
+	}
+	return copied;
+}
+#endif
+
+// fault_around - map the cheap pages around @addr, called with the pt lock
+static void
+fault_around(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr,
+	     pte_perm_t perm)
+{
+	if (vma->vm_flags & (VM_SHARE | VM_RAND_READ | VM_IO)) {
+		return;
+	}
+	uintptr_t start, end, pt_start = ROUNDDOWN(addr, PTSIZE);
+	if (vma->vm_flags & VM_SEQ_READ) {
+		start = addr + PGSIZE;
+		end = addr + 2 * FAULT_AROUND_PAGES * PGSIZE;
+	} else {
+		start = ROUNDDOWN(addr, FAULT_AROUND_PAGES * PGSIZE);
+		end = start + FAULT_AROUND_PAGES * PGSIZE;
+	}
+	if (start < vma->vm_start || start < pt_start) {
+		start = (vma->vm_start > pt_start) ? vma->vm_start : pt_start;
+	}
+	if (end > vma->vm_end || end > pt_start + PTSIZE) {
+		end = (vma->vm_end < pt_start + PTSIZE) ?
+		    vma->vm_end : pt_start + PTSIZE;
+	}
+
+	pte_perm_t ro_perm = perm;
+#ifdef ARCH_ARM
+	ro_perm &= ~PTE_W;
+#else
+	ptep_unset_s_write(&ro_perm);
+#endif
+	for (; start < end; start += PGSIZE) {
+		pte_t *ptep;
+		if (start == addr || (ptep = get_pte(mm->pgdir, start, 0)) == NULL
+		    || ptep_present(ptep)) {
+			continue;
+		}
+		if (!ptep_invalid(ptep)) {
+#ifdef UCONFIG_SWAP
+			/* read only, a write goes through copy-on-write */
+			struct Page *page = swap_lookup_page(*ptep);
+			if (page != NULL
+			    && page_insert(mm->pgdir, page, start, ro_perm) == 0) {
+				atomic_inc(&(mm->nr_around));
+			}
+#endif
+			continue;
+		}
+		struct Page *page;
+		if (vma->mfile.file != NULL) {
+#ifdef SHARE_MAPPED_FILE
+			break;
+#else
+			if ((page = alloc_pages_vma(vma, start, 1)) == NULL) {
+				break;
+			}
+			if (vma_read_page(vma, start, page) == 0) {
+				/* past the end of file */
+				free_page(page);
+				break;
+			}
+			page_insert_pte(mm->pgdir, page, ptep, start, ro_perm);
+#endif
+		} else if (vma->vm_flags & VM_SEQ_READ) {
+			if ((page = alloc_pages_vma(vma, start, 1)) == NULL) {
+				break;
+			}
+			memset(page2kva(page), 0, PGSIZE);
+			page_insert_pte(mm->pgdir, page, ptep, start, perm);
+#ifdef ARCH_ARM
+			if (vma->vm_flags & VM_ANONYMOUS) {
+				memset((void *)start, 0, PGSIZE);
+			}
+#endif
+		} else {
+			continue;
+		}
+		atomic_inc(&(mm->nr_around));
+	}
 }
 
+static int
+handle_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr,
+	       bool around);
+
 int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
+{
+	if (mm != NULL) {
+		atomic_inc(&(mm->nr_faults));
+	}
+	return handle_pgfault(mm, error_code, addr, 1);
+}
+
+// handle_pgfault - resolve a fault at @addr, mapping the pages around it
+//                - as well if @around
+static int
+handle_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr,
+	       bool around)
 {
 	if (mm == NULL) {
 		assert(current != NULL);
@@ -880,13 +1233,10 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 		return -E_KILLED;
 	}
 
-	bool need_unlock = 1;
-	if (!try_lock_mm(mm)) {
-		if (current != NULL && mm->locked_by == current->pid) {
-			need_unlock = 0;
-		} else {
-			lock_mm(mm);
-		}
+	/* faulting in a user copy, the lock is ours already */
+	bool need_unlock = !mm_locked_by_current(mm);
+	if (need_unlock) {
+		lock_mm_read(mm);
 	}
 
 	int ret = -E_INVAL;
@@ -944,9 +1294,33 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 
 	ret = -E_NO_MEM;
 
+#ifdef UCONFIG_HUGEPAGE
+	/* only writes, a read is served by the zero page below */
+	if ((error_code & 3) == 2 && do_huge_pgfault(mm, vma, addr, perm)) {
+		ret = 0;
+		goto failed;
+	}
+#endif
+
+	/*
+	 * Most faults hit fresh anonymous memory: reads map the zero page,
+	 * writes get a cleared page, taken before the pt lock so that other
+	 * threads of the mm fault in their own pages meanwhile. If the pte
+	 * turns out to be in use, the page is given back.
+	 */
+	bool map_zero = (zero_page != NULL && !(error_code & 2));
+	struct Page *anon_page = NULL;
+	if (!(error_code & 1) && !map_zero && vma->mfile.file == NULL
+	    && !(vma->vm_flags & VM_SHARE)) {
+		if ((anon_page = alloc_zeroed_page(vma, addr)) == NULL) {
+			goto failed;
+		}
+	}
+
+	lock_pt(mm);
 	pte_t *ptep;
 	if ((ptep = get_pte(mm->pgdir, addr, 1)) == NULL) {
-		goto failed;
+		goto failed_unlock_pt;
 	}
 	if (ptep_invalid(ptep)) {
 		if (vma->mfile.file != NULL) {
@@ -959,10 +1333,11 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 			if (maddr == NULL) {
 #endif // SHARE_MAPPED_FILE
 				struct Page *page;
-				if ((page = alloc_page()) == NULL) {
+				if ((page = alloc_pages_vma(vma, addr, 1)) == NULL) {
 					assert(false);
-					goto failed;
+					goto failed_unlock_pt;
 				}
+				atomic_inc(&(mm->nr_major_faults));
 				nperm = perm;
 #ifdef ARCH_ARM
 				/* ARM9 software emulated PTE_xxx */
@@ -976,13 +1351,13 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 				if ((ret =
 				     filestruct_setpos(file, new_pos)) != 0) {
 					assert(false);
-					goto failed;
+					goto failed_unlock_pt;
 				}
 				filestruct_read(file, page2kva(page), PGSIZE);
 				if ((ret =
 				     filestruct_setpos(file, old_pos)) != 0) {
 					assert(false);
-					goto failed;
+					goto failed_unlock_pt;
 				}
 #ifdef SHARE_MAPPED_FILE
 				if ((maddr = (struct mapped_addr *)
@@ -1012,12 +1387,33 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 
 		} else
 		if (!(vma->vm_flags & VM_SHARE)) {
-			if (pgdir_alloc_page(mm->pgdir, addr, perm) == NULL) {
-				goto failed;
+			if (map_zero) {
+				nperm = perm;
+#ifdef ARCH_ARM
+				nperm &= ~PTE_W;
+#else
+				ptep_unset_s_write(&nperm);
+#endif
+				if (page_insert(mm->pgdir, zero_page, addr, nperm) != 0) {
+					goto failed_unlock_pt;
+				}
+				goto mapped;
+			}
+			if (anon_page == NULL) {
+				if ((anon_page = alloc_zeroed_page(vma, addr)) == NULL) {
+					goto failed_unlock_pt;
+				}
 			}
+			if (page_insert(mm->pgdir, anon_page, addr, perm) != 0) {
+				goto failed_unlock_pt;
+			}
+			anon_page = NULL;
+#ifdef ARCH_ARM
+			/* ARM9 caches are virtually indexed, clear the user alias too */
 			if (vma->vm_flags & VM_ANONYMOUS) {
 				memset((void *)addr, 0, PGSIZE);
 			}
+#endif
 		} else {	//shared mem
 			lock_shmem(vma->shmem);
 			uintptr_t shmem_addr =
@@ -1026,9 +1422,12 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 			    shmem_get_entry(vma->shmem, shmem_addr, 1);
 			if (sh_ptep == NULL || ptep_invalid(sh_ptep)) {
 				unlock_shmem(vma->shmem);
-				goto failed;
+				goto failed_unlock_pt;
 			}
 			unlock_shmem(vma->shmem);
+			if (vma->vm_flags & VM_NOWRITE) {
+				ptep_unset_s_write(&perm);
+			}
 			if (ptep_present(sh_ptep)) {
 				page_insert(mm->pgdir, pte2page(*sh_ptep), addr,
 					    perm);
@@ -1047,6 +1446,12 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 		    ((vma->vm_flags & (VM_SHARE | VM_WRITE)) == VM_WRITE),
 		    may_copy = 1;
 
+		if (ptep_present(ptep)
+		    && (!(error_code & 2) || ptep_u_write(ptep))) {
+			/* another thread of the mm resolved it first */
+			ret = 0;
+			goto failed_unlock_pt;
+		}
 #if 1
 		if (!(!ptep_present(ptep)
 		      || ((error_code & 2) && !ptep_u_write(ptep) && cow))) {
@@ -1057,18 +1462,22 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 		}
 #endif
 
+		bool from_zero = (ptep_present(ptep)
+				  && pte2page(*ptep) == zero_page);
 		if (cow) {
-			newpage = alloc_page();
+			newpage = from_zero ? alloc_zeroed_page(vma, addr) :
+			    alloc_pages_vma(vma, addr, 1);
 		}
 		if (ptep_present(ptep)) {
 			page = pte2page(*ptep);
 		} else {
 #ifdef UCONFIG_SWAP
+			atomic_inc(&(mm->nr_major_faults));
 			if ((ret = swap_in_page(*ptep, &page)) != 0) {
 				if (newpage != NULL) {
 					free_page(newpage);
 				}
-				goto failed;
+				goto failed_unlock_pt;
 			}
 #else
 			assert(0);
@@ -1091,10 +1500,12 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 			if (page_ref(page) > 1) {
 #endif
 				if (newpage == NULL) {
-					goto failed;
+					goto failed_unlock_pt;
+				}
+				if (!from_zero) {
+					memcpy(page2kva(newpage),
+					       page2kva(page), PGSIZE);
 				}
-				memcpy(page2kva(newpage), page2kva(page),
-				       PGSIZE);
 				//kprintf("COW!\n");
 				page = newpage, newpage = NULL;
 			}
@@ -1127,11 +1538,237 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 			free_page(newpage);
 		}
 	}
+mapped:
+	if (around && !(error_code & 1)) {
+		fault_around(mm, vma, addr, perm);
+	}
 	ret = 0;
 
+failed_unlock_pt:
+	unlock_pt(mm);
+	if (anon_page != NULL) {
+		free_page(anon_page);
+	}
 failed:
 	if (need_unlock) {
-		unlock_mm(mm);
+		unlock_mm_read(mm);
+	}
+	return ret;
+}
+
+/**
+ * mm_populate - fault in the pages of [@addr, @addr + @len) that are not
+ * mapped yet, for MAP_POPULATE. With @anon false only file pages and
+ * swapped out pages are read in, for MADV_WILLNEED. The caller holds the
+ * mm lock; a shortage of memory ends it early.
+ */
+int mm_populate(struct mm_struct *mm, uintptr_t addr, size_t len, bool anon)
+{
+	uintptr_t start = ROUNDDOWN(addr, PGSIZE), end =
+	    ROUNDUP(addr + len, PGSIZE);
+	struct vma_struct *vma;
+	while (start < end
+	       && (vma = find_vma_intersection(mm, start, end)) != NULL) {
+		uintptr_t la = (start > vma->vm_start) ? start : vma->vm_start;
+		start = (end < vma->vm_end) ? end : vma->vm_end;
+		if (vma->vm_flags & VM_IO) {
+			continue;
+		}
+		for (; la < start; la += PGSIZE) {
+#ifdef UCONFIG_HUGEPAGE
+			pmd_t *pmdp = get_pmd(mm->pgdir, la, 0);
+			if (pmdp != NULL && ptep_huge(pmdp)) {
+				la = ROUNDDOWN(la, HPAGE_SIZE) + HPAGE_SIZE - PGSIZE;
+				continue;
+			}
+#endif
+			pte_t *ptep = get_pte(mm->pgdir, la, 0);
+			if (ptep != NULL && ptep_present(ptep)) {
+				continue;
+			}
+			if (!anon && vma->mfile.file == NULL
+			    && (ptep == NULL || ptep_invalid(ptep))) {
+				continue;
+			}
+			/* anonymous memory is written to, not left on the zero page */
+			int ret = handle_pgfault(mm, (anon && vma->mfile.file == NULL
+						      && (vma->vm_flags & VM_WRITE)) ? 2 : 0,
+						 la, 0);
+			if (ret == -E_NO_MEM) {
+				return ret;
+			}
+			if (ret == 0) {
+				atomic_inc(&(mm->nr_populated));
+			}
+		}
+	}
+	return 0;
+}
+
+// madvise_behavior - set the read or merge hint of [@start, @end) in @vma, splitting it
+static int
+madvise_behavior(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start,
+		 uintptr_t end, int advice)
+{
+	uint32_t vm_flags = vma->vm_flags;
+	switch (advice) {
+	case MADV_MERGEABLE:
+		vm_flags |= VM_MERGEABLE;
+		break;
+	case MADV_UNMERGEABLE:
+		vm_flags &= ~VM_MERGEABLE;
+		break;
+	default:
+		vm_flags &= ~(VM_SEQ_READ | VM_RAND_READ);
+		if (advice == MADV_SEQUENTIAL) {
+			vm_flags |= VM_SEQ_READ;
+		} else if (advice == MADV_RANDOM) {
+			vm_flags |= VM_RAND_READ;
+		}
+	}
+	if (vm_flags == vma->vm_flags) {
+		return 0;
+	}
+	int ret;
+	if (vma->vm_start < start) {
+		if ((ret = split_vma(mm, vma, start)) != 0) {
+			return ret;
+		}
+	}
+	if (end < vma->vm_end) {
+		if ((ret = split_vma(mm, vma, end)) != 0) {
+			return ret;
+		}
+		vma = find_vma(mm, start);
+	}
+	vma->vm_flags = vm_flags;
+	vma_merge(mm, vma);
+	return 0;
+}
+
+/**
+ * do_madvise - act on the advice given for [@addr, @addr + @len):
+ *   MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM - set how much is faulted in
+ *       around a fault, see fault_around
+ *   MADV_WILLNEED - read in file pages and swapped out pages now
+ *   MADV_DONTNEED - drop the pages, the next access reads zeroes or the file
+ *   MADV_FREE - like MADV_DONTNEED, for private anonymous memory only
+ *   MADV_MERGEABLE, MADV_UNMERGEABLE - let ksmd merge identical private
+ *       anonymous pages, or stop it; pages merged already stay shared
+ *       until they are written to
+ * Parts of the range that are not mapped are skipped and reported with
+ * -E_NO_MEM, as linux does.
+ */
+int do_madvise(void *addr, size_t len, int advice)
+{
+	struct mm_struct *mm = current->mm;
+	uintptr_t start = (uintptr_t) addr, end = ROUNDUP(start + len, PGSIZE);
+	if (mm == NULL || start % PGSIZE != 0 || end < start) {
+		return -E_INVAL;
+	}
+	switch (advice) {
+	case MADV_NORMAL:
+	case MADV_RANDOM:
+	case MADV_SEQUENTIAL:
+	case MADV_WILLNEED:
+	case MADV_DONTNEED:
+	case MADV_FREE:
+#ifdef UCONFIG_KSM
+	case MADV_MERGEABLE:
+	case MADV_UNMERGEABLE:
+#endif
+		break;
+	default:
+		return -E_INVAL;
+	}
+	if (start == end) {
+		return 0;
+	}
+	if (!USER_ACCESS(start, end)) {
+		return -E_NO_MEM;
+	}
+
+	int ret = 0;
+	bool hole = 0;
+	struct vma_struct *vma;
+	lock_mm(mm);
+	while (start < end
+	       && (vma = find_vma_intersection(mm, start, end)) != NULL) {
+		if (vma->vm_start > start) {
+			hole = 1;
+		}
+		uintptr_t la = (start > vma->vm_start) ? start : vma->vm_start;
+		start = (end < vma->vm_end) ? end : vma->vm_end;
+		switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+		case MADV_SEQUENTIAL:
+			if ((ret = madvise_behavior(mm, vma, la, start,
+						    advice)) != 0) {
+				goto out;
+			}
+			break;
+		case MADV_MERGEABLE:
+			/* only private anonymous memory is merged, the rest is left alone */
+			if (vma->mfile.file != NULL
+			    || (vma->vm_flags & (VM_SHARE | VM_IO))) {
+				break;
+			}
+		case MADV_UNMERGEABLE:
+			if ((ret = madvise_behavior(mm, vma, la, start,
+						    advice)) != 0) {
+				goto out;
+			}
+			break;
+		case MADV_WILLNEED:
+			mm_populate(mm, la, start - la, 0);
+			break;
+		case MADV_FREE:
+			if (vma->mfile.file != NULL
+			    || (vma->vm_flags & (VM_SHARE | VM_IO))) {
+				ret = -E_INVAL;
+				goto out;
+			}
+			/* there is no reclaim to free them lazily, drop them now */
+		case MADV_DONTNEED:
+			if (vma->vm_flags & VM_IO) {
+				ret = -E_INVAL;
+				goto out;
+			}
+			unmap_range(mm->pgdir, la, start);
+			break;
+		}
+	}
+	if (start < end) {
+		hole = 1;
+	}
+	/* the advice is applied around holes, which are reported afterwards */
+	if (hole) {
+		ret = -E_NO_MEM;
+	}
+out:
+	unlock_mm(mm);
+	return ret;
+}
+
+// do_faultstat - copy the page fault counters of the current mm to @stat
+int do_faultstat(struct fault_stat *stat)
+{
+	struct mm_struct *mm = current->mm;
+	struct fault_stat s;
+	if (mm == NULL) {
+		return -E_INVAL;
+	}
+	s.nr_faults = (unsigned int)atomic_read(&(mm->nr_faults));
+	s.nr_major = (unsigned int)atomic_read(&(mm->nr_major_faults));
+	s.nr_around = (unsigned int)atomic_read(&(mm->nr_around));
+	s.nr_populated = (unsigned int)atomic_read(&(mm->nr_populated));
+
+	int ret = 0;
+	lock_mm_read(mm);
+	if (!copy_to_user(mm, stat, &s, sizeof(s))) {
+		ret = -E_INVAL;
 	}
+	unlock_mm_read(mm);
 	return ret;
 }
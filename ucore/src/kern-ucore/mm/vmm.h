@@ -10,7 +10,13 @@
 #include <shmem.h>
 #include <atomic.h>
 #include <sem.h>
+#include <rwsem.h>
 #include <fs.h>
+#include <madvise.h>
+#include <refcache.h>
+#ifdef UCONFIG_NUMA_MEMPOLICY
+#include <mempolicy.h>
+#endif
 #endif
 
 //pre define
@@ -30,9 +36,14 @@ struct vma_struct {
 	uint32_t vm_flags;	// flags of vma
 	rb_node rb_link;	// redblack link which sorted by start addr of vma
 	list_entry_t list_link;	// linear list link which sorted by start addr of vma
+	uintptr_t vm_gap;	// free space between the previous vma and this one
+	uintptr_t vm_gap_max;	// largest vm_gap in this vma's rb subtree
 	struct shmem_struct *shmem;
 	size_t shmem_off;
 	struct mapped_file_struct mfile;
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	struct mempolicy vm_policy;	// set by mbind, MPOL_DEFAULT otherwise
+#endif
 };
 
 #define le2vma(le, member)                  \
@@ -48,9 +59,13 @@ struct vma_struct {
 #define VM_SHARE                0x00000010
 
 #define VM_ANONYMOUS			0x00000020
+#define VM_NOWRITE              0x00000040	/* never writable, e.g. the vDSO */
 
 /* must the same as Linux */
 #define VM_IO           0x00004000
+#define VM_SEQ_READ     0x00008000	/* MADV_SEQUENTIAL */
+#define VM_RAND_READ    0x00010000	/* MADV_RANDOM */
+#define VM_MERGEABLE    0x80000000	/* MADV_MERGEABLE, scanned by ksmd */
 
 #define MAP_FAILED      ((void*)-1)
 
@@ -61,6 +76,7 @@ struct vma_struct {
 #define MAP_FIXED       0x10	/* Interpret addr exactly */
 #define MAP_ANONYMOUS   0x20	/* don't use a file */
 
+#define MAP_POPULATE    0x8000	/* populate (prefault) pagetables */
 #define MAP_STACK		0x20000
 
 #define PROT_READ       0x1	/* page can be read */
@@ -127,29 +143,6 @@ struct vma_struct {
  */
 #define MLOCK_ONFAULT   0x01            /* Lock pages in range after they are faulted in, do not prefault */
 
-#define MADV_NORMAL     0               /* no further special treatment */
-#define MADV_RANDOM     1               /* expect random page references */
-#define MADV_SEQUENTIAL 2               /* expect sequential page references */
-#define MADV_WILLNEED   3               /* will need these pages */
-#define MADV_DONTNEED   4               /* don't need these pages */
-
-/* common parameters: try to keep these consistent across architectures */
-#define MADV_FREE       8               /* free pages only if memory pressure */
-#define MADV_REMOVE     9               /* remove these pages & resources */
-#define MADV_DONTFORK   10              /* don't inherit across fork */
-#define MADV_DOFORK     11              /* do inherit across fork */
-
-#define MADV_MERGEABLE   12             /* KSM may merge identical pages */
-#define MADV_UNMERGEABLE 13             /* KSM may not merge identical pages */
-#define MADV_HWPOISON    100            /* poison a page for testing */
-
-#define MADV_HUGEPAGE   14              /* Worth backing with hugepages */
-#define MADV_NOHUGEPAGE 15              /* Not worth backing with hugepages */
-
-#define MADV_DONTDUMP   16              /* Explicity exclude from the core dump,
-                                            overrides the coredump filter bits */
-#define MADV_DODUMP     17              /* Clear the MADV_NODUMP flag */
-
 /* compatibility flags */
 #define MAP_FILE        0
 
@@ -179,21 +172,37 @@ struct mm_struct {
 #endif
 	int map_count;
 	uintptr_t swap_address;
-	atomic_t mm_count;
-	int locked_by;
+	uintptr_t ksm_address;	// where ksmd goes on scanning
+	struct refobj mm_ref;	// released by the krefcache cleaner, see put_mm
+	int locked_by;		// pid of the writer holding mm_sem
 	uintptr_t brk_start, brk;
 	list_entry_t proc_mm_link;
-	semaphore_t mm_sem;
+	rw_semaphore_t mm_sem;	// shared by faults and user copies, exclusive for vma changes
+	semaphore_t pt_sem;	// page table updates made under a shared mm_sem
+	atomic_t nr_faults, nr_major_faults;	// see struct fault_stat
+	atomic_t nr_around, nr_populated;
 };
 
 void lock_mm(struct mm_struct *mm);
 void unlock_mm(struct mm_struct *mm);
 bool try_lock_mm(struct mm_struct *mm);
+void lock_mm_read(struct mm_struct *mm);
+void unlock_mm_read(struct mm_struct *mm);
+
+static inline void lock_pt(struct mm_struct *mm)
+{
+	down(&(mm->pt_sem));
+}
+
+static inline void unlock_pt(struct mm_struct *mm)
+{
+	up(&(mm->pt_sem));
+}
 
 #define le2mm(le, member)                   \
     to_struct((le), struct mm_struct, member)
 
-#define RB_MIN_MAP_COUNT        32	// If the count of vma >32 then redblack tree link is used
+extern struct Page *zero_page;
 
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr);
 struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start,
@@ -201,6 +210,7 @@ struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start,
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end,
 			      uint32_t vm_flags);
 void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma);
+struct vma_struct *vma_merge(struct mm_struct *mm, struct vma_struct *vma);
 
 struct mm_struct *mm_create(void);
 void mm_destroy(struct mm_struct *mm);
@@ -211,12 +221,16 @@ int mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
 int mm_map_shmem(struct mm_struct *mm, uintptr_t addr, uint32_t vm_flags,
 		 struct shmem_struct *shmem, struct vma_struct **vma_store);
 int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len);
+int split_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr);
 int dup_mmap(struct mm_struct *to, struct mm_struct *from);
 void exit_mmap(struct mm_struct *mm);
 uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len);
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len);
 
 int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr);
+int mm_populate(struct mm_struct *mm, uintptr_t addr, size_t len, bool anon);
+int do_madvise(void *addr, size_t len, int advice);
+int do_faultstat(struct fault_stat *stat);
 bool user_mem_check(struct mm_struct *mm, uintptr_t start, size_t len,
 		    bool write);
 
@@ -231,24 +245,14 @@ bool copy_string(struct mm_struct *mm, char *dst, const char *src, size_t maxn);
 void vma_mapfile(struct vma_struct *vma, struct file *file, off_t off, struct fs_struct *fs_struct);
 int mm_unmap_keep_pages(struct mm_struct *mm, uintptr_t addr, size_t len);
 
-static inline int mm_count(struct mm_struct *mm)
-{
-	return atomic_read(&(mm->mm_count));
-}
-
-static inline void set_mm_count(struct mm_struct *mm, int val)
-{
-	atomic_set(&(mm->mm_count), val);
-}
-
-static inline int mm_count_inc(struct mm_struct *mm)
+static inline void mm_count_inc(struct mm_struct *mm)
 {
-	return atomic_add_return(&(mm->mm_count), 1);
+	refcache_refobj_inc(&(mm->mm_ref));
 }
 
-static inline int mm_count_dec(struct mm_struct *mm)
+static inline void mm_count_dec(struct mm_struct *mm)
 {
-	return atomic_sub_return(&(mm->mm_count), 1);
+	refcache_refobj_dec(&(mm->mm_ref));
 }
 
 struct mapped_addr {
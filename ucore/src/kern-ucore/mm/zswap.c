@@ -0,0 +1,572 @@
+#include <pmm.h>
+#include <swap.h>
+#include <swapfs.h>
+#include <zswap.h>
+#include <slab.h>
+#include <sem.h>
+#include <list.h>
+#include <spinlock.h>
+#include <string.h>
+#include <assert.h>
+#include <error.h>
+#include <kio.h>
+
+#ifdef UCONFIG_ZSWAP
+
+/* *
+ * zswap keeps swapped-out pages compressed in a pool of ordinary pages.
+ * page_launder stores into the pool instead of writing to swap space, and
+ * the oldest pool pages are only written back to disk when the pool is full.
+ * swap_in_page decompresses from the pool whenever the entry is there.
+ *
+ * The pool is managed like Linux's zbud: a pool page holds at most two
+ * compressed objects, the first one at its start and the last one at its
+ * end. Pool pages with room for one more object sit on unbuddied[n], where
+ * n is the number of free chunks; all pool pages are kept on zbud_lru in
+ * the order they were last stored into.
+ *
+ * zswap_map[offset] tells where the entry of a swap offset lives: 0 if it
+ * is not in the pool, ZSWAP_ZERO for zero-filled pages (which take no pool
+ * space), otherwise the index of the pool page and the slot in it.
+ * */
+
+#define ZBUD_CHUNK_SHIFT                6
+#define ZBUD_CHUNK_SIZE                 (1 << ZBUD_CHUNK_SHIFT)
+#define ZBUD_NCHUNKS                    (PGSIZE >> ZBUD_CHUNK_SHIFT)
+#define size_to_chunks(len)             (((len) + ZBUD_CHUNK_SIZE - 1) >> ZBUD_CHUNK_SHIFT)
+
+// pages that do not compress below this are written to swap space directly
+#define ZSWAP_MAX_LEN                   (PGSIZE - PGSIZE / 8)
+// the pool never takes the last free pages of the system
+#define ZSWAP_RESERVE_PAGES             32
+
+#define ZSWAP_ZERO                      0xFFFF
+#define zmap_make(idx, slot)            ((uint16_t)((((idx) + 1) << 1) | (slot)))
+#define zmap_index(v)                   (((v) >> 1) - 1)
+#define zmap_slot(v)                    ((v) & 1)
+
+struct zbud_page {
+	struct Page *page;	// NULL if the descriptor is unused
+	swap_entry_t entry[2];	// 0 if the slot is free
+	uint16_t len[2];
+	list_entry_t buddy_link;	// link in unbuddied[] or zbud_free_list
+	list_entry_t lru_link;	// link in zbud_lru
+};
+
+#define le2zbud(le, member)                 \
+    to_struct((le), struct zbud_page, member)
+
+static struct zbud_page *zbud_pages;
+static list_entry_t zbud_free_list;
+static list_entry_t unbuddied[ZBUD_NCHUNKS];
+static list_entry_t zbud_lru;
+
+static uint16_t *zswap_map;
+static struct zswap_stat zswap_stat;
+static spinlock_s zswap_lock;
+
+// serializes stores, loads and writebacks, and protects the buffers below
+static semaphore_t zswap_sem;
+static uint8_t zswap_buf[PGSIZE];
+static struct Page *zswap_page;
+
+static volatile bool zswap_init_ok = 0;
+
+static void check_zswap(void);
+
+/* *
+ * The compressor writes the LZ4 block format. A sequence is a token byte
+ * (literal length << 4 | match length - 4), extra literal length bytes,
+ * the literals, a 2-byte little-endian match offset and extra match length
+ * bytes. The last sequence carries literals only.
+ * */
+
+#define LZ_HASH_BITS                    12
+#define LZ_MIN_MATCH                    4
+#define LZ_LAST_LITERALS                5
+#define LZ_MF_LIMIT                     12
+
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static inline uint32_t lz_read32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint32_t lz_hash(uint32_t seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *lz_put_length(uint8_t * op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255, len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+static const uint8_t *lz_get_length(const uint8_t * ip, const uint8_t * iend,
+				    size_t * len)
+{
+	uint8_t b;
+	do {
+		if (ip >= iend) {
+			return NULL;
+		}
+		*len += (b = *ip++);
+	} while (b == 255);
+	return ip;
+}
+
+// lz_put_literals - emit the token and literals of a sequence, returns NULL if they do not fit
+static uint8_t *lz_put_literals(uint8_t * op, uint8_t * oend,
+				const uint8_t * anchor, size_t lit)
+{
+	if (lit + lit / 255 + 2 > (size_t)(oend - op)) {
+		return NULL;
+	}
+	*op++ = ((lit < 15) ? lit : 15) << 4;
+	if (lit >= 15) {
+		op = lz_put_length(op, lit - 15);
+	}
+	memcpy(op, anchor, lit);
+	return op + lit;
+}
+
+// lz_compress - compress @n bytes of @src, returns the compressed length or 0 if it exceeds @cap
+static size_t lz_compress(const uint8_t * src, size_t n, uint8_t * dst,
+			  size_t cap)
+{
+	const uint8_t *ip = src, *anchor = src;
+	const uint8_t *mflimit = src + n - LZ_MF_LIMIT;
+	const uint8_t *matchlimit = src + n - LZ_LAST_LITERALS;
+	uint8_t *op = dst, *oend = dst + cap, *token;
+
+	memset(lz_table, 0, sizeof(lz_table));
+	while (ip < mflimit) {
+		uint32_t seq = lz_read32(ip), h = lz_hash(seq);
+		const uint8_t *ref = src + lz_table[h];
+		lz_table[h] = ip - src;
+		if (ref >= ip || lz_read32(ref) != seq) {
+			// skip faster through data that does not match
+			ip += 1 + ((ip - anchor) >> 6);
+			continue;
+		}
+		const uint8_t *p = ip + LZ_MIN_MATCH, *q = ref + LZ_MIN_MATCH;
+		while (p < matchlimit && *p == *q) {
+			p++, q++;
+		}
+		size_t ml = p - ip - LZ_MIN_MATCH, off = ip - ref;
+		token = op;
+		if ((op = lz_put_literals(op, oend, anchor, ip - anchor)) == NULL
+		    || ml / 255 + 3 > (size_t)(oend - op)) {
+			return 0;
+		}
+		*op++ = off & 0xFF, *op++ = off >> 8;
+		*token |= (ml < 15) ? ml : 15;
+		if (ml >= 15) {
+			op = lz_put_length(op, ml - 15);
+		}
+		ip = anchor = p;
+	}
+	if ((op = lz_put_literals(op, oend, anchor, src + n - anchor)) == NULL) {
+		return 0;
+	}
+	return op - dst;
+}
+
+// lz_decompress - returns the decompressed length, or 0 if @src is corrupted
+static size_t lz_decompress(const uint8_t * src, size_t n, uint8_t * dst,
+			    size_t cap)
+{
+	const uint8_t *ip = src, *iend = src + n;
+	uint8_t *op = dst, *oend = dst + cap;
+	while (ip < iend) {
+		uint8_t token = *ip++;
+		size_t lit = token >> 4, ml = token & 15, off;
+		if (lit == 15 && (ip = lz_get_length(ip, iend, &lit)) == NULL) {
+			return 0;
+		}
+		if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) {
+			return 0;
+		}
+		memcpy(op, ip, lit);
+		op += lit, ip += lit;
+		if (ip == iend) {
+			break;
+		}
+		if (iend - ip < 2) {
+			return 0;
+		}
+		off = ip[0] | (ip[1] << 8), ip += 2;
+		if (off == 0 || off > (size_t)(op - dst)) {
+			return 0;
+		}
+		if (ml == 15 && (ip = lz_get_length(ip, iend, &ml)) == NULL) {
+			return 0;
+		}
+		if ((ml += LZ_MIN_MATCH) > (size_t)(oend - op)) {
+			return 0;
+		}
+		// byte by byte, the match may overlap what it produces
+		const uint8_t *ref = op - off;
+		while (ml-- > 0) {
+			*op++ = *ref++;
+		}
+	}
+	return op - dst;
+}
+
+static bool page_is_zero(const void *kva)
+{
+	const unsigned long *p = kva;
+	size_t i;
+	for (i = 0; i < PGSIZE / sizeof(unsigned long); i++) {
+		if (p[i] != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static inline size_t zbud_free_chunks(struct zbud_page *zbud)
+{
+	return ZBUD_NCHUNKS - size_to_chunks(zbud->len[0]) -
+	    size_to_chunks(zbud->len[1]);
+}
+
+static inline uint8_t *zbud_addr(struct zbud_page *zbud, int slot)
+{
+	uint8_t *kva = page2kva(zbud->page);
+	if (slot == 0) {
+		return kva;
+	}
+	return kva + PGSIZE - (size_to_chunks(zbud->len[1]) << ZBUD_CHUNK_SHIFT);
+}
+
+// zbud_refile - file @zbud under its free space again, or release it once empty
+static void zbud_refile(struct zbud_page *zbud)
+{
+	list_del_init(&(zbud->buddy_link));
+	if (zbud->entry[0] == 0 && zbud->entry[1] == 0) {
+		list_del_init(&(zbud->lru_link));
+		free_page(zbud->page);
+		zbud->page = NULL;
+		list_add(&zbud_free_list, &(zbud->buddy_link));
+		zswap_stat.pool_pages--;
+	} else if (zbud->entry[0] == 0 || zbud->entry[1] == 0) {
+		list_add(unbuddied + zbud_free_chunks(zbud),
+			 &(zbud->buddy_link));
+	}
+}
+
+// zswap_drop - forget the entry at @offset, the lock must be held
+static void zswap_drop(size_t offset)
+{
+	uint16_t v = zswap_map[offset];
+	if (v == 0) {
+		return;
+	}
+	zswap_map[offset] = 0;
+	zswap_stat.nr_stored--;
+	if (v == ZSWAP_ZERO) {
+		zswap_stat.nr_zero--;
+		return;
+	}
+	struct zbud_page *zbud = zbud_pages + zmap_index(v);
+	int slot = zmap_slot(v);
+	zswap_stat.compressed_bytes -= zbud->len[slot];
+	zbud->entry[slot] = 0, zbud->len[slot] = 0;
+	zbud_refile(zbud);
+}
+
+// zbud_store - copy @len bytes of zswap_buf into the pool for @entry
+static bool zbud_store(swap_entry_t entry, size_t len)
+{
+	size_t i, nchunks = size_to_chunks(len);
+	struct zbud_page *zbud = NULL;
+	struct Page *page;
+	bool intr_flag;
+
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	for (i = nchunks; i < ZBUD_NCHUNKS; i++) {
+		if (!list_empty(unbuddied + i)) {
+			zbud = le2zbud(list_next(unbuddied + i), buddy_link);
+			break;
+		}
+	}
+	if (zbud == NULL) {
+		if (list_empty(&zbud_free_list)) {
+			spin_unlock_irqrestore(&zswap_lock, intr_flag);
+			return 0;
+		}
+		spin_unlock_irqrestore(&zswap_lock, intr_flag);
+		if (nr_free_pages() < ZSWAP_RESERVE_PAGES
+		    || (page = alloc_page()) == NULL) {
+			return 0;
+		}
+		// descriptors are only taken here, under zswap_sem
+		spin_lock_irqsave(&zswap_lock, intr_flag);
+		zbud = le2zbud(list_next(&zbud_free_list), buddy_link);
+		zbud->page = page;
+		zbud->entry[0] = zbud->entry[1] = 0;
+		zbud->len[0] = zbud->len[1] = 0;
+		zswap_stat.pool_pages++;
+	}
+	int slot = (zbud->entry[0] == 0) ? 0 : 1;
+	zbud->entry[slot] = entry, zbud->len[slot] = len;
+	memcpy(zbud_addr(zbud, slot), zswap_buf, len);
+	list_del_init(&(zbud->lru_link));
+	list_add_before(&zbud_lru, &(zbud->lru_link));
+	zbud_refile(zbud);
+	zswap_map[swap_offset(entry)] = zmap_make(zbud - zbud_pages, slot);
+	zswap_stat.nr_stored++, zswap_stat.compressed_bytes += len;
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+	return 1;
+}
+
+// zswap_writeback - write the objects of the least recently stored pool page to swap space
+static bool zswap_writeback(void)
+{
+	bool intr_flag;
+	int slot, ret;
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	if (list_empty(&zbud_lru)) {
+		spin_unlock_irqrestore(&zswap_lock, intr_flag);
+		return 0;
+	}
+	struct zbud_page *zbud = le2zbud(list_next(&zbud_lru), lru_link);
+	size_t idx = zbud - zbud_pages;
+	for (slot = 0; slot < 2; slot++) {
+		swap_entry_t entry = zbud->entry[slot];
+		if (entry == 0) {
+			continue;
+		}
+		size_t offset = swap_offset(entry);
+		if (lz_decompress(zbud_addr(zbud, slot), zbud->len[slot],
+				  page2kva(zswap_page), PGSIZE) != PGSIZE) {
+			panic("zswap: corrupted entry %08x.\n", entry);
+		}
+		// loads wait on zswap_sem, so nobody reads the slot before it is written
+		spin_unlock_irqrestore(&zswap_lock, intr_flag);
+		ret = swapfs_write(entry, zswap_page);
+		spin_lock_irqsave(&zswap_lock, intr_flag);
+		if (ret != 0) {
+			spin_unlock_irqrestore(&zswap_lock, intr_flag);
+			return 0;
+		}
+		if (zswap_map[offset] == zmap_make(idx, slot)) {
+			zswap_drop(offset);
+		}
+		zswap_stat.nr_writebacks++;
+	}
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+	return 1;
+}
+
+// zswap_store - keep the content of @page compressed in memory as @entry,
+//             - writing older entries back to swap space when the pool is full
+int zswap_store(swap_entry_t entry, struct Page *page)
+{
+	if (!zswap_init_ok) {
+		return -E_NO_DEV;
+	}
+	size_t offset = swap_offset(entry), len;
+	bool intr_flag;
+	int ret = 0;
+
+	down(&zswap_sem);
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	zswap_drop(offset);
+	if (page_is_zero(page2kva(page))) {
+		zswap_map[offset] = ZSWAP_ZERO;
+		zswap_stat.nr_stored++, zswap_stat.nr_zero++;
+		spin_unlock_irqrestore(&zswap_lock, intr_flag);
+		goto out;
+	}
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+
+	if ((len = lz_compress(page2kva(page), PGSIZE, zswap_buf,
+			       ZSWAP_MAX_LEN)) == 0) {
+		ret = -E_TOO_BIG;
+		goto rejected;
+	}
+	while (!zbud_store(entry, len)) {
+		if (!zswap_writeback()) {
+			ret = -E_NO_MEM;
+			goto rejected;
+		}
+	}
+out:
+	up(&zswap_sem);
+	return ret;
+
+rejected:
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	zswap_stat.nr_rejects++;
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+	goto out;
+}
+
+// zswap_load - decompress @entry into @page, returns -E_NOENT if it is not in memory
+int zswap_load(swap_entry_t entry, struct Page *page)
+{
+	if (!zswap_init_ok) {
+		return -E_NOENT;
+	}
+	size_t offset = swap_offset(entry);
+	bool intr_flag;
+	int ret = 0;
+
+	down(&zswap_sem);
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	uint16_t v = zswap_map[offset];
+	if (v == 0) {
+		zswap_stat.nr_misses++;
+		ret = -E_NOENT;
+	} else if (v == ZSWAP_ZERO) {
+		memset(page2kva(page), 0, PGSIZE);
+		zswap_stat.nr_hits++;
+	} else {
+		struct zbud_page *zbud = zbud_pages + zmap_index(v);
+		int slot = zmap_slot(v);
+		if (lz_decompress(zbud_addr(zbud, slot), zbud->len[slot],
+				  page2kva(page), PGSIZE) != PGSIZE) {
+			ret = -E_SWAP_FAULT;
+		} else {
+			zswap_stat.nr_hits++;
+		}
+	}
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+	up(&zswap_sem);
+	return ret;
+}
+
+// zswap_invalidate - drop the copy of @entry once the swap entry is freed or rewritten
+void zswap_invalidate(swap_entry_t entry)
+{
+	if (!zswap_init_ok) {
+		return;
+	}
+	bool intr_flag;
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	zswap_drop(swap_offset(entry));
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+}
+
+void zswap_get_stat(struct zswap_stat *stat)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	*stat = zswap_stat;
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+}
+
+void zswap_print_stat(void)
+{
+	struct zswap_stat stat;
+	zswap_get_stat(&stat);
+	size_t ratio = 0;
+	if (stat.compressed_bytes != 0) {
+		ratio = (stat.nr_stored - stat.nr_zero) * PGSIZE * 100 /
+		    stat.compressed_bytes;
+	}
+	kprintf("zswap: %d pages stored, %d zero-filled, %d pool pages\n",
+		stat.nr_stored, stat.nr_zero, stat.pool_pages);
+	kprintf("zswap: %d bytes compressed, ratio %d.%02d\n",
+		stat.compressed_bytes, ratio / 100, ratio % 100);
+	kprintf("zswap: %d hits, %d misses, %d rejects, %d writebacks\n",
+		stat.nr_hits, stat.nr_misses, stat.nr_rejects,
+		stat.nr_writebacks);
+}
+
+// zswap_init - called by swap_init once max_swap_offset is known
+void zswap_init(void)
+{
+	size_t i;
+	zswap_map = kmalloc(sizeof(uint16_t) * max_swap_offset);
+	zbud_pages = kmalloc(sizeof(struct zbud_page) * UCONFIG_ZSWAP_POOL_PAGES);
+	zswap_page = alloc_page();
+	assert(zswap_map != NULL && zbud_pages != NULL && zswap_page != NULL);
+
+	memset(zswap_map, 0, sizeof(uint16_t) * max_swap_offset);
+	list_init(&zbud_free_list);
+	list_init(&zbud_lru);
+	for (i = 0; i < ZBUD_NCHUNKS; i++) {
+		list_init(unbuddied + i);
+	}
+	for (i = 0; i < UCONFIG_ZSWAP_POOL_PAGES; i++) {
+		zbud_pages[i].page = NULL;
+		list_init(&(zbud_pages[i].lru_link));
+		list_add_before(&zbud_free_list, &(zbud_pages[i].buddy_link));
+	}
+	memset(&zswap_stat, 0, sizeof(zswap_stat));
+	spinlock_init(&zswap_lock);
+	sem_init(&zswap_sem, 1);
+
+	zswap_init_ok = 1;
+	check_zswap();
+}
+
+static void check_zswap(void)
+{
+	size_t nr_used_pages_store = nr_used_pages();
+	struct Page *page = alloc_page(), *out = alloc_page();
+	assert(page != NULL && out != NULL);
+	uint8_t *kva = page2kva(page);
+	const char *text = "zswap keeps swapped-out pages ";
+	uint32_t seed = 1;
+	size_t i, len;
+
+	// text-like data compresses well, random data is rejected
+	for (i = 0; i < PGSIZE; i++) {
+		kva[i] = text[i % 30] ^ (i / 512);
+	}
+	len = lz_compress(kva, PGSIZE, zswap_buf, ZSWAP_MAX_LEN);
+	assert(len != 0 && len < PGSIZE / 4);
+	assert(lz_decompress(zswap_buf, len, page2kva(out), PGSIZE) == PGSIZE);
+	assert(memcmp(kva, page2kva(out), PGSIZE) == 0);
+	assert(lz_decompress(zswap_buf, len - 1, page2kva(out), PGSIZE) !=
+	       PGSIZE);
+
+	swap_entry_t e1 = (1 << 8), e2 = (2 << 8), e3 = (3 << 8);
+	assert(zswap_store(e1, page) == 0);
+
+	for (i = 0; i < PGSIZE; i++) {
+		seed = seed * 1103515245 + 12345;
+		kva[i] = seed >> 16;
+	}
+	assert(lz_compress(kva, PGSIZE, zswap_buf, ZSWAP_MAX_LEN) == 0);
+	assert(zswap_store(e2, page) == -E_TOO_BIG);
+
+	memset(kva, 0, PGSIZE);
+	assert(zswap_store(e3, page) == 0);
+	assert(zswap_stat.nr_stored == 2 && zswap_stat.nr_zero == 1);
+	assert(zswap_stat.pool_pages == 1 && zswap_stat.nr_rejects == 1);
+
+	// both copies come back, the rejected one is not there
+	assert(zswap_load(e1, out) == 0);
+	for (i = 0; i < PGSIZE; i++) {
+		assert(((uint8_t *) page2kva(out))[i] ==
+		       (uint8_t) (text[i % 30] ^ (i / 512)));
+	}
+	memset(page2kva(out), 0xFF, PGSIZE);
+	assert(zswap_load(e3, out) == 0 && page_is_zero(page2kva(out)));
+	assert(zswap_load(e2, out) == -E_NOENT);
+	assert(zswap_stat.nr_hits == 2 && zswap_stat.nr_misses == 1);
+
+	zswap_invalidate(e1), zswap_invalidate(e2), zswap_invalidate(e3);
+	assert(zswap_load(e1, out) == -E_NOENT);
+	assert(zswap_stat.nr_stored == 0 && zswap_stat.pool_pages == 0);
+	assert(list_empty(&zbud_lru) && zswap_stat.compressed_bytes == 0);
+
+	free_page(page), free_page(out);
+	memset(&zswap_stat, 0, sizeof(zswap_stat));
+	assert(nr_used_pages_store == nr_used_pages());
+
+	kprintf("check_zswap() succeeded.\n");
+}
+
+#endif /* UCONFIG_ZSWAP */
@@ -0,0 +1,29 @@
+#ifndef __KERN_MM_ZSWAP_H__
+#define __KERN_MM_ZSWAP_H__
+
+#include <types.h>
+#include <memlayout.h>
+
+#ifdef UCONFIG_ZSWAP
+
+struct zswap_stat {
+	size_t nr_stored;	// swap entries held in memory
+	size_t nr_zero;		// ... of which zero-filled, taking no pool space
+	size_t pool_pages;	// pages used to hold the compressed data
+	size_t compressed_bytes;
+	size_t nr_hits;		// swap-ins served from memory
+	size_t nr_misses;	// swap-ins read from swap space
+	size_t nr_rejects;	// stores that went to swap space
+	size_t nr_writebacks;	// entries pushed to swap space by a full pool
+};
+
+void zswap_init(void);
+int zswap_store(swap_entry_t entry, struct Page *page);
+int zswap_load(swap_entry_t entry, struct Page *page);
+void zswap_invalidate(swap_entry_t entry);
+void zswap_get_stat(struct zswap_stat *stat);
+void zswap_print_stat(void);
+
+#endif /* UCONFIG_ZSWAP */
+
+#endif /* !__KERN_MM_ZSWAP_H__ */
@@ -252,21 +252,46 @@ err_t ethernet_lwip_netif_init(struct netif *netif)
 }
 
 struct netif *__netif = NULL;
-void ethernet_add_driver(struct ethernet_driver* driver)
+
+static struct netif *ethernet_add_netif(struct ethernet_driver* driver,
+  ip_addr_t *ipaddr, ip_addr_t *netmask, ip_addr_t *gateway)
 {
   list_add(&ethernet_driver_list, &driver->list_entry);
   driver->receive_notifier = ethernet_receive_notifier;
   lwip_current_driver = driver;
   struct netif *netif = kmalloc(sizeof(struct netif));
   driver->lwip_netif = netif;
+  NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL);
+  netif_add(netif, ipaddr, netmask, gateway, 0, ethernet_lwip_netif_init, ethernet_input);
+  netif_set_link_up(netif);
+  netif_set_up(netif);
+  return netif;
+}
+
+void ethernet_add_driver(struct ethernet_driver* driver)
+{
   ip_addr_t ipaddr, netmask, gateway;
   IP4_ADDR(&gateway, 0, 0, 0, 0);
   IP4_ADDR(&ipaddr, 0, 0, 0, 0);
   IP4_ADDR(&netmask, 0, 0, 0, 0);
-  NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL);
-  netif_add(netif, &ipaddr, &netmask, &gateway, 0, ethernet_lwip_netif_init, ethernet_input);
-  netif_set_link_up(netif);
-  netif_set_up(netif);
+  struct netif *netif = ethernet_add_netif(driver, &ipaddr, &netmask, &gateway);
   netif_set_default(netif);
   __netif = netif;
 }
+
+void ethernet_add_virtual_driver(struct ethernet_driver* driver,
+  const char *name, const uint8_t ip[4], const uint8_t mask[4])
+{
+  ip_addr_t ipaddr, netmask, gateway;
+  IP4_ADDR(&gateway, 0, 0, 0, 0);
+  IP4_ADDR(&ipaddr, ip[0], ip[1], ip[2], ip[3]);
+  IP4_ADDR(&netmask, mask[0], mask[1], mask[2], mask[3]);
+  struct netif *netif = ethernet_add_netif(driver, &ipaddr, &netmask, &gateway);
+  netif->name[0] = name[0];
+  netif->name[1] = name[1];
+}
+
+bool ethernet_has_driver()
+{
+  return !list_empty(&ethernet_driver_list);
+}
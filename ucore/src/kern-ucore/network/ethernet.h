@@ -44,5 +44,10 @@ void ethernet_lwip_process_data();
 
 void ethernet_init();
 void ethernet_add_driver(struct ethernet_driver* driver);
+//Adds a driver with a static IPv4 address; it never becomes the default route
+//and is not configured by DHCP.
+void ethernet_add_virtual_driver(struct ethernet_driver* driver,
+  const char *name, const uint8_t ip[4], const uint8_t mask[4]);
+bool ethernet_has_driver();
 
 #endif /* __KERN_NETWORK_ETHERNET_H__ */
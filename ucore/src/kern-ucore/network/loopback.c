@@ -0,0 +1,160 @@
+#include <types.h>
+#include <slab.h>
+#include <string.h>
+#include <list.h>
+#include <stddef.h>
+#include <assert.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <kio.h>
+#include <ethernet.h>
+#include "loopback.h"
+
+#include "lwip/netif.h"
+#include "netif/etharp.h"
+
+struct loopback_frame
+{
+  uint16_t length;
+  uint8_t *data;
+  list_entry_t list_entry;
+};
+
+struct loopback_device
+{
+  struct ethernet_driver ethernet_driver;
+  //Device receiving what we send; points to ourself for lo.
+  struct loopback_device *peer;
+  uint8_t mac[6];
+  spinlock_s rx_lock;
+  list_entry_t rx_queue;
+  int rx_queued;
+  unsigned long rx_dropped;
+};
+
+static void loopback_send_handler(
+  struct ethernet_driver* driver, uint16_t length, uint8_t *data
+) {
+  struct loopback_device *device = driver->private_data;
+  struct loopback_device *peer = device->peer;
+  //The caller frees data after we return, so the frame must be copied.
+  struct loopback_frame *frame = kmalloc(sizeof(struct loopback_frame));
+  if(frame == NULL) return;
+  frame->data = kmalloc(length);
+  if(frame->data == NULL) {
+    kfree(frame);
+    return;
+  }
+  memcpy(frame->data, data, length);
+  frame->length = length;
+
+  bool intr_flag;
+  spin_lock_irqsave(&peer->rx_lock, intr_flag);
+  if(peer->rx_queued >= LOOPBACK_RX_QUEUE_LEN) {
+    peer->rx_dropped++;
+    spin_unlock_irqrestore(&peer->rx_lock, intr_flag);
+    kfree(frame->data);
+    kfree(frame);
+    return;
+  }
+  list_add_before(&peer->rx_queue, &frame->list_entry);
+  peer->rx_queued++;
+  spin_unlock_irqrestore(&peer->rx_lock, intr_flag);
+
+  if(peer->ethernet_driver.receive_notifier != NULL) {
+    peer->ethernet_driver.receive_notifier(&peer->ethernet_driver);
+  }
+}
+
+static void loopback_receive_handler(
+  struct ethernet_driver* driver, uint16_t *length, uint8_t **data
+) {
+  struct loopback_device *device = driver->private_data;
+  struct loopback_frame *frame = NULL;
+  bool intr_flag;
+  spin_lock_irqsave(&device->rx_lock, intr_flag);
+  if(!list_empty(&device->rx_queue)) {
+    list_entry_t *le = list_next(&device->rx_queue);
+    list_del(le);
+    device->rx_queued--;
+    frame = container_of(le, struct loopback_frame, list_entry);
+  }
+  spin_unlock_irqrestore(&device->rx_lock, intr_flag);
+  if(frame == NULL) {
+    *data = NULL;
+    return;
+  }
+  //Ownership of the buffer goes to the ethernet layer, which kfree()s it.
+  *length = frame->length;
+  *data = frame->data;
+  kfree(frame);
+}
+
+static void loopback_get_mac_address_handler(
+  struct ethernet_driver* driver, uint8_t* mac_store
+) {
+  struct loopback_device *device = driver->private_data;
+  memcpy(mac_store, device->mac, 6);
+}
+
+static struct loopback_device* loopback_device_create(uint8_t mac_suffix)
+{
+  struct loopback_device *device = kmalloc(sizeof(struct loopback_device));
+  assert(device != NULL);
+  memset(device, 0, sizeof(struct loopback_device));
+  struct ethernet_driver *driver = &device->ethernet_driver;
+  driver->private_data = device;
+  driver->send_handler = loopback_send_handler;
+  driver->receive_handler = loopback_receive_handler;
+  driver->get_mac_address_handler = loopback_get_mac_address_handler;
+  //Locally administered unicast address 02:00:00:00:00:xx
+  device->mac[0] = 0x02;
+  device->mac[5] = mac_suffix;
+  device->peer = device;
+  spinlock_init(&device->rx_lock);
+  list_init(&device->rx_queue);
+  return device;
+}
+
+#ifdef UCONFIG_NET_VETH
+/*
+ * lwIP routes by destination only, so a packet for one end of the pair may
+ * be handed to that very end. Transmit it from the other end instead, so
+ * that it crosses the pair like it would between two hosts.
+ */
+static err_t veth_output(struct netif *netif, struct pbuf *p,
+  const ip4_addr_t *ipaddr)
+{
+  struct ethernet_driver *driver = (struct ethernet_driver*)netif->state;
+  struct loopback_device *device = driver->private_data;
+  if(ip4_addr_cmp(ipaddr, netif_ip4_addr(netif))) {
+    netif = device->peer->ethernet_driver.lwip_netif;
+  }
+  return etharp_output(netif, p, ipaddr);
+}
+#endif
+
+void loopback_init()
+{
+#ifdef UCONFIG_NET_LOOPBACK
+  static const uint8_t lo_ip[4] = {127, 0, 0, 1};
+  static const uint8_t lo_netmask[4] = {255, 0, 0, 0};
+  struct loopback_device *lo = loopback_device_create(0x01);
+  ethernet_add_virtual_driver(&lo->ethernet_driver, "lo", lo_ip, lo_netmask);
+  kprintf("loopback: lo up, 127.0.0.1/8\n");
+#endif
+#ifdef UCONFIG_NET_VETH
+  static const uint8_t ve0_ip[4] = {10, 0, 0, 1};
+  static const uint8_t ve1_ip[4] = {10, 0, 0, 2};
+  static const uint8_t ve_netmask[4] = {255, 255, 255, 0};
+  struct loopback_device *ve0 = loopback_device_create(0x10);
+  struct loopback_device *ve1 = loopback_device_create(0x11);
+  ve0->peer = ve1;
+  ve1->peer = ve0;
+  ethernet_add_virtual_driver(&ve0->ethernet_driver, "ve", ve0_ip, ve_netmask);
+  ethernet_add_virtual_driver(&ve1->ethernet_driver, "ve", ve1_ip, ve_netmask);
+  ve0->ethernet_driver.lwip_netif->output = veth_output;
+  ve1->ethernet_driver.lwip_netif->output = veth_output;
+  kprintf("loopback: ve0 10.0.0.1/24 <-> ve1 10.0.0.2/24\n");
+#endif
+}
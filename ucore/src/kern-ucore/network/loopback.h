@@ -0,0 +1,19 @@
+#ifndef __KERN_NETWORK_LOOPBACK_H__
+#define __KERN_NETWORK_LOOPBACK_H__
+
+#include <types.h>
+
+/*
+ * In-memory ethernet devices, used to exercise and benchmark the network
+ * stack on machines without a real NIC.
+ *
+ * lo            : every frame sent is received again by the same device.
+ * ve0 <-> ve1   : a virtual ethernet pair, frames sent on one end are
+ *                 received by the other.
+ */
+
+#define LOOPBACK_RX_QUEUE_LEN 256
+
+void loopback_init();
+
+#endif /* __KERN_NETWORK_LOOPBACK_H__ */
@@ -1,5 +1,6 @@
 #include <network.h>
 #include <ethernet.h>
+#include <loopback.h>
 #include "lwip/init.h"
 #include "input_thread.h"
 
@@ -8,4 +9,5 @@ void network_init()
   ethernet_init();
   lwip_init();
   network_input_thread_init();
+  loopback_init();
 }
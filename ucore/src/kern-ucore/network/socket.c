@@ -3,13 +3,17 @@
 #include <fd_set.h>
 #include <file.h>
 #include <error.h>
+#include <kio.h>
 #include <stat.h>
 #include <kernel_file_pool.h>
 #include <file_desc_table.h>
+#include <vfs.h>
 #include "lwip/sockets.h"
 #include "socket_inode.h"
 #include "socket.h"
 #include <linux_misc_struct.h>
+#include <vmm.h>
+#include <proc.h>
 
 //TODO : Check user mem!
 //TODO : Check addr length!
@@ -35,11 +39,6 @@ static int wrap_lwip_socket(int lwip_fd)
   if(file == NULL) {
     return -E_NFILE;
   }
-  ret = file_desc_table_get_unused(desc_table);
-  if(ret == -1) {
-    kernel_file_pool_free(file);
-    return -E_MFILE;
-  }
   file_init(file);
   struct inode *node = NULL;
   node = alloc_inode(default_inode);
@@ -49,12 +48,16 @@ static int wrap_lwip_socket(int lwip_fd)
   file->node = node;
   file->readable = 1;
   file->writable = 1;
-  file_desc_table_associate(desc_table, ret, file);
   struct socket_inode_private_data *private_data = kmalloc(sizeof(struct socket_inode_private_data));
   node->private_data = private_data;
   private_data->lwip_socket = lwip_fd;
   vop_open_inc(node);
   vop_ref_inc(node);
+  //Only publish the fd once the socket behind it is set up.
+  if((ret = file_desc_table_install(desc_table, file)) < 0) {
+    vfs_close(node);
+    kernel_file_pool_free(file);
+  }
   return ret;
 }
 
@@ -132,7 +135,6 @@ int socket_listen(int fd, int backlog)
 
 int socket_accept(int fd, struct linux_sockaddr __user *upeer_sockaddr, int __user *upeer_addrlen)
 {
-  kprintf("Entering socket_accept %x %x\n", upeer_sockaddr, upeer_addrlen);
   int ret, lwip_fd;
   ret = socket_ucore_fd_to_lwip_fd(fd, &lwip_fd);
   if(ret != 0) return ret;
@@ -181,7 +183,6 @@ int socket_getpeername(int fd, struct linux_sockaddr __user *usockaddr, int __us
 
 int socket_sendto(int fd, void __user *buff, size_t len, unsigned int flags, struct linux_sockaddr __user *addr, int addr_len)
 {
-  kprintf("Kernel Level socket_sendto\n");
   int ret, lwip_fd;
   ret = socket_ucore_fd_to_lwip_fd(fd, &lwip_fd);
   if(ret != 0) return ret;
@@ -189,43 +190,60 @@ int socket_sendto(int fd, void __user *buff, size_t len, unsigned int flags, str
   memcpy(kernel_buff, buff, len);
   if(addr == NULL) {
     ret = lwip_send(lwip_fd, kernel_buff, len, flags);
-    kprintf("**Kernel Level socket_sendto ret %d\n", ret);
   }
   else {
     struct sockaddr *lwip_sockaddr = kmalloc(sizeof(struct sockaddr));
     linux_sockaddr_to_lwip_sockaddr(addr, lwip_sockaddr);
     ret = lwip_sendto(lwip_fd, kernel_buff, len, flags, lwip_sockaddr, sizeof(struct sockaddr));
     kfree(lwip_sockaddr);
-    kprintf("##Kernel Level socket_sendto ret %d\n", ret);
   }
   //TODO: Not sure if lwip_sendto will free the buffer passed to it.
   kfree(kernel_buff);
-  kprintf("Kernel Level socket_sendto ret %d\n", ret);
   return ret;
 }
 
 int socket_recvfrom(int fd, void __user *ubuf, size_t size, unsigned int flags, struct linux_sockaddr __user *addr, int __user *addr_len)
 {
+  struct mm_struct *mm = current->mm;
   int ret, lwip_fd;
   ret = socket_ucore_fd_to_lwip_fd(fd, &lwip_fd);
-  if(ret != 0) assert(false);
   if(ret != 0) return ret;
   char* kernel_buff = kmalloc(size);
+  if(kernel_buff == NULL) return -E_NO_MEM;
+  struct sockaddr lwip_sockaddr;
+  struct linux_sockaddr linux_sockaddr;
+  int kernel_addr_len = sizeof(struct sockaddr);
   if(addr == NULL) {
-    kprintf("Kernel Level socket_recvfrom\n");
     ret = lwip_recv(lwip_fd, kernel_buff, size, flags);
-    kprintf("Leaving Level socket_recvfrom\n");
   }
   else {
-    //FIXME: Handle cases where linux_sockaddr is needed to copy to user!
-    int kernel_addr_len = *addr_len;
-    struct sockaddr *lwip_sockaddr = kmalloc(sizeof(struct sockaddr));
-    linux_sockaddr_to_lwip_sockaddr(addr, lwip_sockaddr);
-    ret = lwip_recvfrom(lwip_fd, kernel_buff, size, flags, lwip_sockaddr, &kernel_addr_len);
-    *addr_len = kernel_addr_len;
-    kfree(lwip_sockaddr);
+    ret = lwip_recvfrom(lwip_fd, kernel_buff, size, flags, &lwip_sockaddr, &kernel_addr_len);
+  }
+  if(ret > 0) {
+    lock_mm(mm);
+    if(!copy_to_user(mm, ubuf, kernel_buff, ret)) {
+      ret = -E_INVAL;
+    }
+    else if(addr != NULL) {
+      //Hand back the peer, cut to the room the caller gave us.
+      int user_addr_len = sizeof(struct linux_sockaddr);
+      memset(&linux_sockaddr, 0, sizeof(struct linux_sockaddr));
+      lwip_sockaddr_to_linux_sockaddr(&lwip_sockaddr, &linux_sockaddr);
+      if(addr_len == NULL || !copy_from_user(mm, &kernel_addr_len, addr_len, sizeof(int), 0)) {
+        ret = -E_INVAL;
+      }
+      else {
+        if(kernel_addr_len > user_addr_len || kernel_addr_len < 0) {
+          kernel_addr_len = user_addr_len;
+        }
+        if(!copy_to_user(mm, addr, &linux_sockaddr, kernel_addr_len) ||
+           !copy_to_user(mm, addr_len, &user_addr_len, sizeof(int))) {
+          ret = -E_INVAL;
+        }
+      }
+    }
+    unlock_mm(mm);
   }
-  memcpy(ubuf, kernel_buff, size);
   kfree(kernel_buff);
   return ret;
 }
@@ -251,7 +269,7 @@ int socket_get_option(int fd, int level, int optname, char __user *optval, int *
 int socket_lwip_select_wrapper(int nfds, linux_fd_set_t *readfds, linux_fd_set_t *writefds,
   linux_fd_set_t *exceptfds, struct linux_timeval *timeout)
 {
-  kprintf("Enetring socket_lwip_select_wrapper\n");
+  kprintf(KERN_DEBUG "Enetring socket_lwip_select_wrapper\n");
   fd_set *lwip_readfds = kmalloc(sizeof(fd_set));
   fd_set *lwip_writefds = kmalloc(sizeof(fd_set));
   fd_set *lwip_exceptfds = kmalloc(sizeof(fd_set));
@@ -273,8 +291,8 @@ int socket_lwip_select_wrapper(int nfds, linux_fd_set_t *readfds, linux_fd_set_t
       FD_SET(lwip_fd, lwip_exceptfds);
     }
   }
-  if(lwip_readfds) kprintf("readfds: %x\n", *(int*)lwip_readfds);
-  if(lwip_writefds) kprintf("readfds: %x\n", *(int*)lwip_writefds);
+  if(lwip_readfds) kprintf(KERN_DEBUG "readfds: %x\n", *(int*)lwip_readfds);
+  if(lwip_writefds) kprintf(KERN_DEBUG "readfds: %x\n", *(int*)lwip_writefds);
   int ret = lwip_select(
     nfds, lwip_readfds, lwip_writefds, lwip_exceptfds, (struct timeval*)timeout
   );
@@ -302,7 +320,7 @@ int socket_lwip_select_wrapper(int nfds, linux_fd_set_t *readfds, linux_fd_set_t
   kfree(lwip_readfds);
   kfree(lwip_writefds);
   kfree(lwip_exceptfds);
-  kprintf("Leaving socket_lwip_select_wrapper\n");
+  kprintf(KERN_DEBUG "Leaving socket_lwip_select_wrapper\n");
   return ret;
 }
 
@@ -338,7 +356,7 @@ int socket_lwip_select_wrapper_no_block(
   linux_fd_set_t *exceptfds, struct linux_timeval *timeout,
   struct proc_struct **proc_to_wakeup, int *result_store
 ) {
-  kprintf("### %x\n", *(int*)exceptfds);
+  kprintf(KERN_DEBUG "### %x\n", *(int*)exceptfds);
   machine_word_t *thread_data = kmalloc(sizeof(machine_word_t) * 7);
   thread_data[0] = (machine_word_t)nfds;
   thread_data[1] = (machine_word_t)readfds;
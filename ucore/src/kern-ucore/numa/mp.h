@@ -17,6 +17,16 @@ struct cpu;
 struct numa_node;
 
 
+/* page allocation counters, see struct numa_stat */
+struct numa_node_stat{
+	atomic_t numa_hit;
+	atomic_t numa_miss;
+	atomic_t numa_foreign;
+	atomic_t interleave_hit;
+	atomic_t local_node;
+	atomic_t other_node;
+};
+
 struct numa_node{
 	uint32_t id;
 	uint32_t hwid;
@@ -27,6 +37,11 @@ struct numa_node{
 		uint64_t  length;
 	}mems[MAX_NUMA_MEMS];
 	int cpu_ids[NCPU];
+	/* SLIT distances to the other nodes, by id; 10 is local */
+	uint8_t distance[MAX_NUMA_NODES];
+	/* all node ids sorted by distance, this node first */
+	int fallback[MAX_NUMA_NODES];
+	struct numa_node_stat stat;
 };
 
 struct proc_struct;
@@ -0,0 +1,193 @@
+#include <types.h>
+#include <list.h>
+#include <slab.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <pid.h>
+
+/* *
+ * pid allocation
+ *
+ * The in-use pids are kept in a bitmap. pid_alloc searches for the next
+ * clear bit after the cursor, skipping full words, so an allocation costs
+ * O(1) amortized as long as the pid space is not nearly exhausted
+ * (MAX_PID is kept well above MAX_PROCESS). pid_free clears the bit.
+ * */
+
+struct pid_namespace init_pid_ns;
+
+extern spinlock_s proc_lock;
+
+static inline void pid_map_set(struct pid_namespace *ns, int pid)
+{
+	ns->map[pid / PID_MAP_BITS] |= (1UL << (pid % PID_MAP_BITS));
+}
+
+static inline void pid_map_clear(struct pid_namespace *ns, int pid)
+{
+	ns->map[pid / PID_MAP_BITS] &= ~(1UL << (pid % PID_MAP_BITS));
+}
+
+static inline bool pid_map_test(struct pid_namespace *ns, int pid)
+{
+	return (ns->map[pid / PID_MAP_BITS] >> (pid % PID_MAP_BITS)) & 1;
+}
+
+// pid_map_find_zero - find the first clear bit in [start, MAX_PID), -1 if none
+static int pid_map_find_zero(struct pid_namespace *ns, int start)
+{
+	int idx = start / PID_MAP_BITS;
+	unsigned long word = ns->map[idx] | ((1UL << (start % PID_MAP_BITS)) - 1);
+	while (1) {
+		if (word != ~0UL) {
+			int pid = idx * PID_MAP_BITS + __builtin_ctzl(~word);
+			return pid < MAX_PID ? pid : -1;
+		}
+		if (++idx >= PID_MAP_WORDS) {
+			return -1;
+		}
+		word = ns->map[idx];
+	}
+}
+
+void pid_init(struct pid_namespace *ns, int min_pid)
+{
+	static_assert(MAX_PID > MAX_PROCESS);
+	assert(0 < min_pid && min_pid < MAX_PID);
+	int pid;
+	memset(ns->map, 0, sizeof(ns->map));
+	for (pid = 0; pid < min_pid; pid++) {
+		pid_map_set(ns, pid);
+	}
+	ns->min_pid = min_pid;
+	ns->last_pid = min_pid - 1;
+	ns->nr_free = MAX_PID - min_pid;
+}
+
+// pid_alloc - alloc a unique pid, or -1 if the pid space is exhausted
+int pid_alloc(struct pid_namespace *ns)
+{
+	int pid;
+	if (ns->nr_free == 0) {
+		return -1;
+	}
+	if (ns->last_pid + 1 >= MAX_PID
+	    || (pid = pid_map_find_zero(ns, ns->last_pid + 1)) < 0) {
+		pid = pid_map_find_zero(ns, ns->min_pid);
+	}
+	assert(pid >= ns->min_pid);
+	pid_map_set(ns, pid);
+	ns->nr_free--;
+	ns->last_pid = pid;
+	return pid;
+}
+
+void pid_free(struct pid_namespace *ns, int pid)
+{
+	if (pid < ns->min_pid || pid >= MAX_PID) {
+		return;
+	}
+	assert(pid_map_test(ns, pid));
+	pid_map_clear(ns, pid);
+	ns->nr_free++;
+}
+
+/* *
+ * pid -> proc_struct hash table
+ *
+ * It starts with a small static table and doubles when the average chain
+ * length exceeds PID_HASH_LOAD, up to PID_HASH_MAX_SHIFT. Growing needs
+ * kmalloc, so it is done by pid_hash_grow outside of proc_lock.
+ * */
+
+#define PID_HASH_MIN_SHIFT          6
+#define PID_HASH_MAX_SHIFT          12
+#define PID_HASH_LOAD               2
+
+static list_entry_t pid_hash_boot[1 << PID_HASH_MIN_SHIFT];
+static list_entry_t *pid_hash = pid_hash_boot;
+static int pid_hash_shift = PID_HASH_MIN_SHIFT;
+static int pid_hash_count = 0;
+
+#define pid_hashfn(x, shift)        (hash32(x, shift))
+
+void pid_hash_init(void)
+{
+	int i;
+	for (i = 0; i < (1 << PID_HASH_MIN_SHIFT); i++) {
+		list_init(pid_hash_boot + i);
+	}
+}
+
+void pid_hash_add(struct proc_struct *proc)
+{
+	list_add(pid_hash + pid_hashfn(proc->pid, pid_hash_shift),
+		 &(proc->hash_link));
+	pid_hash_count++;
+}
+
+void pid_hash_del(struct proc_struct *proc)
+{
+	list_del(&(proc->hash_link));
+	pid_hash_count--;
+}
+
+struct proc_struct *pid_hash_find(int pid)
+{
+	list_entry_t *list = pid_hash + pid_hashfn(pid, pid_hash_shift), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct proc_struct *proc = le2proc(le, hash_link);
+		if (proc->pid == pid) {
+			return proc;
+		}
+	}
+	return NULL;
+}
+
+void pid_hash_grow(void)
+{
+	int shift = pid_hash_shift, i;
+	if (shift >= PID_HASH_MAX_SHIFT
+	    || pid_hash_count <= (PID_HASH_LOAD << shift)) {
+		return;
+	}
+	int new_shift = shift + 1;
+	list_entry_t *new_hash = kmalloc(sizeof(list_entry_t) << new_shift);
+	if (new_hash == NULL) {
+		// lookups just stay slower
+		return;
+	}
+	for (i = 0; i < (1 << new_shift); i++) {
+		list_init(new_hash + i);
+	}
+
+	list_entry_t *old_hash = NULL;
+	bool intr_flag;
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	if (pid_hash_shift == shift) {
+		for (i = 0; i < (1 << shift); i++) {
+			list_entry_t *list = pid_hash + i, *le;
+			while ((le = list_next(list)) != list) {
+				struct proc_struct *proc = le2proc(le, hash_link);
+				list_del(le);
+				list_add(new_hash + pid_hashfn(proc->pid, new_shift), le);
+			}
+		}
+		old_hash = pid_hash;
+		pid_hash = new_hash;
+		pid_hash_shift = new_shift;
+		new_hash = NULL;
+	}
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
+
+	if (new_hash != NULL) {
+		// somebody else grew the table first
+		kfree(new_hash);
+	}
+	if (old_hash != NULL && old_hash != pid_hash_boot) {
+		kfree(old_hash);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef __KERN_PROCESS_PID_H__
+#define __KERN_PROCESS_PID_H__
+
+#include <types.h>
+#include <proc.h>
+
+#define PID_MAP_BITS                (sizeof(unsigned long) * 8)
+#define PID_MAP_WORDS               ((MAX_PID + PID_MAP_BITS - 1) / PID_MAP_BITS)
+
+/* *
+ * A pid space: a bitmap of the pids in use and a rotating cursor, so that
+ * a freed pid is not handed out again until the whole space has wrapped.
+ * Only init_pid_ns exists for now; the allocator takes the namespace as an
+ * argument so that nested pid namespaces can be added later.
+ * */
+struct pid_namespace {
+	unsigned long map[PID_MAP_WORDS];
+	int last_pid;		// the pid handed out most recently
+	int min_pid;		// pids below this are reserved (idle procs)
+	int nr_free;		// # of free pids in [min_pid, MAX_PID)
+};
+
+extern struct pid_namespace init_pid_ns;
+
+/* all functions below except pid_hash_grow must be called with proc_lock held */
+void pid_init(struct pid_namespace *ns, int min_pid);
+int pid_alloc(struct pid_namespace *ns);
+void pid_free(struct pid_namespace *ns, int pid);
+
+void pid_hash_init(void);
+void pid_hash_add(struct proc_struct *proc);
+void pid_hash_del(struct proc_struct *proc);
+struct proc_struct *pid_hash_find(int pid);
+/* grow the pid hash table if it is overloaded, takes proc_lock itself */
+void pid_hash_grow(void);
+
+#endif /* !__KERN_PROCESS_PID_H__ */
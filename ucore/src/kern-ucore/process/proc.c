@@ -1,4 +1,5 @@
 #include <proc.h>
+#include <pid.h>
 #include <slab.h>
 #include <string.h>
 #include <sync.h>
@@ -18,6 +19,8 @@
 #include <vfs.h>
 #include <sysfile.h>
 #include <swap.h>
+#include <ksm.h>
+#include <sfs.h>
 #include <mbox.h>
 #include <kio.h>
 #include <stdio.h>
@@ -30,6 +33,10 @@
 #include <refcache.h>
 #include <spinlock.h>
 #include <network/input_thread.h>
+#include <network/ethernet.h>
+#ifdef UCONFIG_VDSO
+#include <vdso_data.h>
+#endif
 
 /* ------------- process/thread mechanism design&implementation -------------
 (an simplified Linux process/thread mechanism )
@@ -86,15 +93,11 @@ struct proc_struct *kswapd;
 spinlock_s proc_lock;
 // the process set's list
 list_entry_t proc_list;
-// the process set's mm's list
-list_entry_t proc_mm_list;
-
-#define HASH_SHIFT          10
-#define HASH_LIST_SIZE      (1 << HASH_SHIFT)
-#define pid_hashfn(x)       (hash32(x, HASH_SHIFT))
+// the process set's mm's list, scanners find an mm there without a reference
+static list_entry_t proc_mm_list;
+static spinlock_s proc_mm_lock;
+static int nr_proc_mm = 0;
 
-// has list for process set based on pid
-static list_entry_t hash_list[HASH_LIST_SIZE];
 static int nr_process = 0;
 
 ////////////////////////////////////////////////
@@ -146,45 +149,6 @@ static void remove_links(struct proc_struct *proc)
 	nr_process--;
 }
 
-// get_pid - alloc a unique pid for process
-static int get_pid(void)
-{
-	static_assert(MAX_PID > MAX_PROCESS);
-	struct proc_struct *proc;
-	list_entry_t *list = &proc_list, *le;
-	static int next_safe = MAX_PID, last_pid = MAX_PID;
-	if (++last_pid >= MAX_PID) {
-#ifdef ARCH_RISCV64
-		last_pid = NCPU;
-#else
-		last_pid = sysconf.lcpu_count;
-#endif
-		goto inside;
-	}
-	if (last_pid >= next_safe) {
-inside:
-		next_safe = MAX_PID;
-repeat:
-		le = list;
-		while ((le = list_next(le)) != list) {
-			proc = le2proc(le, list_link);
-			if (proc->pid == last_pid) {
-				if (++last_pid >= next_safe) {
-					if (last_pid >= MAX_PID) {
-						last_pid = 1;
-					}
-					next_safe = MAX_PID;
-					goto repeat;
-				}
-			} else if (proc->pid > last_pid
-				   && next_safe > proc->pid) {
-				next_safe = proc->pid;
-			}
-		}
-	}
-	return last_pid;
-}
-
 // proc_run - make process "proc" running on cpu
 // NOTE: before call switch_to, should load  base addr of "proc"'s new PDT
 void proc_run(struct proc_struct *proc)
@@ -207,6 +171,9 @@ void proc_run(struct proc_struct *proc)
 #endif //UCONFIG_BIONIC_LIBC
 #ifdef ARCH_RISCV64
 			mycpu()->prev = prev;
+#endif
+#ifdef UCONFIG_VDSO
+			vdso_switch(next);
 #endif
 			switch_to(&(prev->context), &(next->context));
 		}
@@ -217,32 +184,27 @@ void proc_run(struct proc_struct *proc)
 // hash_proc - add proc into proc hash_list
 static void hash_proc(struct proc_struct *proc)
 {
-	list_add(hash_list + pid_hashfn(proc->pid), &(proc->hash_link));
+	pid_hash_add(proc);
 }
 
-// unhash_proc - delete proc from proc hash_list
+// unhash_proc - delete proc from proc hash_list and release its pid
 static void unhash_proc(struct proc_struct *proc)
 {
-	list_del(&(proc->hash_link));
+	pid_hash_del(proc);
+	pid_free(&init_pid_ns, proc->pid);
 }
 
 // find_proc - find proc frome proc hash_list according to pid
 struct proc_struct *find_proc(int pid)
 {
 	int intr_flag;
+	struct proc_struct *proc = NULL;
 	spin_lock_irqsave(&proc_lock, intr_flag);
 	if (0 < pid && pid < MAX_PID) {
-		list_entry_t *list = hash_list + pid_hashfn(pid), *le = list;
-		while ((le = list_next(le)) != list) {
-			struct proc_struct *proc = le2proc(le, hash_link);
-			if (proc->pid == pid) {
-				spin_unlock_irqrestore(&proc_lock, intr_flag);
-				return proc;
-			}
-		}
+		proc = pid_hash_find(pid);
 	}
 	spin_unlock_irqrestore(&proc_lock, intr_flag);
-	return NULL;
+	return proc;
 }
 
 // setup_kstack - alloc pages with size KSTACKPAGE as process kernel stack
@@ -311,6 +273,70 @@ static void put_pgdir(struct mm_struct *mm)
 }
 #endif
 
+// mm_onzero - the refcache callback of an mm nobody holds any more
+static int mm_onzero(struct refobj *obj)
+{
+	struct mm_struct *mm = to_struct(obj, struct mm_struct, mm_ref);
+	bool intr_flag, listed;
+	spin_lock_irqsave(&proc_mm_lock, intr_flag);
+	if ((listed = !list_empty(&(mm->proc_mm_link)))) {
+		list_del_init(&(mm->proc_mm_link));
+		nr_proc_mm--;
+	}
+	spin_unlock_irqrestore(&proc_mm_lock, intr_flag);
+	if (listed) {
+		/* a scanner may have pinned it from the list meanwhile, the
+		 * next review sees that reference */
+		return 0;
+	}
+	exit_mmap(mm);
+	put_pgdir(mm);
+	mm_destroy(mm);
+	return 1;
+}
+
+// put_mm - drop a reference to @mm, the krefcache cleaner tears it down after the last one
+void put_mm(struct mm_struct *mm)
+{
+	mm_count_dec(mm);
+}
+
+// proc_mm_add - let the scanners find @mm
+static void proc_mm_add(struct mm_struct *mm)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&proc_mm_lock, intr_flag);
+	list_add(&(proc_mm_list), &(mm->proc_mm_link));
+	nr_proc_mm++;
+	spin_unlock_irqrestore(&proc_mm_lock, intr_flag);
+}
+
+/**
+ * proc_mm_next - for scanners going round all mms: the next one, with a
+ * reference the caller drops with put_mm. Only a listed mm can be taken,
+ * mm_onzero takes it off the list before it may be torn down.
+ * @nr_store: if not NULL, gets the number of listed mms
+ * @return the mm, or NULL if there is none
+ */
+struct mm_struct *proc_mm_next(int *nr_store)
+{
+	struct mm_struct *mm = NULL;
+	bool intr_flag;
+	spin_lock_irqsave(&proc_mm_lock, intr_flag);
+	if (!list_empty(&proc_mm_list)) {
+		list_entry_t *le = list_next(&proc_mm_list);
+		list_del(le);
+		list_add_before(&proc_mm_list, le);
+		mm = le2mm(le, proc_mm_link);
+		mm_count_inc(mm);
+	}
+	if (nr_store != NULL) {
+		*nr_store = nr_proc_mm;
+	}
+	spin_unlock_irqrestore(&proc_mm_lock, intr_flag);
+	return mm;
+}
+
 // de_thread - delete this thread "proc" from thread_group list
 static void de_thread(struct proc_struct *proc)
 {
@@ -353,6 +379,7 @@ static int copy_mm(uint32_t clone_flags, struct proc_struct *proc)
 	if ((mm = mm_create()) == NULL) {
 		goto bad_mm;
 	}
+	set_refobj_callback(&(mm->mm_ref), mm_onzero);
 	if (setup_pgdir(mm) != 0) {
 		goto bad_pgdir_cleanup_mm;
 	}
@@ -379,12 +406,7 @@ good_mm:
 	if (mm != oldmm) {
 		mm->brk_start = oldmm->brk_start;
 		mm->brk = oldmm->brk;
-		bool intr_flag;
-		local_intr_save(intr_flag);
-		{
-			list_add(&(proc_mm_list), &(mm->proc_mm_link));
-		}
-		local_intr_restore(intr_flag);
+		proc_mm_add(mm);
 	}
 	mm_count_inc(mm);
 	proc->mm = mm;
@@ -601,6 +623,18 @@ int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf)
 	}
 	if(clone_flags & __CLONE_PINCPU)
 		proc->flags |= PF_PINCPU;
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	proc->mempolicy = current->mempolicy;
+#endif
+
+	bool intr_flag;
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	proc->pid = pid_alloc(&init_pid_ns);
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
+	if (proc->pid < 0) {
+		ret = -E_NO_FREE_PROC;
+		goto bad_fork_cleanup_proc;
+	}
 
 	proc->parent = current;
 	list_init(&(proc->thread_group));
@@ -611,7 +645,7 @@ int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf)
 	current->time_slice -= proc->time_slice;
 
 	if (setup_kstack(proc) != 0) {
-		goto bad_fork_cleanup_proc;
+		goto bad_fork_cleanup_pid;
 	}
 	if (copy_sem(clone_flags, proc) != 0) {
 		goto bad_fork_cleanup_kstack;
@@ -634,10 +668,10 @@ int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf)
 
 	proc->tls_pointer = current->tls_pointer;
 
-	bool intr_flag;
+	pid_hash_grow();
+
 	spin_lock_irqsave(&proc_lock, intr_flag);
 	{
-		proc->pid = get_pid();
 		proc->tid = proc->pid;
 		hash_proc(proc);
 		set_links(proc);
@@ -675,6 +709,10 @@ bad_fork_cleanup_kstack:
 kprintf("bad_fork_cleanup_kstack\n");
 
 	put_kstack(proc);
+bad_fork_cleanup_pid:
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	pid_free(&init_pid_ns, proc->pid);
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
 bad_fork_cleanup_proc:
 kprintf("bad_fork_cleanup_proc\n");
 
@@ -699,17 +737,7 @@ static int __do_exit(void)
 	struct mm_struct *mm = current->mm;
 	if (mm != NULL) {
 		mp_set_mm_pagetable(NULL);
-		if (mm_count_dec(mm) == 0) {
-			exit_mmap(mm);
-			put_pgdir(mm);
-			bool intr_flag;
-			local_intr_save(intr_flag);
-			{
-				list_del(&(mm->proc_mm_link));
-			}
-			local_intr_restore(intr_flag);
-			mm_destroy(mm);
-		}
+		put_mm(mm);
 		current->mm = NULL;
 	}
 //	kprintf("[EXIT0.5!] %d\n", nr_used_pages());
@@ -910,6 +938,7 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 
 	struct mm_struct *mm = mm_create();
 	if (mm == NULL) goto bad_mm;
+	set_refobj_callback(&(mm->mm_ref), mm_onzero);
 
 	if (setup_pgdir(mm) != 0) {
 		goto bad_pgdir_cleanup_mm;
@@ -985,6 +1014,11 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 		    NULL)) != 0) {
 		goto bad_cleanup_mmap;
 	}
+#ifdef UCONFIG_VDSO
+	if ((ret = vdso_map(mm)) != 0) {
+		goto bad_cleanup_mmap;
+	}
+#endif
 
 	if (is_dynamic) {
 		elf->e_entry += bias;
@@ -1059,12 +1093,7 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 
 	sysfile_close(fd);
 
-	bool intr_flag;
-	local_intr_save(intr_flag);
-	{
-		list_add(&(proc_mm_list), &(mm->proc_mm_link));
-	}
-	local_intr_restore(intr_flag);
+	proc_mm_add(mm);
 	mm_count_inc(mm);
 	current->mm = mm;
 	set_pgdir(current, mm->pgdir);
@@ -1216,17 +1245,7 @@ int do_execve(const char *filename, const char **argv, const char **envp)
 
 	if (mm != NULL) {
 		mp_set_mm_pagetable(NULL);
-		if (mm_count_dec(mm) == 0) {
-			exit_mmap(mm);
-			put_pgdir(mm);
-			bool intr_flag;
-			local_intr_save(intr_flag);
-			{
-				list_del(&(mm->proc_mm_link));
-			}
-			local_intr_restore(intr_flag);
-			mm_destroy(mm);
-		}
+		put_mm(mm);
 		current->mm = NULL;
 	}
 	put_sem_queue(current);
@@ -1353,14 +1372,14 @@ found:
 
 	int ret = 0;
 	if (code_store != NULL) {
-		lock_mm(mm);
+		lock_mm_read(mm);
 		{
 			if (!copy_to_user
 			    (mm, code_store, &exit_code, sizeof(int))) {
 				ret = -E_INVAL;
 			}
 		}
-		unlock_mm(mm);
+		unlock_mm_read(mm);
 	}
 	return ret;
 }
@@ -1429,19 +1448,19 @@ found:
 	int exit_code = proc->exit_code;
   int return_pid = proc->pid;
   if(proc->state == PROC_ZOMBIE) {
-  	local_intr_save(intr_flag);
+  	spin_lock_irqsave(&proc_lock, intr_flag);
   	{
   		unhash_proc(proc);
   		remove_links(proc);
   	}
-  	local_intr_restore(intr_flag);
+  	spin_unlock_irqrestore(&proc_lock, intr_flag);
   	put_kstack(proc);
   	kfree(proc);
   }
 
 	int ret = 0;
 	if (code_store != NULL) {
-		lock_mm(mm);
+		lock_mm_read(mm);
 		{
 			int status = exit_code << 8;
       if(proc->state == PROC_STOPPED) {
@@ -1451,7 +1470,7 @@ found:
 				ret = -E_INVAL;
 			}
 		}
-		unlock_mm(mm);
+		unlock_mm_read(mm);
 	}
 	return (ret == 0) ? return_pid : ret;
 }
@@ -1643,12 +1662,12 @@ int do_linux_sleep(const struct linux_timespec __user * req,
 {
 	struct mm_struct *mm = current->mm;
 	struct linux_timespec kts;
-	lock_mm(mm);
+	lock_mm_read(mm);
 	if (!copy_from_user(mm, &kts, req, sizeof(struct linux_timespec), 1)) {
-		unlock_mm(mm);
+		unlock_mm_read(mm);
 		return -E_INVAL;
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	long msec = kts.tv_sec * 1000 + kts.tv_nsec / 1000000;
 	if (msec < 0)
 		return -E_INVAL;
@@ -1661,12 +1680,12 @@ int do_linux_sleep(const struct linux_timespec __user * req,
 	int ret = do_sleep(j);
 	if (rem) {
 		memset(&kts, 0, sizeof(struct linux_timespec));
-		lock_mm(mm);
+		lock_mm_read(mm);
 		if (!copy_to_user(mm, rem, &kts, sizeof(struct linux_timespec))) {
-			unlock_mm(mm);
+			unlock_mm_read(mm);
 			return -E_INVAL;
 		}
-		unlock_mm(mm);
+		unlock_mm_read(mm);
 	}
 	return ret;
 }
@@ -1702,15 +1721,20 @@ __do_linux_mmap(uintptr_t __user * addr_store, size_t len, uint32_t mmap_flags)
 		vm_flags |= VM_STACK;
 
 	ret = -E_NO_MEM;
+	lock_mm(mm);
 	if (addr == 0) {
 		if ((addr = get_unmapped_area(mm, len)) == 0) {
 			goto out_unlock;
 		}
 	}
 	if ((ret = mm_map(mm, addr, len, vm_flags, NULL)) == 0) {
+		if (mmap_flags & MMAP_POPULATE) {
+			mm_populate(mm, addr, len, 1);
+		}
 		*addr_store = addr;
 	}
 out_unlock:
+	unlock_mm(mm);
 	return ret;
 }
 
@@ -1750,7 +1774,12 @@ int do_mmap(uintptr_t __user * addr_store, size_t len, uint32_t mmap_flags)
 			goto out_unlock;
 		}
 	}
-	if ((ret = mm_map(mm, addr, len, vm_flags, NULL)) == 0) {
+	struct vma_struct *vma;
+	if ((ret = mm_map(mm, addr, len, vm_flags, &vma)) == 0) {
+		vma_merge(mm, vma);
+		if (mmap_flags & MMAP_POPULATE) {
+			mm_populate(mm, addr, len, 1);
+		}
 		copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t));
 	}
 out_unlock:
@@ -1779,11 +1808,6 @@ int do_munmap(uintptr_t addr, size_t len)
 
 int do_mprotect(void *addr, size_t len, int prot)
 {
-
-	/*
-	   return 0;
-	 */
-
 	struct mm_struct *mm = current->mm;
 	assert(mm != NULL);
 	if (len == 0) {
@@ -1795,55 +1819,37 @@ int do_mprotect(void *addr, size_t len, int prot)
 	int ret = -E_INVAL;
 	lock_mm(mm);
 
-	while (1) {
+	/* split the vmas at the range boundaries, flip VM_WRITE on the ones
+	 * in between and fold them back into their neighbours where alike */
+	while (start < end) {
 		struct vma_struct *vma = find_vma(mm, start);
-		uintptr_t last_end;
-		if (vma != NULL) {
-			last_end = vma->vm_end;
-		}
 		if (vma == NULL) {
+			ret = -E_INVAL;
 			goto out;
-		} else if (vma->vm_start == start && vma->vm_end == end) {
-			if (prot & PROT_WRITE) {
-				vma->vm_flags |= VM_WRITE;
-			} else {
-				vma->vm_flags &= ~VM_WRITE;
-			}
-		} else {
-			uintptr_t this_end =
-			    (end <= vma->vm_end) ? end : vma->vm_end;
-			uintptr_t this_start =
-			    (start >= vma->vm_start) ? start : vma->vm_start;
-
-			struct mapped_file_struct mfile = vma->mfile;
-			mfile.offset += this_start - vma->vm_start;
-			uint32_t flags = vma->vm_flags;
-			if ((ret =
-			     mm_unmap_keep_pages(mm, this_start,
-						 this_end - this_start)) != 0) {
+		}
+		if ((prot & PROT_WRITE) && (vma->vm_flags & VM_NOWRITE)) {
+			ret = -E_ACCES;
+			goto out;
+		}
+		if (vma->vm_start < start) {
+			if ((ret = split_vma(mm, vma, start)) != 0) {
 				goto out;
 			}
-			if (prot & PROT_WRITE) {
-				flags |= VM_WRITE;
-			} else {
-				flags &= ~VM_WRITE;
-			}
-			if ((ret =
-			     mm_map(mm, this_start, this_end - this_start,
-				    flags, &vma)) != 0) {
+		}
+		if (end < vma->vm_end) {
+			if ((ret = split_vma(mm, vma, end)) != 0) {
 				goto out;
 			}
-			vma->mfile = mfile;
-			if (vma->mfile.file != NULL) {
-				filemap_acquire(mfile.file);
-			}
+			vma = find_vma(mm, start);
 		}
-
+		if (prot & PROT_WRITE) {
+			vma->vm_flags |= VM_WRITE;
+		} else {
+			vma->vm_flags &= ~VM_WRITE;
+		}
+		start = vma->vm_end;
+		vma_merge(mm, vma);
 		ret = 0;
-
-		if (end <= last_end)
-			break;
-		start = last_end;
 	}
 
 out:
@@ -1939,20 +1945,41 @@ static int user_main(void *arg)
 
 static void foo(void* arg) {
   struct netif *netif = (struct netif*)arg;
-  dhcp_start(netif);
+  if(netif != NULL) {
+    dhcp_start(netif);
+  }
 }
 // init_main - the second kernel thread used to create kswapd_main & user_main kernel threads
 static int init_main(void *arg)
 {
 	int pid;
-#ifdef UCONFIG_SWAP
-	if ((pid = ucore_kernel_thread(kswapd_main, NULL, 0)) <= 0) {
-		panic("kswapd init failed.\n");
+	if ((pid = ucore_kernel_thread(krefcache_cleaner, NULL, 0)) <= 0) {
+		panic("krefcache_cleaner init failed.\n");
 	}
-	kswapd = find_proc(pid);
-	set_proc_name(kswapd, "kswapd");
-#else
-	kprintf("init_main:: swapping is disabled.\n");
+	struct proc_struct *cleaner = find_proc(pid);
+	set_proc_name(cleaner, "krefcache");
+	int nr_daemons = 0;
+#ifdef UCONFIG_HAVE_SFS
+	if ((pid = ucore_kernel_thread(sfs_flushd_main, NULL, 0)) <= 0) {
+		panic("ksfsflushd init failed.\n");
+	}
+	set_proc_name(find_proc(pid), "ksfsflushd");
+	nr_daemons++;
+#endif
+#ifdef UCONFIG_KMSG
+	if ((pid = ucore_kernel_thread(kmsgd_main, NULL, 0)) <= 0) {
+		panic("kmsgd init failed.\n");
+	}
+	set_proc_name(find_proc(pid), "kmsgd");
+	nr_daemons++;
+#endif
+#ifdef UCONFIG_KSM
+	ksm_init();
+	if ((pid = ucore_kernel_thread(ksmd_main, NULL, 0)) <= 0) {
+		panic("ksmd init failed.\n");
+	}
+	set_proc_name(find_proc(pid), "ksmd");
+	nr_daemons++;
 #endif
 
 	int ret;
@@ -1966,12 +1993,27 @@ static int init_main(void *arg)
 
   extern struct netif *__netif;
   bool get_network = false;
-  if(__netif != NULL) {
+  //Virtual devices (lo, veth) need the input thread even without a real NIC.
+  if(ethernet_has_driver()) {
     ucore_kernel_thread(network_input_thread_main, NULL, 0);
     tcpip_init(foo, __netif);
     get_network = true;
 //	kprintf("[network]\n");
   }
+	/* started last, so that it is the youngest child, see below */
+#ifdef UCONFIG_SWAP
+	if ((pid = ucore_kernel_thread(kswapd_main, NULL, 0)) <= 0) {
+		panic("kswapd init failed.\n");
+	}
+	kswapd = find_proc(pid);
+	set_proc_name(kswapd, "kswapd");
+	nr_daemons++;
+#else
+	kprintf("init_main:: swapping is disabled.\n");
+#endif
+#ifdef UCONFIG_HAVE_SFS
+	sfs_drop_caches();
+#endif
 	size_t nr_used_pages_store = nr_used_pages();
 	unsigned int nr_process_store = nr_process;
 
@@ -1994,6 +2036,8 @@ static int init_main(void *arg)
 	}
 //	kprintf("[test 2_page]%d %d\n", nr_used_pages_store, nr_used_pages());
 //	kprintf("[test 2]\n");
+	/* exited mms and closed files are released by the cleaner */
+	refcache_drain();
 #ifdef UCONFIG_SWAP
 	assert(kswapd != NULL);
 	int i;
@@ -2007,34 +2051,30 @@ static int init_main(void *arg)
 
 //	kprintf("[test 3_page]%d %d\n", nr_used_pages_store, nr_used_pages());
 //	kprintf("[test 3]\n");
+#ifdef UCONFIG_KSM
+	ksm_flush();
+#endif
+#ifdef UCONFIG_HAVE_SFS
+	sfs_drop_caches();
+#endif
 	mbox_cleanup();
 //	kprintf("[test 4_page]%d %d\n", nr_used_pages_store, nr_used_pages());
 //	kprintf("[test 4]\n");
 	fs_cleanup();
 
 	kprintf("all user-mode processes have quit.\n");
+	assert(cleaner->cptr == NULL && cleaner->optr == NULL);
 #ifdef UCONFIG_SWAP
 	assert(initproc->cptr == kswapd && initproc->yptr == NULL
 	       && initproc->optr == NULL);
-	assert(kswapd->cptr == NULL && kswapd->yptr == NULL
-	       && kswapd->optr == NULL);
-#ifdef ARCH_RISCV64
-	assert(nr_process == 2 + NCPU);
-#else
-	assert(nr_process == 2 + sysconf.lcpu_count);
+	assert(kswapd->cptr == NULL && kswapd->yptr == NULL);
 #endif
-#else
+	/* the cpus' idle threads, init, the cleaner and the daemons */
 #ifdef ARCH_RISCV64
-    if (get_network)
-	    assert(nr_process == 1 + NCPU + 2);
-    else
-	    assert(nr_process == 1 + NCPU);
+	assert(nr_process == 2 + NCPU + nr_daemons + (get_network ? 2 : 0));
 #else
-    if (get_network)
-	    assert(nr_process == 1 + sysconf.lcpu_count + 2);
-    else
-	    assert(nr_process == 1 + sysconf.lcpu_count);
-#endif
+	assert(nr_process ==
+	       2 + sysconf.lcpu_count + nr_daemons + (get_network ? 2 : 0));
 #endif
 //	kprintf("[test 5_page]%d %d\n", nr_used_pages_store, nr_used_pages());
 	assert(nr_used_pages_store == nr_used_pages());
@@ -2046,16 +2086,20 @@ static int init_main(void *arg)
 //           - create the second kernel thread init_main
 void proc_init(void)
 {
-	int i;
 	int cpuid = myid();
 	struct proc_struct *idle;
 
 	spinlock_init(&proc_lock);
 	list_init(&proc_list);
 	list_init(&proc_mm_list);
-	for (i = 0; i < HASH_LIST_SIZE; i++) {
-		list_init(hash_list + i);
-	}
+	spinlock_init(&proc_mm_lock);
+	pid_hash_init();
+	refcache_init();
+#ifdef ARCH_RISCV64
+	pid_init(&init_pid_ns, NCPU);
+#else
+	pid_init(&init_pid_ns, sysconf.lcpu_count);
+#endif
 
 	idle = alloc_proc();
 	if (idle == NULL) {
@@ -2132,18 +2176,6 @@ void proc_init_ap(void)
 #endif
 	idleproc = idle;
 	current = idle;
-#ifndef ARCH_RISCV64
-	int pid;
-	char proc_name[32];
-	if((pid = ucore_kernel_thread(krefcache_cleaner, NULL, 0)) <= 0){
-		panic("krefcache_cleaner init failed.\n");
-	}
-	struct proc_struct* cleaner = find_proc(pid);
-	snprintf(proc_name, 32, "krefcache/%d", myid());
-	set_proc_name(cleaner, proc_name);
-	set_proc_cpu_affinity(cleaner, myid());
-	nr_process++;
-#endif
 
 	assert(idleproc != NULL && idleproc->pid == cpuid);
 }
@@ -2160,12 +2192,12 @@ int do_linux_ugetrlimit(int res, struct linux_rlimit *__user __limit)
 		return -E_INVAL;
 	}
 	struct mm_struct *mm = current->mm;
-	lock_mm(mm);
+	lock_mm_read(mm);
 	int ret = 0;
 	if (!copy_to_user(mm, __limit, &limit, sizeof(struct linux_rlimit))) {
 		ret = -E_INVAL;
 	}
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	return ret;
 }
 
@@ -2173,7 +2205,7 @@ int do_linux_usetrlimit(int res, const struct linux_rlimit *__user __limit)
 {
 	int ret = 0;
 	struct mm_struct *mm = current->mm;
-	lock_mm(mm);
+	lock_mm_read(mm);
 	if (!user_mem_check(mm, __limit, sizeof(struct linux_rlimit), 0))
 	{
 		ret = -E_FAULT;
@@ -2201,6 +2233,6 @@ int do_linux_usetrlimit(int res, const struct linux_rlimit *__user __limit)
 	}
 	ret = 0;
 out:
-	unlock_mm(mm);
+	unlock_mm_read(mm);
 	return ret;
 }
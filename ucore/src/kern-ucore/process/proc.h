@@ -16,6 +16,9 @@
 #include <arch_proc.h>
 #include <signal.h>
 #include <spinlock.h>
+#ifdef UCONFIG_NUMA_MEMPOLICY
+#include <mempolicy.h>
+#endif
 
 // process's state in his life cycle
 enum proc_state {
@@ -29,11 +32,10 @@ enum proc_state {
 #define PROC_IS_IDLE(proc)   (((proc)->attribute & PROC_ATTR_ROLE) == PROC_ATTR_ROLE_IDLE)
 
 #define PROC_NAME_LEN               15
-#define MAX_PROCESS                 4096
-#define MAX_PID                     (MAX_PROCESS * 2)
+#define MAX_PROCESS                 8192
+#define MAX_PID                     (MAX_PROCESS * 4)
 
 extern list_entry_t proc_list;
-extern list_entry_t proc_mm_list;
 
 struct inode;
 struct fs_struct;
@@ -48,6 +50,8 @@ struct proc_struct {
 	volatile bool need_resched;	// bool value: need to be rescheduled to release CPU?
 	struct proc_struct *parent;	// the parent process
 	struct mm_struct *mm;	// Process's memory management field
+	struct mm_struct *mm_rlocked;	// mm whose mm_sem this thread holds shared
+	void *journal_info;	// fs whose journal handle this thread holds
 	struct context context;	// Switch here to run process
 	struct trapframe *tf;	// Trap frame for current interrupt
 	uintptr_t cr3;		// CR3 register: the base addr of Page Directroy Table(PDT)
@@ -75,6 +79,9 @@ struct proc_struct {
 
 	int cpu_affinity;
 	spinlock_s lock;
+#ifdef UCONFIG_NUMA_MEMPOLICY
+	struct mempolicy mempolicy;	// set_mempolicy, inherited by children
+#endif
 };
 
 #define PROC_CPU_NO_AFFINITY (-1)
@@ -100,6 +107,7 @@ struct linux_timespec {
 #define WT_EVENT_RECV               (0x00000111 | WT_INTERRUPTED)	// wait the recving event
 #define WT_MBOX_SEND                (0x00000120 | WT_INTERRUPTED)	// wait the sending mbox
 #define WT_MBOX_RECV                (0x00000121 | WT_INTERRUPTED)	// wait the recving mbox
+#define WT_FUTEX                    (0x00000130 | WT_INTERRUPTED)	// wait a futex word
 #define WT_PIPE                     (0x00000200 | WT_INTERRUPTED)	// wait the pipe
 #define WT_SIGNAL					          (0x00000400 | WT_INTERRUPTED)	// wait the signal
 #define WT_KERNEL_SIGNAL            (0x00000800| WT_INTERRUPTED)
@@ -149,6 +157,8 @@ int do_mmap(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
 int do_munmap(uintptr_t addr, size_t len);
 int do_shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
 int do_linux_waitpid(int pid, int *code_store);
+void put_mm(struct mm_struct *mm);
+struct mm_struct *proc_mm_next(int *nr_store);
 
 /* Implemented by archs */
 struct proc_struct *alloc_proc(void);
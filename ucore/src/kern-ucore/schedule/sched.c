@@ -15,6 +15,7 @@
 #include <trap.h>
 #include <sysconf.h>
 #include <spinlock.h>
+#include <refcache.h>
 
 #ifndef ARCH_RISCV64
 /* we may use lock free list */
@@ -451,6 +452,7 @@ void run_timer_list(void)
 		sched_class_proc_tick(current);
 	}
 	spin_unlock_irqrestore(&mycpu()->timer_list.lock, intr_flag);
+	refcache_tick();
 }
 
 void post_switch(void)
@@ -566,5 +568,6 @@ void run_timer_list(void)
 		sched_class_proc_tick(current);
 	}
 	spin_unlock_irqrestore(&__timer_list.lock, intr_flag);
+	refcache_tick();
 }
 #endif
@@ -0,0 +1,210 @@
+#include <types.h>
+#include <list.h>
+#include <proc.h>
+#include <vmm.h>
+#include <ipc.h>
+#include <sync.h>
+#include <assert.h>
+#include <error.h>
+#include <clock.h>
+#include <unistd.h>
+#include <futex.h>
+
+/*
+ * Futexes let user locks sleep in the kernel only when they have to.
+ * FUTEX_WAIT puts the caller to sleep on a word of its memory if the word
+ * still holds the value it expects; FUTEX_WAKE wakes up to n sleepers on
+ * a word. All other lock state lives in user memory.
+ *
+ * Sleepers are hashed on a key for the word: the mm and the address for
+ * private memory, the shmem and the offset in it for shared memory, so
+ * that processes sharing a page through SYS_shmem meet on the same key.
+ *
+ * A waiter goes on its bucket before it reads the word. A waker changes
+ * the word before it looks at the bucket, so either the waiter reads the
+ * new value, or the waker finds it queued; no wakeup is lost.
+ */
+
+#define FUTEX_HASH_SHIFT        6
+#define FUTEX_HASH_SIZE         (1 << FUTEX_HASH_SHIFT)
+
+struct futex_key {
+	void *obj;
+	uintptr_t off;
+};
+
+struct futex_waiter {
+	struct futex_key key;
+	struct proc_struct *proc;
+	bool sleeping;		// in schedule(), woken by wakeup_proc
+	bool woken;		// taken off the bucket by a waker
+	list_entry_t link;
+};
+
+#define le2waiter(le, member)               \
+    to_struct((le), struct futex_waiter, member)
+
+struct futex_bucket {
+	spinlock_s lock;
+	list_entry_t waiters;
+};
+
+static struct futex_bucket futex_hash[FUTEX_HASH_SIZE];
+
+void futex_init(void)
+{
+	int i;
+	for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+		spinlock_init(&(futex_hash[i].lock));
+		list_init(&(futex_hash[i].waiters));
+	}
+}
+
+// futex_key - the key for @uaddr in @mm, with @mm locked
+static int futex_key(struct mm_struct *mm, uintptr_t uaddr, struct futex_key *key)
+{
+	struct vma_struct *vma;
+	if (uaddr % sizeof(uint32_t) != 0) {
+		return -E_INVAL;
+	}
+	if ((vma = find_vma(mm, uaddr)) == NULL || uaddr < vma->vm_start) {
+		return -E_FAULT;
+	}
+	if (vma->vm_flags & VM_SHARE) {
+		key->obj = vma->shmem;
+		key->off = uaddr - vma->vm_start + vma->shmem_off;
+	} else {
+		key->obj = mm;
+		key->off = uaddr;
+	}
+	return 0;
+}
+
+static inline struct futex_bucket *futex_bucket(struct futex_key *key)
+{
+	uint32_t hash = (uint32_t)((uintptr_t) key->obj >> 4) ^ (uint32_t)(key->off >> 2);
+	return futex_hash + ((uint32_t)(hash * 0x9e370001U) >> (32 - FUTEX_HASH_SHIFT));
+}
+
+static inline bool futex_key_equal(struct futex_key *a, struct futex_key *b)
+{
+	return a->obj == b->obj && a->off == b->off;
+}
+
+static int futex_wait(uintptr_t uaddr, uint32_t val, unsigned int timeout)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_waiter __waiter, *waiter = &__waiter;
+	struct futex_bucket *bucket;
+	uint32_t cur;
+	bool intr_flag;
+	int ret;
+
+	lock_mm_read(mm);
+	if ((ret = futex_key(mm, uaddr, &(waiter->key))) != 0) {
+		unlock_mm_read(mm);
+		return ret;
+	}
+	waiter->proc = current;
+	waiter->sleeping = waiter->woken = 0;
+	bucket = futex_bucket(&(waiter->key));
+
+	spin_lock_irqsave(&(bucket->lock), intr_flag);
+	list_add_before(&(bucket->waiters), &(waiter->link));
+	spin_unlock_irqrestore(&(bucket->lock), intr_flag);
+
+	if (!copy_from_user(mm, &cur, (void *)uaddr, sizeof(uint32_t), 0)) {
+		ret = -E_FAULT;
+	} else if (cur != val) {
+		ret = -E_AGAIN;
+	}
+	unlock_mm_read(mm);
+
+	unsigned long saved_ticks;
+	timer_t __timer, *timer = NULL;
+	if (ret == 0) {
+		timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+	}
+
+	spin_lock_irqsave(&(bucket->lock), intr_flag);
+	if (ret == 0 && !waiter->woken) {
+		waiter->sleeping = 1;
+		current->state = PROC_SLEEPING;
+		current->wait_state = WT_FUTEX;
+		ipc_add_timer(timer);
+		spin_unlock_irqrestore(&(bucket->lock), intr_flag);
+
+		schedule();
+
+		spin_lock_irqsave(&(bucket->lock), intr_flag);
+		ipc_del_timer(timer);
+		if (!waiter->woken) {
+			ret = ipc_check_timeout(timeout, saved_ticks);
+			if (ret != -E_TIMEOUT) {
+				ret = -E_INTR;
+			}
+		}
+	}
+	if (!waiter->woken) {
+		list_del(&(waiter->link));
+	} else if (ret == -E_AGAIN) {
+		// woken before it saw the value change, that is fine too
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&(bucket->lock), intr_flag);
+	return ret;
+}
+
+static int futex_wake(uintptr_t uaddr, int n)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_key key;
+	struct futex_bucket *bucket;
+	list_entry_t *le;
+	bool intr_flag;
+	int ret, woken = 0;
+
+	lock_mm_read(mm);
+	ret = futex_key(mm, uaddr, &key);
+	unlock_mm_read(mm);
+	if (ret != 0) {
+		return ret;
+	}
+	bucket = futex_bucket(&key);
+
+	spin_lock_irqsave(&(bucket->lock), intr_flag);
+	le = list_next(&(bucket->waiters));
+	while (le != &(bucket->waiters) && woken < n) {
+		struct futex_waiter *waiter = le2waiter(le, link);
+		le = list_next(le);
+		if (futex_key_equal(&(waiter->key), &key)) {
+			list_del(&(waiter->link));
+			waiter->woken = 1;
+			if (waiter->sleeping) {
+				wakeup_proc(waiter->proc);
+			}
+			woken++;
+		}
+	}
+	spin_unlock_irqrestore(&(bucket->lock), intr_flag);
+	return woken;
+}
+
+/*
+ * do_futex - FUTEX_WAIT returns 0 when woken, -E_AGAIN if *@uaddr is not
+ * @val, and -E_TIMEOUT or -E_INTR when it gives up. FUTEX_WAKE returns the
+ * number of sleepers woken.
+ */
+int do_futex(uintptr_t uaddr, int op, int val, unsigned int timeout)
+{
+	if (current->mm == NULL) {
+		return -E_INVAL;
+	}
+	switch (op) {
+	case FUTEX_WAIT:
+		return futex_wait(uaddr, val, timeout);
+	case FUTEX_WAKE:
+		return futex_wake(uaddr, val);
+	}
+	return -E_INVAL;
+}
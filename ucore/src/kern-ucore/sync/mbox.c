@@ -16,19 +16,45 @@
 #include <string.h>
 #include <spinlock.h>
 
+/*
+ * mbox_lock only protects mbox_map and free_mbox_list, every mailbox has its
+ * own lock for its queue and wait queues. The two are never held together.
+ */
 static spinlock_s mbox_lock;
 
-struct msg_seg {
-	struct msg_seg *next;
-};
+/*
+ * Messages up to MSG_INLINE_LEN bytes are stored in the msg_msg itself,
+ * larger ones in whole pages. A page-aligned page of the sender's private
+ * anonymous memory is not copied at all: the message takes a reference to
+ * it and the sender's pte is write protected, so whoever writes first gets
+ * a private copy through the usual copy-on-write fault. The receiver maps
+ * such pages the same way when its buffer is page-aligned too.
+ */
+#define MSG_MAX_PAGES               (MAX_MSG_BYTES / PGSIZE)
+#define MSG_INLINE_LEN              192
 
 struct msg_msg {
 	int pid;
 	unsigned int bytes;
-	struct msg_seg *next;
+	unsigned int nr_pages;
 	list_entry_t msg_link;
+	union {
+		struct Page *pages[MSG_MAX_PAGES];
+		char data[MSG_INLINE_LEN];
+	};
 };
 
+#if !defined(ARCH_ARM)
+#define MSG_ZEROCOPY
+#endif
+
+/* free msg_msg objects kept around instead of going back to kmalloc */
+#define MSG_CACHE_MAX               256
+
+static spinlock_s msg_cache_lock;
+static list_entry_t msg_cache;
+static int msg_cache_nr;
+
 #define le2msg(le, member)              \
     to_struct((le), struct msg_msg, member)
 
@@ -44,6 +70,7 @@ struct msg_mbox {
 	enum mbox_state state;
 	unsigned int max_slots, slots;
 	list_entry_t msg_link;
+	spinlock_s lock;
 	wait_queue_t senders;
 	wait_queue_t receivers;
 };
@@ -54,7 +81,6 @@ struct msg_mbox {
 #define MAX_MBOX_NUM                8192
 #define MBOX_P_PAGE                 (PGSIZE / sizeof(struct msg_mbox))
 #define MAX_MBOX_PAGES              ((MAX_MBOX_NUM + MBOX_P_PAGE - 1) / MBOX_P_PAGE)
-#define MAX_MSG_DATALEN             (512 - sizeof(struct msg_msg))
 
 static struct msg_mbox *mbox_map[MAX_MBOX_PAGES];
 static list_entry_t free_mbox_list;
@@ -68,7 +94,12 @@ void mbox_init(void)
 	}
 	sem_init(&sem_mbox_map, 1);
 	list_init(&free_mbox_list);
+	spinlock_init(&mbox_lock);
+	spinlock_init(&msg_cache_lock);
+	list_init(&msg_cache);
+	msg_cache_nr = 0;
 	static_assert(MBOX_P_PAGE != 0);
+	static_assert(sizeof(((struct msg_msg *)0)->pages) <= MSG_INLINE_LEN);
 }
 
 static struct msg_mbox *get_mbox(int id)
@@ -85,15 +116,23 @@ static struct msg_mbox *get_mbox(int id)
 	return NULL;
 }
 
+/* called without mbox->lock, once the last user has left a CLOSING mbox */
 static void mbox_free(struct msg_mbox *mbox)
 {
 	assert(mbox->state == CLOSING && mbox->inuse == 0);
 	assert(list_empty(&(mbox->msg_link)));
 	assert(wait_queue_empty(&(mbox->senders)));
 	assert(wait_queue_empty(&(mbox->receivers)));
-	mbox->state = CLOSED;
-	mbox->max_slots = mbox->slots = 0;
-	list_add_before(&(free_mbox_list), &(mbox->msg_link));
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&mbox_lock);
+	{
+		mbox->state = CLOSED;
+		mbox->max_slots = mbox->slots = 0;
+		list_add_before(&(free_mbox_list), &(mbox->msg_link));
+	}
+	spinlock_release(&mbox_lock);
+	local_intr_restore(intr_flag);
 }
 
 static void add_msg(struct msg_mbox *mbox, struct msg_msg *msg, bool append)
@@ -153,6 +192,7 @@ static struct msg_mbox *new_mbox(unsigned int max_slots)
 				mbox->state = CLOSED;
 				mbox->max_slots = mbox->slots = 0;
 				list_init(&(mbox->msg_link));
+				spinlock_init(&(mbox->lock));
 				wait_queue_init(&(mbox->senders));
 				wait_queue_init(&(mbox->receivers));
 				list_add_before(&(free_mbox_list),
@@ -189,56 +229,144 @@ int ipc_mbox_init(unsigned int max_slots)
 	return ret;
 }
 
-static void free_seg(struct msg_seg *seg)
+static struct msg_msg *alloc_msg(void)
+{
+	struct msg_msg *msg = NULL;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&msg_cache_lock);
+	if (!list_empty(&msg_cache)) {
+		list_entry_t *le = list_next(&msg_cache);
+		list_del(le);
+		msg_cache_nr--;
+		msg = le2msg(le, msg_link);
+	}
+	spinlock_release(&msg_cache_lock);
+	local_intr_restore(intr_flag);
+	if (msg == NULL) {
+		msg = kmalloc(sizeof(struct msg_msg));
+	}
+	return msg;
+}
+
+static void put_msg_page(struct Page *page)
 {
-	if (seg->next != NULL) {
-		free_seg(seg->next);
+	if (!PageSwap(page)) {
+		if (page_ref_dec(page) == 0) {
+			free_page(page);
+		}
+	} else {
+		page_ref_dec(page);
 	}
-	kfree(seg);
 }
 
 static void free_msg(struct msg_msg *msg)
 {
-	if (msg->next != NULL) {
-		free_seg(msg->next);
+	int i;
+	for (i = 0; i < msg->nr_pages; i++) {
+		put_msg_page(msg->pages[i]);
+	}
+
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&msg_cache_lock);
+	if (msg_cache_nr < MSG_CACHE_MAX) {
+		list_add(&msg_cache, &(msg->msg_link));
+		msg_cache_nr++, msg = NULL;
+	}
+	spinlock_release(&msg_cache_lock);
+	local_intr_restore(intr_flag);
+	if (msg != NULL) {
+		kfree(msg);
 	}
-	kfree(msg);
 }
 
-static struct msg_msg *load_msg(const void *src, size_t len)
+#ifdef MSG_ZEROCOPY
+static bool msg_page_shareable(struct mm_struct *mm, uintptr_t la)
 {
-	size_t alen, bytes = len;
-	if ((alen = len) > MAX_MSG_DATALEN) {
-		alen = MAX_MSG_DATALEN;
+	struct vma_struct *vma = find_vma(mm, la);
+	if (vma == NULL || vma->vm_start > la) {
+		return 0;
 	}
-	struct msg_msg *msg;
-	if ((msg = kmalloc(sizeof(struct msg_msg) + alen)) == NULL) {
+	if ((vma->vm_flags & (VM_SHARE | VM_IO)) || vma->mfile.file != NULL) {
+		return 0;
+	}
+	return 1;
+}
+
+/* take a reference to the user page at @la and make it copy-on-write */
+static struct Page *share_user_page(struct mm_struct *mm, uintptr_t la)
+{
+	if (!msg_page_shareable(mm, la)) {
+		return NULL;
+	}
+	pte_t *ptep = get_pte(mm->pgdir, la, 0);
+	if (ptep == NULL || !ptep_present(ptep)) {
 		return NULL;
 	}
+	struct Page *page = pte2page(*ptep);
+	if (ptep_s_write(ptep)) {
+		pte_perm_t perm = ptep_get_perm(ptep, PTE_USER);
+		ptep_unset_s_write(&perm);
+		pte_perm_t perm_with_swap_stat = ptep_get_perm(ptep, PTE_SWAP);
+		ptep_set_perm(&perm_with_swap_stat, perm);
+		page_insert(mm->pgdir, page, la, perm_with_swap_stat);
+	}
+	page_ref_inc(page);
+	return page;
+}
 
-	struct msg_seg **segp = &(msg->next);
+/* map @page read-only at @la, the first write fault copies it if shared */
+static bool map_user_page(struct mm_struct *mm, uintptr_t la,
+			  struct Page *page)
+{
+	if (!msg_page_shareable(mm, la)) {
+		return 0;
+	}
+	pte_perm_t perm;
+	ptep_unmap(&perm);
+	ptep_set_u_read(&perm);
+	return page_insert(mm->pgdir, page, la, perm) == 0;
+}
+#endif /* MSG_ZEROCOPY */
 
-	void *dst = msg + 1;
-	goto inside;
+static struct msg_msg *load_msg(const void *src, size_t len)
+{
+	struct mm_struct *mm = current->mm;
+	struct msg_msg *msg;
+	if ((msg = alloc_msg()) == NULL) {
+		return NULL;
+	}
+	msg->bytes = len;
+	msg->pid = current->pid;
+	msg->nr_pages = 0;
+
+	if (len <= MSG_INLINE_LEN) {
+		copy_from_user(mm, msg->data, src, len, 0);
+		return msg;
+	}
 
-	while (len > 0) {
-		if ((alen = len) > MAX_MSG_DATALEN) {
-			alen = MAX_MSG_DATALEN;
+	size_t off, alen;
+	for (off = 0; off < len; off += alen) {
+		if ((alen = len - off) > PGSIZE) {
+			alen = PGSIZE;
 		}
-		struct msg_seg *seg;
-		if ((seg = kmalloc(sizeof(struct msg_seg) + alen)) == NULL) {
-			goto failed;
+		uintptr_t la = (uintptr_t) src + off;
+		struct Page *page = NULL;
+#ifdef MSG_ZEROCOPY
+		if (alen == PGSIZE && la % PGSIZE == 0) {
+			page = share_user_page(mm, la);
 		}
-		*segp = seg, segp = &(seg->next);
-		dst = seg + 1;
-inside:
-		copy_from_user(current->mm, dst, src, alen, 0);
-		len -= alen, src = ((char *)src) + alen;
-		*segp = NULL;
+#endif
+		if (page == NULL) {
+			if ((page = alloc_page()) == NULL) {
+				goto failed;
+			}
+			set_page_ref(page, 1);
+			copy_from_user(mm, page2kva(page), (void *)la, alen, 0);
+		}
+		msg->pages[msg->nr_pages++] = page;
 	}
-
-	msg->bytes = bytes;
-	msg->pid = current->pid;
 	return msg;
 
 failed:
@@ -250,22 +378,27 @@ static uint32_t
 send_msg(struct msg_mbox *mbox, struct msg_msg *msg, timer_t * timer)
 {
 	uint32_t ret;
-	bool intr_flag;
+	bool intr_flag, need_free = 0;
 	local_intr_save(intr_flag);
-	spinlock_acquire(&mbox_lock);
+	spinlock_acquire(&(mbox->lock));
+	if (mbox->state != OPENED) {
+		spinlock_release(&(mbox->lock));
+		local_intr_restore(intr_flag);
+		return WT_INTERRUPTED;
+	}
 	mbox->inuse++;
 	wait_t __wait, *wait = &__wait;
 	while (mbox->max_slots <= mbox->slots) {
 		assert(mbox->state == OPENED);
 		wait_current_set(&(mbox->senders), wait, WT_MBOX_SEND);
 		ipc_add_timer(timer);
-		spinlock_release(&mbox_lock);
+		spinlock_release(&(mbox->lock));
 		local_intr_restore(intr_flag);
 
 		schedule();
 
 		local_intr_save(intr_flag);
-		spinlock_acquire(&mbox_lock);
+		spinlock_acquire(&(mbox->lock));
 		ipc_del_timer(timer);
 		wait_current_del(&(mbox->senders), wait);
 		if (mbox->state != OPENED || wait->wakeup_flags != WT_MBOX_SEND) {
@@ -283,12 +416,13 @@ out:
 	mbox->inuse--;
 	if (mbox->state != OPENED) {
 		assert(ret != 0 && mbox->state == CLOSING);
-		if (mbox->inuse == 0) {
-			mbox_free(mbox);
-		}
+		need_free = (mbox->inuse == 0);
 	}
-	spinlock_release(&mbox_lock);
+	spinlock_release(&(mbox->lock));
 	local_intr_restore(intr_flag);
+	if (need_free) {
+		mbox_free(mbox);
+	}
 	return ret;
 }
 
@@ -345,25 +479,27 @@ int ipc_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout)
 
 static void store_msg(struct msg_msg *msg, void *dst)
 {
-	size_t alen, len = msg->bytes;
-	if ((alen = len) > MAX_MSG_DATALEN) {
-		alen = MAX_MSG_DATALEN;
+	struct mm_struct *mm = current->mm;
+	size_t off, alen, len = msg->bytes;
+	if (msg->nr_pages == 0) {
+		copy_to_user(mm, dst, msg->data, len);
+		return;
 	}
 
-	struct msg_seg *seg = msg->next;
-
-	const void *src = msg + 1;
-	goto inside;
-
-	while (len > 0) {
-		if ((alen = len) > MAX_MSG_DATALEN) {
-			alen = MAX_MSG_DATALEN;
+	int i;
+	for (i = 0, off = 0; off < len; i++, off += alen) {
+		if ((alen = len - off) > PGSIZE) {
+			alen = PGSIZE;
+		}
+		assert(i < msg->nr_pages);
+		uintptr_t la = (uintptr_t) dst + off;
+#ifdef MSG_ZEROCOPY
+		if (alen == PGSIZE && la % PGSIZE == 0
+		    && map_user_page(mm, la, msg->pages[i])) {
+			continue;
 		}
-		assert(seg != NULL);
-		src = seg + 1, seg = seg->next;
-inside:
-		copy_to_user(current->mm, dst, src, alen);
-		len -= alen, dst = ((char *)dst) + alen;
+#endif
+		copy_to_user(mm, (void *)la, page2kva(msg->pages[i]), alen);
 	}
 }
 
@@ -372,22 +508,27 @@ recv_msg(struct msg_mbox *mbox, size_t max_bytes, struct msg_msg **msg_store,
 	 timer_t * timer)
 {
 	int ret = -1;
-	bool intr_flag;
+	bool intr_flag, need_free = 0;
 	local_intr_save(intr_flag);
-	spinlock_acquire(&mbox_lock);
+	spinlock_acquire(&(mbox->lock));
+	if (mbox->state != OPENED) {
+		spinlock_release(&(mbox->lock));
+		local_intr_restore(intr_flag);
+		return -E_INVAL;
+	}
 	mbox->inuse++;
 	wait_t __wait, *wait = &__wait;
 	while (mbox->slots == 0) {
 		assert(mbox->state == OPENED);
 		wait_current_set(&(mbox->receivers), wait, WT_MBOX_RECV);
 		ipc_add_timer(timer);
-		spinlock_release(&mbox_lock);
+		spinlock_release(&(mbox->lock));
 		local_intr_restore(intr_flag);
 
 		schedule();
 
 		local_intr_save(intr_flag);
-		spinlock_acquire(&mbox_lock);
+		spinlock_acquire(&(mbox->lock));
 		ipc_del_timer(timer);
 		wait_current_del(&(mbox->receivers), wait);
 		if (mbox->state != OPENED || wait->wakeup_flags != WT_MBOX_RECV) {
@@ -405,12 +546,13 @@ out:
 	mbox->inuse--;
 	if (mbox->state != OPENED) {
 		assert(ret != 0 && mbox->state == CLOSING);
-		if (mbox->inuse == 0) {
-			mbox_free(mbox);
-		}
+		need_free = (mbox->inuse == 0);
 	}
-	spinlock_release(&mbox_lock);
+	spinlock_release(&(mbox->lock));
 	local_intr_restore(intr_flag);
+	if (need_free) {
+		mbox_free(mbox);
+	}
 	return ret;
 }
 
@@ -473,15 +615,18 @@ int ipc_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout)
 	unlock_mm(mm);
 
 	if (ret != 0 && (mbox = get_mbox(id)) != NULL) {
-		bool local_intr;
-		local_intr_save(local_intr);
-		{
-			add_msg(mbox, msg, 0);
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		spinlock_acquire(&(mbox->lock));
+		if (mbox->state == OPENED) {
+			add_msg(mbox, msg, 0), msg = NULL;
 		}
-		local_intr_restore(local_intr);
-		return ret;
+		spinlock_release(&(mbox->lock));
+		local_intr_restore(intr_flag);
+	}
+	if (msg != NULL) {
+		free_msg(msg);
 	}
-	free_msg(msg);
 	return ret;
 }
 
@@ -491,26 +636,41 @@ int ipc_mbox_free(int id)
 	if ((mbox = get_mbox(id)) == NULL) {
 		return -E_INVAL;
 	}
-	bool intr_flag;
+	bool intr_flag, need_free;
+	list_entry_t msgs;
+	list_init(&msgs);
 	local_intr_save(intr_flag);
-	spinlock_acquire(&mbox_lock);
+	spinlock_acquire(&(mbox->lock));
+	if (mbox->state != OPENED) {
+		spinlock_release(&(mbox->lock));
+		local_intr_restore(intr_flag);
+		return -E_INVAL;
+	}
 	{
 		mbox->state = CLOSING;
 
 		list_entry_t *list = &(mbox->msg_link), *le;
 		while ((le = list_next(list)) != list) {
 			list_del(le);
-			free_msg(le2msg(le, msg_link));
+			list_add_before(&msgs, le);
 		}
+		mbox->slots = 0;
 		wakeup_queue(&(mbox->senders), WT_INTERRUPTED, 1);
 		wakeup_queue(&(mbox->receivers), WT_INTERRUPTED, 1);
 
-		if (mbox->inuse == 0) {
-			mbox_free(mbox);
-		}
+		need_free = (mbox->inuse == 0);
 	}
-	spinlock_release(&mbox_lock);
+	spinlock_release(&(mbox->lock));
 	local_intr_restore(intr_flag);
+
+	list_entry_t *le;
+	while ((le = list_next(&msgs)) != &msgs) {
+		list_del(le);
+		free_msg(le2msg(le, msg_link));
+	}
+	if (need_free) {
+		mbox_free(mbox);
+	}
 	return 0;
 }
 
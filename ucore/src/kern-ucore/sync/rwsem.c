@@ -0,0 +1,128 @@
+#include <types.h>
+#include <wait.h>
+#include <sync.h>
+#include <proc.h>
+#include <sched.h>
+#include <assert.h>
+#include <rwsem.h>
+
+void rwsem_init(rw_semaphore_t * sem)
+{
+	sem->count = 0;
+	wait_queue_init(&(sem->read_queue));
+	wait_queue_init(&(sem->write_queue));
+	spinlock_init(&sem->lock);
+}
+
+//__rwsem_wait - sleep on @queue until a leaving holder hands us the lock,
+//             - called with sem->lock held and returns with it released
+static void
+__rwsem_wait(rw_semaphore_t * sem, wait_queue_t * queue, bool intr_flag)
+{
+	wait_t __wait, *wait = &__wait;
+	wait_current_set(queue, wait, WT_KSEM);
+	spin_unlock_irqrestore(&sem->lock, intr_flag);
+
+	schedule();
+
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	wait_current_del(queue, wait);
+	spin_unlock_irqrestore(&sem->lock, intr_flag);
+	assert(wait->wakeup_flags == WT_KSEM);
+}
+
+//__rwsem_wake_readers - pass the lock to every waiting reader, if any
+static bool __rwsem_wake_readers(rw_semaphore_t * sem)
+{
+	wait_t *wait;
+	if ((wait = wait_queue_first(&(sem->read_queue))) == NULL) {
+		return 0;
+	}
+	do {
+		sem->count++;
+	} while ((wait = wait_queue_next(&(sem->read_queue), wait)) != NULL);
+	wakeup_queue(&(sem->read_queue), WT_KSEM, 1);
+	return 1;
+}
+
+//__rwsem_wake_writer - pass the lock to the first waiting writer, if any
+static bool __rwsem_wake_writer(rw_semaphore_t * sem)
+{
+	if (wait_queue_empty(&(sem->write_queue))) {
+		return 0;
+	}
+	sem->count = -1;
+	wakeup_first(&(sem->write_queue), WT_KSEM, 1);
+	return 1;
+}
+
+void down_read(rw_semaphore_t * sem)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	if (sem->count >= 0 && wait_queue_empty(&(sem->write_queue))) {
+		sem->count++;
+		spin_unlock_irqrestore(&sem->lock, intr_flag);
+		return;
+	}
+	__rwsem_wait(sem, &(sem->read_queue), intr_flag);
+}
+
+bool try_down_read(rw_semaphore_t * sem)
+{
+	bool intr_flag, ret = 0;
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	if (sem->count >= 0 && wait_queue_empty(&(sem->write_queue))) {
+		sem->count++, ret = 1;
+	}
+	spin_unlock_irqrestore(&sem->lock, intr_flag);
+	return ret;
+}
+
+void up_read(rw_semaphore_t * sem)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	assert(sem->count > 0);
+	/* the readers queued meanwhile came after the writer, it goes first */
+	if (--sem->count == 0 && !__rwsem_wake_writer(sem)) {
+		__rwsem_wake_readers(sem);
+	}
+	spin_unlock_irqrestore(&sem->lock, intr_flag);
+}
+
+void down_write(rw_semaphore_t * sem)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	if (sem->count == 0) {
+		sem->count = -1;
+		spin_unlock_irqrestore(&sem->lock, intr_flag);
+		return;
+	}
+	__rwsem_wait(sem, &(sem->write_queue), intr_flag);
+}
+
+bool try_down_write(rw_semaphore_t * sem)
+{
+	bool intr_flag, ret = 0;
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	if (sem->count == 0) {
+		sem->count = -1, ret = 1;
+	}
+	spin_unlock_irqrestore(&sem->lock, intr_flag);
+	return ret;
+}
+
+void up_write(rw_semaphore_t * sem)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	assert(sem->count == -1);
+	sem->count = 0;
+	/* and the readers waiting on this writer go before the next one */
+	if (!__rwsem_wake_readers(sem)) {
+		__rwsem_wake_writer(sem);
+	}
+	spin_unlock_irqrestore(&sem->lock, intr_flag);
+}
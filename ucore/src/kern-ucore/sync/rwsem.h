@@ -0,0 +1,30 @@
+#ifndef __KERN_SYNC_RWSEM_H__
+#define __KERN_SYNC_RWSEM_H__
+
+#include <types.h>
+#include <wait.h>
+#include <spinlock.h>
+
+/*
+ * A sleeping reader/writer lock. Readers share it, a writer holds it
+ * alone. Once a writer waits, new readers queue behind it and the last
+ * reader leaving hands the lock to that writer. A writer leaving hands
+ * it to all waiting readers first, so neither side starves. The lock is
+ * handed over on wakeup: a woken waiter owns it.
+ */
+typedef struct rw_semaphore {
+	int count;		// readers inside, -1 if a writer is
+	wait_queue_t read_queue;
+	wait_queue_t write_queue;
+	spinlock_s lock;
+} rw_semaphore_t;
+
+void rwsem_init(rw_semaphore_t * sem);
+void down_read(rw_semaphore_t * sem);
+void up_read(rw_semaphore_t * sem);
+bool try_down_read(rw_semaphore_t * sem);
+void down_write(rw_semaphore_t * sem);
+void up_write(rw_semaphore_t * sem);
+bool try_down_write(rw_semaphore_t * sem);
+
+#endif /* !__KERN_SYNC_RWSEM_H__ */
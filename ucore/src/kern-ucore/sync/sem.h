@@ -15,7 +15,6 @@ typedef struct semaphore {
 	atomic_t count;
 	wait_queue_t wait_queue;
 	spinlock_s lock;
-	uintptr_t addr;
 } semaphore_t;
 
 // The sem_undo_t is used to permit semaphore manipulations that can be undone. If a process
@@ -32,9 +31,6 @@ typedef struct sem_undo {
 #define le2semu(le, member)             \
     to_struct((le), sem_undo_t, member)
 
-#define FUTEX_WAIT 0
-#define FUTEX_WAKE 1
-
 typedef struct sem_queue {
 	semaphore_t sem;
 	atomic_t count;
@@ -65,8 +61,6 @@ int ipc_sem_wait(sem_t sem_id, unsigned int timeout);
 int ipc_sem_free(sem_t sem_id);
 int ipc_sem_get_value(sem_t sem_id, int *value_store);
 
-int do_futex(uintptr_t uaddr, int op, int val);
-
 static inline int sem_count(semaphore_t * sem)
 {
 	return atomic_read(&(sem->count));
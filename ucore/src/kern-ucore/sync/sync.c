@@ -1,7 +1,9 @@
 #include <sync.h>
 #include <mbox.h>
+#include <futex.h>
 
 void sync_init(void)
 {
 	mbox_init();
+	futex_init();
 }
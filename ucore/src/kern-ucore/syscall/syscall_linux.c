@@ -296,6 +296,8 @@ machine_word_t syscall_linux_mmap(machine_word_t args[])
 		uint32_t ucoreflags = 0;
 		if (prot & PROT_WRITE)
 			ucoreflags |= MMAP_WRITE;
+		if (flags & MAP_POPULATE)
+			ucoreflags |= MMAP_POPULATE;
 		int ret = __do_linux_mmap((uintptr_t) & addr, len, ucoreflags);
 		//kprintf("@@@ ret=%d %e %08x\n", ret,ret, addr);
 		if (ret)
@@ -323,6 +325,14 @@ machine_word_t syscall_linux_mprotect(machine_word_t args[])
 	return do_mprotect(addr, len, prot);
 }
 
+machine_word_t syscall_linux_madvise(machine_word_t args[])
+{
+	void *addr = (void*)args[0];
+	size_t len = (size_t)args[1];
+	int advice = (int)args[2];
+	return do_madvise(addr, len, advice);
+}
+
 machine_word_t syscall_linux_poll(machine_word_t args[])
 {
   struct linux_pollfd {
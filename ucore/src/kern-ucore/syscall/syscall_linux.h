@@ -37,6 +37,7 @@ machine_word_t syscall_linux_old_mmap(machine_word_t args[]);
 machine_word_t syscall_linux_mmap(machine_word_t args[]);
 machine_word_t syscall_linux_munmap(machine_word_t args[]);
 machine_word_t syscall_linux_mprotect(machine_word_t args[]);
+machine_word_t syscall_linux_madvise(machine_word_t args[]);
 
 machine_word_t syscall_linux_poll(machine_word_t args[]);
 machine_word_t syscall_linux_select(machine_word_t args[]);
@@ -15,14 +15,15 @@ uint64_t syscall(int num, ...)
 	}
 	va_end(ap);
 
+	// the syscall instruction, the bit asks for the native table
+	register uint64_t r10 asm("r10") = a[3];
+	register uint64_t r8 asm("r8") = a[4];
+	register uint64_t r9 asm("r9") = a[5];
 	uint64_t ret;
-	asm volatile ("movq 0x00(%%rbx), %%rdi;"
-		      "movq 0x08(%%rbx), %%rsi;"
-		      "movq 0x10(%%rbx), %%rdx;"
-		      "movq 0x18(%%rbx), %%rcx;"
-		      "movq 0x20(%%rbx), %%r8;"
-		      "movq 0x28(%%rbx), %%r9;" "int %1":"=a" (ret)
-		      :"i"(T_SYSCALL), "a"(num), "b"(a)
-		      :"cc", "memory");
+	asm volatile ("syscall"
+		      :"=a" (ret), "+r"(r10), "+r"(r8), "+r"(r9)
+		      :"a"(num | (1 << SYSCALL_NATIVE_BIT)), "D"(a[0]), "S"(a[1]),
+		      "d"(a[2])
+		      :"rcx", "r11", "cc", "memory");
 	return ret;
 }
@@ -0,0 +1,417 @@
+#include <types.h>
+#include <string.h>
+#include <stdio.h>
+#include <syscall.h>
+#include <malloc.h>
+#include <stat.h>
+#include <file.h>
+#include <unistd.h>
+#include <mutex.h>
+#include <bufio.h>
+
+#define F_READ          0x01
+#define F_WRITE         0x02
+#define F_EOF           0x04
+#define F_ERR           0x08
+#define F_SETUP         0x10	// buffering mode decided
+#define F_MALLOC        0x20	// the FILE and its buffer came from malloc
+#define F_CONSOLE       0x40	// print with sys_putc what the fd does not take
+
+struct __file {
+	int fd;
+	int flags;
+	int mode;
+	char *buf;
+	size_t size;
+	size_t pos, len;	// unread input is buf[pos, len), pending output buf[0, len)
+	mutex_t lock;
+	FILE *next;
+};
+
+static char stdin_buf[BUFSIZ], stdout_buf[BUFSIZ];
+
+/*
+ * cprintf used to go straight to the console, so stdout still does when
+ * fd 1 is not open, e.g. before umain has set it up.
+ */
+static FILE __stderr = { 2, F_WRITE | F_SETUP, _IONBF, NULL, 0, 0, 0, MUTEX_INIT, NULL };
+static FILE __stdout = { 1, F_WRITE | F_CONSOLE, _IOLBF, stdout_buf, BUFSIZ, 0, 0, MUTEX_INIT, &__stderr };
+static FILE __stdin = { 0, F_READ | F_SETUP, _IOFBF, stdin_buf, BUFSIZ, 0, 0, MUTEX_INIT, &__stdout };
+
+FILE *stdin = &__stdin, *stdout = &__stdout, *stderr = &__stderr;
+
+/* all streams, for fflush(NULL); streams_lock is taken before a stream's lock */
+static FILE *streams = &__stdin;
+static mutex_t streams_lock = MUTEX_INIT;
+
+// stream_setup - line buffer devices, fully buffer files and pipes
+static void stream_setup(FILE *fp)
+{
+	struct stat __stat, *stat = &__stat;
+	if (!(fp->flags & F_SETUP)) {
+		if (fstat(fp->fd, stat) == 0) {
+			fp->mode = S_ISCHR(stat->st_mode) ? _IOLBF : _IOFBF;
+		}
+		fp->flags |= F_SETUP;
+	}
+}
+
+static int write_all(FILE *fp, const char *data, size_t n)
+{
+	int ret;
+	while (n > 0 && (ret = sys_write(fp->fd, (void *)data, n)) > 0) {
+		data += ret, n -= ret;
+	}
+	if (n > 0) {
+		if (!(fp->flags & F_CONSOLE)) {
+			fp->flags |= F_ERR;
+			return -1;
+		}
+		while (n-- > 0) {
+			sys_putc(*data++);
+		}
+	}
+	return 0;
+}
+
+static int flush_locked(FILE *fp)
+{
+	int ret = 0;
+	if ((fp->flags & F_WRITE) && fp->len != 0) {
+		ret = write_all(fp, fp->buf, fp->len);
+		fp->len = 0;
+	}
+	return ret;
+}
+
+static int put_locked(FILE *fp, const char *data, size_t n)
+{
+	size_t i;
+	stream_setup(fp);
+	if (fp->mode == _IONBF || fp->size == 0) {
+		if (flush_locked(fp) != 0) {
+			return -1;
+		}
+		return write_all(fp, data, n);
+	}
+	if (fp->len + n > fp->size) {
+		if (flush_locked(fp) != 0) {
+			return -1;
+		}
+		if (n >= fp->size) {
+			return write_all(fp, data, n);
+		}
+	}
+	memcpy(fp->buf + fp->len, data, n);
+	fp->len += n;
+	if (fp->len == fp->size) {
+		return flush_locked(fp);
+	}
+	if (fp->mode == _IOLBF) {
+		for (i = 0; i < n; i++) {
+			if (data[i] == '\n') {
+				return flush_locked(fp);
+			}
+		}
+	}
+	return 0;
+}
+
+static inline int putc_locked(int c, FILE *fp)
+{
+	if ((fp->flags & F_SETUP) && fp->mode != _IONBF && fp->len < fp->size) {
+		fp->buf[fp->len++] = c;
+		if (fp->len == fp->size || (c == '\n' && fp->mode == _IOLBF)) {
+			return flush_locked(fp);
+		}
+		return 0;
+	}
+	char ch = c;
+	return put_locked(fp, &ch, 1);
+}
+
+// fill_locked - read more input, line buffered output is written out first
+static int fill_locked(FILE *fp)
+{
+	int ret;
+	flush_linebuf();
+	fp->pos = fp->len = 0;
+	if ((ret = sys_read(fp->fd, fp->buf, fp->size)) <= 0) {
+		fp->flags |= (ret == 0) ? F_EOF : F_ERR;
+		return -1;
+	}
+	fp->len = ret;
+	return 0;
+}
+
+FILE *fdopen(int fd, const char *mode)
+{
+	FILE *fp;
+	if ((fp = malloc(sizeof(FILE) + BUFSIZ)) == NULL) {
+		return NULL;
+	}
+	fp->fd = fd;
+	fp->flags = F_MALLOC | ((mode[0] == 'r') ? (F_READ | F_SETUP) : F_WRITE);
+	fp->mode = _IOFBF;
+	fp->buf = (char *)(fp + 1);
+	fp->size = BUFSIZ;
+	fp->pos = fp->len = 0;
+	mutex_init(&(fp->lock));
+	mutex_lock(&streams_lock);
+	fp->next = streams, streams = fp;
+	mutex_unlock(&streams_lock);
+	return fp;
+}
+
+FILE *fopen(const char *path, const char *mode)
+{
+	uint32_t open_flags;
+	switch (mode[0]) {
+	case 'r':
+		open_flags = O_RDONLY;
+		break;
+	case 'w':
+		open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+		break;
+	case 'a':
+		open_flags = O_WRONLY | O_CREAT | O_APPEND;
+		break;
+	default:
+		return NULL;
+	}
+	int fd;
+	FILE *fp;
+	if ((fd = open(path, open_flags)) < 0) {
+		return NULL;
+	}
+	if ((fp = fdopen(fd, mode)) == NULL) {
+		close(fd);
+	}
+	return fp;
+}
+
+int fclose(FILE *fp)
+{
+	FILE **pp;
+	int ret = fflush(fp);
+	mutex_lock(&streams_lock);
+	for (pp = &streams; *pp != NULL; pp = &((*pp)->next)) {
+		if (*pp == fp) {
+			*pp = fp->next;
+			break;
+		}
+	}
+	mutex_unlock(&streams_lock);
+	if (close(fp->fd) != 0) {
+		ret = EOF;
+	}
+	if (fp->flags & F_MALLOC) {
+		free(fp);
+	}
+	return ret;
+}
+
+int fileno(FILE *fp)
+{
+	return fp->fd;
+}
+
+int setvbuf(FILE *fp, char *buf, int mode, size_t size)
+{
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+		return -1;
+	}
+	mutex_lock(&(fp->lock));
+	flush_locked(fp);
+	if (buf != NULL) {
+		fp->buf = buf, fp->size = size;
+	}
+	fp->mode = mode;
+	fp->flags |= F_SETUP;
+	mutex_unlock(&(fp->lock));
+	return 0;
+}
+
+// fflush - write out @fp, or every output stream if @fp is NULL
+int fflush(FILE *fp)
+{
+	int ret = 0;
+	if (fp != NULL) {
+		mutex_lock(&(fp->lock));
+		ret = flush_locked(fp);
+		mutex_unlock(&(fp->lock));
+		return ret;
+	}
+	mutex_lock(&streams_lock);
+	for (fp = streams; fp != NULL; fp = fp->next) {
+		if ((fp->flags & F_WRITE) && fp->len != 0) {
+			mutex_lock(&(fp->lock));
+			ret |= flush_locked(fp);
+			mutex_unlock(&(fp->lock));
+		}
+	}
+	mutex_unlock(&streams_lock);
+	return ret;
+}
+
+// flush_linebuf - write out line buffered streams, before reading input
+void flush_linebuf(void)
+{
+	FILE *fp;
+	mutex_lock(&streams_lock);
+	for (fp = streams; fp != NULL; fp = fp->next) {
+		if ((fp->flags & F_WRITE) && fp->mode == _IOLBF && fp->len != 0) {
+			mutex_lock(&(fp->lock));
+			flush_locked(fp);
+			mutex_unlock(&(fp->lock));
+		}
+	}
+	mutex_unlock(&streams_lock);
+}
+
+// fd2stream - the output stream writing to @fd, if there is one
+FILE *fd2stream(int fd)
+{
+	FILE *fp;
+	mutex_lock(&streams_lock);
+	for (fp = streams; fp != NULL; fp = fp->next) {
+		if ((fp->flags & F_WRITE) && fp->fd == fd) {
+			break;
+		}
+	}
+	mutex_unlock(&streams_lock);
+	return fp;
+}
+
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *fp)
+{
+	size_t total = size * nmemb, copied = 0, n;
+	int ret;
+	if (total == 0) {
+		return 0;
+	}
+	mutex_lock(&(fp->lock));
+	while (copied < total) {
+		if (fp->pos < fp->len) {
+			n = fp->len - fp->pos;
+			if (n > total - copied) {
+				n = total - copied;
+			}
+			memcpy((char *)ptr + copied, fp->buf + fp->pos, n);
+			fp->pos += n, copied += n;
+		} else if (total - copied >= fp->size) {
+			// large reads bypass the buffer
+			flush_linebuf();
+			if ((ret = sys_read(fp->fd, (char *)ptr + copied, total - copied)) <= 0) {
+				fp->flags |= (ret == 0) ? F_EOF : F_ERR;
+				break;
+			}
+			copied += ret;
+		} else if (fill_locked(fp) != 0) {
+			break;
+		}
+	}
+	mutex_unlock(&(fp->lock));
+	return copied / size;
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *fp)
+{
+	size_t total = size * nmemb;
+	if (total == 0) {
+		return 0;
+	}
+	mutex_lock(&(fp->lock));
+	int ret = put_locked(fp, ptr, total);
+	mutex_unlock(&(fp->lock));
+	return (ret == 0) ? nmemb : 0;
+}
+
+int fgetc(FILE *fp)
+{
+	int c = EOF;
+	mutex_lock(&(fp->lock));
+	if (fp->pos < fp->len || fill_locked(fp) == 0) {
+		c = (unsigned char)fp->buf[fp->pos++];
+	}
+	mutex_unlock(&(fp->lock));
+	return c;
+}
+
+int fputc(int c, FILE *fp)
+{
+	mutex_lock(&(fp->lock));
+	int ret = putc_locked(c, fp);
+	mutex_unlock(&(fp->lock));
+	return (ret == 0) ? (unsigned char)c : EOF;
+}
+
+int fputs(const char *s, FILE *fp)
+{
+	mutex_lock(&(fp->lock));
+	int ret = put_locked(fp, s, strlen(s));
+	mutex_unlock(&(fp->lock));
+	return (ret == 0) ? 0 : EOF;
+}
+
+int feof(FILE *fp)
+{
+	return (fp->flags & F_EOF) != 0;
+}
+
+int ferror(FILE *fp)
+{
+	return (fp->flags & F_ERR) != 0;
+}
+
+struct stream_putdat {
+	FILE *fp;
+	int cnt;
+};
+
+static void stream_putch(int c, struct stream_putdat *putdat, int fd)
+{
+	putc_locked(c, putdat->fp);
+	putdat->cnt++;
+}
+
+/*
+ * vfprintf_stream - the formatting behind cprintf and fprintf. Output to
+ * an unbuffered stream such as stderr is collected on the stack and
+ * written once per call rather than once per character.
+ */
+int vfprintf_stream(FILE *fp, const char *fmt, va_list ap)
+{
+	char buf[256];
+	FILE tmp = { fp->fd, F_WRITE | F_SETUP | (fp->flags & F_CONSOLE), _IOFBF, buf, sizeof(buf), 0, 0, MUTEX_INIT, NULL };
+	struct stream_putdat putdat = { fp, 0 };
+	mutex_lock(&(fp->lock));
+	stream_setup(fp);
+	if (fp->mode == _IONBF || fp->size == 0) {
+		putdat.fp = &tmp;
+	}
+	vprintfmt((void *)stream_putch, fp->fd, &putdat, fmt, ap);
+	if (putdat.fp == &tmp && flush_locked(&tmp) != 0) {
+		fp->flags |= F_ERR;
+	}
+	mutex_unlock(&(fp->lock));
+	return putdat.cnt;
+}
+
+/*
+ * vfprintf_fd - the formatting behind fprintf(fd, ...). It goes through
+ * the stream of @fd if there is one, otherwise through an unlisted stream
+ * on the stack that is flushed before returning.
+ */
+int vfprintf_fd(int fd, const char *fmt, va_list ap)
+{
+	FILE *fp;
+	if ((fp = fd2stream(fd)) != NULL) {
+		return vfprintf_stream(fp, fmt, ap);
+	}
+	char buf[256];
+	FILE tmp = { fd, F_WRITE | F_SETUP, _IOFBF, buf, sizeof(buf), 0, 0, MUTEX_INIT, NULL };
+	int cnt = vfprintf_stream(&tmp, fmt, ap);
+	flush_locked(&tmp);
+	return cnt;
+}
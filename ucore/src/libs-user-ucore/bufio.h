@@ -0,0 +1,47 @@
+#ifndef __USER_LIBS_BUFIO_H__
+#define __USER_LIBS_BUFIO_H__
+
+#include <types.h>
+#include <stdarg.h>
+
+/*
+ * Buffered streams on top of read/write. stdout is line buffered when it
+ * is a device and fully buffered otherwise, stderr is unbuffered. cprintf
+ * and fprintf(fd, ...) go through the stream of their fd, so they mix
+ * with fwrite on it in order. Everything is flushed at fork, exec and
+ * exit, and line buffered output before a read.
+ */
+
+#define BUFSIZ          1024
+#define EOF             (-1)
+
+/* setvbuf modes */
+#define _IOFBF          0	// flush when full
+#define _IOLBF          1	// flush at a newline as well
+#define _IONBF          2	// no buffering
+
+typedef struct __file FILE;
+
+extern FILE *stdin, *stdout, *stderr;
+
+FILE *fdopen(int fd, const char *mode);
+FILE *fopen(const char *path, const char *mode);
+int fclose(FILE *fp);
+int fileno(FILE *fp);
+int setvbuf(FILE *fp, char *buf, int mode, size_t size);
+int fflush(FILE *fp);
+
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *fp);
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *fp);
+int fgetc(FILE *fp);
+int fputc(int c, FILE *fp);
+int fputs(const char *s, FILE *fp);
+int feof(FILE *fp);
+int ferror(FILE *fp);
+
+int vfprintf_stream(FILE *fp, const char *fmt, va_list ap);
+int vfprintf_fd(int fd, const char *fmt, va_list ap);
+FILE *fd2stream(int fd);
+void flush_linebuf(void);
+
+#endif /* !__USER_LIBS_BUFIO_H__ */
@@ -0,0 +1,39 @@
+#ifndef __LIBS_KMSG_H__
+#define __LIBS_KMSG_H__
+
+#include <types.h>
+
+/* log levels, as the "<N>" prefix of a kprintf format */
+#define KMSG_EMERG          0
+#define KMSG_ALERT          1
+#define KMSG_CRIT           2
+#define KMSG_ERR            3
+#define KMSG_WARNING        4
+#define KMSG_NOTICE         5
+#define KMSG_INFO           6
+#define KMSG_DEBUG          7
+
+#define KMSG_TEXT_MAX       108
+
+/* kmsg_record flags */
+#define KMSG_CONT           0x1	// continues the line of the previous record from this cpu
+#define KMSG_LOST           0x2	// overwritten, seq is the oldest record still kept
+
+/*
+ * One record of the kernel log, as read from /dev/kmsg. Record n is at
+ * offset n * sizeof(struct kmsg_record) of the device, and a read returns
+ * whole records only, up to the newest one. Text is not NUL terminated.
+ */
+struct kmsg_record {
+	uint32_t seq;		// position in the log
+	uint32_t cpu_seq;	// position among the records of the same cpu
+	uint32_t ticks;		// clock ticks when logged
+	uint16_t cpu;
+	uint8_t level;
+	uint8_t flags;
+	uint16_t len;		// bytes of text
+	uint16_t reserved;
+	char text[KMSG_TEXT_MAX];
+};
+
+#endif /* !__LIBS_KMSG_H__ */
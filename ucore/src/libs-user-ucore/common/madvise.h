@@ -0,0 +1,42 @@
+#ifndef __LIBS_MADVISE_H__
+#define __LIBS_MADVISE_H__
+
+#include <types.h>
+
+/* SYS_madvise advice, numbered as in linux */
+#define MADV_NORMAL         0	// fault around the faulting page
+#define MADV_RANDOM         1	// fault in single pages only
+#define MADV_SEQUENTIAL     2	// fault in the pages ahead as well
+#define MADV_WILLNEED       3	// read in file and swapped out pages now
+#define MADV_DONTNEED       4	// drop the pages, they read back as zero or from the file
+
+#define MADV_FREE           8	// drop private anonymous pages
+#define MADV_REMOVE         9
+#define MADV_DONTFORK       10
+#define MADV_DOFORK         11
+#define MADV_MERGEABLE      12
+#define MADV_UNMERGEABLE    13
+#define MADV_HUGEPAGE       14
+#define MADV_NOHUGEPAGE     15
+#define MADV_DONTDUMP       16
+#define MADV_DODUMP         17
+#define MADV_HWPOISON       100
+
+/* SYS_faultstat, page fault counters of the calling process */
+struct fault_stat {
+	size_t nr_faults;	// page faults taken
+	size_t nr_major;	// of which read a page from a file or swap
+	size_t nr_around;	// pages mapped around a fault
+	size_t nr_populated;	// pages mapped by MAP_POPULATE or MADV_WILLNEED
+};
+
+/* SYS_ksmstat, counters of the same-page merging daemon */
+struct ksm_stat {
+	size_t pages_shared;	// merged pages kept by ksmd
+	size_t pages_sharing;	// further mappings of them, i.e. pages saved
+	size_t pages_merged;	// mappings merged so far
+	size_t pages_zero;	// zero-filled pages merged into the zero page
+	size_t full_scans;	// passes over all mergeable memory
+};
+
+#endif /* !__LIBS_MADVISE_H__ */
@@ -0,0 +1,37 @@
+#ifndef __LIBS_VDSO_H__
+#define __LIBS_VDSO_H__
+
+/*
+ * The vDSO is a page of code the kernel maps into every process (amd64
+ * only, with the VDSO option), so that reading the clocks or the pid
+ * does not have to enter the kernel. It starts with a struct vdso_image,
+ * whose address a native program finds in %rcx at its entry. The
+ * functions follow the C calling convention and return 0 or -E_*.
+ */
+
+#define VDSO_MAGIC              0x4f534456	// "VDSO"
+
+/* functions, by index in vdso_image.offsets */
+#define VDSO_GETTIMEOFDAY       0	// int (struct timeval *tv, void *tz)
+#define VDSO_CLOCK_GETTIME      1	// int (int clock, struct timespec *ts)
+#define VDSO_TIME               2	// long (long *t)
+#define VDSO_GETPID             3	// int (void)
+#define VDSO_NR_FUNCS           4
+
+/* clocks of clock_gettime */
+#define CLOCK_REALTIME          0	// time of day
+#define CLOCK_MONOTONIC         1	// time since boot
+
+#ifndef __ASSEMBLY__
+
+#include <types.h>
+
+struct vdso_image {
+	uint32_t magic;
+	uint32_t nr_funcs;
+	uint32_t offsets[VDSO_NR_FUNCS];	// from the start of the image
+};
+
+#endif /* !__ASSEMBLY__ */
+
+#endif /* !__LIBS_VDSO_H__ */
@@ -6,6 +6,7 @@
 #include <malloc.h>
 #include <error.h>
 #include <unistd.h>
+#include <bufio.h>
 
 int open(const char *path, uint32_t open_flags)
 {
@@ -19,11 +20,17 @@ int close(int fd)
 
 int read(int fd, void *base, size_t len)
 {
+	flush_linebuf();
 	return sys_read(fd, base, len);
 }
 
 int write(int fd, void *base, size_t len)
 {
+	FILE *fp;
+	// keep the order with what was printed to @fd before
+	if ((fp = fd2stream(fd)) != NULL) {
+		fflush(fp);
+	}
 	return sys_write(fd, base, len);
 }
 
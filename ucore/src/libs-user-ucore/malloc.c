@@ -2,171 +2,388 @@
 #include <ulib.h>
 #include <syscall.h>
 #include <malloc.h>
-#include <lock.h>
+#include <mutex.h>
+#include <thread.h>
 #include <unistd.h>
 
-// A thread-awared memory allocator based on  the 
-// memory allocatorby Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+/*
+ * A size-class allocator in the manner of tcmalloc.
+ *
+ * Requests up to MAX_SMALL bytes are rounded up to one of NCLASSES object
+ * sizes. Each class has a central free list made of spans: a span is one
+ * CHUNK_SIZE aligned chunk, starting with its struct span and cut into
+ * objects of the class, so free() finds the span of any pointer by
+ * masking it. Threads do not take objects from the central lists one by
+ * one but through a thread cache, which moves them in batches. Spans that
+ * become empty go back to a small pool of chunks, and past that to the
+ * kernel. Larger requests and shared memory get a mapping of their own,
+ * with the struct span at its aligned start, and are unmapped by free().
+ *
+ * Thread caches are picked by the stack the caller runs on. thread()
+ * aligns its stacks to THREAD_STACK_ALIGN, so a thread keeps to one
+ * cache; the main thread and threads made by clone() share theirs. Every
+ * cache has a mutex anyway, which costs one atomic operation as long as
+ * only its thread uses it.
+ */
 
-void lock_fork(void);
-void unlock_fork(void);
+#define CHUNK_SHIFT         18
+#define CHUNK_SIZE          (1 << CHUNK_SHIFT)
+#define CHUNK_MASK          (~((uintptr_t)CHUNK_SIZE - 1))
+#define PGSIZE              4096
 
-union header {
+#define MAX_SMALL           32768
+#define NCLASSES            40
+#define NCACHES             16
+
+#define POOL_GROW           4	// chunks mapped at a time
+#define POOL_MAX            4	// empty chunks kept, the rest are unmapped
+
+#define SPAN_SMALL          0x5350414e
+#define SPAN_LARGE          0x4c415247
+#define SPAN_SHMEM          0x53484d4d
+
+struct span {
+	uint32_t magic;
+	int cls;
+	uintptr_t base;		// the mapping, for large and shared spans
+	size_t len;
+	void *free;		// objects given back to the span
+	char *carve, *end;	// objects never handed out yet: [carve, end)
+	int inuse;		// objects out of the span, thread caches included
+	bool listed;		// on the partial list of its class
+	struct span *prev, *next;
+} __attribute__ ((aligned(64)));
+
+struct central {
+	mutex_t lock;
+	int batch;		// objects moved between it and thread caches at once
+	struct span *partial;	// spans with objects left
+};
+
+struct cache {
+	mutex_t lock;
 	struct {
-		union header *ptr;
-		size_t size;
-		bool type;	// 0: normal, sys_brk; 1: shared memory, shmem
-	} s;
-	uint32_t align[16];
+		void *head;
+		int count;
+	} lists[NCLASSES];
 };
 
-typedef union header header_t;
+static struct central central[NCLASSES];
+static struct cache caches[NCACHES];
 
-static header_t base;
-static header_t *freep = NULL;
+static void *pool;		// empty chunks, linked through their first word
+static int pool_count;
+static mutex_t pool_lock = MUTEX_INIT;
 
-static lock_t mem_lock = INIT_LOCK;
+// size_class - the smallest class that holds @size bytes
+static inline int size_class(size_t size)
+{
+	int lg;
+	if (size <= 128) {
+		return (size != 0) ? (size - 1) >> 4 : 0;
+	}
+	for (lg = 7; ((size - 1) >> (lg + 1)) != 0; lg++) ;
+	return 8 + (lg - 7) * 4 + (((size - 1) >> (lg - 2)) & 3);
+}
 
-static void free_locked(void *ap);
+// class_size - 16 byte steps up to 128, then four classes per power of two
+static inline size_t class_size(int cls)
+{
+	if (cls < 8) {
+		return (cls + 1) * 16;
+	}
+	int lg = (cls - 8) / 4, step = (cls - 8) % 4 + 1;
+	return (128 << lg) + step * (32 << lg);
+}
 
-static inline void lock_malloc(void)
+static inline struct span *ptr2span(void *ptr)
 {
-	lock_fork();
-	lock(&mem_lock);
+	return (struct span *)((uintptr_t) ptr & CHUNK_MASK);
 }
 
-static inline void unlock_malloc(void)
+// map_aligned - map @len bytes at an @align aligned address
+static void *map_aligned(size_t len, size_t align)
 {
-	unlock(&mem_lock);
-	unlock_fork();
+	uintptr_t addr = 0, start;
+	if (mmap(&addr, len + align, MMAP_WRITE) != 0) {
+		return NULL;
+	}
+	start = (addr + align - 1) & ~((uintptr_t)align - 1);
+	if (start != addr) {
+		munmap(addr, start - addr);
+	}
+	if (start + len != addr + len + align) {
+		munmap(start + len, addr + align - start);
+	}
+	return (void *)start;
 }
 
-static bool morecore_brk_locked(size_t nu)
+static void *chunk_alloc(void)
 {
-	static uintptr_t brk = 0;
-	if (brk == 0) {
-		if (sys_brk(&brk) != 0 || brk == 0) {
-			return 0;
+	void *chunk;
+	int i;
+	mutex_lock(&pool_lock);
+	if (pool == NULL) {
+		char *mem;
+		if ((mem = map_aligned(POOL_GROW * CHUNK_SIZE, CHUNK_SIZE)) == NULL) {
+			mutex_unlock(&pool_lock);
+			return NULL;
 		}
+		for (i = POOL_GROW - 1; i >= 0; i--) {
+			*(void **)(mem + i * CHUNK_SIZE) = pool;
+			pool = mem + i * CHUNK_SIZE;
+		}
+		pool_count += POOL_GROW;
 	}
-	uintptr_t newbrk = brk + nu * sizeof(header_t);
-	if (sys_brk(&newbrk) != 0 || newbrk <= brk) {
-		return 0;
-	}
-	header_t *p = (void *)brk;
-	p->s.size = (newbrk - brk) / sizeof(header_t);
-	p->s.type = 0;
-	free_locked((void *)(p + 1));
-	brk = newbrk;
-	return 1;
+	chunk = pool, pool = *(void **)chunk;
+	pool_count--;
+	mutex_unlock(&pool_lock);
+	return chunk;
 }
 
-static bool morecore_shmem_locked(size_t nu)
+static void chunk_free(void *chunk)
 {
-	size_t size = ((nu * sizeof(header_t) + 0xfff) & (~0xfff));
-	uintptr_t mem = 0;
-	if (sys_shmem(&mem, size, MMAP_WRITE) != 0 || mem == 0) {
-		return 0;
+	mutex_lock(&pool_lock);
+	if (pool_count < POOL_MAX) {
+		*(void **)chunk = pool, pool = chunk;
+		pool_count++;
+		chunk = NULL;
+	}
+	mutex_unlock(&pool_lock);
+	if (chunk != NULL) {
+		munmap((uintptr_t) chunk, CHUNK_SIZE);
 	}
-	header_t *p = (void *)mem;
-	p->s.size = size / sizeof(header_t);
-	p->s.type = 1;
-	free_locked((void *)(p + 1));
-	return 1;
 }
 
-static void *malloc_locked(size_t size, bool type)
+static void span_link(struct central *c, struct span *s)
 {
-	static_assert(sizeof(header_t) == 0x40);
-	header_t *p, *prevp;
-	size_t nunits;
+	s->prev = NULL, s->next = c->partial;
+	if (c->partial != NULL) {
+		c->partial->prev = s;
+	}
+	c->partial = s, s->listed = 1;
+}
 
-	// make sure that type is 0 or 1
-	if (type) {
-		type = 1;
+static void span_unlink(struct central *c, struct span *s)
+{
+	if (s->prev != NULL) {
+		s->prev->next = s->next;
+	} else {
+		c->partial = s->next;
 	}
+	if (s->next != NULL) {
+		s->next->prev = s->prev;
+	}
+	s->listed = 0;
+}
 
-	nunits = (size + sizeof(header_t) - 1) / sizeof(header_t) + 1;
-	if ((prevp = freep) == NULL) {
-		base.s.ptr = freep = prevp = &base;
-		base.s.size = 0;
+static struct span *span_new(int cls)
+{
+	struct span *s;
+	size_t size = class_size(cls);
+	if ((s = chunk_alloc()) == NULL) {
+		return NULL;
 	}
+	s->magic = SPAN_SMALL;
+	s->cls = cls;
+	s->free = NULL;
+	s->carve = (char *)(s + 1);
+	s->end = s->carve + (CHUNK_SIZE - sizeof(struct span)) / size * size;
+	s->inuse = 0;
+	return s;
+}
 
-	for (p = prevp->s.ptr;; prevp = p, p = p->s.ptr) {
-		if (p->s.type == type && p->s.size >= nunits) {
-			if (p->s.size == nunits) {
-				prevp->s.ptr = p->s.ptr;
-			} else {
-				header_t *np = prevp->s.ptr = (p + nunits);
-				np->s.ptr = p->s.ptr;
-				np->s.size = p->s.size - nunits;
-				np->s.type = type;
-				p->s.size = nunits;
+// central_fetch - take up to @n objects of @cls, chained through their first word
+static int central_fetch(int cls, int n, void **headp)
+{
+	struct central *c = central + cls;
+	struct span *s;
+	void *head = NULL, *obj;
+	size_t size = class_size(cls);
+	int got = 0;
+
+	mutex_lock(&(c->lock));
+	while (got < n) {
+		if ((s = c->partial) == NULL) {
+			if ((s = span_new(cls)) == NULL) {
+				break;
 			}
-			freep = prevp;
-			return (void *)(p + 1);
+			span_link(c, s);
 		}
-		if (p == freep) {
-			bool(*morecore_locked) (size_t nu);
-			morecore_locked =
-			    (!type) ? morecore_brk_locked :
-			    morecore_shmem_locked;
-			if (!morecore_locked(nunits)) {
-				return NULL;
+		for (; got < n; got++, s->inuse++) {
+			if ((obj = s->free) != NULL) {
+				s->free = *(void **)obj;
+			} else if (s->carve < s->end) {
+				obj = s->carve, s->carve += size;
+			} else {
+				break;
 			}
+			*(void **)obj = head, head = obj;
+		}
+		if (s->free == NULL && s->carve == s->end) {
+			span_unlink(c, s);
 		}
 	}
+	mutex_unlock(&(c->lock));
+	*headp = head;
+	return got;
 }
 
-static void free_locked(void *ap)
+// central_release - give back a chain of objects of @cls
+static void central_release(int cls, void *head)
 {
-	header_t *bp = ((header_t *) ap) - 1, *p;
+	struct central *c = central + cls;
+	struct span *s;
+	void *obj;
 
-	for (p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr) {
-		if (p >= p->s.ptr && (bp > p || bp < p->s.ptr)) {
-			break;
+	mutex_lock(&(c->lock));
+	while ((obj = head) != NULL) {
+		head = *(void **)obj;
+		s = ptr2span(obj);
+		*(void **)obj = s->free, s->free = obj;
+		if (!s->listed) {
+			span_link(c, s);
+		}
+		if (--s->inuse == 0) {
+			span_unlink(c, s);
+			chunk_free(s);
 		}
 	}
+	mutex_unlock(&(c->lock));
+}
 
-	if (bp->s.type == p->s.ptr->s.type && bp + bp->s.size == p->s.ptr) {
-		bp->s.size += p->s.ptr->s.size;
-		bp->s.ptr = p->s.ptr->s.ptr;
-	} else {
-		bp->s.ptr = p->s.ptr;
+static inline struct cache *my_cache(void)
+{
+	uintptr_t sp = (uintptr_t) __builtin_frame_address(0);
+	return caches + (sp / THREAD_STACK_ALIGN) % NCACHES;
+}
+
+static void *malloc_small(size_t size)
+{
+	int cls = size_class(size);
+	struct cache *cache = my_cache();
+	void *obj;
+
+	mutex_lock(&(cache->lock));
+	if (cache->lists[cls].head == NULL) {
+		struct central *c = central + cls;
+		if (c->batch == 0) {
+			int batch = 8192 / class_size(cls);
+			c->batch = (batch < 2) ? 2 : (batch > 32) ? 32 : batch;
+		}
+		cache->lists[cls].count = central_fetch(cls, c->batch, &(cache->lists[cls].head));
 	}
+	if ((obj = cache->lists[cls].head) != NULL) {
+		cache->lists[cls].head = *(void **)obj;
+		cache->lists[cls].count--;
+	}
+	mutex_unlock(&(cache->lock));
+	return obj;
+}
 
-	if (p->s.type == bp->s.type && p + p->s.size == bp) {
-		p->s.size += bp->s.size;
-		p->s.ptr = bp->s.ptr;
-	} else {
-		p->s.ptr = bp;
+static void free_small(struct span *s, void *obj)
+{
+	int cls = s->cls, batch = central[cls].batch, i;
+	struct cache *cache = my_cache();
+
+	mutex_lock(&(cache->lock));
+	*(void **)obj = cache->lists[cls].head;
+	cache->lists[cls].head = obj;
+	if (++cache->lists[cls].count > 2 * batch) {
+		// keep one batch, hand the one on top back
+		void *head = obj, **tailp = &head;
+		for (i = 0; i < batch; i++) {
+			tailp = (void **)*tailp;
+		}
+		cache->lists[cls].head = *tailp;
+		cache->lists[cls].count -= batch;
+		*tailp = NULL;
+		mutex_unlock(&(cache->lock));
+		central_release(cls, head);
+		return;
 	}
+	mutex_unlock(&(cache->lock));
+}
 
-	freep = p;
+static void *malloc_large(size_t size)
+{
+	struct span *s;
+	size_t len = (sizeof(struct span) + size + PGSIZE - 1) & ~(PGSIZE - 1);
+	if (size > len || (s = map_aligned(len, CHUNK_SIZE)) == NULL) {
+		return NULL;
+	}
+	s->magic = SPAN_LARGE;
+	s->base = (uintptr_t) s, s->len = len;
+	return s + 1;
 }
 
 void *malloc(size_t size)
 {
-	void *ret;
-	lock_malloc();
-	ret = malloc_locked(size, 0);
-	unlock_malloc();
-	return ret;
+	if (size <= MAX_SMALL) {
+		return malloc_small(size);
+	}
+	return malloc_large(size);
 }
 
+// shmem_malloc - memory that stays shared with the children forked later
 void *shmem_malloc(size_t size)
 {
-	void *ret;
-	lock_malloc();
-	ret = malloc_locked(size, 1);
-	unlock_malloc();
-	return ret;
+	uintptr_t mem = 0;
+	size_t len = (sizeof(struct span) + size + PGSIZE - 1) & ~(PGSIZE - 1);
+	// shared mappings are not split, so align inside a larger one
+	if (size > len || sys_shmem(&mem, len + CHUNK_SIZE, MMAP_WRITE) != 0 || mem == 0) {
+		return NULL;
+	}
+	struct span *s = ptr2span((void *)(mem + CHUNK_SIZE - 1));
+	s->magic = SPAN_SHMEM;
+	s->base = mem, s->len = len + CHUNK_SIZE;
+	return s + 1;
 }
 
 void free(void *ap)
 {
-	lock_malloc();
-	free_locked(ap);
-	unlock_malloc();
+	struct span *s;
+	if (ap == NULL) {
+		return;
+	}
+	s = ptr2span(ap);
+	switch (s->magic) {
+	case SPAN_SMALL:
+		free_small(s, ap);
+		break;
+	case SPAN_LARGE:
+	case SPAN_SHMEM:
+		munmap(s->base, s->len);
+		break;
+	default:
+		panic("free: bad pointer %p.\n", ap);
+	}
+}
+
+/*
+ * fork() holds every allocator lock across sys_fork, so that the child
+ * does not start with a lock held by a thread it does not have.
+ */
+void malloc_lock_all(void)
+{
+	int i;
+	for (i = 0; i < NCACHES; i++) {
+		mutex_lock(&(caches[i].lock));
+	}
+	for (i = 0; i < NCLASSES; i++) {
+		mutex_lock(&(central[i].lock));
+	}
+	mutex_lock(&pool_lock);
+}
+
+void malloc_unlock_all(void)
+{
+	int i;
+	mutex_unlock(&pool_lock);
+	for (i = NCLASSES - 1; i >= 0; i--) {
+		mutex_unlock(&(central[i].lock));
+	}
+	for (i = NCACHES - 1; i >= 0; i--) {
+		mutex_unlock(&(caches[i].lock));
+	}
 }
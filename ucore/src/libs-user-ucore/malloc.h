@@ -7,4 +7,7 @@ void *malloc(size_t size);
 void *shmem_malloc(size_t size);
 void free(void *ap);
 
+void malloc_lock_all(void);
+void malloc_unlock_all(void);
+
 #endif /* !__USER_LIBS_MALLOC_H__ */
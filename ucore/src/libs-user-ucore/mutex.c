@@ -0,0 +1,174 @@
+#include <types.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <error.h>
+#include <mutex.h>
+
+// tries on a held mutex before sleeping, its holder may be about to leave
+#define MUTEX_SPIN          100
+
+#define WAKE_ALL            0x7fffffff
+
+static inline int futex_wait(volatile int *uaddr, int val, unsigned int timeout)
+{
+	return sys_futex(uaddr, FUTEX_WAIT, val, timeout);
+}
+
+static inline void futex_wake(volatile int *uaddr, int n)
+{
+	sys_futex(uaddr, FUTEX_WAKE, n, 0);
+}
+
+// mutex_lock_contended - take @m, leaving it marked as waited for
+static void mutex_lock_contended(mutex_t * m)
+{
+	while (__sync_lock_test_and_set(&(m->val), 2) != 0) {
+		futex_wait(&(m->val), 2, 0);
+	}
+}
+
+void mutex_lock_slow(mutex_t * m)
+{
+	int i;
+	for (i = 0; i < MUTEX_SPIN; i++) {
+		if (m->val == 0 && mutex_trylock(m)) {
+			return;
+		}
+		asm volatile ("":::"memory");
+	}
+	mutex_lock_contended(m);
+}
+
+// mutex_wake - the unlock of a mutex that may have sleepers
+void mutex_wake(mutex_t * m)
+{
+	m->val = 0;
+	__sync_synchronize();
+	futex_wake(&(m->val), 1);
+}
+
+void cond_init(cond_t * c)
+{
+	c->seq = c->waiters = 0;
+}
+
+/*
+ * cond_wait_timeout - release @m and sleep until @c is signalled or
+ * @timeout ticks (0: no limit) have passed, then take @m back. Returns 0
+ * or -E_TIMEOUT, and like any condition wait may return early.
+ */
+int cond_wait_timeout(cond_t * c, mutex_t * m, unsigned int timeout)
+{
+	int seq = c->seq, ret;
+	__sync_fetch_and_add(&(c->waiters), 1);
+	mutex_unlock(m);
+	ret = futex_wait(&(c->seq), seq, timeout);
+	__sync_fetch_and_sub(&(c->waiters), 1);
+	// others woken with us go to sleep on the mutex, so it must wake them
+	mutex_lock_contended(m);
+	return (ret == -E_TIMEOUT) ? ret : 0;
+}
+
+int cond_wait(cond_t * c, mutex_t * m)
+{
+	return cond_wait_timeout(c, m, 0);
+}
+
+void cond_signal(cond_t * c)
+{
+	if (c->waiters != 0) {
+		__sync_fetch_and_add(&(c->seq), 1);
+		futex_wake(&(c->seq), 1);
+	}
+}
+
+void cond_broadcast(cond_t * c)
+{
+	if (c->waiters != 0) {
+		__sync_fetch_and_add(&(c->seq), 1);
+		futex_wake(&(c->seq), WAKE_ALL);
+	}
+}
+
+void rwlock_init(rwlock_t * rw)
+{
+	rw->state = rw->writers = rw->waiters = rw->seq = 0;
+}
+
+/*
+ * rwlock_sleep - wait for a change of @rw while @blocked holds. The
+ * waiter is counted before it checks again, so an unlock either sees it
+ * and bumps seq, or happened before the check.
+ */
+#define rwlock_sleep(rw, blocked)                                   \
+    do {                                                            \
+        int __seq = (rw)->seq;                                      \
+        __sync_fetch_and_add(&((rw)->waiters), 1);                  \
+        if (blocked) {                                              \
+            futex_wait(&((rw)->seq), __seq, 0);                     \
+        }                                                           \
+        __sync_fetch_and_sub(&((rw)->waiters), 1);                  \
+    } while (0)
+
+void rwlock_rdlock(rwlock_t * rw)
+{
+	int state;
+	while (1) {
+		state = rw->state;
+		if (state >= 0 && rw->writers == 0) {
+			if (__sync_bool_compare_and_swap(&(rw->state), state, state + 1)) {
+				return;
+			}
+			continue;
+		}
+		rwlock_sleep(rw, rw->state < 0 || rw->writers != 0);
+	}
+}
+
+void rwlock_wrlock(rwlock_t * rw)
+{
+	if (__sync_bool_compare_and_swap(&(rw->state), 0, -1)) {
+		return;
+	}
+	__sync_fetch_and_add(&(rw->writers), 1);
+	while (!__sync_bool_compare_and_swap(&(rw->state), 0, -1)) {
+		rwlock_sleep(rw, rw->state != 0);
+	}
+	__sync_fetch_and_sub(&(rw->writers), 1);
+}
+
+void rwlock_unlock(rwlock_t * rw)
+{
+	if (rw->state < 0) {
+		rw->state = 0;
+		__sync_synchronize();
+	} else if (__sync_sub_and_fetch(&(rw->state), 1) != 0) {
+		return;
+	}
+	if (rw->waiters != 0) {
+		__sync_fetch_and_add(&(rw->seq), 1);
+		futex_wake(&(rw->seq), WAKE_ALL);
+	}
+}
+
+void barrier_init(barrier_t * b, int count)
+{
+	b->count = count;
+	b->arrived = b->seq = 0;
+}
+
+// barrier_wait - returns 1 in the thread that completes the round, 0 in the others
+int barrier_wait(barrier_t * b)
+{
+	int seq = b->seq;
+	if (__sync_add_and_fetch(&(b->arrived), 1) == b->count) {
+		b->arrived = 0;
+		__sync_fetch_and_add(&(b->seq), 1);
+		futex_wake(&(b->seq), WAKE_ALL);
+		return 1;
+	}
+	while (b->seq == seq) {
+		futex_wait(&(b->seq), seq, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef __USER_LIBS_MUTEX_H__
+#define __USER_LIBS_MUTEX_H__
+
+#include <types.h>
+
+/*
+ * Sleeping locks on top of SYS_futex. Taking or releasing a lock nobody
+ * waits for is a single atomic operation; only a thread that has to wait
+ * enters the kernel, and only an unlock that finds waiters wakes them.
+ * They work between processes as well when they live in memory from
+ * shmem() or shmem_malloc().
+ */
+
+/* 0: unlocked, 1: locked, 2: locked and maybe waited for */
+typedef struct {
+	volatile int val;
+} mutex_t;
+
+typedef struct {
+	volatile int seq;	// bumped by every signal
+	volatile int waiters;
+} cond_t;
+
+/* readers in state, or -1 held by a writer */
+typedef struct {
+	volatile int state;
+	volatile int writers;	// writers waiting, readers give way to them
+	volatile int waiters;
+	volatile int seq;
+} rwlock_t;
+
+typedef struct {
+	int count;
+	volatile int arrived;
+	volatile int seq;	// bumped when a round is complete
+} barrier_t;
+
+#define MUTEX_INIT          {0}
+#define COND_INIT           {0, 0}
+#define RWLOCK_INIT         {0, 0, 0, 0}
+
+void mutex_lock_slow(mutex_t * m);
+void mutex_wake(mutex_t * m);
+
+static inline void mutex_init(mutex_t * m)
+{
+	m->val = 0;
+}
+
+static inline bool mutex_trylock(mutex_t * m)
+{
+	return __sync_bool_compare_and_swap(&(m->val), 0, 1);
+}
+
+static inline void mutex_lock(mutex_t * m)
+{
+	if (!mutex_trylock(m)) {
+		mutex_lock_slow(m);
+	}
+}
+
+static inline void mutex_unlock(mutex_t * m)
+{
+	if (__sync_fetch_and_sub(&(m->val), 1) != 1) {
+		mutex_wake(m);
+	}
+}
+
+void cond_init(cond_t * c);
+int cond_wait(cond_t * c, mutex_t * m);
+int cond_wait_timeout(cond_t * c, mutex_t * m, unsigned int timeout);
+void cond_signal(cond_t * c);
+void cond_broadcast(cond_t * c);
+
+void rwlock_init(rwlock_t * rw);
+void rwlock_rdlock(rwlock_t * rw);
+void rwlock_wrlock(rwlock_t * rw);
+void rwlock_unlock(rwlock_t * rw);
+
+void barrier_init(barrier_t * b, int count);
+int barrier_wait(barrier_t * b);
+
+#endif /* !__USER_LIBS_MUTEX_H__ */
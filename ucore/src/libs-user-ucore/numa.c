@@ -0,0 +1,48 @@
+#include <types.h>
+#include <syscall.h>
+#include <numa.h>
+
+int mbind(void *addr, size_t len, int mode, const unsigned long *nmask,
+	  unsigned long maxnode, unsigned int flags)
+{
+	return sys_mbind((uintptr_t) addr, len, mode, nmask, maxnode, flags);
+}
+
+int set_mempolicy(int mode, const unsigned long *nmask, unsigned long maxnode)
+{
+	return sys_set_mempolicy(mode, nmask, maxnode);
+}
+
+int get_mempolicy(int *mode, unsigned long *nmask, unsigned long maxnode,
+		  void *addr, unsigned int flags)
+{
+	return sys_get_mempolicy(mode, nmask, maxnode, (uintptr_t) addr, flags);
+}
+
+int numa_stat(int node, struct numa_stat *stat)
+{
+	return sys_numa_stat(node, stat);
+}
+
+int numa_num_nodes(void)
+{
+	unsigned long mask;
+	int n = 0;
+	if (get_mempolicy(NULL, &mask, MPOL_MAX_NODES + 1, NULL,
+			  MPOL_F_MEMS_ALLOWED) != 0) {
+		return 1;
+	}
+	while (mask & 1) {
+		n++, mask >>= 1;
+	}
+	return n > 0 ? n : 1;
+}
+
+int numa_node_of(void *addr)
+{
+	int node;
+	if (get_mempolicy(&node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+		return -1;
+	}
+	return node;
+}
@@ -0,0 +1,19 @@
+#ifndef __USER_LIBS_NUMA_H__
+#define __USER_LIBS_NUMA_H__
+
+#include <types.h>
+#include <mpolicy.h>
+
+int mbind(void *addr, size_t len, int mode, const unsigned long *nmask,
+	  unsigned long maxnode, unsigned int flags);
+int set_mempolicy(int mode, const unsigned long *nmask, unsigned long maxnode);
+int get_mempolicy(int *mode, unsigned long *nmask, unsigned long maxnode,
+		  void *addr, unsigned int flags);
+int numa_stat(int node, struct numa_stat *stat);
+
+/* number of online nodes, nodes are numbered from 0 */
+int numa_num_nodes(void);
+/* node the page at @addr lives on, faulting it in if needed */
+int numa_node_of(void *addr);
+
+#endif /* !__USER_LIBS_NUMA_H__ */
@@ -0,0 +1,65 @@
+#include <types.h>
+#include <string.h>
+#include <syscall.h>
+#include <socket.h>
+
+int socket(int domain, int type, int protocol)
+{
+	return sys_socket(domain, type, protocol);
+}
+
+int connect(int fd, const struct sockaddr *addr, int addrlen)
+{
+	return sys_connect(fd, addr, addrlen);
+}
+
+int bind(int fd, const struct sockaddr *addr, int addrlen)
+{
+	return sys_bind(fd, addr, addrlen);
+}
+
+int listen(int fd, int backlog)
+{
+	return sys_listen(fd, backlog);
+}
+
+int accept(int fd, struct sockaddr *addr, int *addrlen)
+{
+	return sys_accept(fd, addr, addrlen);
+}
+
+int send(int fd, const void *buf, size_t len, unsigned int flags)
+{
+	return sys_sendto(fd, buf, len, flags, NULL, 0);
+}
+
+int recv(int fd, void *buf, size_t len, unsigned int flags)
+{
+	return sys_recvfrom(fd, buf, len, flags, NULL, NULL);
+}
+
+int sendto(int fd, const void *buf, size_t len, unsigned int flags,
+	   const struct sockaddr *addr, int addrlen)
+{
+	return sys_sendto(fd, buf, len, flags, addr, addrlen);
+}
+
+int recvfrom(int fd, void *buf, size_t len, unsigned int flags,
+	     struct sockaddr *addr, int *addrlen)
+{
+	return sys_recvfrom(fd, buf, len, flags, addr, addrlen);
+}
+
+int setsockopt(int fd, int level, int optname, const void *optval,
+	       int optlen)
+{
+	return sys_setsockopt(fd, level, optname, optval, optlen);
+}
+
+void sockaddr_in_init(struct sockaddr_in *sin, uint32_t addr, uint16_t port)
+{
+	memset(sin, 0, sizeof(struct sockaddr_in));
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(port);
+	sin->sin_addr.s_addr = addr;
+}
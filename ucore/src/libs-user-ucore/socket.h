@@ -0,0 +1,68 @@
+#ifndef __USER_LIBS_SOCKET_H__
+#define __USER_LIBS_SOCKET_H__
+
+#include <types.h>
+
+#define AF_INET             2
+
+#define SOCK_STREAM         1
+#define SOCK_DGRAM          2
+
+#define INADDR_ANY          0
+
+struct sockaddr {
+	uint16_t sa_family;
+	char sa_data[14];
+};
+
+struct in_addr {
+	uint32_t s_addr;	// network byte order
+};
+
+struct sockaddr_in {
+	uint16_t sin_family;
+	uint16_t sin_port;	// network byte order
+	struct in_addr sin_addr;
+	char sin_zero[8];
+};
+
+static inline uint16_t htons(uint16_t x)
+{
+	union {
+		uint8_t b[2];
+		uint16_t v;
+	} u;
+	u.b[0] = x >> 8, u.b[1] = x & 0xff;
+	return u.v;
+}
+
+#define ntohs(x)            htons(x)
+
+// inet_addr4(127, 0, 0, 1) returns 127.0.0.1 in network byte order
+static inline uint32_t inet_addr4(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	union {
+		uint8_t b[4];
+		uint32_t v;
+	} u;
+	u.b[0] = a, u.b[1] = b, u.b[2] = c, u.b[3] = d;
+	return u.v;
+}
+
+int socket(int domain, int type, int protocol);
+int connect(int fd, const struct sockaddr *addr, int addrlen);
+int bind(int fd, const struct sockaddr *addr, int addrlen);
+int listen(int fd, int backlog);
+int accept(int fd, struct sockaddr *addr, int *addrlen);
+int send(int fd, const void *buf, size_t len, unsigned int flags);
+int recv(int fd, void *buf, size_t len, unsigned int flags);
+int sendto(int fd, const void *buf, size_t len, unsigned int flags,
+	   const struct sockaddr *addr, int addrlen);
+int recvfrom(int fd, void *buf, size_t len, unsigned int flags,
+	     struct sockaddr *addr, int *addrlen);
+int setsockopt(int fd, int level, int optname, const void *optval,
+	       int optlen);
+
+void sockaddr_in_init(struct sockaddr_in *sin, uint32_t addr, uint16_t port);
+
+#endif /* !__USER_LIBS_SOCKET_H__ */
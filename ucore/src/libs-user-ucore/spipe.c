@@ -1,67 +1,68 @@
 #include <types.h>
 #include <unistd.h>
 #include <ulib.h>
+#include <mutex.h>
 #include <spipe.h>
 
 #define SPIPE_SIZE      4096
 #define SPIPE_BUFSIZE   (SPIPE_SIZE - sizeof(__spipe_state_t))
 
-static bool __spipeisclosed_nolock(spipe_t * p, bool read);
+/*
+ * The state and its lock live in the shared page itself, so a reader
+ * waiting for data and a writer waiting for room sleep on the condition
+ * variables there until the other side moves.
+ */
 
 int spipe(spipe_t * p)
 {
 	static_assert(SPIPE_SIZE > SPIPE_BUFSIZE);
 	int ret;
-	sem_t spipe_sem;
 	uintptr_t addr = 0;
 	if ((ret = shmem(&addr, SPIPE_SIZE, MMAP_WRITE)) != 0) {
-		goto failed;
-	}
-	if ((spipe_sem = sem_init(1)) < 0) {
-		goto failed_cleanup_mem;
+		return ret;
 	}
 	p->isclosed = 0;
-	p->spipe_sem = spipe_sem;
 	p->addr = addr;
 	p->state = (__spipe_state_t *) addr;
 	p->buf = (uint8_t *) (p->state + 1);
 	p->state->p_rpos = p->state->p_wpos = 0;
 	p->state->isclosed = 0;
-out:
-	return ret;
+	mutex_init(&(p->state->lock));
+	cond_init(&(p->state->readable));
+	cond_init(&(p->state->writable));
+	return 0;
+}
 
-failed_cleanup_mem:
-	munmap(addr, SPIPE_BUFSIZE);
-failed:
-	goto out;
+// __spipe_unmap - drop this side's mapping, never with the lock in it held
+static void __spipe_unmap(spipe_t * p)
+{
+	p->isclosed = 1;
+	munmap(p->addr, SPIPE_SIZE);
 }
 
 size_t spiperead(spipe_t * p, void *buf, size_t n)
 {
 	size_t ret = 0;
 	__spipe_state_t *state = p->state;
-try_again:
-	if (p->isclosed || sem_wait(p->spipe_sem) != 0) {
-		goto out;
-	}
-	if (__spipeisclosed_nolock(p, 1)) {
-		goto out_unlock;
+	if (p->isclosed || n == 0) {
+		return 0;
 	}
-	if (state->p_rpos == state->p_wpos) {
-		sem_post(p->spipe_sem);
-		yield();
-		goto try_again;
+	mutex_lock(&(state->lock));
+	while (state->p_rpos == state->p_wpos && !state->isclosed) {
+		cond_wait(&(state->readable), &(state->lock));
 	}
-	for (; ret < n; ret++, state->p_rpos++) {
-		if (state->p_rpos == state->p_wpos) {
-			break;
-		}
+	for (; ret < n && state->p_rpos != state->p_wpos; ret++, state->p_rpos++) {
 		*(uint8_t *) (buf + ret) =
 		    p->buf[state->p_rpos % SPIPE_BUFSIZE];
 	}
-out_unlock:
-	sem_post(p->spipe_sem);
-out:
+	if (ret != 0) {
+		cond_signal(&(state->writable));
+	}
+	mutex_unlock(&(state->lock));
+	// nothing read: closed by the other side and drained
+	if (ret == 0) {
+		__spipe_unmap(p);
+	}
 	return ret;
 }
 
@@ -69,71 +70,57 @@ size_t spipewrite(spipe_t * p, void *buf, size_t n)
 {
 	size_t ret = 0;
 	__spipe_state_t *state = p->state;
-try_again:
-	if (p->isclosed || sem_wait(p->spipe_sem) != 0) {
-		goto out;
-	}
-	if (__spipeisclosed_nolock(p, 0)) {
-		goto out_unlock;
+	bool isclosed;
+	if (p->isclosed) {
+		return 0;
 	}
-	for (; ret < n; ret++, state->p_wpos++) {
+	mutex_lock(&(state->lock));
+	while (ret < n && !state->isclosed) {
 		if (state->p_wpos - state->p_rpos >= SPIPE_BUFSIZE) {
-			sem_post(p->spipe_sem);
-			yield();
-			goto try_again;
+			cond_signal(&(state->readable));
+			cond_wait(&(state->writable), &(state->lock));
+			continue;
 		}
 		p->buf[state->p_wpos % SPIPE_BUFSIZE] =
 		    *(uint8_t *) (buf + ret);
+		ret++, state->p_wpos++;
 	}
-out_unlock:
-	sem_post(p->spipe_sem);
-out:
-	return ret;
-}
-
-static int __spipeclose_nolock(spipe_t * p)
-{
-	if (!p->isclosed) {
-		p->isclosed = p->state->isclosed = 1;
-		munmap(p->addr, SPIPE_BUFSIZE);
-		return 0;
+	if (ret != 0) {
+		cond_signal(&(state->readable));
 	}
-	return -1;
+	isclosed = state->isclosed;
+	mutex_unlock(&(state->lock));
+	if (isclosed) {
+		__spipe_unmap(p);
+	}
+	return ret;
 }
 
 int spipeclose(spipe_t * p)
 {
 	if (!p->isclosed) {
-		int ret;
-		sem_wait(p->spipe_sem);
-		ret = __spipeclose_nolock(p);
-		sem_post(p->spipe_sem);
-		return ret;
+		__spipe_state_t *state = p->state;
+		mutex_lock(&(state->lock));
+		state->isclosed = 1;
+		cond_broadcast(&(state->readable));
+		cond_broadcast(&(state->writable));
+		mutex_unlock(&(state->lock));
+		__spipe_unmap(p);
+		return 0;
 	}
 	return -1;
 }
 
-static bool __spipeisclosed_nolock(spipe_t * p, bool read)
-{
-	if (!p->isclosed) {
-		if (!p->state->isclosed) {
-			return 0;
-		}
-		if (p->state->p_rpos < p->state->p_wpos) {
-			return !read;
-		}
-		__spipeclose_nolock(p);
-	}
-	return 1;
-}
-
 bool spipeisclosed(spipe_t * p)
 {
 	if (!p->isclosed) {
 		bool isclosed;
-		sem_wait(p->spipe_sem);
-		isclosed = __spipeisclosed_nolock(p, 0);
-		sem_post(p->spipe_sem);
+		mutex_lock(&(p->state->lock));
+		isclosed = p->state->isclosed;
+		mutex_unlock(&(p->state->lock));
+		if (isclosed) {
+			__spipe_unmap(p);
+		}
 		return isclosed;
 	}
 	return 1;
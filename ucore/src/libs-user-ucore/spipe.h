@@ -2,16 +2,18 @@
 #define __USER_LIBS_SPIPE_H__
 
 #include <types.h>
+#include <mutex.h>
 
 typedef struct {
 	off_t p_rpos;
 	off_t p_wpos;
 	bool isclosed;
+	mutex_t lock;
+	cond_t readable, writable;
 } __spipe_state_t;
 
 typedef struct {
 	volatile bool isclosed;
-	sem_t spipe_sem;
 	uintptr_t addr;
 	__spipe_state_t *state;
 	uint8_t *buf;
@@ -4,16 +4,8 @@
 #include <file.h>
 #include <syscall.h>
 #include <unistd.h>
-
-/* *
- * cputch - writes a single character @c to stdout, and it will
- * increace the value of counter pointed by @cnt.
- * */
-static void cputch(int c, int *cnt)
-{
-	sys_putc(c);
-	(*cnt)++;
-}
+#include <string.h>
+#include <bufio.h>
 
 /* *
  * vcprintf - format a string and writes it to stdout
@@ -26,9 +18,7 @@ static void cputch(int c, int *cnt)
  * */
 int vcprintf(const char *fmt, va_list ap)
 {
-	int cnt = 0;
-	vprintfmt((void *)cputch, NO_FD, &cnt, fmt, ap);
-	return cnt;
+	return vfprintf_stream(stdout, fmt, ap);
 }
 
 /* *
@@ -54,26 +44,15 @@ int cprintf(const char *fmt, ...)
  * */
 int cputs(const char *str)
 {
-	int cnt = 0;
-	char c;
-	while ((c = *str++) != '\0') {
-		cputch(c, &cnt);
-	}
-	cputch('\n', &cnt);
-	return cnt;
-}
-
-static void fputch(char c, int *cnt, int fd)
-{
-	write(fd, &c, sizeof(char));
-	(*cnt)++;
+	int cnt = strlen(str);
+	fwrite(str, 1, cnt, stdout);
+	fputc('\n', stdout);
+	return cnt + 1;
 }
 
 int vfprintf(int fd, const char *fmt, va_list ap)
 {
-	int cnt = 0;
-	vprintfmt((void *)fputch, fd, &cnt, fmt, ap);
-	return cnt;
+	return vfprintf_fd(fd, fmt, ap);
 }
 
 int fprintf(int fd, const char *fmt, ...)
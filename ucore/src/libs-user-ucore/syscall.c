@@ -76,6 +76,21 @@ int sys_shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags)
 	return syscall(SYS_shmem, addr_store, len, mmap_flags);
 }
 
+int sys_madvise(uintptr_t addr, size_t len, int advice)
+{
+	return syscall(SYS_madvise, addr, len, advice);
+}
+
+int sys_faultstat(struct fault_stat *stat)
+{
+	return syscall(SYS_faultstat, stat);
+}
+
+int sys_ksmstat(struct ksm_stat *stat)
+{
+	return syscall(SYS_ksmstat, stat);
+}
+
 int sys_putc(int c)
 {
 	return syscall(SYS_putc, c);
@@ -111,6 +126,11 @@ int sys_sem_get_value(sem_t sem_id, int *value_store)
 	return syscall(SYS_sem_get_value, sem_id, value_store);
 }
 
+int sys_futex(volatile int *uaddr, int op, int val, unsigned int timeout)
+{
+	return syscall(SYS_futex, uaddr, op, val, timeout);
+}
+
 int sys_send_event(int pid, int event, unsigned int timeout)
 {
 	return syscall(SYS_event_send, pid, event, timeout);
@@ -283,6 +303,73 @@ int sys_debug(uint32_t pid, uint32_t sig, uint32_t arg) {
     return syscall(SYS_debug, pid, sig, arg);
 }
 
+int sys_socket(int domain, int type, int protocol)
+{
+	return syscall(SYS_socket, domain, type, protocol);
+}
+
+int sys_connect(int fd, const struct sockaddr *addr, int addrlen)
+{
+	return syscall(SYS_connect, fd, addr, addrlen);
+}
+
+int sys_bind(int fd, const struct sockaddr *addr, int addrlen)
+{
+	return syscall(SYS_bind, fd, addr, addrlen);
+}
+
+int sys_listen(int fd, int backlog)
+{
+	return syscall(SYS_listen, fd, backlog);
+}
+
+int sys_accept(int fd, struct sockaddr *addr, int *addrlen)
+{
+	return syscall(SYS_accept, fd, addr, addrlen);
+}
+
+int sys_sendto(int fd, const void *buf, size_t len, unsigned int flags,
+	       const struct sockaddr *addr, int addrlen)
+{
+	return syscall(SYS_sendto, fd, buf, len, flags, addr, addrlen);
+}
+
+int sys_recvfrom(int fd, void *buf, size_t len, unsigned int flags,
+		 struct sockaddr *addr, int *addrlen)
+{
+	return syscall(SYS_recvfrom, fd, buf, len, flags, addr, addrlen);
+}
+
+int sys_setsockopt(int fd, int level, int optname, const void *optval,
+		   int optlen)
+{
+	return syscall(SYS_setsockopt, fd, level, optname, optval, optlen);
+}
+
+int sys_mbind(uintptr_t start, size_t len, int mode,
+	      const unsigned long *nmask, unsigned long maxnode,
+	      unsigned int flags)
+{
+	return syscall(SYS_mbind, start, len, mode, nmask, maxnode, flags);
+}
+
+int sys_set_mempolicy(int mode, const unsigned long *nmask,
+		      unsigned long maxnode)
+{
+	return syscall(SYS_set_mempolicy, mode, nmask, maxnode);
+}
+
+int sys_get_mempolicy(int *mode, unsigned long *nmask, unsigned long maxnode,
+		      uintptr_t addr, unsigned int flags)
+{
+	return syscall(SYS_get_mempolicy, mode, nmask, maxnode, addr, flags);
+}
+
+int sys_numa_stat(int node, struct numa_stat *stat)
+{
+	return syscall(SYS_numa_stat, node, stat);
+}
+
 //halt the system, now only used in AMD64
 int sys_halt(void)
 {
@@ -408,6 +495,9 @@ _syscall1(int, brk, uintptr_t *, brk);
 _syscall3(int, mmap, uintptr_t *, addr, size_t, len, uint32_t, mmap);
 _syscall2(int, munmap, uintptr_t, addr, size_t, len);
 _syscall3(int, shmem, uintptr_t *, addr, size_t, len, uint32_t, mmap);
+_syscall3(int, madvise, uintptr_t, addr, size_t, len, int, advice);
+_syscall1(int, faultstat, struct fault_stat *, stat);
+_syscall1(int, ksmstat, struct ksm_stat *, stat);
 _syscall1(int, putc, int, c);
 _syscall0(int, pgdir);
 _syscall1(sem_t, sem_init, int, value);
@@ -19,6 +19,11 @@ int sys_brk(uintptr_t * brk_store);
 int sys_mmap(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
 int sys_munmap(uintptr_t addr, size_t len);
 int sys_shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
+int sys_madvise(uintptr_t addr, size_t len, int advice);
+struct fault_stat;
+int sys_faultstat(struct fault_stat *stat);
+struct ksm_stat;
+int sys_ksmstat(struct ksm_stat *stat);
 int sys_putc(int c);
 int sys_pgdir(void);
 sem_t sys_sem_init(int value);
@@ -26,6 +31,7 @@ int sys_sem_post(sem_t sem_id);
 int sys_sem_wait(sem_t sem_id, unsigned int timeout);
 int sys_sem_free(sem_t sem_id);
 int sys_sem_get_value(sem_t sem_id, int *value_store);
+int sys_futex(volatile int *uaddr, int op, int val, unsigned int timeout);
 int sys_send_event(int pid, int event, unsigned int timeout);
 int sys_recv_event(int *pid_store, int *event_store, unsigned int timeout);
 
@@ -78,6 +84,31 @@ void *sys_linux_mmap(void *addr, size_t length, int fd, size_t offset);
 int sys_rf212_send(uint8_t len, uint8_t * data);
 int sys_rf212_reg(uint8_t reg, uint8_t value);
 int sys_rf212_reset();
+struct sockaddr;
+
+int sys_socket(int domain, int type, int protocol);
+int sys_connect(int fd, const struct sockaddr *addr, int addrlen);
+int sys_bind(int fd, const struct sockaddr *addr, int addrlen);
+int sys_listen(int fd, int backlog);
+int sys_accept(int fd, struct sockaddr *addr, int *addrlen);
+int sys_sendto(int fd, const void *buf, size_t len, unsigned int flags,
+	       const struct sockaddr *addr, int addrlen);
+int sys_recvfrom(int fd, void *buf, size_t len, unsigned int flags,
+		 struct sockaddr *addr, int *addrlen);
+int sys_setsockopt(int fd, int level, int optname, const void *optval,
+		   int optlen);
+
+struct numa_stat;
+
+int sys_mbind(uintptr_t start, size_t len, int mode,
+	      const unsigned long *nmask, unsigned long maxnode,
+	      unsigned int flags);
+int sys_set_mempolicy(int mode, const unsigned long *nmask,
+		      unsigned long maxnode);
+int sys_get_mempolicy(int *mode, unsigned long *nmask, unsigned long maxnode,
+		      uintptr_t addr, unsigned int flags);
+int sys_numa_stat(int node, struct numa_stat *stat);
+
 //halt the system
 int sys_halt();
 int sys_debug(uint32_t pid, uint32_t sig, uint32_t arg);
@@ -4,6 +4,24 @@
 #include <unistd.h>
 #include <error.h>
 
+// stack_alloc - map a stack that starts at a THREAD_STACK_ALIGN boundary
+static int stack_alloc(uintptr_t * stack_store)
+{
+	int ret;
+	uintptr_t addr = 0, start;
+	if ((ret = mmap(&addr, THREAD_STACKSIZE + THREAD_STACK_ALIGN,
+			MMAP_WRITE | MMAP_STACK)) != 0) {
+		return ret;
+	}
+	start = (addr + THREAD_STACK_ALIGN - 1) & ~(THREAD_STACK_ALIGN - 1);
+	if (start != addr) {
+		munmap(addr, start - addr);
+	}
+	munmap(start + THREAD_STACKSIZE, addr + THREAD_STACK_ALIGN - start);
+	*stack_store = start;
+	return 0;
+}
+
 int thread(int (*fn) (void *), void *arg, thread_t * tidp)
 {
 	if (fn == NULL || tidp == NULL) {
@@ -11,8 +29,7 @@ int thread(int (*fn) (void *), void *arg, thread_t * tidp)
 	}
 	int ret;
 	uintptr_t stack = 0;
-	if ((ret =
-	     mmap(&stack, THREAD_STACKSIZE, MMAP_WRITE | MMAP_STACK)) != 0) {
+	if ((ret = stack_alloc(&stack)) != 0) {
 		return ret;
 	}
 	assert(stack != 0);
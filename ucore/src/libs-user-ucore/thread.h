@@ -7,6 +7,7 @@ typedef struct {
 } thread_t;
 
 #define THREAD_STACKSIZE        (4096 * 10)
+#define THREAD_STACK_ALIGN      (4096 * 16)	// malloc picks thread caches by it
 
 int thread(int (*fn) (void *), void *arg, thread_t * tidp);
 int thread_wait(thread_t * tidp, int *exit_code);
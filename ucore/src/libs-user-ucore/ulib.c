@@ -4,22 +4,26 @@
 #include <stdio.h>
 #include <ulib.h>
 #include <stat.h>
-#include <lock.h>
+#include <mutex.h>
+#include <bufio.h>
+#include <malloc.h>
+#include <error.h>
 
-static lock_t fork_lock = INIT_LOCK;
+static mutex_t fork_lock = MUTEX_INIT;
 
 void lock_fork(void)
 {
-	lock(&fork_lock);
+	mutex_lock(&fork_lock);
 }
 
 void unlock_fork(void)
 {
-	unlock(&fork_lock);
+	mutex_unlock(&fork_lock);
 }
 
 void exit(int error_code)
 {
+	fflush(NULL);
 	sys_exit(error_code);
 	cprintf("BUG: exit failed.\n");
 	while (1) ;
@@ -28,8 +32,12 @@ void exit(int error_code)
 int fork(void)
 {
 	int ret;
+	// the child must not print what is still buffered a second time
+	fflush(NULL);
 	lock_fork();
+	malloc_lock_all();
 	ret = sys_fork();
+	malloc_unlock_all();
 	unlock_fork();
 	return ret;
 }
@@ -64,11 +72,78 @@ unsigned int gettime_msec(void)
 	return (unsigned int)sys_gettime();
 }
 
+/* set by _start on amd64 when the kernel maps a vDSO, see vdso.h */
+const struct vdso_image *__vdso_image;
+
+#define TICK_HZ             100	// what sys_gettime counts
+
+static void *vdso_func(int idx)
+{
+	const struct vdso_image *image = __vdso_image;
+	if (image == NULL || image->magic != VDSO_MAGIC
+	    || idx >= image->nr_funcs) {
+		return NULL;
+	}
+	return (char *)image + image->offsets[idx];
+}
+
 int getpid(void)
 {
+	int (*fn) (void) = vdso_func(VDSO_GETPID);
+	if (fn != NULL) {
+		return fn();
+	}
 	return sys_getpid();
 }
 
+// without a vDSO, both clocks are the time since boot in ticks
+int clock_gettime(int clock, struct timespec *ts)
+{
+	int (*fn) (int, struct timespec *) = vdso_func(VDSO_CLOCK_GETTIME);
+	if (fn != NULL) {
+		return fn(clock, ts);
+	}
+	if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC) {
+		return -E_INVAL;
+	}
+	size_t ticks = sys_gettime();
+	ts->tv_sec = ticks / TICK_HZ;
+	ts->tv_nsec = (ticks % TICK_HZ) * (1000000000 / TICK_HZ);
+	return 0;
+}
+
+int gettimeofday(struct timeval *tv, void *tz)
+{
+	int (*fn) (struct timeval *, void *) = vdso_func(VDSO_GETTIMEOFDAY);
+	struct timespec ts;
+	if (fn != NULL) {
+		return fn(tv, tz);
+	}
+	if (tz != NULL) {
+		memset(tz, 0, 2 * sizeof(int));
+	}
+	if (tv != NULL) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+	}
+	return 0;
+}
+
+long time(long *t)
+{
+	long (*fn) (long *) = vdso_func(VDSO_TIME);
+	struct timespec ts;
+	if (fn != NULL) {
+		return fn(t);
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+	if (t != NULL) {
+		*t = ts.tv_sec;
+	}
+	return ts.tv_sec;
+}
+
 //print_pgdir - print the PDT&PT
 void print_pgdir(void)
 {
@@ -90,6 +165,21 @@ int shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags)
 	return sys_shmem(addr_store, len, mmap_flags);
 }
 
+int madvise(uintptr_t addr, size_t len, int advice)
+{
+	return sys_madvise(addr, len, advice);
+}
+
+int faultstat(struct fault_stat *stat)
+{
+	return sys_faultstat(stat);
+}
+
+int ksmstat(struct ksm_stat *stat)
+{
+	return sys_ksmstat(stat);
+}
+
 sem_t sem_init(int value)
 {
 	return sys_sem_init(value);
@@ -181,6 +271,7 @@ int __exec(const char *name, const char **argv, const char **envp)
 	while (argv[argc] != NULL) {
 		argc++;
 	}
+	fflush(NULL);
 	return sys_exec(argv[0], argv, envp);
 }
 
@@ -2,6 +2,7 @@
 #define __USER_LIBS_ULIB_H__
 
 #include <types.h>
+#include <vdso.h>
 
 void __warn(const char *file, int line, const char *fmt, ...);
 void __panic(const char *file, int line, const char *fmt, ...)
@@ -36,10 +37,29 @@ int sleep(unsigned int time);
 int kill(int pid);
 unsigned int gettime_msec(void);
 int getpid(void);
+
+struct timeval {
+	long tv_sec;
+	long tv_usec;
+};
+
+struct timespec {
+	long tv_sec;
+	long tv_nsec;
+};
+
+int gettimeofday(struct timeval *tv, void *tz);
+int clock_gettime(int clock, struct timespec *ts);
+long time(long *t);
 void print_pgdir(void);
 int mmap(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
 int munmap(uintptr_t addr, size_t len);
 int shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
+int madvise(uintptr_t addr, size_t len, int advice);
+struct fault_stat;
+int faultstat(struct fault_stat *stat);
+struct ksm_stat;
+int ksmstat(struct ksm_stat *stat);
 int clone(uint32_t clone_flags, uintptr_t stack, int (*fn) (void *), void *arg);
 sem_t sem_init(int value);
 int sem_post(sem_t sem_id);
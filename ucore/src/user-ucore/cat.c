@@ -2,32 +2,37 @@
 #include <file.h>
 #include <stat.h>
 #include <unistd.h>
+#include <bufio.h>
+#include <error.h>
 
 #define BUFSIZE                         4096
 
-int cat(int fd)
+int cat(FILE *in)
 {
 	static char buffer[BUFSIZE];
-	int ret1, ret2;
-	while ((ret1 = read(fd, buffer, sizeof(buffer))) > 0) {
-		if ((ret2 = write(1, buffer, ret1)) != ret1) {
-			return ret2;
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+		if (fwrite(buffer, 1, n, stdout) != n) {
+			return -E_IO;
 		}
 	}
-	return ret1;
+	return ferror(in) ? -E_IO : 0;
 }
 
 int main(int argc, char **argv)
 {
 	if (argc == 1) {
-		return cat(0);
+		return cat(stdin);
 	} else {
 		int i, ret;
+		FILE *in;
 		for (i = 1; i < argc; i++) {
-			if ((ret = open(argv[i], O_RDONLY)) < 0) {
-				return ret;
+			if ((in = fopen(argv[i], "r")) == NULL) {
+				return -E_NOENT;
 			}
-			if ((ret = cat(ret)) != 0) {
+			ret = cat(in);
+			fclose(in);
+			if (ret != 0) {
 				return ret;
 			}
 		}
@@ -8,6 +8,7 @@
 #include <error.h>
 #include <malloc.h>
 #include <unistd.h>
+#include <bufio.h>
 
 #define printf(...)                 fprintf(1, __VA_ARGS__)
 
@@ -19,37 +20,43 @@ int main(int argc, char *argv[])
 		exit(0);
 	}
 
-	int fd1 = open(argv[1], O_EXCL | O_RDONLY);
-	if (fd1 < 0) {
+	FILE *in = fopen(argv[1], "r");
+	if (in == NULL) {
 		printf("fail to open %s\n", argv[1]);
 		return -E_NOENT;
 	}
 
-	int fd2 = open(argv[2], O_CREAT | O_RDWR | O_TRUNC);
-	if (fd2 < 0) {
+	FILE *out = fopen(argv[2], "w");
+	if (out == NULL) {
 		printf("fail to open %s\n", argv[2]);
-		close(fd1);
+		fclose(in);
 		return -E_INVAL;
 	}
 
 	char *buf = (char *)malloc(BUF_SIZE);
 	if (!buf) {
 		printf("out of memory\n");
-		close(fd1);
-		close(fd2);
+		fclose(in);
+		fclose(out);
 		return -E_NO_MEM;
 	}
 
-	int readsize;
-	while (1) {
-		readsize = read(fd1, buf, BUF_SIZE);
-		if (readsize <= 0)
+	size_t readsize;
+	int ret = 0;
+	while ((readsize = fread(buf, 1, BUF_SIZE, in)) > 0) {
+		if (fwrite(buf, 1, readsize, out) != readsize) {
+			ret = -E_IO;
 			break;
-		write(fd2, buf, readsize);
+		}
+	}
+	if (ferror(in)) {
+		ret = -E_IO;
+	}
+	fclose(in);
+	if (fclose(out) != 0) {
+		ret = -E_IO;
 	}
-	close(fd1);
-	close(fd2);
 
 	free(buf);
-	return 0;
+	return ret;
 }
@@ -0,0 +1,73 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <kmsg.h>
+
+/*
+ * dmesg [-l level] - print the kernel log kept in /dev/kmsg. Each line
+ * starts with the clock tick and the cpu it was logged on; records above
+ * @level (default: all) are left out.
+ */
+
+#define NRECS       32
+#define BUFSIZE     4096
+
+static struct kmsg_record recs[NRECS];
+static char outbuf[BUFSIZE];
+static int outlen;
+
+static void flush(void)
+{
+	if (outlen != 0) {
+		write(1, outbuf, outlen);
+		outlen = 0;
+	}
+}
+
+static void put(const char *s, int len)
+{
+	if (outlen + len > BUFSIZE) {
+		flush();
+	}
+	memcpy(outbuf + outlen, s, len);
+	outlen += len;
+}
+
+int main(int argc, char **argv)
+{
+	int level = KMSG_DEBUG, fd, n, i;
+	char head[32];
+
+	if (argc == 3 && strcmp(argv[1], "-l") == 0) {
+		level = strtol(argv[2], NULL, 10);
+	} else if (argc != 1) {
+		fprintf(2, "usage: dmesg [-l level]\n");
+		return -1;
+	}
+	if ((fd = open("/dev/kmsg", O_RDONLY)) < 0) {
+		fprintf(2, "dmesg: cannot open /dev/kmsg: %e\n", fd);
+		return fd;
+	}
+	while ((n = read(fd, recs, sizeof(recs))) > 0) {
+		for (i = 0; i < n / sizeof(struct kmsg_record); i++) {
+			struct kmsg_record *rec = recs + i;
+			if (rec->flags & KMSG_LOST) {
+				// older records are gone, go on with the oldest one kept
+				seek(fd, rec->seq * sizeof(struct kmsg_record), LSEEK_SET);
+				break;
+			}
+			if (rec->level > level) {
+				continue;
+			}
+			if (!(rec->flags & KMSG_CONT)) {
+				put(head, snprintf(head, sizeof(head), "[%8u cpu%d] ", rec->ticks, rec->cpu));
+			}
+			put(rec->text, rec->len);
+		}
+	}
+	flush();
+	close(fd);
+	return n < 0 ? n : 0;
+}
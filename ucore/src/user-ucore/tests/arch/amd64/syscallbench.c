@@ -0,0 +1,102 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <syscall.h>
+
+/*
+ * System call cost: getpid the old way through int 0x80, with the syscall
+ * instruction, and out of the vDSO, then the clock calls of the vDSO.
+ * Also checks the answers agree, that the monotonic clock does not go
+ * back and that a forked child sees its own pid.
+ */
+
+#define NLOOPS          100000
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+	assert(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int int80_getpid(void)
+{
+	long ret;
+	asm volatile ("int %1":"=a" (ret)
+		      :"i"(T_SYSCALL), "a"(SYS_getpid)
+		      :"cc", "memory");
+	return ret;
+}
+
+static void report(const char *what, long long start)
+{
+	long long ns = now_ns() - start;
+	cprintf("syscallbench: %-16s %d ns/call.\n", what, (int)(ns / NLOOPS));
+}
+
+int main(void)
+{
+	struct timespec ts;
+	struct timeval tv;
+	long long start, last, t;
+	int i, pid, exit_code;
+
+	pid = sys_getpid();
+	assert(getpid() == pid && int80_getpid() == pid);
+	assert(clock_gettime(-1, &ts) != 0);
+
+	start = now_ns();
+	for (i = 0; i < NLOOPS; i++) {
+		int80_getpid();
+	}
+	report("int 0x80 getpid", start);
+
+	start = now_ns();
+	for (i = 0; i < NLOOPS; i++) {
+		sys_getpid();
+	}
+	report("syscall getpid", start);
+
+	start = now_ns();
+	for (i = 0; i < NLOOPS; i++) {
+		getpid();
+	}
+	report("getpid", start);
+
+	start = last = now_ns();
+	for (i = 0; i < NLOOPS; i++) {
+		t = now_ns();
+		assert(t >= last);
+		last = t;
+	}
+	report("clock_gettime", start);
+
+	start = now_ns();
+	for (i = 0; i < NLOOPS; i++) {
+		assert(gettimeofday(&tv, NULL) == 0);
+	}
+	report("gettimeofday", start);
+	assert(tv.tv_usec >= 0 && tv.tv_usec < 1000000);
+
+	start = now_ns();
+	for (i = 0; i < NLOOPS; i++) {
+		time(NULL);
+	}
+	report("time", start);
+	assert(time(NULL) >= tv.tv_sec);
+
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < 100; i++) {
+			if (getpid() != sys_getpid()) {
+				exit(-1);
+			}
+			yield();
+		}
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	assert(getpid() == sys_getpid());
+
+	cprintf("syscallbench pass.\n");
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+#include <bufio.h>
+
+/*
+ * Buffered streams: writes a file through a stream, with output pending
+ * across a fork, and reads it back with fgetc and fread. Then times
+ * cprintf to a fully buffered stdout against writing byte by byte.
+ */
+
+#define FNAME       "bufio_test.txt"
+#define NLINES      200
+#define LINE        "0123456789abcdefghijklmnopqrstuvwxyz\n"
+
+static char buf[NLINES * sizeof(LINE)];
+
+int main(void)
+{
+	FILE *fp;
+	int i, pid, exit_code, len = strlen(LINE);
+
+	assert((fp = fopen(FNAME, "w")) != NULL);
+	for (i = 0; i < NLINES / 2; i++) {
+		assert(fputs(LINE, fp) == 0);
+	}
+	// the first half must reach the file once, not once per process
+	if ((pid = fork()) == 0) {
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	for (i = 0; i < NLINES / 2; i++) {
+		assert(fwrite(LINE, 1, len, fp) == len);
+	}
+	assert(fclose(fp) == 0);
+
+	assert((fp = fopen(FNAME, "r")) != NULL);
+	for (i = 0; i < len; i++) {
+		assert(fgetc(fp) == LINE[i]);
+	}
+	assert(fread(buf, 1, sizeof(buf), fp) == (NLINES - 1) * len);
+	for (i = 0; i < NLINES - 1; i++) {
+		assert(memcmp(buf + i * len, LINE, len) == 0);
+	}
+	assert(fgetc(fp) == EOF && feof(fp) && !ferror(fp));
+	assert(fclose(fp) == 0);
+	assert(unlink(FNAME) == 0);
+
+	// fully buffered stdout, each cprintf below is a single write at most
+	unsigned int start = gettime_msec(), buffered, direct;
+	assert(setvbuf(stdout, NULL, _IOFBF, 0) == 0);
+	for (i = 0; i < NLINES; i++) {
+		cprintf("bufio: line %d\r", i);
+	}
+	fflush(stdout);
+	buffered = gettime_msec() - start;
+	start = gettime_msec();
+	assert(setvbuf(stdout, NULL, _IONBF, 0) == 0);
+	for (i = 0; i < NLINES; i++) {
+		cprintf("bufio: line %d\r", i);
+	}
+	direct = gettime_msec() - start;
+	assert(setvbuf(stdout, NULL, _IOLBF, 0) == 0);
+
+	cprintf("\nbufio: %d lines in %d ms buffered, %d ms unbuffered.\n",
+		NLINES, buffered, direct);
+	cprintf("bufio pass.\n");
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <madvise.h>
+
+#define PGSIZE      4096
+#define NR_PAGES    256
+
+const size_t size = NR_PAGES * PGSIZE;
+
+/* faults taken while touching every page of [addr, addr + size) */
+static size_t touch(uintptr_t addr, int seed)
+{
+	struct fault_stat st;
+	assert(faultstat(&st) == 0);
+	size_t faults = st.nr_faults;
+	size_t off;
+	for (off = 0; off < size; off += PGSIZE) {
+		*(int *)(addr + off) = seed + off / PGSIZE;
+	}
+	assert(faultstat(&st) == 0);
+	return st.nr_faults - faults;
+}
+
+static void verify(uintptr_t addr, int seed)
+{
+	size_t off;
+	for (off = 0; off < size; off += PGSIZE) {
+		assert(*(int *)(addr + off) == seed + off / PGSIZE);
+	}
+}
+
+int main(void)
+{
+	uintptr_t plain = 0, seq = 0, pop = 0;
+	assert(mmap(&plain, size, MMAP_WRITE) == 0);
+	assert(mmap(&seq, size, MMAP_WRITE) == 0);
+	assert(madvise(seq, size, MADV_SEQUENTIAL) == 0);
+
+	size_t nr_plain = touch(plain, 1), nr_seq = touch(seq, 2);
+	cprintf("faultaround: %d faults plain, %d with MADV_SEQUENTIAL\n",
+		nr_plain, nr_seq);
+	assert(nr_seq * 4 < nr_plain);
+	verify(plain, 1);
+	verify(seq, 2);
+
+	/* a populated mapping takes no faults at all */
+	assert(mmap(&pop, size, MMAP_WRITE | MMAP_POPULATE) == 0);
+	size_t nr_pop = touch(pop, 3);
+	cprintf("faultaround: %d faults with MMAP_POPULATE\n", nr_pop);
+	assert(nr_pop < 4);
+	verify(pop, 3);
+
+	/* dropped pages read back as zero, the rest stays */
+	assert(madvise(plain + PGSIZE, 2 * PGSIZE, MADV_DONTNEED) == 0);
+	assert(madvise(seq + PGSIZE, 2 * PGSIZE, MADV_FREE) == 0);
+	assert(*(int *)(plain + PGSIZE) == 0 && *(int *)(seq + PGSIZE) == 0);
+	assert(*(int *)(plain + 2 * PGSIZE) == 0);
+	assert(*(int *)plain == 1 && *(int *)(plain + 3 * PGSIZE) == 4);
+	assert(*(int *)(seq + 3 * PGSIZE) == 5);
+
+	assert(madvise(pop, size, MADV_WILLNEED) == 0);
+	assert(madvise(pop, size, MADV_RANDOM) == 0);
+	assert(madvise(pop, size, MADV_NORMAL) == 0);
+	assert(madvise(pop + 1, PGSIZE, MADV_DONTNEED) != 0);
+	assert(madvise(pop, PGSIZE, MADV_HWPOISON) != 0);
+	verify(pop, 3);
+
+	struct fault_stat st;
+	assert(faultstat(&st) == 0);
+	cprintf("faultaround: %d faults, %d major, %d around, %d populated\n",
+		st.nr_faults, st.nr_major, st.nr_around, st.nr_populated);
+
+	assert(munmap(plain, size) == 0);
+	assert(munmap(seq, size) == 0);
+	assert(munmap(pop, size) == 0);
+	cprintf("faultaround pass.\n");
+	return 0;
+}
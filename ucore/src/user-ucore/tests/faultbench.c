@@ -0,0 +1,107 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread.h>
+#include <unistd.h>
+
+/*
+ * Page fault scalability: N threads write every page of their own part of
+ * one anonymous mapping, so that all faults go to the same mm.
+ *   faultbench          1, 2 and 4 threads
+ *   faultbench N        1, 2, 4, ... up to N threads
+ *
+ * One page at the end of every 2MB block is unmapped, so that no block
+ * is backed by a huge page and each fault maps a single small page.
+ */
+
+#define PGSIZE          4096
+#define HPAGE_SIZE      (2 * 1024 * 1024)
+#define BLOCKS          4	// per thread
+#define MAX_THREADS     32
+
+static uintptr_t base;
+
+static uintptr_t part(long id)
+{
+	return base + id * BLOCKS * HPAGE_SIZE;
+}
+
+static int toucher(void *arg)
+{
+	long id = (long)arg;
+	uintptr_t start = part(id), va;
+	for (va = start; va < start + BLOCKS * HPAGE_SIZE; va += PGSIZE) {
+		if ((va + PGSIZE) % HPAGE_SIZE != 0) {
+			*(long *)va = id + va;
+		}
+	}
+	return 0;
+}
+
+static void verify(int nthreads)
+{
+	long id;
+	uintptr_t va;
+	for (id = 0; id < nthreads; id++) {
+		for (va = part(id); va < part(id + 1); va += PGSIZE) {
+			if ((va + PGSIZE) % HPAGE_SIZE != 0) {
+				assert(*(long *)va == id + va);
+			}
+		}
+	}
+}
+
+static void run(int nthreads)
+{
+	size_t len = (nthreads * BLOCKS + 1) * HPAGE_SIZE, off;
+	uintptr_t addr = 0;
+	assert(mmap(&addr, len, MMAP_WRITE) == 0);
+	base = (addr + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1);
+	for (off = HPAGE_SIZE - PGSIZE; off < nthreads * BLOCKS * HPAGE_SIZE;
+	     off += HPAGE_SIZE) {
+		assert(munmap(base + off, PGSIZE) == 0);
+	}
+
+	thread_t tid[MAX_THREADS];
+	int i, exit_code;
+	unsigned int msec = gettime_msec();
+	for (i = 0; i < nthreads; i++) {
+		assert(thread(toucher, (void *)(long)i, tid + i) == 0);
+	}
+	for (i = 0; i < nthreads; i++) {
+		assert(thread_wait(tid + i, &exit_code) == 0 && exit_code == 0);
+	}
+	msec = gettime_msec() - msec;
+
+	int faults = nthreads * BLOCKS * (HPAGE_SIZE / PGSIZE - 1);
+	cprintf("faultbench: %2d thread(s), %6d faults in %5d msec", nthreads,
+		faults, msec);
+	if (msec != 0) {
+		cprintf(", %d faults/msec", faults / msec);
+	}
+	cprintf("\n");
+	verify(nthreads);
+
+	/* the pieces left between the holes, and the unaligned ends */
+	uintptr_t va = addr;
+	for (off = HPAGE_SIZE - PGSIZE; off < nthreads * BLOCKS * HPAGE_SIZE;
+	     off += HPAGE_SIZE) {
+		assert(munmap(va, base + off - va) == 0);
+		va = base + off + PGSIZE;
+	}
+	assert(munmap(va, addr + len - va) == 0);
+}
+
+int main(int argc, char **argv)
+{
+	int max = (argc > 1) ? strtol(argv[1], NULL, 10) : 4, n;
+	if (max < 1 || max > MAX_THREADS) {
+		cprintf("usage: faultbench [1-%d]\n", MAX_THREADS);
+		return -1;
+	}
+	for (n = 1; n <= max; n *= 2) {
+		run(n);
+	}
+	cprintf("faultbench pass.\n");
+	return 0;
+}
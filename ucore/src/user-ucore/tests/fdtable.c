@@ -0,0 +1,67 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <stat.h>
+#include <file.h>
+
+/*
+ * File descriptor table growth and reuse.
+ * Opens enough fds to make the table grow a few times, checks that the
+ * lowest free fd is always the one handed out, that a high dup2 target
+ * works, and that a forked child sees exactly the parent's open fds.
+ */
+
+#define NFDS        200
+#define HIGH_FD     900
+#define FD_LIMIT    1024
+
+static int fds[NFDS];
+
+static int fd_valid(int fd)
+{
+	struct stat st;
+	return fstat(fd, &st) == 0;
+}
+
+int main(void)
+{
+	int i, pid, exit_code;
+
+	for (i = 0; i < NFDS; i++) {
+		assert((fds[i] = dup(1)) >= 0);
+		if (i != 0) {
+			assert(fds[i] == fds[i - 1] + 1);
+		}
+	}
+
+	// the lowest free fd is reused first
+	assert(close(fds[NFDS / 2]) == 0 && close(fds[10]) == 0);
+	assert(dup(1) == fds[10]);
+	assert(dup(1) == fds[NFDS / 2]);
+
+	assert(dup2(1, HIGH_FD) == HIGH_FD && fd_valid(HIGH_FD));
+	assert(!fd_valid(HIGH_FD - 1) && !fd_valid(HIGH_FD + 1));
+	assert(dup2(1, FD_LIMIT) < 0);
+
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < NFDS; i++) {
+			assert(fd_valid(fds[i]));
+		}
+		assert(fd_valid(HIGH_FD) && !fd_valid(HIGH_FD - 1));
+		assert(close(HIGH_FD) == 0);
+		exit(0);
+	}
+	assert(pid > 0);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	// the child's close does not affect the parent's table
+	assert(fd_valid(HIGH_FD));
+
+	assert(close(HIGH_FD) == 0);
+	for (i = 0; i < NFDS; i++) {
+		assert(close(fds[i]) == 0);
+	}
+	assert(dup(1) == fds[0]);
+	assert(close(fds[0]) == 0);
+
+	cprintf("fdtable pass.\n");
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+
+/*
+ * fork/exit churn with many live processes:
+ *   forkchurn [nr_live [nr_churn]]
+ * First creates nr_live sleeping children, then measures fork + exit + wait
+ * of nr_churn short-lived children while the others stay alive.
+ */
+
+#define DEFAULT_LIVE    5000
+#define DEFAULT_CHURN   2000
+
+int main(int argc, char **argv)
+{
+	int nr_live = DEFAULT_LIVE, nr_churn = DEFAULT_CHURN;
+	int i, pid;
+
+	if (argc > 1) {
+		nr_live = strtol(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		nr_churn = strtol(argv[2], NULL, 10);
+	}
+
+	int *live = malloc(sizeof(int) * nr_live);
+	assert(live != NULL);
+
+	unsigned int start = gettime_msec();
+	for (i = 0; i < nr_live; i++) {
+		if ((pid = fork()) == 0) {
+			while (1) {
+				sleep(1000);
+			}
+		}
+		if (pid < 0) {
+			cprintf("forkchurn: only %d live processes could be created\n", i);
+			nr_live = i;
+			break;
+		}
+		live[i] = pid;
+	}
+	unsigned int spawn_msec = gettime_msec() - start;
+
+	start = gettime_msec();
+	for (i = 0; i < nr_churn; i++) {
+		if ((pid = fork()) == 0) {
+			exit(0);
+		}
+		assert(pid > 0);
+		assert(waitpid(pid, NULL) == 0);
+	}
+	unsigned int churn_msec = gettime_msec() - start;
+
+	for (i = 0; i < nr_live; i++) {
+		assert(kill(live[i]) == 0);
+	}
+	for (i = 0; i < nr_live; i++) {
+		assert(waitpid(live[i], NULL) == 0);
+	}
+	free(live);
+
+	cprintf("forkchurn: %d live processes spawned in %d ms\n", nr_live, spawn_msec);
+	cprintf("forkchurn: %d fork/exit/wait in %d ms, %d us each\n", nr_churn,
+		churn_msec, nr_churn ? churn_msec * 1000 / nr_churn : 0);
+	cprintf("forkchurn pass.\n");
+	return 0;
+}
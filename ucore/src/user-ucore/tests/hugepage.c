@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+
+#define PGSIZE      4096
+#define HPAGE_SIZE  (2 * 1024 * 1024)
+
+const size_t size = 4 * HPAGE_SIZE;
+
+static void fill(uintptr_t addr, size_t len, int seed)
+{
+	size_t off;
+	for (off = 0; off < len; off += PGSIZE) {
+		*(int *)(addr + off) = seed + off / PGSIZE;
+	}
+}
+
+static void verify(uintptr_t addr, size_t len, int seed)
+{
+	size_t off;
+	for (off = 0; off < len; off += PGSIZE) {
+		assert(*(int *)(addr + off) == seed + off / PGSIZE);
+	}
+}
+
+int main(void)
+{
+	uintptr_t addr = 0;
+	size_t off;
+
+	/* a read maps the zero page, only a write takes a huge page */
+	assert(mmap(&addr, size, MMAP_WRITE) == 0);
+	for (off = 0; off < size; off += PGSIZE) {
+		assert(*(int *)(addr + off) == 0);
+	}
+	assert(munmap(addr, size) == 0);
+
+	/* fresh anonymous memory still reads as zero under a first write */
+	addr = 0;
+	assert(mmap(&addr, size, MMAP_WRITE) == 0);
+	for (off = 0; off < size; off += HPAGE_SIZE) {
+		*(int *)(addr + off) = 0;
+	}
+	for (off = 0; off < size; off += PGSIZE) {
+		assert(*(int *)(addr + off) == 0);
+	}
+
+	unsigned int saved_msec = gettime_msec();
+	fill(addr, size, 1);
+	cprintf("hugepage: touched %d pages in %d msec\n", size / PGSIZE,
+		gettime_msec() - saved_msec);
+	verify(addr, size, 1);
+
+	/* punch a hole into an aligned 2MB block, the rest of it stays */
+	uintptr_t block = (addr + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1);
+	uintptr_t hole = block + HPAGE_SIZE / 2;
+	assert(munmap(hole, PGSIZE) == 0);
+	verify(addr, hole - addr, 1);
+	verify(hole + PGSIZE, addr + size - hole - PGSIZE,
+	       1 + (hole + PGSIZE - addr) / PGSIZE);
+
+	/* copy-on-write after fork keeps the parent's data */
+	int pid, ret;
+	if ((pid = fork()) == 0) {
+		verify(addr, hole - addr, 1);
+		fill(addr, hole - addr, 100000);
+		verify(addr, hole - addr, 100000);
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, &ret) == 0 && ret == 0);
+	verify(addr, hole - addr, 1);
+
+	assert(munmap(addr, hole - addr) == 0);
+	assert(munmap(hole + PGSIZE, addr + size - hole - PGSIZE) == 0);
+	cprintf("hugepage pass.\n");
+	return 0;
+}
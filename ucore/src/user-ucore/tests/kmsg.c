@@ -0,0 +1,57 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <file.h>
+#include <unistd.h>
+#include <kmsg.h>
+
+/*
+ * Reads the kernel log back from /dev/kmsg and checks that the records
+ * are consecutive and well formed, and that the device refuses writes
+ * and reads that do not start at a record.
+ */
+
+#define NRECS       16
+
+static struct kmsg_record recs[NRECS];
+
+int main(void)
+{
+	int fd, n, i, nrecs = 0;
+	uint32_t next = 0;
+
+	if ((fd = open("/dev/kmsg", O_RDONLY)) < 0) {
+		cprintf("kmsg: no /dev/kmsg, skipped.\n");
+		cprintf("kmsg pass.\n");
+		return 0;
+	}
+	assert(open("/dev/kmsg", O_WRONLY) < 0);
+
+	while ((n = read(fd, recs, sizeof(recs))) > 0) {
+		assert(n % sizeof(struct kmsg_record) == 0);
+		for (i = 0; i < n / sizeof(struct kmsg_record); i++) {
+			struct kmsg_record *rec = recs + i;
+			if (rec->flags & KMSG_LOST) {
+				assert(i == 0 && rec->seq > next);
+				next = rec->seq;
+				assert(seek(fd, next * sizeof(struct kmsg_record), LSEEK_SET) == 0);
+				break;
+			}
+			assert(rec->seq == next);
+			assert(rec->level <= KMSG_DEBUG);
+			assert(rec->len > 0 && rec->len <= KMSG_TEXT_MAX);
+			next++, nrecs++;
+		}
+	}
+	assert(n == 0 && nrecs > 0);
+
+	// nothing past the newest record, and no reads from inside one
+	assert(seek(fd, (next + 1000) * sizeof(struct kmsg_record), LSEEK_SET) == 0);
+	assert(read(fd, recs, sizeof(recs)) == 0);
+	assert(seek(fd, 0, LSEEK_SET) == 0);
+	assert(read(fd, recs, sizeof(struct kmsg_record) - 1) < 0);
+	close(fd);
+
+	cprintf("kmsg: read %d records, next is %d.\n", nrecs, next);
+	cprintf("kmsg pass.\n");
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <madvise.h>
+
+#define PGSIZE      4096
+#define NR_PAGES    64
+#define NR_ZERO     8
+#define NR_KINDS    4
+
+const size_t size = NR_PAGES * PGSIZE;
+
+/* the first NR_ZERO pages are zero, the others come in NR_KINDS kinds */
+static int expect(int i, int j)
+{
+	return (i < NR_ZERO) ? 0 : (i % NR_KINDS + 1) * 10000 + j;
+}
+
+static void fill(uintptr_t addr)
+{
+	int i, j;
+	for (i = 0; i < NR_PAGES; i++) {
+		int *p = (int *)(addr + i * PGSIZE);
+		p[0] = 1;
+		for (j = 0; j < PGSIZE / sizeof(int); j++) {
+			p[j] = expect(i, j);
+		}
+	}
+}
+
+static void verify(uintptr_t addr)
+{
+	int i, j;
+	for (i = 0; i < NR_PAGES; i++) {
+		int *p = (int *)(addr + i * PGSIZE);
+		for (j = 0; j < PGSIZE / sizeof(int); j++) {
+			assert(p[j] == expect(i, j));
+		}
+	}
+}
+
+int main(void)
+{
+	uintptr_t addr = 0;
+	assert(mmap(&addr, size, MMAP_WRITE) == 0);
+	fill(addr);
+	assert(madvise(addr, size, MADV_MERGEABLE) == 0);
+	assert(madvise(addr + 1, size, MADV_MERGEABLE) != 0);
+
+	/* wait for ksmd to get through the mapping */
+	struct ksm_stat st;
+	int i;
+	for (i = 0; i < 500; i++) {
+		assert(ksmstat(&st) == 0);
+		if (st.pages_merged >= NR_PAGES - NR_ZERO - NR_KINDS
+		    && st.pages_zero >= NR_ZERO) {
+			break;
+		}
+		sleep(10);
+	}
+	cprintf("ksm: %d shared, %d sharing, %d merged, %d zero, %d scans\n",
+		st.pages_shared, st.pages_sharing, st.pages_merged,
+		st.pages_zero, st.full_scans);
+	assert(st.pages_merged >= NR_PAGES - NR_ZERO - NR_KINDS);
+	assert(st.pages_zero >= NR_ZERO && st.pages_shared >= NR_KINDS);
+	assert(st.pages_sharing >= NR_PAGES - NR_ZERO - NR_KINDS);
+	verify(addr);
+
+	/* writes go to a private copy, the merged page stays as it was */
+	int pid, ret;
+	if ((pid = fork()) == 0) {
+		*(int *)(addr + NR_ZERO * PGSIZE) = -1;
+		*(int *)addr = -1;
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, &ret) == 0 && ret == 0);
+	verify(addr);
+	*(int *)(addr + (NR_ZERO + 1) * PGSIZE) = -1;
+	assert(*(int *)(addr + (NR_ZERO + 1 + NR_KINDS) * PGSIZE) ==
+	       expect(NR_ZERO + 1 + NR_KINDS, 0));
+	*(int *)(addr + (NR_ZERO + 1) * PGSIZE) = expect(NR_ZERO + 1, 0);
+	verify(addr);
+
+	assert(madvise(addr, size, MADV_UNMERGEABLE) == 0);
+	assert(munmap(addr, size) == 0);
+	cprintf("ksm pass.\n");
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <lock.h>
+#include <mutex.h>
+#include <thread.h>
+
+/*
+ * Lock contention: N threads increment one counter under the old
+ * yield/sleep spin lock and under a futex mutex, then the other futex
+ * locks get a run of their own:
+ *   pingpong  two threads hand a token back and forth with a cond_t
+ *   rwlock    readers check a pair of counters writers keep equal
+ *   barrier   every thread goes through the same barrier each round
+ */
+
+#define MAX_THREADS     4
+#define NLOOPS          20000
+#define NPINGS          2000
+#define NROUNDS         200
+
+static lock_t spin = INIT_LOCK;
+static mutex_t mutex = MUTEX_INIT;
+static volatile long counter;
+
+static int spin_worker(void *arg)
+{
+	int i;
+	for (i = 0; i < NLOOPS; i++) {
+		lock(&spin);
+		counter++;
+		unlock(&spin);
+	}
+	return 0;
+}
+
+static int mutex_worker(void *arg)
+{
+	int i;
+	for (i = 0; i < NLOOPS; i++) {
+		mutex_lock(&mutex);
+		counter++;
+		mutex_unlock(&mutex);
+	}
+	return 0;
+}
+
+static cond_t turn = COND_INIT;
+static volatile int token;
+
+static int pinger(void *arg)
+{
+	long me = (long)arg;
+	int i;
+	mutex_lock(&mutex);
+	for (i = 0; i < NPINGS; i++) {
+		while (token != me) {
+			cond_wait(&turn, &mutex);
+		}
+		token = !me;
+		cond_signal(&turn);
+	}
+	mutex_unlock(&mutex);
+	return 0;
+}
+
+static rwlock_t rwlock = RWLOCK_INIT;
+static volatile long pair[2];
+
+static int rw_worker(void *arg)
+{
+	long id = (long)arg;
+	int i;
+	for (i = 0; i < NLOOPS / 10; i++) {
+		if (id == 0 && i % 10 == 0) {
+			rwlock_wrlock(&rwlock);
+			pair[0]++, pair[1]++;
+			rwlock_unlock(&rwlock);
+		} else {
+			rwlock_rdlock(&rwlock);
+			assert(pair[0] == pair[1]);
+			rwlock_unlock(&rwlock);
+		}
+	}
+	return 0;
+}
+
+static barrier_t barrier;
+static volatile int round_done[NROUNDS];
+
+static int barrier_worker(void *arg)
+{
+	int i;
+	for (i = 0; i < NROUNDS; i++) {
+		__sync_fetch_and_add(&round_done[i], 1);
+		barrier_wait(&barrier);
+		assert(round_done[i] == barrier.count);
+	}
+	return 0;
+}
+
+static unsigned int run(int nthreads, int (*fn) (void *))
+{
+	thread_t tids[MAX_THREADS];
+	unsigned int start = gettime_msec();
+	int i, exit_code;
+	for (i = 0; i < nthreads; i++) {
+		assert(thread(fn, (void *)(long)i, tids + i) == 0);
+	}
+	for (i = 0; i < nthreads; i++) {
+		assert(thread_wait(tids + i, &exit_code) == 0 && exit_code == 0);
+	}
+	return gettime_msec() - start;
+}
+
+int main(void)
+{
+	unsigned int spin_ms, mutex_ms;
+	int n;
+
+	for (n = 1; n <= MAX_THREADS; n *= 2) {
+		counter = 0;
+		spin_ms = run(n, spin_worker);
+		assert(counter == n * NLOOPS);
+		counter = 0;
+		mutex_ms = run(n, mutex_worker);
+		assert(counter == n * NLOOPS);
+		cprintf("lockbench: %d threads, spin lock %d ms, mutex %d ms.\n",
+			n, spin_ms, mutex_ms);
+	}
+
+	cprintf("lockbench: pingpong %d ms.\n", run(2, pinger));
+	cprintf("lockbench: rwlock %d ms.\n", run(MAX_THREADS, rw_worker));
+	assert(pair[0] == pair[1] && pair[0] == NLOOPS / 100);
+	barrier_init(&barrier, MAX_THREADS);
+	cprintf("lockbench: barrier %d ms.\n", run(MAX_THREADS, barrier_worker));
+
+	cprintf("lockbench pass.\n");
+	return 0;
+}
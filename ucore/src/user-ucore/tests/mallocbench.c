@@ -0,0 +1,144 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <thread.h>
+
+/*
+ * malloc microbenchmarks, each checking what it got back:
+ *   pairs     malloc and free right away, one size at a time
+ *   batch     allocate many objects of mixed sizes, then free them all
+ *   large     allocations that get a mapping of their own
+ *   threads   1, 2 and 4 threads doing batch in parallel
+ *   xfree     objects freed by another thread than the one that made them
+ */
+
+#define NPAIRS          20000
+#define NBATCH          2048
+#define NROUNDS         8
+#define NLARGE          64
+#define MAX_THREADS     4
+
+static void *ptrs[MAX_THREADS][NBATCH];
+
+static size_t batch_size(int i)
+{
+	static const size_t sizes[] = { 8, 24, 40, 64, 100, 200, 500, 1000, 3000, 20000 };
+	return sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+}
+
+static void fill(void *p, size_t size, int tag)
+{
+	memset(p, tag & 0xff, size);
+}
+
+static void check(void *p, size_t size, int tag)
+{
+	unsigned char *c = p;
+	assert(c[0] == (tag & 0xff) && c[size - 1] == (tag & 0xff));
+}
+
+static unsigned int pairs(void)
+{
+	static const size_t sizes[] = { 16, 128, 1024, 8192 };
+	unsigned int start = gettime_msec();
+	int i, j;
+	for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+		for (i = 0; i < NPAIRS; i++) {
+			char *p = malloc(sizes[j]);
+			assert(p != NULL);
+			p[0] = p[sizes[j] - 1] = i;
+			free(p);
+		}
+	}
+	return gettime_msec() - start;
+}
+
+static int batch(void *arg)
+{
+	long id = (long)arg;
+	int round, i;
+	for (round = 0; round < NROUNDS; round++) {
+		for (i = 0; i < NBATCH; i++) {
+			assert((ptrs[id][i] = malloc(batch_size(i))) != NULL);
+			fill(ptrs[id][i], batch_size(i), i + id);
+		}
+		for (i = 0; i < NBATCH; i++) {
+			check(ptrs[id][i], batch_size(i), i + id);
+			free(ptrs[id][i]);
+		}
+	}
+	return 0;
+}
+
+static unsigned int large(void)
+{
+	unsigned int start = gettime_msec();
+	int i;
+	for (i = 0; i < NLARGE; i++) {
+		size_t size = (i + 1) * 40000;
+		char *p = malloc(size);
+		assert(p != NULL);
+		p[0] = p[size - 1] = i;
+		assert(p[0] == (char)i && p[size - 1] == (char)i);
+		free(p);
+	}
+	return gettime_msec() - start;
+}
+
+static unsigned int threads(int nthreads, int (*fn) (void *))
+{
+	thread_t tids[MAX_THREADS];
+	unsigned int start = gettime_msec();
+	int i, exit_code;
+	for (i = 0; i < nthreads; i++) {
+		assert(thread(fn, (void *)(long)i, tids + i) == 0);
+	}
+	for (i = 0; i < nthreads; i++) {
+		assert(thread_wait(tids + i, &exit_code) == 0 && exit_code == 0);
+	}
+	return gettime_msec() - start;
+}
+
+// frees what the main thread allocated
+static int xfree(void *arg)
+{
+	int i;
+	for (i = 0; i < NBATCH; i++) {
+		check(ptrs[0][i], batch_size(i), i);
+		free(ptrs[0][i]);
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int n, i;
+	unsigned int start;
+
+	cprintf("mallocbench: pairs %d ms.\n", pairs());
+	start = gettime_msec();
+	batch((void *)0);
+	cprintf("mallocbench: batch %d ms.\n", gettime_msec() - start);
+	cprintf("mallocbench: large %d ms.\n", large());
+
+	for (n = 1; n <= MAX_THREADS; n *= 2) {
+		cprintf("mallocbench: %d threads %d ms.\n", n, threads(n, batch));
+	}
+
+	for (i = 0; i < NBATCH; i++) {
+		assert((ptrs[0][i] = malloc(batch_size(i))) != NULL);
+		fill(ptrs[0][i], batch_size(i), i);
+	}
+	threads(1, xfree);
+
+	// what went back to the allocator is handed out again
+	void *p = malloc(64);
+	assert(p != NULL);
+	free(p);
+	assert(malloc(64) == p);
+	free(p);
+
+	cprintf("mallocbench pass.\n");
+	return 0;
+}
@@ -7,6 +7,58 @@
 
 const int mbox_slots = 128;
 
+#define BENCH_PGSIZE 4096
+
+static char bench_buf[MAX_MSG_BYTES] __attribute__ ((aligned(BENCH_PGSIZE)));
+
+/*
+ * Send @count messages of @size bytes from the parent to a child. The
+ * first byte of every page carries the message number; the sender bumps it
+ * right after each send, so a receiver seeing a stale or future value means
+ * a page was shared without copy-on-write.
+ */
+static void mbox_bench(const char *name, size_t size, int count)
+{
+	int mbox_id = mbox_init(mbox_slots);
+	assert(mbox_id >= 0);
+
+	struct mboxbuf __buf, *buf = &__buf;
+	buf->data = bench_buf;
+
+	int pid, ret, i;
+	size_t off;
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < count; i++) {
+			buf->size = MAX_MSG_BYTES;
+			assert(mbox_recv(mbox_id, buf) == 0);
+			assert(buf->len == size);
+			for (off = 0; off < size; off += BENCH_PGSIZE) {
+				assert(bench_buf[off] == (char)i);
+			}
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+
+	unsigned int saved_msec = gettime_msec();
+	for (i = 0; i < count; i++) {
+		for (off = 0; off < size; off += BENCH_PGSIZE) {
+			bench_buf[off] = (char)i;
+		}
+		buf->len = size;
+		assert(mbox_send(mbox_id, buf) == 0);
+	}
+	assert(waitpid(pid, &ret) == 0 && ret == 0);
+	unsigned int msec = gettime_msec() - saved_msec;
+	if (msec == 0) {
+		msec = 1;
+	}
+	cprintf("mbox bench %s: %d x %d bytes in %d msec, %d msg/s, %d KB/s\n",
+		name, count, (int)size, msec, count * 1000 / msec,
+		(int)(count * (unsigned int)size / 1024 * 1000 / msec));
+	assert(mbox_free(mbox_id) == 0);
+}
+
 void mbox_test(void)
 {
 	int mbox_id = mbox_init(1);
@@ -68,6 +120,8 @@ int main(void)
 		mbox_test();
 	}
 	assert(pid > 0 && waitpid(pid, &ret) == 0 && ret == 0);
+	mbox_bench("small", 64, 20000);
+	mbox_bench("64k", MAX_MSG_BYTES, 2000);
 	cprintf("mboxtest pass.\n");
 	return 0;
 }
@@ -0,0 +1,89 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <socket.h>
+
+/*
+ * TCP connection setup rate (connect + accept + close) over the in-kernel
+ * loopback device.
+ *   netbench_accept       use lo (127.0.0.1)
+ *   netbench_accept veth  use the virtual ethernet pair (10.0.0.2 -> 10.0.0.1)
+ */
+
+#define PORT        5003
+#define CONNS       1000
+
+static int server(void)
+{
+	struct sockaddr_in sin;
+	int lfd, fd, i;
+	char c;
+
+	if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	sockaddr_in_init(&sin, INADDR_ANY, PORT);
+	if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) != 0
+	    || listen(lfd, 16) != 0) {
+		return -1;
+	}
+	for (i = 0; i < CONNS; i++) {
+		if ((fd = accept(lfd, NULL, NULL)) < 0) {
+			return -1;
+		}
+		// wait for the client to close first, keeping TIME_WAIT on its side
+		recv(fd, &c, 1, 0);
+		close(fd);
+	}
+	close(lfd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	bool veth = (argc > 1 && strcmp(argv[1], "veth") == 0);
+	uint32_t server_addr = veth ? inet_addr4(10, 0, 0, 1) : inet_addr4(127, 0, 0, 1);
+	struct sockaddr_in sin, local;
+	int pid, fd, i, exit_code;
+
+	if ((pid = fork()) == 0) {
+		exit(server());
+	}
+	assert(pid > 0);
+
+	sockaddr_in_init(&sin, server_addr, PORT);
+	sockaddr_in_init(&local, inet_addr4(10, 0, 0, 2), 0);
+
+	unsigned int start = 0;
+	for (i = 0; i < CONNS; i++) {
+		assert((fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+		if (veth) {
+			assert(bind(fd, (struct sockaddr *)&local, sizeof(local)) == 0);
+		}
+		while (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
+			// only the first connect may race with the server's listen
+			assert(i == 0);
+			close(fd);
+			sleep(1);
+			assert((fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+			if (veth) {
+				assert(bind(fd, (struct sockaddr *)&local, sizeof(local)) == 0);
+			}
+		}
+		if (i == 0) {
+			start = gettime_msec();
+		}
+		close(fd);
+	}
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	unsigned int msec = gettime_msec() - start;
+	if (msec == 0) {
+		msec = 1;
+	}
+
+	cprintf("netbench_accept: %s, %d connections in %d ms, %d conn/s\n",
+		veth ? "veth" : "lo", CONNS, msec, CONNS * 1000 / msec);
+	cprintf("netbench_accept pass.\n");
+	return 0;
+}
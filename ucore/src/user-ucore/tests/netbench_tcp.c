@@ -0,0 +1,109 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <socket.h>
+
+/*
+ * TCP stream throughput over the in-kernel loopback device.
+ *   netbench_tcp          use lo (127.0.0.1)
+ *   netbench_tcp veth     use the virtual ethernet pair (10.0.0.2 -> 10.0.0.1)
+ */
+
+#define PORT        5001
+#define CHUNK       8192
+#define TOTAL       (16 * 1024 * 1024)
+#define CONNECT_TRIES   10
+
+static char buf[CHUNK];
+
+static int server(void)
+{
+	struct sockaddr_in sin;
+	int lfd, fd, ret;
+	size_t received = 0;
+
+	if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	sockaddr_in_init(&sin, INADDR_ANY, PORT);
+	if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) != 0
+	    || listen(lfd, 1) != 0) {
+		return -1;
+	}
+	if ((fd = accept(lfd, NULL, NULL)) < 0) {
+		return -1;
+	}
+	while ((ret = recv(fd, buf, CHUNK, 0)) > 0) {
+		received += ret;
+	}
+	close(fd);
+	close(lfd);
+	return received == TOTAL ? 0 : -1;
+}
+
+/*
+ * A refused connect leaves the socket unusable, so every try starts over
+ * with a fresh one. Gives up when the server never comes up.
+ */
+static int connect_server(bool veth, uint32_t server_addr)
+{
+	struct sockaddr_in sin;
+	int fd, tries;
+
+	for (tries = 0; tries < CONNECT_TRIES; tries++) {
+		if (tries != 0) {
+			// the server may not be listening yet
+			sleep(1);
+		}
+		assert((fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+		if (veth) {
+			sockaddr_in_init(&sin, inet_addr4(10, 0, 0, 2), 0);
+			assert(bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+		}
+		sockaddr_in_init(&sin, server_addr, PORT);
+		if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0) {
+			return fd;
+		}
+		close(fd);
+	}
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	bool veth = (argc > 1 && strcmp(argv[1], "veth") == 0);
+	uint32_t server_addr = veth ? inet_addr4(10, 0, 0, 1) : inet_addr4(127, 0, 0, 1);
+	int pid, fd, exit_code;
+
+	if ((pid = fork()) == 0) {
+		exit(server());
+	}
+	assert(pid > 0);
+
+	if ((fd = connect_server(veth, server_addr)) < 0) {
+		kill(pid);
+		panic("netbench_tcp: cannot connect to the server.\n");
+	}
+
+	memset(buf, 'x', CHUNK);
+	unsigned int start = gettime_msec();
+	size_t sent = 0;
+	while (sent < TOTAL) {
+		int ret = send(fd, buf, CHUNK, 0);
+		assert(ret > 0);
+		sent += ret;
+	}
+	close(fd);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	unsigned int msec = gettime_msec() - start;
+	if (msec == 0) {
+		msec = 1;
+	}
+
+	cprintf("netbench_tcp: %s, %d KB in %d ms, %d KB/s\n",
+		veth ? "veth" : "lo", TOTAL / 1024, msec,
+		(int)((uint64_t)TOTAL / 1024 * 1000 / msec));
+	cprintf("netbench_tcp pass.\n");
+	return 0;
+}
@@ -0,0 +1,85 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <socket.h>
+
+/*
+ * UDP request/response latency over the in-kernel loopback device.
+ *   netbench_udp          use lo (127.0.0.1)
+ *   netbench_udp veth     use the virtual ethernet pair (10.0.0.2 -> 10.0.0.1)
+ */
+
+#define PORT        5002
+#define MSG_SIZE    64
+#define ROUNDS      10000
+
+static int server(void)
+{
+	char msg[MSG_SIZE];
+	struct sockaddr_in sin, peer;
+	int fd, i;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		return -1;
+	}
+	sockaddr_in_init(&sin, INADDR_ANY, PORT);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
+		return -1;
+	}
+	// one extra round for the client's "are you there" probe
+	for (i = 0; i <= ROUNDS; i++) {
+		int len = sizeof(peer);
+		int ret = recvfrom(fd, msg, MSG_SIZE, 0, (struct sockaddr *)&peer, &len);
+		if (ret <= 0) {
+			return -1;
+		}
+		sendto(fd, msg, ret, 0, (struct sockaddr *)&peer, sizeof(peer));
+	}
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	bool veth = (argc > 1 && strcmp(argv[1], "veth") == 0);
+	uint32_t server_addr = veth ? inet_addr4(10, 0, 0, 1) : inet_addr4(127, 0, 0, 1);
+	char msg[MSG_SIZE];
+	struct sockaddr_in sin;
+	int pid, fd, i, exit_code;
+
+	if ((pid = fork()) == 0) {
+		exit(server());
+	}
+	assert(pid > 0);
+
+	assert((fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+	sockaddr_in_init(&sin, veth ? inet_addr4(10, 0, 0, 2) : INADDR_ANY, 0);
+	assert(bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+	sockaddr_in_init(&sin, server_addr, PORT);
+	assert(connect(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+
+	memset(msg, 'x', MSG_SIZE);
+	// give the server time to bind before the probe
+	sleep(10);
+	assert(send(fd, msg, MSG_SIZE, 0) == MSG_SIZE);
+	assert(recv(fd, msg, MSG_SIZE, 0) == MSG_SIZE);
+
+	unsigned int start = gettime_msec();
+	for (i = 0; i < ROUNDS; i++) {
+		assert(send(fd, msg, MSG_SIZE, 0) == MSG_SIZE);
+		assert(recv(fd, msg, MSG_SIZE, 0) == MSG_SIZE);
+	}
+	unsigned int msec = gettime_msec() - start;
+	if (msec == 0) {
+		msec = 1;
+	}
+	close(fd);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+
+	cprintf("netbench_udp: %s, %d round trips of %d bytes in %d ms, "
+		"%d trans/s, %d us/trans\n", veth ? "veth" : "lo", ROUNDS,
+		MSG_SIZE, msec, ROUNDS * 1000 / msec, msec * 1000 / ROUNDS);
+	cprintf("netbench_udp pass.\n");
+	return 0;
+}
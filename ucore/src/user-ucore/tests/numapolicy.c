@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <numa.h>
+
+#define PGSIZE      4096
+#define NPAGES      64
+
+const size_t size = NPAGES * PGSIZE;
+
+static void touch(uintptr_t addr, size_t len)
+{
+	size_t off;
+	for (off = 0; off < len; off += PGSIZE) {
+		*(int *)(addr + off) = off / PGSIZE;
+	}
+}
+
+int main(void)
+{
+	int nnodes = numa_num_nodes(), i, j;
+	unsigned long all = (1ul << nnodes) - 1, mask;
+	struct numa_stat st;
+
+	cprintf("numapolicy: %d node(s)\n", nnodes);
+	for (i = 0; i < nnodes; i++) {
+		assert(numa_stat(i, &st) == 0);
+		cprintf("node %d: %d cpu(s), %d/%d pages free, hit %d miss %d "
+			"interleave %d\n", i, st.nr_cpus, st.free_pages,
+			st.total_pages, st.numa_hit, st.numa_miss,
+			st.interleave_hit);
+		cprintf("  distance:");
+		for (j = 0; j < nnodes; j++) {
+			cprintf(" %d", st.distance[j]);
+		}
+		cprintf("\n");
+		assert(st.distance[i] == 10);
+	}
+	assert(numa_stat(nnodes, &st) != 0);
+
+	/* interleave over all nodes, by page index */
+	uintptr_t addr = 0;
+	assert(mmap(&addr, size, MMAP_WRITE) == 0);
+	assert(mbind((void *)addr, size, MPOL_INTERLEAVE, &all,
+		     MPOL_MAX_NODES + 1, 0) == 0);
+	int mode = -1;
+	assert(get_mempolicy(&mode, &mask, MPOL_MAX_NODES + 1, (void *)addr,
+			     MPOL_F_ADDR) == 0);
+	assert(mode == MPOL_INTERLEAVE && mask == all);
+	touch(addr, size);
+	for (i = 0; i < NPAGES; i++) {
+		uintptr_t va = addr + i * PGSIZE;
+		assert(numa_node_of((void *)va) == (va / PGSIZE) % nnodes);
+	}
+
+	/* bind the second half to the last node, the first half keeps its policy */
+	unsigned long last = 1ul << (nnodes - 1);
+	assert(munmap(addr, size) == 0);
+	addr = 0;
+	assert(mmap(&addr, size, MMAP_WRITE) == 0);
+	assert(mbind((void *)(addr + size / 2), size / 2, MPOL_BIND, &last,
+		     MPOL_MAX_NODES + 1, 0) == 0);
+	touch(addr, size);
+	for (i = NPAGES / 2; i < NPAGES; i++) {
+		assert(numa_node_of((void *)(addr + i * PGSIZE)) == nnodes - 1);
+	}
+	assert(get_mempolicy(&mode, NULL, 0, (void *)addr, MPOL_F_ADDR) == 0);
+	assert(mode == MPOL_DEFAULT);
+	assert(munmap(addr, size) == 0);
+
+	/* process policy is inherited by the child */
+	assert(set_mempolicy(MPOL_PREFERRED, &last, MPOL_MAX_NODES + 1) == 0);
+	int pid, ret;
+	if ((pid = fork()) == 0) {
+		assert(get_mempolicy(&mode, &mask, MPOL_MAX_NODES + 1, NULL, 0) == 0);
+		assert(mode == MPOL_PREFERRED && mask == last);
+		addr = 0;
+		assert(mmap(&addr, PGSIZE, MMAP_WRITE) == 0);
+		touch(addr, PGSIZE);
+		assert(numa_node_of((void *)addr) == nnodes - 1);
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, &ret) == 0 && ret == 0);
+	assert(set_mempolicy(MPOL_DEFAULT, NULL, 0) == 0);
+	assert(get_mempolicy(&mode, NULL, 0, NULL, 0) == 0 && mode == MPOL_DEFAULT);
+
+	/* bad arguments */
+	unsigned long none = 0, offline = 1ul << nnodes;
+	assert(set_mempolicy(MPOL_MAX, NULL, 0) != 0);
+	assert(set_mempolicy(MPOL_BIND, &none, MPOL_MAX_NODES + 1) != 0);
+	assert(set_mempolicy(MPOL_INTERLEAVE, &offline, MPOL_MAX_NODES + 1) != 0);
+	assert(set_mempolicy(MPOL_DEFAULT, &all, MPOL_MAX_NODES + 1) != 0);
+	assert(get_mempolicy(&mode, NULL, 0, NULL, MPOL_F_NODE) != 0);
+	assert(mbind((void *)0x1000, PGSIZE, MPOL_BIND, &all,
+		     MPOL_MAX_NODES + 1, 0) != 0);
+
+	cprintf("numapolicy pass.\n");
+	return 0;
+}
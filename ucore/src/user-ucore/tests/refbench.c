@@ -0,0 +1,92 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+
+/*
+ * Reference count scalability: 1, 2, 4 ... nproc processes at a time
+ *   refbench [nproc [iters]]
+ * The first round dups, reads and closes a file they all share, and opens
+ * and closes one of their own. The second forks, exits and waits. Each
+ * round reports the operations done per msec by all of them together.
+ */
+
+#define DEFAULT_NPROC   8
+#define DEFAULT_ITERS   2000
+#define MAX_NPROC       64
+
+static int nproc, iters;
+
+static void fd_worker(int fd)
+{
+	char c;
+	int i, fd2;
+	for (i = 0; i < iters; i++) {
+		assert((fd2 = dup(fd)) >= 0);
+		assert(read(fd2, &c, 1) >= 0);
+		assert(close(fd2) == 0);
+		assert((fd2 = open("null:", O_RDONLY)) >= 0);
+		assert(close(fd2) == 0);
+	}
+}
+
+static void fork_worker(void)
+{
+	int i, pid;
+	for (i = 0; i < iters / 10; i++) {
+		if ((pid = fork()) == 0) {
+			exit(0);
+		}
+		assert(pid > 0 && waitpid(pid, NULL) == 0);
+	}
+}
+
+// run - run @n copies of @worker, returns the msec it took them all
+static unsigned int run(int n, int fd)
+{
+	int pids[MAX_NPROC], i, ret;
+	unsigned int start = gettime_msec();
+	for (i = 0; i < n; i++) {
+		if ((pids[i] = fork()) == 0) {
+			if (fd >= 0) {
+				fd_worker(fd);
+			} else {
+				fork_worker();
+			}
+			exit(0);
+		}
+		assert(pids[i] > 0);
+	}
+	for (i = 0; i < n; i++) {
+		assert(waitpid(pids[i], &ret) == 0 && ret == 0);
+	}
+	unsigned int msec = gettime_msec() - start;
+	return (msec != 0) ? msec : 1;
+}
+
+int main(int argc, char **argv)
+{
+	nproc = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_NPROC;
+	iters = (argc > 2) ? strtol(argv[2], NULL, 10) : DEFAULT_ITERS;
+	if (nproc <= 0 || nproc > MAX_NPROC || iters < 10) {
+		cprintf("usage: refbench [nproc [iters]]\n");
+		return -1;
+	}
+
+	int fd, n;
+	assert((fd = open("null:", O_RDWR)) >= 0);
+	for (n = 1; n <= nproc; n *= 2) {
+		unsigned int msec = run(n, fd);
+		cprintf("refbench: %d procs, dup/read/close/open/close %d ops/msec\n",
+			n, n * iters * 5 / msec);
+	}
+	for (n = 1; n <= nproc; n *= 2) {
+		unsigned int msec = run(n, -1);
+		cprintf("refbench: %d procs, fork/exit/wait %d ops/msec\n",
+			n, n * (iters / 10) / msec);
+	}
+	assert(close(fd) == 0);
+	cprintf("refbench pass.\n");
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stat.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+
+/*
+ * SFS metadata throughput.
+ *   sfs_metabench [nfiles]
+ * Creates @nfiles small files spread over NDIRS directories, opens and
+ * stats each of them, unlinks them and removes the directories. Each phase
+ * reports files/sec, the number to compare when changing how sfs gets its
+ * metadata to disk.
+ */
+
+#define DEFAULT_NFILES  10000
+#define NDIRS           100
+#define FILE_SIZE       100
+#define DIR_NAME        "metabench"
+
+static char buf[FILE_SIZE];
+
+// make_name - DIR_NAME/d<dir>[/f<file>] into @name
+static char *make_name(char *name, int dir, int file)
+{
+	char *p = name;
+	int i, n, len = 0, digits[2] = { dir, file };
+	strcpy(p, DIR_NAME "/d"), p += strlen(p);
+	for (i = 0; i < 2 && digits[i] >= 0; i++) {
+		if (i != 0) {
+			*p++ = '/', *p++ = 'f';
+		}
+		char tmp[16];
+		for (n = digits[i], len = 0; n != 0 || len == 0; n /= 10) {
+			tmp[len++] = '0' + n % 10;
+		}
+		while (len != 0) {
+			*p++ = tmp[--len];
+		}
+	}
+	*p = '\0';
+	return name;
+}
+
+static void report(const char *what, unsigned int start, int nfiles)
+{
+	unsigned int msec = gettime_msec() - start;
+	if (msec == 0) {
+		msec = 1;
+	}
+	cprintf("sfs_metabench: %s %d files in %d msec, %d files/sec\n", what,
+		nfiles, msec, nfiles * 1000 / msec);
+}
+
+int main(int argc, char **argv)
+{
+	int nfiles = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_NFILES;
+	if (nfiles <= 0) {
+		cprintf("usage: sfs_metabench [nfiles]\n");
+		return -1;
+	}
+	char name[64];
+	int fd, i;
+	struct stat st;
+
+	assert(mkdir(DIR_NAME) == 0);
+	for (i = 0; i < NDIRS; i++) {
+		assert(mkdir(make_name(name, i, -1)) == 0);
+	}
+	memset(buf, 'm', sizeof(buf));
+
+	unsigned int start = gettime_msec();
+	for (i = 0; i < nfiles; i++) {
+		make_name(name, i % NDIRS, i / NDIRS);
+		assert((fd = open(name, O_WRONLY | O_CREAT | O_EXCL)) >= 0);
+		assert(write(fd, buf, FILE_SIZE) == FILE_SIZE);
+		if (i == nfiles - 1) {
+			assert(fsync(fd) == 0);
+		}
+		close(fd);
+	}
+	report("create", start, nfiles);
+
+	start = gettime_msec();
+	for (i = 0; i < nfiles; i++) {
+		make_name(name, i % NDIRS, i / NDIRS);
+		assert((fd = open(name, O_RDONLY)) >= 0);
+		assert(fstat(fd, &st) == 0 && st.st_size == FILE_SIZE);
+		close(fd);
+	}
+	report("stat", start, nfiles);
+
+	start = gettime_msec();
+	for (i = 0; i < nfiles; i++) {
+		assert(unlink(make_name(name, i % NDIRS, i / NDIRS)) == 0);
+	}
+	for (i = 0; i < NDIRS; i++) {
+		assert(unlink(make_name(name, i, -1)) == 0);
+	}
+	assert(unlink(DIR_NAME) == 0);
+	report("unlink", start, nfiles);
+
+	cprintf("sfs_metabench pass.\n");
+	return 0;
+}
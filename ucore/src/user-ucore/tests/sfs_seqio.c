@@ -0,0 +1,76 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stat.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+
+/*
+ * SFS sequential throughput.
+ *   sfs_seqio [mbytes]
+ * Writes @mbytes MB with 64KB writes, fsyncs, then reads the file back
+ * 64KB at a time and checks it. Each pass reports KB/sec, the number to
+ * compare when changing how sfs talks to the disk.
+ */
+
+#define DEFAULT_MBYTES  8
+#define CHUNK           (64 * 1024)
+#define FILE_NAME       "seqio.tmp"
+
+static char buf[CHUNK];
+
+static void fill(char *p, size_t len, int seed)
+{
+	size_t i;
+	for (i = 0; i < len; i++) {
+		p[i] = 'a' + (seed + i) % 26;
+	}
+}
+
+static void report(const char *what, unsigned int start, size_t bytes)
+{
+	unsigned int msec = gettime_msec() - start;
+	if (msec == 0) {
+		msec = 1;
+	}
+	cprintf("sfs_seqio: %s %d KB in %d msec, %d KB/sec\n", what,
+		bytes / 1024, msec, bytes / msec * 1000 / 1024);
+}
+
+int main(int argc, char **argv)
+{
+	int mbytes = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_MBYTES;
+	if (mbytes <= 0) {
+		cprintf("usage: sfs_seqio [mbytes]\n");
+		return -1;
+	}
+	int fd, i, n = mbytes * (1024 * 1024 / CHUNK);
+	size_t bytes = (size_t)n * CHUNK;
+
+	assert((fd = open(FILE_NAME, O_RDWR | O_CREAT | O_TRUNC)) >= 0);
+	unsigned int start = gettime_msec();
+	for (i = 0; i < n; i++) {
+		fill(buf, CHUNK, i);
+		assert(write(fd, buf, CHUNK) == CHUNK);
+	}
+	assert(fsync(fd) == 0);
+	report("write", start, bytes);
+	close(fd);
+
+	struct stat st;
+	assert((fd = open(FILE_NAME, O_RDONLY)) >= 0);
+	assert(fstat(fd, &st) == 0 && st.st_size == bytes);
+	start = gettime_msec();
+	for (i = 0; i < n; i++) {
+		assert(read(fd, buf, CHUNK) == CHUNK);
+		assert(buf[0] == 'a' + i % 26 && buf[CHUNK - 1] ==
+		       'a' + (i + CHUNK - 1) % 26);
+	}
+	report("read", start, bytes);
+	close(fd);
+
+	assert(unlink(FILE_NAME) == 0);
+	cprintf("sfs_seqio pass.\n");
+	return 0;
+}
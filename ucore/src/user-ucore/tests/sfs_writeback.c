@@ -0,0 +1,121 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stat.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+
+/*
+ * SFS write-back: small appends and an untar-like burst of small files.
+ *   sfs_writeback [files [appends]]
+ * The first round appends a line at a time to two files in turns, the way
+ * two logs grow, reads both back and fsyncs them. The second creates @files
+ * files of a few KB in a fresh directory, the way untar does, then removes
+ * them. Each round reports the msec it took and KB/sec written.
+ */
+
+#define DEFAULT_FILES   200
+#define DEFAULT_APPENDS 2000
+#define LINE_LEN        100
+#define DIR_NAME        "wbtest"
+
+static char buf[4 * 4096 + LINE_LEN];
+
+static void fill(char *p, size_t len, int seed)
+{
+	size_t i;
+	for (i = 0; i < len; i++) {
+		p[i] = 'a' + (seed + i) % 26;
+	}
+}
+
+static unsigned int report(const char *what, unsigned int start, size_t bytes)
+{
+	unsigned int msec = gettime_msec() - start;
+	if (msec == 0) {
+		msec = 1;
+	}
+	cprintf("sfs_writeback: %s %d KB in %d msec, %d KB/sec\n", what,
+		bytes / 1024, msec, bytes / msec * 1000 / 1024);
+	return msec;
+}
+
+static void appends(int n)
+{
+	const char *names[2] = { DIR_NAME "/log0", DIR_NAME "/log1" };
+	int fds[2], i, j;
+	for (j = 0; j < 2; j++) {
+		assert((fds[j] = open(names[j], O_RDWR | O_CREAT | O_TRUNC)) >= 0);
+	}
+	unsigned int start = gettime_msec();
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < 2; j++) {
+			fill(buf, LINE_LEN, i + j);
+			assert(write(fds[j], buf, LINE_LEN) == LINE_LEN);
+		}
+	}
+	report("append", start, 2 * n * LINE_LEN);
+
+	struct stat st;
+	for (j = 0; j < 2; j++) {
+		assert(fstat(fds[j], &st) == 0 && st.st_size == n * LINE_LEN);
+		assert(seek(fds[j], 0, LSEEK_SET) == 0);
+		for (i = 0; i < n; i++) {
+			char line[LINE_LEN];
+			assert(read(fds[j], line, LINE_LEN) == LINE_LEN);
+			fill(buf, LINE_LEN, i + j);
+			assert(memcmp(line, buf, LINE_LEN) == 0);
+		}
+	}
+	start = gettime_msec();
+	for (j = 0; j < 2; j++) {
+		assert(fsync(fds[j]) == 0);
+		close(fds[j]);
+		assert(unlink(names[j]) == 0);
+	}
+	cprintf("sfs_writeback: fsync %d msec\n", gettime_msec() - start);
+}
+
+static void untar(int n)
+{
+	char name[64];
+	int i, fd;
+	size_t len, bytes = 0;
+	unsigned int start = gettime_msec();
+	for (i = 0; i < n; i++) {
+		len = 512 + (i * 1237) % (sizeof(buf) - 512);
+		snprintf(name, sizeof(name), DIR_NAME "/f%d", i);
+		assert((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC)) >= 0);
+		fill(buf, len, i);
+		assert(write(fd, buf, len) == len);
+		close(fd);
+		bytes += len;
+	}
+	report("untar", start, bytes);
+
+	for (i = 0; i < n; i++) {
+		len = 512 + (i * 1237) % (sizeof(buf) - 512);
+		snprintf(name, sizeof(name), DIR_NAME "/f%d", i);
+		assert((fd = open(name, O_RDONLY)) >= 0);
+		assert(read(fd, buf, sizeof(buf)) == len);
+		close(fd);
+		assert(unlink(name) == 0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int files = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_FILES;
+	int n = (argc > 2) ? strtol(argv[2], NULL, 10) : DEFAULT_APPENDS;
+	if (files <= 0 || n <= 0) {
+		cprintf("usage: sfs_writeback [files [appends]]\n");
+		return -1;
+	}
+	assert(mkdir(DIR_NAME) == 0);
+	appends(n);
+	untar(files);
+	assert(unlink(DIR_NAME) == 0);
+	cprintf("sfs_writeback pass.\n");
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <madvise.h>
+
+/*
+ * Reclaim under thrashing: sweep a working set a little larger than memory
+ * over and over, the worst case for an LRU-like reclaim.
+ *   thrash [MB [rounds]]
+ * The default size fits the i386 qemu target, which runs with 512MB of RAM
+ * and 128MB of swap. Each round reports the pages read back from swap.
+ */
+
+#define PGSIZE          4096
+#define DEFAULT_MB      544
+#define DEFAULT_ROUNDS  8
+
+int main(int argc, char **argv)
+{
+	int mb = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_MB;
+	int rounds = (argc > 2) ? strtol(argv[2], NULL, 10) : DEFAULT_ROUNDS;
+	if (mb <= 0 || rounds <= 0) {
+		cprintf("usage: thrash [MB [rounds]]\n");
+		return -1;
+	}
+
+	size_t len = (size_t)mb * 1024 * 1024, npages = len / PGSIZE, i;
+	uintptr_t addr = 0;
+	if (mmap(&addr, len, MMAP_WRITE) != 0) {
+		cprintf("thrash: cannot map %dMB\n", mb);
+		return -1;
+	}
+	for (i = 0; i < npages; i++) {
+		*(size_t *)(addr + i * PGSIZE) = i;
+	}
+
+	struct fault_stat st;
+	int r;
+	size_t total = 0;
+	unsigned int start = gettime_msec();
+	for (r = 1; r <= rounds; r++) {
+		assert(faultstat(&st) == 0);
+		size_t major = st.nr_major;
+		unsigned int msec = gettime_msec();
+		for (i = 0; i < npages; i++) {
+			size_t *p = (size_t *)(addr + i * PGSIZE);
+			assert(*p == i + (r - 1) * npages);
+			*p = i + r * npages;
+		}
+		msec = gettime_msec() - msec;
+		assert(faultstat(&st) == 0);
+		major = st.nr_major - major, total += major;
+		cprintf("thrash: round %d, %d of %d pages read back, %d msec\n",
+			r, major, npages, msec);
+	}
+	cprintf("thrash: %dMB x %d rounds, %d pages read back in %d msec\n",
+		mb, rounds, total, gettime_msec() - start);
+
+	assert(munmap(addr, len) == 0);
+	cprintf("thrash pass.\n");
+	return 0;
+}
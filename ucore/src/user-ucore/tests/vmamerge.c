@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+
+#define PGSIZE      4096
+#define NR_MAPS     2048
+
+static uintptr_t maps[NR_MAPS];
+
+int main(void)
+{
+	int i;
+	unsigned int saved_msec = gettime_msec();
+	for (i = 0; i < NR_MAPS; i++) {
+		maps[i] = 0;
+		assert(mmap(&maps[i], PGSIZE, MMAP_WRITE) == 0);
+		*(int *)maps[i] = i;
+	}
+	cprintf("vmamerge: %d mmaps in %d msec\n", NR_MAPS,
+		gettime_msec() - saved_msec);
+
+	/* punch holes into every other page, then fill them again */
+	for (i = 0; i < NR_MAPS; i += 2) {
+		assert(munmap(maps[i], PGSIZE) == 0);
+	}
+	saved_msec = gettime_msec();
+	for (i = 0; i < NR_MAPS; i += 2) {
+		maps[i] = 0;
+		assert(mmap(&maps[i], PGSIZE, MMAP_WRITE) == 0);
+		*(int *)maps[i] = i;
+	}
+	cprintf("vmamerge: %d mmaps into holes in %d msec\n", NR_MAPS / 2,
+		gettime_msec() - saved_msec);
+	for (i = 0; i < NR_MAPS; i++) {
+		assert(*(int *)maps[i] == i);
+	}
+	for (i = 0; i < NR_MAPS; i++) {
+		assert(munmap(maps[i], PGSIZE) == 0);
+	}
+
+	/* adjacent mappings merge, unmapping the middle splits them again */
+	uintptr_t addr = 0;
+	assert(mmap(&addr, 8 * PGSIZE, MMAP_WRITE) == 0);
+	assert(munmap(addr, 8 * PGSIZE) == 0);
+	assert(mmap(&addr, 4 * PGSIZE, MMAP_WRITE) == 0);
+	uintptr_t next = addr + 4 * PGSIZE;
+	assert(mmap(&next, 4 * PGSIZE, MMAP_WRITE) == 0);
+	for (i = 0; i < 8; i++) {
+		*(int *)(addr + i * PGSIZE) = i + 8;
+	}
+
+	/* unmapping a range that starts in a hole still unmaps what follows */
+	assert(munmap(addr + PGSIZE, PGSIZE) == 0);
+	assert(munmap(addr + PGSIZE, 3 * PGSIZE) == 0);
+	assert(*(int *)addr == 8);
+	for (i = 4; i < 8; i++) {
+		assert(*(int *)(addr + i * PGSIZE) == i + 8);
+	}
+	assert(munmap(addr, 8 * PGSIZE) == 0);
+	cprintf("vmamerge pass.\n");
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <madvise.h>
+
+#define PGSIZE      4096
+#define NR_PAGES    512
+#define N           96
+
+const size_t size = NR_PAGES * PGSIZE;
+
+static int matrix_a[N][N], matrix_b[N][N];
+
+static size_t nr_faults(void)
+{
+	struct fault_stat st;
+	assert(faultstat(&st) == 0);
+	return st.nr_faults;
+}
+
+int main(void)
+{
+	uintptr_t addr = 0;
+	size_t off, faults;
+	unsigned int msec;
+	assert(mmap(&addr, size, MMAP_WRITE) == 0);
+
+	/* reading first maps the zero page everywhere */
+	faults = nr_faults(), msec = gettime_msec();
+	for (off = 0; off < size; off += PGSIZE) {
+		assert(*(int *)(addr + off) == 0);
+	}
+	cprintf("zeropage: %d read faults in %d msec\n", nr_faults() - faults,
+		gettime_msec() - msec);
+
+	/* then writing replaces it page by page */
+	faults = nr_faults(), msec = gettime_msec();
+	for (off = 0; off < size; off += 2 * PGSIZE) {
+		*(int *)(addr + off) = off / PGSIZE + 1;
+	}
+	cprintf("zeropage: %d write faults in %d msec\n", nr_faults() - faults,
+		gettime_msec() - msec);
+	for (off = 0; off < size; off += PGSIZE) {
+		int expect = (off % (2 * PGSIZE) == 0) ? off / PGSIZE + 1 : 0;
+		assert(*(int *)(addr + off) == expect);
+	}
+
+	/* the zero page stays zero for the parent when a child writes */
+	int pid, ret;
+	if ((pid = fork()) == 0) {
+		for (off = PGSIZE; off < size; off += 2 * PGSIZE) {
+			*(int *)(addr + off) = -1;
+		}
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, &ret) == 0 && ret == 0);
+	for (off = PGSIZE; off < size; off += 2 * PGSIZE) {
+		assert(*(int *)(addr + off) == 0);
+	}
+	assert(munmap(addr, size) == 0);
+
+	/* first touch of a matrix.c sized working set */
+	int i, j, k;
+	faults = nr_faults(), msec = gettime_msec();
+	for (i = 0; i < N; i++) {
+		for (j = 0; j < N; j++) {
+			matrix_a[i][j] = matrix_b[i][j] = (i * N + j) % 7;
+		}
+	}
+	for (i = 0; i < N; i++) {
+		for (j = 0; j < N; j++) {
+			int sum = 0;
+			for (k = 0; k < N; k++) {
+				sum += matrix_a[i][k] * matrix_b[k][j];
+			}
+			matrix_b[i][j] = sum;
+		}
+	}
+	cprintf("zeropage: matrix %dx%d, %d faults in %d msec\n", N, N,
+		nr_faults() - faults, gettime_msec() - msec);
+
+	cprintf("zeropage pass.\n");
+	return 0;
+}